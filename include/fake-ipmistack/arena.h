@@ -0,0 +1,63 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ARENA_H
+# define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+# define ARENA_SIZE 4096
+
+struct arena_chunk;
+
+/* Bump allocator for request/response payloads. Memory is never freed
+ * piecewise, arena_reset() releases everything at once.
+ */
+struct arena {
+	uint8_t *base;
+	size_t size;
+	size_t used;
+	/* chunks malloc()-ed when base is exhausted, freed on reset */
+	struct arena_chunk *overflow;
+	uint64_t allocs;
+	uint64_t heap_allocs;
+	/* allocs and heap_allocs as of the last arena_reset() */
+	uint64_t folded_allocs;
+	uint64_t folded_heap_allocs;
+};
+
+int arena_init(struct arena *arena, size_t size);
+void arena_free(struct arena *arena);
+void arena_reset(struct arena *arena);
+void *arena_alloc(struct arena *arena, size_t len);
+void arena_use(struct arena *arena);
+void *rsp_alloc(size_t len);
+void arena_stats(uint64_t *allocs, uint64_t *heap_allocs);
+
+#endif
@@ -0,0 +1,61 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef BMC_H
+# define BMC_H
+
+#include <stdint.h>
+
+#include "fake-ipmistack/netfn_app.h"
+#include "fake-ipmistack/netfn_chassis.h"
+#include "fake-ipmistack/netfn_sensor.h"
+#include "fake-ipmistack/netfn_storage.h"
+#include "fake-ipmistack/netfn_transport.h"
+
+#include <pthread.h>
+
+# define BMC_COUNT_MAX 65536
+
+/* Everything one simulated BMC remembers. Handlers receive the BMC they
+ * are serving and must hold 'lock' while touching its state.
+ */
+struct bmc {
+	pthread_mutex_t lock;
+	uint32_t id;
+	struct app_state app;
+	struct chassis_state chassis;
+	struct sensor_state sensor;
+	struct storage_state storage;
+	struct transport_state transport;
+};
+
+int bmc_pool_init(uint32_t count);
+uint32_t bmc_count();
+struct bmc *bmc_get(uint32_t id);
+
+#endif
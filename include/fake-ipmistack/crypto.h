@@ -0,0 +1,96 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef CRYPTO_H
+# define CRYPTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Hash algorithms, SHA-1 and SHA-256 share block size and padding */
+enum hash_alg {
+	HASH_SHA1 = 0,
+	HASH_SHA256,
+	HASH_ALGS
+};
+
+# define HASH_BLOCK_SIZE 64
+# define SHA1_DIGEST_SIZE 20
+# define SHA256_DIGEST_SIZE 32
+# define HASH_MAX_SIZE SHA256_DIGEST_SIZE
+
+# define AES_BLOCK_SIZE 16
+# define AES128_KEY_SIZE 16
+# define AES128_ROUNDS 10
+
+/* Accelerated implementations crypto_init() may pick */
+# define CRYPTO_ACCEL_AES 0x01
+# define CRYPTO_ACCEL_SHA 0x02
+
+struct hash_ctx {
+	uint32_t h[8];
+	/* bytes hashed so far */
+	uint64_t len;
+	uint8_t buf[HASH_BLOCK_SIZE];
+	uint8_t alg;
+};
+
+/* HMAC key, kept as the hash state after the inner and the outer padded
+ * key block. Computing it takes two compressions, which is what hmac()
+ * saves when the key is reused.
+ */
+struct hmac_key {
+	uint32_t inner[8];
+	uint32_t outer[8];
+	uint8_t alg;
+};
+
+/* AES-128 round keys, and those of the equivalent inverse cipher, so that
+ * any implementation can use the same key
+ */
+struct aes128_key {
+	uint8_t enc[AES128_ROUNDS + 1][AES_BLOCK_SIZE];
+	uint8_t dec[AES128_ROUNDS + 1][AES_BLOCK_SIZE];
+};
+
+unsigned int crypto_init(unsigned int allow);
+size_t hash_size(uint8_t alg);
+void hash_init(struct hash_ctx *ctx, uint8_t alg);
+void hash_update(struct hash_ctx *ctx, const void *data, size_t len);
+void hash_final(struct hash_ctx *ctx, uint8_t *digest);
+void hmac_key_init(struct hmac_key *key, uint8_t alg, const uint8_t *k,
+		size_t k_len);
+void hmac(const struct hmac_key *key, const void *msg, size_t len,
+		uint8_t *mac);
+void aes128_key_init(struct aes128_key *key, const uint8_t *k);
+void aes128_cbc_encrypt(const struct aes128_key *key, const uint8_t *iv,
+		uint8_t *buf, size_t len);
+void aes128_cbc_decrypt(const struct aes128_key *key, const uint8_t *iv,
+		uint8_t *buf, size_t len);
+
+#endif
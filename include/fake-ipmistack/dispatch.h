@@ -0,0 +1,58 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef DISPATCH_H
+# define DISPATCH_H
+
+struct bmc;
+
+/* Dense index of every command in IPMI_COMMANDS, e.g. for per-command
+ * statistics. IPMI_CMD_COUNT is one past the last one.
+ */
+enum ipmi_cmd_id {
+#define X(netfn, cmd, handler, min, max, priv) IPMI_CMD_ID_##netfn##_##cmd,
+	IPMI_COMMANDS(X)
+#undef X
+	IPMI_CMD_COUNT
+};
+
+struct ipmi_cmd {
+	int (*handler)(struct bmc *bmc, struct dummy_rq *req,
+			struct dummy_rs *rsp);
+	uint16_t data_len_min;
+	uint16_t data_len_max;
+	uint8_t priv;
+	uint16_t id;
+};
+
+const struct ipmi_cmd *ipmi_cmd_lookup(uint8_t netfn, uint8_t cmd);
+int ipmi_cmd_key(uint16_t id, uint8_t *netfn, uint8_t *cmd);
+int ipmi_dispatch(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp);
+
+#endif
@@ -31,11 +31,13 @@
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/un.h>
@@ -44,6 +46,15 @@
 # define IPMI_BUF_SIZE 1024
 # define DUMMY_SOCKET_PATH "/tmp/.ipmi_dummy"
 
+/* Server-side commands in OEM NetFn 0x3F, never forwarded to handlers.
+ * Select BMC takes 2 bytes of BMC ID, LS byte first. Get Stats is
+ * described in stats.h.
+ */
+# define DUMMY_NETFN 0x3F
+# define DUMMY_CMD_GET_STATS 0xFD
+# define DUMMY_CMD_SELECT_BMC 0xFE
+# define DUMMY_CMD_CLOSE 0xFF
+
 struct dummy_rq {
 	struct {
 		uint8_t netfn;
@@ -78,7 +89,15 @@ struct dummy_rs {
 # define NETFN_TRANSPORT 0x0C
 # define NETFN_GRP_EXT 0x2C
 # define NETFN_OEM_GRP 0x2E
+/* highest request NetFn, 6 bits */
+# define NETFN_MAX 0x3E
 /* Commands */
+# define APP_GET_CHANNEL_AUTH_CAPS 0x38
+# define APP_GET_SESSION_CHALLENGE 0x39
+# define APP_ACTIVATE_SESSION 0x3A
+# define APP_SET_SESSION_PRIV 0x3B
+# define APP_CLOSE_SESSION 0x3C
+# define APP_GET_SESSION_INFO 0x3D
 # define APP_SET_CHANNEL_ACCESS 0x40
 # define APP_GET_CHANNEL_ACCESS 0x41
 # define APP_GET_CHANNEL_INFO 0x42
@@ -109,7 +128,30 @@ struct dummy_rs {
 # define CHASSIS_GET_POH_COUNTER 0x0F
 
 # define PEF_GET_CAPABILITIES 0x10
+# define PEF_SET_CONFIG 0x12
+# define PEF_GET_CONFIG 0x13
+
+# define SENSOR_GET_THRESHOLDS 0x27
+# define SENSOR_GET_EVENT_STATUS 0x2B
+# define SENSOR_GET_READING 0x2D
+/* OEM */
+# define SENSOR_SET_GENERATOR 0xF0
+
+# define FRU_GET_AREA_INFO 0x10
+# define FRU_READ_DATA 0x11
+# define FRU_WRITE_DATA 0x12
+
+# define SDR_GET_INFO 0x20
+# define SDR_GET_ALLOC_INFO 0x21
+# define SDR_RESERVE 0x22
+# define SDR_GET_RECORD 0x23
 
+# define SEL_GET_INFO 0x40
+# define SEL_RESERVE 0x42
+# define SEL_GET_ENTRY 0x43
+# define SEL_ADD_ENTRY 0x44
+# define SEL_DELETE_ENTRY 0x46
+# define SEL_CLEAR 0x47
 # define SEL_GET_TIME 0x48
 # define SEL_SET_TIME 0x49
 
@@ -117,6 +159,8 @@ struct dummy_rs {
 # define TRANSPORT_GET_LAN_CFG 0x02
 # define TRANSPORT_SUSPEND_BMC_ARP 0x03
 # define TRANSPORT_GET_IP_STATS 0x04
+# define TRANSPORT_SET_SOL_CFG 0x21
+# define TRANSPORT_GET_SOL_CFG 0x22
 
 # define USER_SET_ACCESS 0x43
 # define USER_GET_ACCESS 0x44
@@ -124,19 +168,103 @@ struct dummy_rs {
 # define USER_GET_NAME 0x46
 # define USER_SET_PASSWORD 0x47
 
+/* Privilege Levels, none is for messages outside of a session */
+# define PRIV_NONE 0x00
+# define PRIV_CALLBACK 0x01
+# define PRIV_USER 0x02
+# define PRIV_OPERATOR 0x03
+# define PRIV_ADMIN 0x04
+
+/* Command registry - one line per implemented command:
+ * X(netfn, cmd, handler, min data_len, max data_len, privilege)
+ * Request data_len outside of <min, max> is rejected with CC_DATA_LEN
+ * before the handler is called. DATA_LEN_ANY lets handler check data_len
+ * on its own.
+ */
+# define DATA_LEN_ANY 0xFFFF
+
+# define IPMI_COMMANDS(X) \
+	X(NETFN_APP, APP_GET_CHANNEL_ACCESS, app_get_channel_access, 2, 2, PRIV_USER) \
+	X(NETFN_APP, APP_ACTIVATE_SESSION, app_activate_session, 22, 22, PRIV_NONE) \
+	X(NETFN_APP, APP_CLOSE_SESSION, app_close_session, 4, 5, PRIV_CALLBACK) \
+	X(NETFN_APP, APP_GET_CHANNEL_AUTH_CAPS, app_get_channel_auth_caps, 2, 2, PRIV_NONE) \
+	X(NETFN_APP, APP_GET_CHANNEL_INFO, app_get_channel_info, 1, 1, PRIV_USER) \
+	X(NETFN_APP, APP_GET_SESSION_CHALLENGE, app_get_session_challenge, 17, 17, PRIV_NONE) \
+	X(NETFN_APP, APP_GET_SESSION_INFO, app_get_session_info, 1, 5, PRIV_USER) \
+	X(NETFN_APP, APP_SET_CHANNEL_ACCESS, app_set_channel_access, 3, 3, PRIV_ADMIN) \
+	X(NETFN_APP, APP_SET_SESSION_PRIV, app_set_session_priv, 1, 1, PRIV_CALLBACK) \
+	X(NETFN_APP, BMC_GET_DEVICE_ID, mc_get_device_id, 0, DATA_LEN_ANY, PRIV_USER) \
+	X(NETFN_APP, BMC_RESET_COLD, mc_reset, 0, DATA_LEN_ANY, PRIV_ADMIN) \
+	X(NETFN_APP, BMC_RESET_WARM, mc_reset, 0, DATA_LEN_ANY, PRIV_ADMIN) \
+	X(NETFN_APP, BMC_SELFTEST, mc_selftest, 0, DATA_LEN_ANY, PRIV_USER) \
+	X(NETFN_APP, BMC_GET_DEVICE_GUID, mc_get_device_guid, 0, DATA_LEN_ANY, PRIV_USER) \
+	X(NETFN_APP, USER_GET_ACCESS, user_get_access, 2, 2, PRIV_OPERATOR) \
+	X(NETFN_APP, USER_GET_NAME, user_get_name, 1, 1, PRIV_OPERATOR) \
+	X(NETFN_APP, USER_SET_ACCESS, user_set_access, 4, 4, PRIV_ADMIN) \
+	X(NETFN_APP, USER_SET_NAME, user_set_name, 2, 17, PRIV_ADMIN) \
+	X(NETFN_APP, USER_SET_PASSWORD, user_set_password, 2, 22, PRIV_ADMIN) \
+	X(NETFN_CHASSIS, CHASSIS_CONTROL, chassis_control, 1, 1, PRIV_OPERATOR) \
+	X(NETFN_CHASSIS, CHASSIS_GET_CAPA, chassis_get_capa, 0, DATA_LEN_ANY, PRIV_USER) \
+	X(NETFN_CHASSIS, CHASSIS_GET_POH_COUNTER, chassis_get_poh_counter, 0, DATA_LEN_ANY, PRIV_USER) \
+	X(NETFN_CHASSIS, CHASSIS_GET_STATUS, chassis_get_status, 0, DATA_LEN_ANY, PRIV_USER) \
+	X(NETFN_CHASSIS, CHASSIS_GET_SYSBOOT_OPTS, chassis_get_sysboot_opts, 3, 3, PRIV_OPERATOR) \
+	X(NETFN_CHASSIS, CHASSIS_GET_SYSRES_CAUSE, chassis_get_sysres_cause, 0, DATA_LEN_ANY, PRIV_USER) \
+	X(NETFN_CHASSIS, CHASSIS_IDENTIFY, chassis_identify, 0, 2, PRIV_OPERATOR) \
+	X(NETFN_CHASSIS, CHASSIS_RESET, chassis_reset, 0, DATA_LEN_ANY, PRIV_OPERATOR) \
+	X(NETFN_CHASSIS, CHASSIS_SET_CAPA, chassis_set_capa, 0, DATA_LEN_ANY, PRIV_ADMIN) \
+	X(NETFN_CHASSIS, CHASSIS_SET_FP_BUTTONS, chassis_set_fp_buttons, 1, 1, PRIV_ADMIN) \
+	X(NETFN_CHASSIS, CHASSIS_SET_PWR_CYCLE_INT, chassis_set_pwr_cycle_int, 1, 1, PRIV_ADMIN) \
+	X(NETFN_CHASSIS, CHASSIS_SET_PWR_RESTORE_POL, chassis_set_pwr_restore_pol, 1, 1, PRIV_OPERATOR) \
+	X(NETFN_CHASSIS, CHASSIS_SET_SYSBOOT_OPTS, chassis_set_sysboot_opts, 1, DATA_LEN_ANY, PRIV_OPERATOR) \
+	X(NETFN_SENSOR, PEF_GET_CAPABILITIES, pef_get_capabilities, 0, DATA_LEN_ANY, PRIV_USER) \
+	X(NETFN_SENSOR, PEF_GET_CONFIG, pef_get_config, 3, 3, PRIV_OPERATOR) \
+	X(NETFN_SENSOR, PEF_SET_CONFIG, pef_set_config, 1, DATA_LEN_ANY, PRIV_ADMIN) \
+	X(NETFN_SENSOR, SENSOR_GET_EVENT_STATUS, sensor_get_event_status, 1, 1, PRIV_USER) \
+	X(NETFN_SENSOR, SENSOR_GET_READING, sensor_get_reading, 1, 1, PRIV_USER) \
+	X(NETFN_SENSOR, SENSOR_GET_THRESHOLDS, sensor_get_thresholds, 1, 1, PRIV_USER) \
+	X(NETFN_SENSOR, SENSOR_SET_GENERATOR, sensor_set_generator, 8, 8 + 64, PRIV_OPERATOR) \
+	X(NETFN_STORAGE, FRU_GET_AREA_INFO, fru_get_area_info, 1, 1, PRIV_USER) \
+	X(NETFN_STORAGE, FRU_READ_DATA, fru_read_data, 4, 4, PRIV_USER) \
+	X(NETFN_STORAGE, FRU_WRITE_DATA, fru_write_data, 4, 3 + 0xFF, PRIV_OPERATOR) \
+	X(NETFN_STORAGE, SDR_GET_INFO, sdr_get_info, 0, DATA_LEN_ANY, PRIV_USER) \
+	X(NETFN_STORAGE, SDR_GET_ALLOC_INFO, sdr_get_alloc_info, 0, DATA_LEN_ANY, PRIV_USER) \
+	X(NETFN_STORAGE, SDR_RESERVE, sdr_reserve, 0, DATA_LEN_ANY, PRIV_USER) \
+	X(NETFN_STORAGE, SDR_GET_RECORD, sdr_get_record, 6, 6, PRIV_USER) \
+	X(NETFN_STORAGE, SEL_GET_INFO, sel_get_info, 0, DATA_LEN_ANY, PRIV_USER) \
+	X(NETFN_STORAGE, SEL_RESERVE, sel_reserve, 0, DATA_LEN_ANY, PRIV_USER) \
+	X(NETFN_STORAGE, SEL_GET_ENTRY, sel_get_entry, 6, 6, PRIV_USER) \
+	X(NETFN_STORAGE, SEL_ADD_ENTRY, sel_add_entry, 16, 16, PRIV_OPERATOR) \
+	X(NETFN_STORAGE, SEL_DELETE_ENTRY, sel_delete_entry, 4, 4, PRIV_OPERATOR) \
+	X(NETFN_STORAGE, SEL_CLEAR, sel_clear, 6, 6, PRIV_OPERATOR) \
+	X(NETFN_STORAGE, SEL_GET_TIME, sel_get_time, 0, DATA_LEN_ANY, PRIV_USER) \
+	X(NETFN_STORAGE, SEL_SET_TIME, sel_set_time, 4, 4, PRIV_OPERATOR) \
+	X(NETFN_TRANSPORT, TRANSPORT_GET_IP_STATS, transport_get_ip_stats, 2, 2, PRIV_USER) \
+	X(NETFN_TRANSPORT, TRANSPORT_GET_LAN_CFG, transport_get_lan_cfg, 4, 4, PRIV_OPERATOR) \
+	X(NETFN_TRANSPORT, TRANSPORT_GET_SOL_CFG, transport_get_sol_cfg, 4, 4, PRIV_USER) \
+	X(NETFN_TRANSPORT, TRANSPORT_SET_LAN_CFG, transport_set_lan_cfg, 2, DATA_LEN_ANY, PRIV_ADMIN) \
+	X(NETFN_TRANSPORT, TRANSPORT_SET_SOL_CFG, transport_set_sol_cfg, 2, DATA_LEN_ANY, PRIV_ADMIN) \
+	X(NETFN_TRANSPORT, TRANSPORT_SUSPEND_BMC_ARP, transport_suspend_bmc_arp, 2, 2, PRIV_ADMIN)
+
 /* Completion Codes ~ p.42 */
 # define CC_OK 0x00
+/* Get/Set ... Configuration Parameters */
+# define CC_PARAM_NOT_SUPPORTED 0x80
+# define CC_PARAM_SET_IN_PROGRESS 0x81
+# define CC_PARAM_READ_ONLY 0x82
 # define CC_BUSY 0xC0
 # define CC_CMD_INV 0xC1
 # define CC_CMD_LUN_INV 0xC2
 # define CC_TIMEOUT 0xC3
 # define CC_NO_SPACE 0xC4
+# define CC_RESV_INV 0xC5
 # define CC_DATA_TRUNC 0xC6
 # define CC_DATA_LEN 0xC7
 # define CC_DATA_FIELD_LEN 0xC8
 # define CC_PARAM_OOR 0xC9
+# define CC_BYTES_NA 0xCA
 # define CC_SDR_NA 0xCB
 # define CC_DATA_FIELD_INV 0xCC
+# define CC_PRIV_INSUFFICIENT 0xD4
 # define CC_EXEC_NA_STATE 0xD5
 # define CC_EXEC_NA_PARAM 0xD6
 # define CC_UNSPEC 0xFF
@@ -0,0 +1,72 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef FRU_H
+# define FRU_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* FRU device ID FFh is reserved */
+# define FRU_DEVICES_MAX 0xFF
+# define FRU_SIZE_MAX 0xFFFF
+/* most bytes returned by one Read FRU Data */
+# define FRU_READ_MAX 0xFF
+
+/* FRU images are mmap()-ed read-only once and shared by all BMCs. A BMC
+ * gets its own MAP_PRIVATE mapping of an image on its first write, so only
+ * the pages it has written are copied and the file itself is never
+ * modified. Caller is expected to hold lock of the owning BMC.
+ */
+struct fru_state {
+	/* per device ID, NULL until the device is written to */
+	uint8_t **private;
+	/* devices of this BMC only, in place of the images of the same
+	 * device IDs; ref_count of them, NULL if none
+	 */
+	const struct fru_ref *refs;
+	uint32_t ref_count;
+};
+
+/* FRU device contents stored elsewhere, e.g. in a scenario, see
+ * scenario.h. Data is at offset, which may be negative, from the first
+ * struct fru_ref of the array. A BMC gets a heap copy on its first write.
+ */
+struct fru_ref {
+	uint32_t dev_id;
+	uint32_t size;
+	int64_t offset;
+};
+
+int fru_image_load(uint8_t dev_id, const char *path);
+int fru_dir_load(const char *dir);
+size_t fru_size(const struct fru_state *fru, uint8_t dev_id);
+const uint8_t *fru_data(struct fru_state *fru, uint8_t dev_id);
+uint8_t *fru_data_writable(struct fru_state *fru, uint8_t dev_id);
+
+#endif
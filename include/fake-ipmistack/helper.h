@@ -31,5 +31,7 @@
 
 int is_valid_channel(uint8_t channel_num);
 int is_valid_priv_limit(uint8_t priv_limit);
+uint64_t monotonic_ms();
+uint64_t monotonic_ns();
 
 #endif
@@ -0,0 +1,74 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef LOG_H
+# define LOG_H
+
+#include <stdint.h>
+
+# define LOG_LVL_ERROR 0
+# define LOG_LVL_WARN 1
+# define LOG_LVL_NOTICE 2
+# define LOG_LVL_INFO 3
+# define LOG_LVL_DEBUG 4
+
+/* Messages above LOG_LEVEL_MAX are compiled out, build with
+ * -DLOG_LEVEL_MAX=LOG_LVL_NOTICE to drop per-request messages for good.
+ */
+# ifndef LOG_LEVEL_MAX
+#  define LOG_LEVEL_MAX LOG_LVL_DEBUG
+# endif
+
+# define LOG_LEVEL_DEFAULT LOG_LVL_NOTICE
+
+extern int g_log_level;
+
+/* Format is kept as a pointer and formatted later by the logger thread, so
+ * it must be a string literal. Only integer, %c, %p and %s conversions are
+ * supported, at most LOG_ARGS_MAX of them.
+ */
+# define log_msg(level, ...) \
+	do { \
+		if ((level) <= LOG_LEVEL_MAX && (level) <= g_log_level) { \
+			log_write((level), __VA_ARGS__); \
+		} \
+	} while (0)
+
+# define log_error(...) log_msg(LOG_LVL_ERROR, __VA_ARGS__)
+# define log_warn(...) log_msg(LOG_LVL_WARN, __VA_ARGS__)
+# define log_notice(...) log_msg(LOG_LVL_NOTICE, __VA_ARGS__)
+# define log_info(...) log_msg(LOG_LVL_INFO, __VA_ARGS__)
+# define log_debug(...) log_msg(LOG_LVL_DEBUG, __VA_ARGS__)
+
+int log_init();
+void log_flush();
+void log_set_level(int level);
+void log_write(int level, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+#endif
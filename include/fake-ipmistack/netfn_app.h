@@ -1,4 +1,4 @@
-/* Copyright (c) 2013, Zdenek Styblik
+/* Copyright (c) 2014, Zdenek Styblik
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -29,6 +29,87 @@
 #ifndef NETFN_APP_H
 # define NETFN_APP_H
 
-int netfn_app_main(struct dummy_rq *req, struct dummy_rs *rsp);
+#include "fake-ipmistack/crypto.h"
+#include "fake-ipmistack/session.h"
+
+struct bmc;
+
+# define CHANNEL_MAX 16
+/* the only channel sessions are established over */
+# define CHANNEL_LAN 0x01
+
+# define UID_MAX 63
+# define UID_MIN 1
+# define UID_ENABLED 0x40
+# define UID_DISABLED 0x80
+
+struct ipmi_channel {
+	uint8_t number;
+	uint8_t ptype;
+	uint8_t mtype;
+	uint8_t sessions;
+	uint8_t capabilities;
+	uint8_t priv_level;
+	char desc[24];
+};
+
+struct ipmi_user {
+	uint8_t name[17];
+	uint8_t password[21];
+	uint8_t password_size; /* password stored as 16b = 0; 20b = 1 */
+	uint8_t session_limit; /* [3:0], 0 = only limited by channel */
+};
+
+/* Users of a BMC, indexed by UID, and what each of them may do on each
+ * channel. Whether a user is enabled isn't here, see struct app_state.
+ */
+struct user_db {
+	struct ipmi_user users[UID_MAX + 1];
+	/* access - bitfield - [7] - reserved;
+	 * [6] - call-in call-back = 0, only call-b = 1;
+	 * [5] - disable link auth = 0; [4] - disable IPMI msg = 0;
+	 * [3:0] - user priv limit
+	 */
+	uint8_t access[UID_MAX + 1][CHANNEL_MAX];
+};
+
+/* Per-BMC state of App NetFn */
+struct app_state {
+	struct ipmi_channel channels[CHANNEL_MAX];
+	/* NULL until the first change, users_shared are used until then */
+	struct user_db *users;
+	/* built-in users, or those of BMC's scenario profile */
+	const struct user_db *users_shared;
+	/* bit per UID - enabled users, users with a fixed (non-null) name */
+	uint64_t users_enabled;
+	uint64_t users_named;
+	/* HMAC state of users' passwords, K_UID of RAKP, by UID and hash
+	 * algorithm, allocated with the first RMCP+ login; bit per UID whose
+	 * key is up to date
+	 */
+	struct hmac_key *user_keys;
+	uint64_t user_keys_valid[HASH_ALGS];
+	/* Device GUID, also sent in RAKP 2 */
+	uint8_t guid[16];
+	/* Get Device ID response, built-in or of BMC's scenario profile */
+	const uint8_t *device_id;
+	uint8_t device_id_len;
+	struct session_table sessions;
+	/* BMC is linked in timer list while it has sessions */
+	uint8_t timer_armed;
+	struct bmc *timer_next;
+};
+
+void app_state_init(struct app_state *app);
+void app_timer_arm(struct bmc *bmc);
+int app_run_timers();
+const struct ipmi_user *user_get(const struct app_state *app, uint8_t uid);
+const struct hmac_key *user_key(struct app_state *app, uint8_t uid,
+		uint8_t alg, struct hmac_key *scratch);
+void user_key_cache_enable(int enable);
+int user_by_name(struct app_state *app, const uint8_t *name,
+		size_t name_len);
+uint8_t user_session_priv(struct app_state *app, uint8_t uid,
+		uint8_t channel);
 
 #endif
@@ -1,4 +1,4 @@
-/* Copyright (c) 2013, Zdenek Styblik
+/* Copyright (c) 2014, Zdenek Styblik
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -29,6 +29,45 @@
 #ifndef NETFN_CHASSIS_H
 # define NETFN_CHASSIS_H
 
-int netfn_chassis_main(struct dummy_rq *req, struct dummy_rs *rsp);
+#include "fake-ipmistack/param.h"
+
+struct bmc;
+
+/* Power transitions which take time. Chassis Control only arms the
+ * transition and returns, chassis_run_timers() finishes it once the
+ * deadline has passed.
+ */
+enum pwr_transition {
+	PWR_IDLE = 0,
+	PWR_CYCLE,
+	PWR_HARD_RESET,
+	PWR_SOFT_OFF
+};
+
+/* Per-BMC state of Chassis NetFn */
+struct chassis_state {
+	uint64_t led_deadline;
+	uint64_t pwr_deadline;
+	uint32_t poh_counter;
+	uint8_t fp_buttons;
+	uint8_t host_power_state;
+	/* 0 - off, 1 - on until led_deadline, 2 - forced on */
+	uint8_t led_identify;
+	uint8_t pwr_restore_pol;
+	uint8_t pwr_cycle_int;
+	uint8_t pwr_transition;
+	/* 0x0-0xB */
+	uint8_t sys_restart_cause;
+	uint8_t poh_mins_pcount;
+	struct param_store boot;
+	/* boot parameters marked invalid, bit per selector */
+	uint32_t boot_invalid;
+	/* BMC is linked in timer list while it has a deadline pending */
+	uint8_t timer_armed;
+	struct bmc *timer_next;
+};
+
+void chassis_state_init(struct chassis_state *chassis);
+int chassis_run_timers();
 
 #endif
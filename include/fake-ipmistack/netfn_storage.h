@@ -29,6 +29,22 @@
 #ifndef NETFN_STORAGE_H
 # define NETFN_STORAGE_H
 
-int netfn_storage_main(struct dummy_rq *req, struct dummy_rs *rsp);
+#include "fake-ipmistack/fru.h"
+#include "fake-ipmistack/sel.h"
+
+struct bmc;
+
+/* Per-BMC state of Storage NetFn */
+struct storage_state {
+	struct fru_state fru;
+	struct sel sel;
+	/* SDR repository is shared, reservations are per BMC */
+	uint16_t sdr_resv;
+	uint16_t sdr_resv_last;
+	uint8_t sel_time[4];
+};
+
+void storage_state_init(struct storage_state *storage);
+uint32_t sel_time_now(struct bmc *bmc);
 
 #endif
@@ -1,4 +1,4 @@
-/* Copyright (c) 2013, Zdenek Styblik
+/* Copyright (c) 2014, Zdenek Styblik
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -29,5 +29,24 @@
 #ifndef NETFN_TRANSPORT_H
 # define NETFN_TRANSPORT_H
 
-int netfn_transport_main(struct dummy_rq *req, struct dummy_rs *rsp);
+#include "fake-ipmistack/param.h"
+
+/* Per-BMC state of Transport NetFn */
+struct transport_state {
+	uint16_t ip_addr_err_rx;
+	uint16_t ip_frag_rx;
+	uint16_t ip_hdr_err_rx;
+	uint16_t ip_pkts_rx;
+	uint16_t ip_pkts_tx;
+	uint16_t rcmp_pkts_rx;
+	uint16_t udp_pkts_rx;
+	uint16_t udp_proxy_rx;
+	uint16_t udp_proxy_drop;
+	/* one set of parameters, whichever LAN channel is asked about */
+	struct param_store lan;
+	struct param_store sol;
+};
+
+void transport_state_init(struct transport_state *transport);
+
 #endif
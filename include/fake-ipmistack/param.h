@@ -0,0 +1,94 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef PARAM_H
+# define PARAM_H
+
+#include <stdint.h>
+
+/* Longest value of any configuration parameter */
+# define PARAM_LEN_MAX 32
+# define PARAM_SELECTORS_MAX 32
+/* Selector 0 of every family is Set In Progress */
+# define PARAM_SET_IN_PROGRESS 0x00
+# define PARAM_SET_COMPLETE 0x00
+# define PARAM_SET_LOCKED 0x01
+# define PARAM_SET_COMMIT 0x02
+
+/* enum param_flags */
+# define PARAM_RO 0x01
+/* value may be shorter than len, but not empty */
+# define PARAM_VAR 0x02
+
+/* One configuration parameter. Parameters with more than one block (LAN
+ * destinations, PEF event filters, ...) carry block number in the first
+ * byte of their value, as Set requests do. A zero len means the selector
+ * isn't supported.
+ */
+struct param_desc {
+	uint8_t len;
+	uint8_t flags;
+	uint8_t blocks;
+	/* number of the first block, 0 or 1 */
+	uint8_t block_base;
+	/* default, or NULL for zeros */
+	const uint8_t *def;
+};
+
+/* Parameters of one "Get/Set ... Configuration Parameters" family, e.g.
+ * LAN configuration. Descriptors are indexed by selector. Values of all
+ * parameters of a family are laid out in one buffer, a length byte and len
+ * bytes per block, at offsets computed once by param_family_init().
+ */
+struct param_family {
+	const char *name;
+	uint8_t revision;
+	uint8_t count;
+	const struct param_desc *desc;
+	uint16_t offset[PARAM_SELECTORS_MAX];
+	uint16_t size;
+};
+
+/* Parameter values of one BMC. Buffer is allocated on the first Set, until
+ * then values are read straight from descriptors. Caller is expected to
+ * hold lock of the owning BMC.
+ */
+struct param_store {
+	struct param_family *family;
+	uint8_t *values;
+	uint8_t set_state;
+};
+
+void param_family_init(struct param_family *family);
+void param_store_init(struct param_store *store, struct param_family *family);
+uint8_t param_get(struct param_store *store, uint8_t selector, uint8_t block,
+		uint8_t *value, uint8_t *len);
+uint8_t param_set(struct param_store *store, uint8_t selector,
+		const uint8_t *value, uint8_t len);
+
+#endif
@@ -0,0 +1,108 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef RMCP_H
+# define RMCP_H
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct bmc;
+
+/* Largest datagram taken or sent */
+# define RMCP_PKT_MAX 1024
+
+# define RMCP_VERSION 0x06
+# define RMCP_SEQ_NO_ACK 0xFF
+# define RMCP_CLASS_ASF 0x06
+# define RMCP_CLASS_IPMI 0x07
+# define RMCP_HEADER_SIZE 4
+
+# define ASF_TYPE_PING 0x80
+# define ASF_TYPE_PONG 0x40
+
+/* Session header authentication type */
+# define IPMI_AUTH_NONE 0x00
+# define IPMI_AUTH_MD2 0x01
+# define IPMI_AUTH_MD5 0x02
+# define IPMI_AUTH_PASSWORD 0x04
+# define IPMI_AUTH_RMCP_PLUS 0x06
+
+/* IPMI v2.0 payload types */
+# define IPMI_PAYLOAD_IPMI 0x00
+# define IPMI_PAYLOAD_SOL 0x01
+# define IPMI_PAYLOAD_OEM 0x02
+# define IPMI_PAYLOAD_ENCRYPTED 0x80
+# define IPMI_PAYLOAD_AUTHENTICATED 0x40
+# define IPMI_PAYLOAD_TYPE 0x3F
+# define IPMI_PAYLOAD_OPEN_SESSION_RQ 0x10
+# define IPMI_PAYLOAD_OPEN_SESSION_RS 0x11
+# define IPMI_PAYLOAD_RAKP1 0x12
+# define IPMI_PAYLOAD_RAKP2 0x13
+# define IPMI_PAYLOAD_RAKP3 0x14
+# define IPMI_PAYLOAD_RAKP4 0x15
+
+/* RMCP+ and RAKP message status codes */
+# define RMCP_STATUS_OK 0x00
+# define RMCP_STATUS_NO_RESOURCES 0x01
+# define RMCP_STATUS_SESSION_INV 0x02
+# define RMCP_STATUS_AUTH_ALG_INV 0x04
+# define RMCP_STATUS_INTEGRITY_ALG_INV 0x05
+# define RMCP_STATUS_ROLE_INV 0x09
+# define RMCP_STATUS_ROLE_UNAUTH 0x0A
+# define RMCP_STATUS_NAME_LEN_INV 0x0C
+# define RMCP_STATUS_NAME_UNAUTH 0x0D
+# define RMCP_STATUS_INTEGRITY_INV 0x0F
+# define RMCP_STATUS_CONF_ALG_INV 0x10
+# define RMCP_STATUS_PARAM_ILLEGAL 0x12
+
+/* RMCP+ algorithm payload types and algorithms */
+# define RMCP_ALG_AUTH 0x00
+# define RMCP_ALG_INTEGRITY 0x01
+# define RMCP_ALG_CONF 0x02
+# define RMCP_AUTH_RAKP_NONE 0x00
+# define RMCP_AUTH_RAKP_HMAC_SHA1 0x01
+# define RMCP_AUTH_RAKP_HMAC_SHA256 0x03
+# define RMCP_INTEGRITY_NONE 0x00
+# define RMCP_INTEGRITY_HMAC_SHA1_96 0x01
+# define RMCP_INTEGRITY_HMAC_SHA256_128 0x04
+# define RMCP_CONF_NONE 0x00
+# define RMCP_CONF_AES_CBC_128 0x01
+
+/* Next header field of integrity trailer */
+# define RMCP_NEXT_HEADER 0x07
+
+# define IPMI_BMC_SLAVE_ADDR 0x20
+/* rsAddr .. rqSeq, cmd and both checksums */
+# define IPMI_LAN_MSG_MIN 7
+
+int rmcp_handle(struct bmc *bmc, const struct sockaddr_in *peer,
+		uint8_t *pkt, size_t len, uint8_t *out, size_t out_size);
+
+#endif
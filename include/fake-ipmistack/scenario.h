@@ -0,0 +1,124 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef SCENARIO_H
+# define SCENARIO_H
+
+#include <stdint.h>
+
+#include "fake-ipmistack/fru.h"
+#include "fake-ipmistack/netfn_app.h"
+#include "fake-ipmistack/sensor.h"
+
+/* Scenario describes who BMCs are: Get Device ID, GUID, channels, users,
+ * sensor readings and thresholds and FRU data, profile by profile. Text
+ * description is compiled by fake-ipmistack-scenario into a flat file of
+ * fixed size records and offsets, which the server mmap()-s read-only and
+ * points BMCs into. Nothing is parsed or copied at start-up but a few
+ * bytes per BMC.
+ *
+ * File layout: struct scenario_header, profile_count times struct
+ * scenario_profile, then sections referenced from profiles by offset from
+ * the start of file, each SCENARIO_ALIGN aligned. Identical sections are
+ * stored once.
+ */
+# define SCENARIO_MAGIC "FIPMSCEN"
+# define SCENARIO_VERSION 2
+# define SCENARIO_ALIGN 8
+# define SCENARIO_BYTE_ORDER 0x01020304
+# define SCENARIO_NAME_MAX 32
+
+/* Get Device ID response of a BMC, built-in and where profiles start:
+ * device ID, revision, firmware revision 1 and 2, IPMI version, device
+ * support, manufacturer ID (3 bytes), product ID (2 bytes) and auxiliary
+ * firmware revision (4 bytes)
+ */
+# define DEVICE_ID_LEN_MIN 11
+# define DEVICE_ID_LEN_MAX 15
+# define DEVICE_ID_DEFAULT \
+	{ 12, 0x80, 0x00, 0x00, 0x00, 0xFF, 0xCC, 0x9B, 0x00, 0x00, 0x00 }
+
+/* profile has a GUID of its own */
+# define SCENARIO_GUID 0x01
+
+struct scenario_header {
+	char magic[8];
+	uint32_t version;
+	/* SCENARIO_BYTE_ORDER as written by the compiler */
+	uint32_t byte_order;
+	uint64_t size;
+	uint32_t profile_count;
+	/* BMCs described, sum of bmcs of all profiles */
+	uint32_t bmc_count;
+	/* sizes of records, to refuse a file of another build */
+	uint32_t profile_size;
+	uint32_t user_db_size;
+	uint32_t channel_size;
+	uint32_t preset_size;
+	uint32_t fru_ref_size;
+	uint32_t reserved;
+	/* offset of the first profile */
+	uint64_t profiles;
+	/* FNV-1a of everything after the header, what snapshots taken on
+	 * the scenario are bound to
+	 */
+	uint64_t hash;
+};
+
+struct scenario_profile {
+	char name[SCENARIO_NAME_MAX];
+	/* BMCs first_bmc - first_bmc + bmcs - 1 are of this profile */
+	uint32_t first_bmc;
+	uint32_t bmcs;
+	uint8_t flags;
+	uint8_t device_id_len;
+	uint8_t device_id[DEVICE_ID_LEN_MAX];
+	/* n-th BMC of the profile gets n added to the last 4 bytes */
+	uint8_t guid[16];
+	uint8_t channel_count;
+	uint32_t sensor_count;
+	uint32_t fru_count;
+	uint64_t users_enabled;
+	uint64_t users_named;
+	/* struct user_db, 0 if the profile keeps the built-in users */
+	uint64_t users;
+	/* channel_count times struct ipmi_channel, each replacing the
+	 * built-in channel of the same number
+	 */
+	uint64_t channels;
+	/* sensor_count times struct sensor_preset */
+	uint64_t sensors;
+	/* fru_count times struct fru_ref, see fru.h */
+	uint64_t frus;
+};
+
+long scenario_map(const char *path);
+int scenario_apply();
+void scenario_identity(uint64_t *size, uint64_t *hash);
+
+#endif
@@ -0,0 +1,81 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef SDR_H
+# define SDR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+# define SDR_VERSION 0x51
+# define SDR_HEADER_SIZE 5
+# define SDR_RECORD_MAX 64
+# define SDR_ID_FIRST 0x0000
+# define SDR_ID_LAST 0xFFFF
+/* Get SDR Repository Info, Operation Support */
+# define SDR_OP_RESERVE 0x02
+# define SDR_OP_ALLOC_INFO 0x01
+/* Get SDR Repository Allocation Info */
+# define SDR_ALLOC_UNIT 16
+
+# define SDR_TYPE_FULL_SENSOR 0x01
+# define SDR_TYPE_MC_LOCATOR 0x12
+
+# define SDR_SENSORS_DEFAULT 16
+# define SDR_SENSORS_MAX 4000
+
+/* Where a record sits in the repository buffer, sorted by record ID. */
+struct sdr_index {
+	uint16_t id;
+	uint16_t len;
+	uint32_t offset;
+};
+
+/* Sensor Data Record repository. Records are stored back-to-back in one
+ * buffer and found through the sorted index, so Get SDR costs a binary
+ * search and following record is the next index entry. Repository is
+ * built at start-up and is read-only afterwards, all BMCs share it.
+ */
+struct sdr_repo {
+	uint8_t *buf;
+	size_t len;
+	size_t size;
+	struct sdr_index *index;
+	uint32_t count;
+	uint32_t index_size;
+	/* SDR_ALLOC_UNIT sized units taken by records */
+	uint32_t units;
+	uint32_t add_ts;
+	uint32_t erase_ts;
+};
+
+int sdr_repo_init(uint32_t sensors);
+const struct sdr_repo *sdr_repo();
+const uint8_t *sdr_lookup(uint16_t id, uint16_t *next, uint16_t *len);
+
+#endif
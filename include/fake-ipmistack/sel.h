@@ -0,0 +1,78 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef SEL_H
+# define SEL_H
+
+#include <stdint.h>
+
+# define SEL_RECORD_SIZE 16
+/* Record IDs 0000h and FFFFh are reserved, so SEL holds 65534 records */
+# define SEL_ENTRIES_MAX 0xFFFE
+# define SEL_ID_FIRST 0x0000
+# define SEL_ID_LAST 0xFFFF
+# define SEL_VERSION 0x51
+/* Get SEL Info, Operation Support */
+# define SEL_OP_OVERFLOW 0x80
+# define SEL_OP_DELETE 0x08
+# define SEL_OP_RESERVE 0x02
+
+/* System Event Log kept in a ring of SEL_ENTRIES_MAX fixed-size records.
+ * Record in slot N always has record ID N + 1, so lookup by ID is a single
+ * index. When the ring is full, the oldest record is overwritten and the
+ * overflow flag is set. Deleted records are marked by record ID 0000h and
+ * are dropped once they reach either end of the ring.
+ *
+ * Ring is allocated on the first Add, BMCs which never log anything don't
+ * pay for it. Caller is expected to hold lock of the owning BMC.
+ */
+struct sel {
+	uint8_t (*records)[SEL_RECORD_SIZE];
+	/* slot of the oldest record */
+	uint32_t head;
+	/* slots from head on, including deleted records */
+	uint32_t span;
+	/* records which haven't been deleted */
+	uint32_t entries;
+	uint32_t add_ts;
+	uint32_t erase_ts;
+	/* current reservation ID, 0 - none or cancelled */
+	uint16_t resv;
+	uint16_t resv_last;
+	uint8_t overflow;
+};
+
+void sel_init(struct sel *sel);
+int sel_add(struct sel *sel, const uint8_t *record, uint32_t ts,
+		uint16_t *id);
+const uint8_t *sel_get(struct sel *sel, uint16_t id, uint16_t *next);
+int sel_delete(struct sel *sel, uint16_t id, uint16_t *deleted);
+void sel_erase(struct sel *sel, uint32_t ts);
+uint16_t sel_new_reservation(struct sel *sel);
+
+#endif
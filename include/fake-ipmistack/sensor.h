@@ -0,0 +1,154 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef SENSOR_H
+# define SENSOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fake-ipmistack/sel.h"
+
+/* Thresholds in the order of their status bits and of Get Sensor
+ * Thresholds response.
+ */
+enum sensor_thr {
+	SENSOR_THR_LNC = 0,
+	SENSOR_THR_LC,
+	SENSOR_THR_LNR,
+	SENSOR_THR_UNC,
+	SENSOR_THR_UC,
+	SENSOR_THR_UNR,
+	SENSOR_THR_COUNT
+};
+
+# define SENSOR_THR_READABLE 0x3F
+/* Get Sensor Reading, byte 2 */
+# define SENSOR_EVENTS_ENABLED 0x80
+# define SENSOR_SCANNING_ENABLED 0x40
+# define SENSOR_READING_NA 0x20
+/* sensor numbers addressable through BMC's own LUNs */
+# define SENSOR_LUNS 4
+# define SENSOR_NUMBERS 255
+# define SENSOR_NONE 0xFFFF
+
+/* Generators sensor readings follow. Reading is computed from monotonic
+ * clock when somebody asks for it, nothing runs in between.
+ */
+enum sensor_gen_kind {
+	/* nominal reading, the default */
+	SENSOR_GEN_CONST = 0,
+	/* base +/- amplitude, one cycle per period */
+	SENSOR_GEN_SINE,
+	/* base up to base + amplitude, one ramp per period */
+	SENSOR_GEN_RAMP,
+	/* step of -1, 0 or +1 every period, within base +/- amplitude */
+	SENSOR_GEN_WALK,
+	/* samples of a trace, one per period, over and over */
+	SENSOR_GEN_TRACE,
+	SENSOR_GEN_COUNT
+};
+
+# define SENSOR_TRACE_MAX 64
+/* a random walk left alone for longer just continues from where it was */
+# define SENSOR_WALK_STEPS_MAX 1024
+
+struct sensor_gen {
+	uint8_t kind;
+	uint8_t base;
+	uint8_t amplitude;
+	uint8_t trace_len;
+	uint32_t period_ms;
+	uint32_t seed;
+	uint64_t start_ms;
+	/* SENSOR_GEN_WALK: time of the last step taken */
+	uint64_t last_ms;
+	uint8_t *trace;
+};
+
+/* State of all sensors of one BMC as parallel arrays, one element per
+ * sensor, each array SENSOR_ALIGN aligned. Scans over a single attribute
+ * of the whole table touch nothing else and vectorize. Sensor index is the
+ * position of sensor's Full Sensor Record in SDR repository.
+ *
+ * Table is allocated on the first access, BMCs nobody asks about sensors
+ * don't pay for it. Caller is expected to hold lock of the owning BMC.
+ */
+# define SENSOR_ALIGN 64
+
+struct sensor_table {
+	uint32_t count;
+	uint8_t *raw;
+	/* threshold comparison status, bit per enum sensor_thr */
+	uint8_t *status;
+	/* status bits changed since SEL events have been logged */
+	uint8_t *pending;
+	/* SENSOR_EVENTS_ENABLED, SENSOR_SCANNING_ENABLED */
+	uint8_t *flags;
+	/* positive- and negative-going threshold hysteresis */
+	uint8_t *hyst_pos;
+	uint8_t *hyst_neg;
+	uint8_t *thr[SENSOR_THR_COUNT];
+	/* NULL until a generator is attached to any of sensors */
+	struct sensor_gen *gen;
+};
+
+/* Reading and thresholds a sensor of one BMC starts with in place of those
+ * of its SDR, e.g. from a scenario, see scenario.h. Mask has a bit per
+ * enum sensor_thr to take from thr, and SENSOR_PRESET_RAW.
+ */
+# define SENSOR_PRESET_RAW 0x40
+
+struct sensor_preset {
+	uint8_t lun;
+	uint8_t number;
+	uint8_t mask;
+	uint8_t raw;
+	uint8_t thr[SENSOR_THR_COUNT];
+};
+
+int sensor_engine_init();
+uint32_t sensor_count();
+uint16_t sensor_lookup(uint8_t lun, uint8_t number);
+size_t sensor_table_size();
+void sensor_table_attach(struct sensor_table *table, uint8_t *block);
+int sensor_table_alloc(struct sensor_table *table,
+		const struct sensor_preset *presets, uint32_t preset_count);
+void sensor_eval(struct sensor_table *table, uint32_t from, uint32_t to);
+void sensor_eval_scalar(struct sensor_table *table, uint32_t from,
+		uint32_t to);
+void sensor_eval_simd(struct sensor_table *table, uint32_t from,
+		uint32_t to);
+int sensor_log_events(struct sensor_table *table, uint32_t from, uint32_t to,
+		uint32_t ts, struct sel *sel);
+int sensor_gen_attach(struct sensor_table *table, uint16_t idx,
+		const struct sensor_gen *gen, uint64_t now_ms);
+void sensor_update(struct sensor_table *table, uint16_t idx,
+		uint64_t now_ms);
+
+#endif
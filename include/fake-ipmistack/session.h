@@ -0,0 +1,162 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef SESSION_H
+# define SESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fake-ipmistack/crypto.h"
+
+/* Sessions per BMC, pending ones included. Handles are 1..SESSION_MAX. */
+# define SESSION_MAX 32
+/* Session ID hash index, power of two, so it is at most half full */
+# define SESSION_HASH_BITS 6
+# define SESSION_HASH_SIZE (1 << SESSION_HASH_BITS)
+/* UIDs and channel numbers sessions are counted by */
+# define SESSION_UIDS 64
+# define SESSION_CHANNELS 16
+/* Idle time after which a session is closed */
+# define SESSION_TIMEOUT_MS 60000
+/* Time given to a console between Get Session Challenge or Open Session
+ * Request and activation of the session
+ */
+# define SESSION_SETUP_MS 10000
+/* Expired sessions are reaped at most this often */
+# define SESSION_REAP_MS 1000
+/* How far behind the highest one an inbound sequence number may be */
+# define SESSION_SEQ_WINDOW 16
+
+enum session_state {
+	SESSION_FREE = 0,
+	SESSION_PENDING,
+	SESSION_ACTIVE
+};
+
+/* Activation failures */
+# define SESSION_ERR_CHANNEL (-1)
+# define SESSION_ERR_USER (-2)
+
+struct session {
+	uint32_t id;
+	/* console's session ID, RMCP+ only */
+	uint32_t remote_id;
+	/* highest inbound and next outbound sequence number */
+	uint32_t in_seq;
+	uint32_t out_seq;
+	/* inbound sequence numbers seen, bit N is in_seq - N */
+	uint32_t seq_mask;
+	uint64_t expires_ms;
+	/* console address, network byte order */
+	uint32_t addr;
+	uint16_t port;
+	uint8_t state;
+	uint8_t channel;
+	uint8_t uid;
+	uint8_t priv;
+	uint8_t max_priv;
+	/* v1.5 authentication type, IPMI_AUTH_RMCP_PLUS for v2.0 */
+	uint8_t auth_type;
+	/* RMCP+ algorithms and RAKP 1 role */
+	uint8_t auth_alg;
+	uint8_t integrity_alg;
+	uint8_t conf_alg;
+	uint8_t role;
+	uint8_t name_len;
+	uint8_t name[16];
+	/* v1.5 challenge string, RMCP+ BMC random number */
+	uint8_t challenge[16];
+	/* RMCP+ console random number */
+	uint8_t remote_random[16];
+	/* RMCP+ Session Integrity Key, and keys derived from it: K1 keys
+	 * the integrity algorithm, first 16 bytes of K2 the cipher
+	 */
+	uint8_t sik[HASH_MAX_SIZE];
+	struct hmac_key k1;
+	struct aes128_key k2;
+};
+
+struct session_pool {
+	struct session slot[SESSION_MAX];
+	/* session ID hash -> slot + 1, 0 when empty, linear probing */
+	uint8_t index[SESSION_HASH_SIZE];
+	/* active sessions */
+	uint8_t channel_active[SESSION_CHANNELS];
+	uint8_t user_active[SESSION_UIDS];
+};
+
+/* Sessions of one BMC. The pool is allocated with the first session, so
+ * BMCs nobody logs in to cost a few bytes only.
+ */
+struct session_table {
+	struct session_pool *pool;
+	uint8_t used;
+	uint8_t active;
+	/* no session expires before this, UINT64_MAX when there are none */
+	uint64_t next_expiry_ms;
+	uint64_t rng;
+};
+
+/* Where the request being served came from, see session_use(). 'id' is 0
+ * for messages outside of a session, 'priv' is the privilege level the
+ * request is checked against.
+ */
+struct session_ctx {
+	uint32_t id;
+	uint32_t addr;
+	uint16_t port;
+	uint8_t channel;
+	uint8_t priv;
+	uint8_t auth_type;
+};
+
+void session_table_init(struct session_table *table, uint64_t seed);
+void session_random(struct session_table *table, uint8_t *buf, size_t len);
+struct session *session_new(struct session_table *table, uint8_t channel,
+		uint64_t now_ms);
+struct session *session_find(struct session_table *table, uint32_t id,
+		uint64_t now_ms);
+struct session *session_by_handle(struct session_table *table,
+		uint8_t handle, uint64_t now_ms);
+struct session *session_nth_active(struct session_table *table,
+		uint8_t nth, uint64_t now_ms);
+uint8_t session_handle(struct session_table *table,
+		const struct session *session);
+int session_activate(struct session_table *table, struct session *session,
+		uint8_t uid, uint8_t user_limit, uint8_t channel_limit,
+		uint64_t now_ms);
+int session_seq_check(struct session *session, uint32_t seq);
+void session_touch(struct session_table *table, struct session *session,
+		uint64_t now_ms);
+void session_close(struct session_table *table, struct session *session);
+uint32_t session_reap(struct session_table *table, uint64_t now_ms);
+void session_use(const struct session_ctx *ctx);
+const struct session_ctx *session_current();
+
+#endif
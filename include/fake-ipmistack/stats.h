@@ -0,0 +1,69 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef STATS_H
+# define STATS_H
+
+#include <stdint.h>
+
+#include "fake-ipmistack/histogram.h"
+
+# define STATS_SHARDS_MAX 256
+/* most completion codes listed per command in one response */
+# define STATS_CCODES_MAX 32
+/* NetFn/Cmd reported for requests no handler has been registered for */
+# define STATS_UNKNOWN_CMD 0xFF
+
+/* Latency histogram and completion code counters of one command. */
+struct cmd_stats {
+	struct histogram latency;
+	uint64_t ccodes[256];
+};
+
+/* Get Stats response, all numbers LS byte first:
+ * [0] command ID to ask for next, 0xFF when there is nothing left
+ * [1:8] response arena allocations, [9:16] how many of them went to heap,
+ * summed over all threads, see arena_stats()
+ * then one record per command which has been called at least once:
+ * [0] NetFn, [1] Cmd, [2] number of ccode entries N
+ * [3:10] requests, [11:18] sum of latencies in ns
+ * [19:26] p50, [27:34] p99, [35:42] p999, [43:50] max latency in ns
+ * N times: [0] ccode, [1:8] number of responses with that ccode
+ * Request carries one byte, ID of the first command to report.
+ */
+# define STATS_HEADER_SIZE 17
+# define STATS_RECORD_SIZE 51
+# define STATS_CCODE_SIZE 9
+
+int stats_thread_init();
+void stats_record(uint8_t netfn, uint8_t cmd, uint8_t ccode,
+		uint64_t latency_ns);
+int stats_snapshot(uint16_t id, struct cmd_stats *out);
+void stats_get(struct dummy_rq *req, struct dummy_rs *rsp);
+
+#endif
@@ -0,0 +1,244 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "fake-ipmistack/arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+# define ARENA_ALIGN(len) (((len) + 7) & ~((size_t)7))
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t len;
+};
+
+/* Arena handlers allocate from, set by arena_use(). Threads which never
+ * called arena_use() fall back to their own default arena.
+ */
+static __thread struct arena *arena_current = NULL;
+static __thread struct arena arena_default;
+
+/* Counters of arenas used by one thread, arenas add to them when they are
+ * reset, not per allocation, so allocating touches no shared cache line.
+ * arena_stats() sums up all threads. Shards are never freed.
+ */
+# define ARENA_SHARDS_MAX 1024
+
+struct arena_shard {
+	uint64_t allocs;
+	uint64_t heap_allocs;
+};
+
+static struct arena_shard *arena_shards[ARENA_SHARDS_MAX];
+static int arena_shard_count = 0;
+static __thread struct arena_shard *arena_local = NULL;
+
+/* arena_fold - add allocations of the arena since it was last folded to
+ * counters of the calling thread.
+ *
+ * @arena: arena
+ */
+static void
+arena_fold(struct arena *arena)
+{
+	struct arena_shard *shard;
+	int idx;
+	if (arena->allocs == arena->folded_allocs) {
+		return;
+	}
+	if (arena_local == NULL) {
+		shard = calloc(1, sizeof(struct arena_shard));
+		if (shard == NULL) {
+			return;
+		}
+		idx = __atomic_fetch_add(&arena_shard_count, 1,
+				__ATOMIC_RELAXED);
+		if (idx >= ARENA_SHARDS_MAX) {
+			/* counts of this thread are lost */
+			free(shard);
+			return;
+		}
+		__atomic_store_n(&arena_shards[idx], shard, __ATOMIC_RELEASE);
+		arena_local = shard;
+	}
+	/* only this thread writes its shard */
+	__atomic_store_n(&arena_local->allocs, arena_local->allocs
+			+ arena->allocs - arena->folded_allocs,
+			__ATOMIC_RELAXED);
+	__atomic_store_n(&arena_local->heap_allocs, arena_local->heap_allocs
+			+ arena->heap_allocs - arena->folded_heap_allocs,
+			__ATOMIC_RELAXED);
+	arena->folded_allocs = arena->allocs;
+	arena->folded_heap_allocs = arena->heap_allocs;
+}
+
+/* arena_init - allocate backing memory of the arena.
+ *
+ * @arena: arena
+ * @size: how many bytes can be allocated before falling back to heap
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+arena_init(struct arena *arena, size_t size)
+{
+	memset(arena, 0, sizeof(struct arena));
+	arena->base = malloc(size);
+	if (arena->base == NULL) {
+		perror("malloc fail");
+		return (-1);
+	}
+	arena->size = size;
+	return 0;
+}
+
+/* arena_free - release arena and everything allocated from it.
+ *
+ * @arena: arena
+ */
+void
+arena_free(struct arena *arena)
+{
+	arena_reset(arena);
+	free(arena->base);
+	arena->base = NULL;
+	arena->size = 0;
+	if (arena_current == arena) {
+		arena_current = NULL;
+	}
+}
+
+/* arena_reset - release everything allocated from the arena and count its
+ * allocations in arena_stats(). This is O(1) unless the arena has overflown
+ * into heap.
+ *
+ * @arena: arena
+ */
+void
+arena_reset(struct arena *arena)
+{
+	struct arena_chunk *chunk;
+	arena_fold(arena);
+	while (arena->overflow != NULL) {
+		chunk = arena->overflow;
+		arena->overflow = chunk->next;
+		free(chunk);
+	}
+	arena->used = 0;
+}
+
+/* arena_alloc - allocate memory from the arena. When the arena is
+ * exhausted, memory comes from heap and is counted in heap_allocs.
+ *
+ * @arena: arena
+ * @len: how many bytes to allocate
+ *
+ * returns pointer to memory, NULL on error
+ */
+void *
+arena_alloc(struct arena *arena, size_t len)
+{
+	struct arena_chunk *chunk;
+	void *ptr;
+	len = ARENA_ALIGN(len);
+	arena->allocs++;
+	if (arena->size - arena->used >= len) {
+		ptr = arena->base + arena->used;
+		arena->used+= len;
+		return ptr;
+	}
+	chunk = malloc(sizeof(struct arena_chunk) + len);
+	if (chunk == NULL) {
+		perror("malloc fail");
+		return NULL;
+	}
+	arena->heap_allocs++;
+	chunk->next = arena->overflow;
+	chunk->len = len;
+	arena->overflow = chunk;
+	return chunk + 1;
+}
+
+/* arena_use - make handlers running in this thread allocate from arena.
+ *
+ * @arena: arena, NULL means thread's default arena
+ */
+void
+arena_use(struct arena *arena)
+{
+	arena_current = arena;
+}
+
+/* rsp_alloc - allocate response data for a handler. Memory is released
+ * by the caller of the handler once the response has been sent, handlers
+ * must not free() it.
+ *
+ * @len: how many bytes to allocate
+ *
+ * returns pointer to memory, NULL on error
+ */
+void *
+rsp_alloc(size_t len)
+{
+	if (arena_current == NULL) {
+		if (arena_default.base == NULL
+				&& arena_init(&arena_default, ARENA_SIZE) != 0) {
+			return NULL;
+		}
+		arena_current = &arena_default;
+	}
+	return arena_alloc(arena_current, len);
+}
+
+/* arena_stats - return allocation counters summed over all threads, as of
+ * the last reset of each arena.
+ *
+ * @allocs: number of allocations served
+ * @heap_allocs: how many of those had to fall back to heap
+ */
+void
+arena_stats(uint64_t *allocs, uint64_t *heap_allocs)
+{
+	struct arena_shard *shard;
+	int count;
+	int i;
+	*allocs = 0;
+	*heap_allocs = 0;
+	count = __atomic_load_n(&arena_shard_count, __ATOMIC_ACQUIRE);
+	for (i = 0; i < count && i < ARENA_SHARDS_MAX; i++) {
+		shard = __atomic_load_n(&arena_shards[i], __ATOMIC_ACQUIRE);
+		if (shard == NULL) {
+			continue;
+		}
+		*allocs+= __atomic_load_n(&shard->allocs, __ATOMIC_RELAXED);
+		*heap_allocs+= __atomic_load_n(&shard->heap_allocs,
+				__ATOMIC_RELAXED);
+	}
+}
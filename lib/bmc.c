@@ -0,0 +1,94 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "fake-ipmistack/fake-ipmistack.h"
+#include "fake-ipmistack/bmc.h"
+#include "fake-ipmistack/log.h"
+
+/* All BMCs live in one flat array allocated at start-up, so per-BMC cost
+ * is sizeof(struct bmc) and nothing else. Pool is never resized, which
+ * lets handlers keep plain pointers to BMCs.
+ */
+static struct bmc *bmc_pool = NULL;
+static uint32_t bmc_pool_count = 0;
+
+/* bmc_pool_init - allocate and initialize given number of BMCs.
+ *
+ * @count: number of BMCs, 1 - BMC_COUNT_MAX
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+bmc_pool_init(uint32_t count)
+{
+	struct bmc *bmc;
+	uint32_t i;
+	if (count < 1 || count > BMC_COUNT_MAX) {
+		log_error("BMC count must be 1-%i", BMC_COUNT_MAX);
+		return (-1);
+	}
+	bmc_pool = calloc(count, sizeof(struct bmc));
+	if (bmc_pool == NULL) {
+		perror("calloc fail");
+		return (-1);
+	}
+	for (i = 0; i < count; i++) {
+		bmc = &bmc_pool[i];
+		pthread_mutex_init(&bmc->lock, NULL);
+		bmc->id = i;
+		app_state_init(&bmc->app);
+		chassis_state_init(&bmc->chassis);
+		sensor_state_init(&bmc->sensor);
+		storage_state_init(&bmc->storage);
+		transport_state_init(&bmc->transport);
+	}
+	bmc_pool_count = count;
+	return 0;
+}
+
+/* bmc_count - returns number of BMCs in the pool */
+uint32_t
+bmc_count()
+{
+	return bmc_pool_count;
+}
+
+/* bmc_get - look up BMC by its ID.
+ *
+ * @id: BMC ID
+ *
+ * returns pointer to BMC, NULL if there is no such BMC
+ */
+struct bmc *
+bmc_get(uint32_t id)
+{
+	if (id >= bmc_pool_count) {
+		return NULL;
+	}
+	return &bmc_pool[id];
+}
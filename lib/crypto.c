@@ -0,0 +1,919 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "fake-ipmistack/crypto.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+# define CRYPTO_X86
+# include <cpuid.h>
+# include <immintrin.h>
+#endif
+
+/* SHA-1, SHA-256 (FIPS 180-4), HMAC (RFC 2104) and AES-128-CBC (FIPS 197,
+ * SP 800-38A), what RMCP+ sessions need. Every primitive has a plain C
+ * implementation and, on x86, one using AES-NI or SHA extensions, which
+ * crypto_init() picks at run time. Plain C is used until it's called.
+ */
+
+struct hash_impl {
+	size_t size;
+	uint32_t iv[8];
+	/* compress given number of 64 byte blocks into hash state */
+	void (*blocks)(uint32_t *h, const uint8_t *p, size_t blocks);
+};
+
+static void sha1_blocks_c(uint32_t *h, const uint8_t *p, size_t blocks);
+static void sha256_blocks_c(uint32_t *h, const uint8_t *p, size_t blocks);
+static void aes128_cbc_encrypt_c(const struct aes128_key *key,
+		const uint8_t *iv, uint8_t *buf, size_t len);
+static void aes128_cbc_decrypt_c(const struct aes128_key *key,
+		const uint8_t *iv, uint8_t *buf, size_t len);
+
+static struct hash_impl hash_impls[HASH_ALGS] = {
+	[HASH_SHA1] = {
+		SHA1_DIGEST_SIZE,
+		{ 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476,
+			0xC3D2E1F0 },
+		sha1_blocks_c
+	},
+	[HASH_SHA256] = {
+		SHA256_DIGEST_SIZE,
+		{ 0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+			0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19 },
+		sha256_blocks_c
+	}
+};
+
+static void (*aes128_cbc_encrypt_impl)(const struct aes128_key *key,
+		const uint8_t *iv, uint8_t *buf, size_t len)
+	= aes128_cbc_encrypt_c;
+static void (*aes128_cbc_decrypt_impl)(const struct aes128_key *key,
+		const uint8_t *iv, uint8_t *buf, size_t len)
+	= aes128_cbc_decrypt_c;
+
+static const uint32_t sha256_k[64] = {
+	0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5,
+	0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+	0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3,
+	0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+	0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC,
+	0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+	0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7,
+	0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+	0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13,
+	0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+	0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3,
+	0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+	0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5,
+	0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+	0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208,
+	0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+/* AES S-box, its inverse, and round tables of SubBytes and MixColumns,
+ * InvSubBytes and InvMixColumns of one byte, columns LS byte first. All
+ * computed by aes_tables_init().
+ */
+static uint8_t aes_sbox[256];
+static uint8_t aes_inv_sbox[256];
+static uint32_t aes_te[256];
+static uint32_t aes_td[256];
+static pthread_once_t aes_once = PTHREAD_ONCE_INIT;
+
+/* rol32 - returns value rotated left by n bits */
+static inline uint32_t
+rol32(uint32_t value, unsigned int n)
+{
+	return (value << n) | (value >> (32 - n));
+}
+
+/* ror32 - returns value rotated right by n bits */
+static inline uint32_t
+ror32(uint32_t value, unsigned int n)
+{
+	return (value >> n) | (value << (32 - n));
+}
+
+/* get_be32 - returns 32-bit MS byte first value */
+static inline uint32_t
+get_be32(const uint8_t *buf)
+{
+	return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16)
+		| ((uint32_t)buf[2] << 8) | buf[3];
+}
+
+/* get_le32 - returns 32-bit LS byte first value */
+static inline uint32_t
+get_le32(const uint8_t *buf)
+{
+	return buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16)
+		| ((uint32_t)buf[3] << 24);
+}
+
+/* put_le32 - store 32-bit value LS byte first */
+static inline void
+put_le32(uint8_t *buf, uint32_t value)
+{
+	buf[0] = value;
+	buf[1] = value >> 8;
+	buf[2] = value >> 16;
+	buf[3] = value >> 24;
+}
+
+/* One SHA-1 round; message schedule is kept in 16 words, expanded as the
+ * rounds go.
+ */
+#define SHA1_W(i) (w[(i) & 15] = rol32(w[((i) - 3) & 15] ^ w[((i) - 8) & 15] \
+		^ w[((i) - 14) & 15] ^ w[(i) & 15], 1))
+#define SHA1_ROUND(f, k, wi) do { \
+		t = rol32(a, 5) + (f) + e + (k) + (wi); \
+		e = d; \
+		d = c; \
+		c = rol32(b, 30); \
+		b = a; \
+		a = t; \
+	} while (0)
+
+static void
+sha1_blocks_c(uint32_t *h, const uint8_t *p, size_t blocks)
+{
+	uint32_t w[16];
+	uint32_t a, b, c, d, e, t;
+	int i;
+	for (; blocks > 0; blocks--, p += HASH_BLOCK_SIZE) {
+		for (i = 0; i < 16; i++) {
+			w[i] = get_be32(&p[4 * i]);
+		}
+		a = h[0];
+		b = h[1];
+		c = h[2];
+		d = h[3];
+		e = h[4];
+		for (i = 0; i < 16; i++) {
+			SHA1_ROUND(d ^ (b & (c ^ d)), 0x5A827999, w[i]);
+		}
+		for (; i < 20; i++) {
+			SHA1_ROUND(d ^ (b & (c ^ d)), 0x5A827999, SHA1_W(i));
+		}
+		for (; i < 40; i++) {
+			SHA1_ROUND(b ^ c ^ d, 0x6ED9EBA1, SHA1_W(i));
+		}
+		for (; i < 60; i++) {
+			SHA1_ROUND((b & c) | (d & (b | c)), 0x8F1BBCDC,
+					SHA1_W(i));
+		}
+		for (; i < 80; i++) {
+			SHA1_ROUND(b ^ c ^ d, 0xCA62C1D6, SHA1_W(i));
+		}
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+	}
+}
+
+static void
+sha256_blocks_c(uint32_t *h, const uint8_t *p, size_t blocks)
+{
+	uint32_t w[64];
+	uint32_t s[8];
+	uint32_t t1, t2;
+	int i;
+	for (; blocks > 0; blocks--, p += HASH_BLOCK_SIZE) {
+		for (i = 0; i < 16; i++) {
+			w[i] = get_be32(&p[4 * i]);
+		}
+		for (; i < 64; i++) {
+			w[i] = w[i - 16] + w[i - 7]
+				+ (ror32(w[i - 15], 7) ^ ror32(w[i - 15], 18)
+						^ (w[i - 15] >> 3))
+				+ (ror32(w[i - 2], 17) ^ ror32(w[i - 2], 19)
+						^ (w[i - 2] >> 10));
+		}
+		memcpy(s, h, sizeof(s));
+		for (i = 0; i < 64; i++) {
+			t1 = s[7] + (ror32(s[4], 6) ^ ror32(s[4], 11)
+					^ ror32(s[4], 25))
+				+ ((s[4] & s[5]) ^ (~s[4] & s[6]))
+				+ sha256_k[i] + w[i];
+			t2 = (ror32(s[0], 2) ^ ror32(s[0], 13)
+					^ ror32(s[0], 22))
+				+ ((s[0] & s[1]) ^ (s[0] & s[2])
+						^ (s[1] & s[2]));
+			s[7] = s[6];
+			s[6] = s[5];
+			s[5] = s[4];
+			s[4] = s[3] + t1;
+			s[3] = s[2];
+			s[2] = s[1];
+			s[1] = s[0];
+			s[0] = t1 + t2;
+		}
+		for (i = 0; i < 8; i++) {
+			h[i] += s[i];
+		}
+	}
+}
+
+/* hash_size - returns digest size of hash algorithm */
+size_t
+hash_size(uint8_t alg)
+{
+	return hash_impls[alg].size;
+}
+
+void
+hash_init(struct hash_ctx *ctx, uint8_t alg)
+{
+	memcpy(ctx->h, hash_impls[alg].iv, sizeof(ctx->h));
+	ctx->len = 0;
+	ctx->alg = alg;
+}
+
+void
+hash_update(struct hash_ctx *ctx, const void *data, size_t len)
+{
+	const struct hash_impl *impl = &hash_impls[ctx->alg];
+	const uint8_t *p = data;
+	size_t used = ctx->len % HASH_BLOCK_SIZE;
+	size_t n;
+	ctx->len += len;
+	if (used > 0) {
+		n = HASH_BLOCK_SIZE - used;
+		if (n > len) {
+			n = len;
+		}
+		memcpy(&ctx->buf[used], p, n);
+		p += n;
+		len -= n;
+		if (used + n < HASH_BLOCK_SIZE) {
+			return;
+		}
+		impl->blocks(ctx->h, ctx->buf, 1);
+	}
+	if (len >= HASH_BLOCK_SIZE) {
+		impl->blocks(ctx->h, p, len / HASH_BLOCK_SIZE);
+		p += len - len % HASH_BLOCK_SIZE;
+		len %= HASH_BLOCK_SIZE;
+	}
+	memcpy(ctx->buf, p, len);
+}
+
+/* hash_final - pad message and store digest, hash_size() bytes */
+void
+hash_final(struct hash_ctx *ctx, uint8_t *digest)
+{
+	const struct hash_impl *impl = &hash_impls[ctx->alg];
+	uint64_t bits = ctx->len * 8;
+	size_t used = ctx->len % HASH_BLOCK_SIZE;
+	size_t i;
+	ctx->buf[used++] = 0x80;
+	if (used > HASH_BLOCK_SIZE - 8) {
+		memset(&ctx->buf[used], 0, HASH_BLOCK_SIZE - used);
+		impl->blocks(ctx->h, ctx->buf, 1);
+		used = 0;
+	}
+	memset(&ctx->buf[used], 0, HASH_BLOCK_SIZE - 8 - used);
+	for (i = 0; i < 8; i++) {
+		ctx->buf[HASH_BLOCK_SIZE - 1 - i] = bits >> (8 * i);
+	}
+	impl->blocks(ctx->h, ctx->buf, 1);
+	for (i = 0; i < impl->size / 4; i++) {
+		digest[4 * i] = ctx->h[i] >> 24;
+		digest[4 * i + 1] = ctx->h[i] >> 16;
+		digest[4 * i + 2] = ctx->h[i] >> 8;
+		digest[4 * i + 3] = ctx->h[i];
+	}
+}
+
+/* hmac_key_init - hash padded key blocks.
+ *
+ * @key: key state to fill in
+ * @alg: hash algorithm
+ * @k: key, hashed first if it's longer than a block
+ * @k_len: length of key
+ */
+void
+hmac_key_init(struct hmac_key *key, uint8_t alg, const uint8_t *k,
+		size_t k_len)
+{
+	const struct hash_impl *impl = &hash_impls[alg];
+	struct hash_ctx ctx;
+	uint8_t pad[HASH_BLOCK_SIZE];
+	uint8_t digest[HASH_MAX_SIZE];
+	size_t i;
+	if (k_len > HASH_BLOCK_SIZE) {
+		hash_init(&ctx, alg);
+		hash_update(&ctx, k, k_len);
+		hash_final(&ctx, digest);
+		k = digest;
+		k_len = impl->size;
+	}
+	key->alg = alg;
+	memset(pad, 0x36, sizeof(pad));
+	for (i = 0; i < k_len; i++) {
+		pad[i] ^= k[i];
+	}
+	memcpy(key->inner, impl->iv, sizeof(key->inner));
+	impl->blocks(key->inner, pad, 1);
+	memset(pad, 0x5C, sizeof(pad));
+	for (i = 0; i < k_len; i++) {
+		pad[i] ^= k[i];
+	}
+	memcpy(key->outer, impl->iv, sizeof(key->outer));
+	impl->blocks(key->outer, pad, 1);
+}
+
+/* hmac - compute HMAC of message with prepared key, hash_size() bytes */
+void
+hmac(const struct hmac_key *key, const void *msg, size_t len, uint8_t *mac)
+{
+	struct hash_ctx ctx;
+	memcpy(ctx.h, key->inner, sizeof(ctx.h));
+	ctx.len = HASH_BLOCK_SIZE;
+	ctx.alg = key->alg;
+	hash_update(&ctx, msg, len);
+	hash_final(&ctx, mac);
+	memcpy(ctx.h, key->outer, sizeof(ctx.h));
+	ctx.len = HASH_BLOCK_SIZE;
+	hash_update(&ctx, mac, hash_impls[key->alg].size);
+	hash_final(&ctx, mac);
+}
+
+/* aes_xt - returns byte multiplied by x in GF(2^8) */
+static inline uint8_t
+aes_xt(uint8_t value)
+{
+	return (value << 1) ^ ((value >> 7) * 0x1B);
+}
+
+/* aes_tables_init - compute S-box from multiplicative inverses in GF(2^8),
+ * walking the field by powers of generator 3.
+ */
+static void
+aes_tables_init()
+{
+	uint8_t p = 1;
+	uint8_t q = 1;
+	uint8_t x, x2, x4, x8;
+	int i;
+	do {
+		/* p * 3 */
+		p = p ^ aes_xt(p);
+		/* q / 3 */
+		q ^= q << 1;
+		q ^= q << 2;
+		q ^= q << 4;
+		if (q & 0x80) {
+			q ^= 0x09;
+		}
+		/* affine transformation */
+		x = q ^ (uint8_t)((q << 1) | (q >> 7))
+			^ (uint8_t)((q << 2) | (q >> 6))
+			^ (uint8_t)((q << 3) | (q >> 5))
+			^ (uint8_t)((q << 4) | (q >> 4));
+		aes_sbox[p] = x ^ 0x63;
+	} while (p != 1);
+	/* 0 has no inverse */
+	aes_sbox[0] = 0x63;
+	for (i = 0; i < 256; i++) {
+		aes_inv_sbox[aes_sbox[i]] = i;
+	}
+	for (i = 0; i < 256; i++) {
+		/* 2, 1, 1, 3 */
+		x = aes_sbox[i];
+		aes_te[i] = aes_xt(x) | ((uint32_t)x << 8)
+			| ((uint32_t)x << 16)
+			| ((uint32_t)(aes_xt(x) ^ x) << 24);
+		/* 14, 9, 13, 11 */
+		x = aes_inv_sbox[i];
+		x2 = aes_xt(x);
+		x4 = aes_xt(x2);
+		x8 = aes_xt(x4);
+		aes_td[i] = (uint8_t)(x8 ^ x4 ^ x2)
+			| ((uint32_t)(x8 ^ x) << 8)
+			| ((uint32_t)(x8 ^ x4 ^ x) << 16)
+			| ((uint32_t)(x8 ^ x2 ^ x) << 24);
+	}
+}
+
+/* aes_mix - MixColumns, state is in column order */
+static void
+aes_mix(uint8_t *s)
+{
+	uint8_t a0, a1, a2, a3, all;
+	int c;
+	for (c = 0; c < AES_BLOCK_SIZE; c += 4) {
+		a0 = s[c];
+		a1 = s[c + 1];
+		a2 = s[c + 2];
+		a3 = s[c + 3];
+		all = a0 ^ a1 ^ a2 ^ a3;
+		s[c] = a0 ^ all ^ aes_xt(a0 ^ a1);
+		s[c + 1] = a1 ^ all ^ aes_xt(a1 ^ a2);
+		s[c + 2] = a2 ^ all ^ aes_xt(a2 ^ a3);
+		s[c + 3] = a3 ^ all ^ aes_xt(a3 ^ a0);
+	}
+}
+
+/* aes_inv_mix - InvMixColumns, which is MixColumns after multiplying even
+ * and odd rows by x^2 + 1
+ */
+static void
+aes_inv_mix(uint8_t *s)
+{
+	uint8_t u, v;
+	int c;
+	for (c = 0; c < AES_BLOCK_SIZE; c += 4) {
+		u = aes_xt(aes_xt(s[c] ^ s[c + 2]));
+		v = aes_xt(aes_xt(s[c + 1] ^ s[c + 3]));
+		s[c] ^= u;
+		s[c + 1] ^= v;
+		s[c + 2] ^= u;
+		s[c + 3] ^= v;
+	}
+	aes_mix(s);
+}
+
+/* aes128_key_init - expand 16 byte key into round keys of both ciphers */
+void
+aes128_key_init(struct aes128_key *key, const uint8_t *k)
+{
+	uint8_t *w = &key->enc[0][0];
+	uint8_t rcon = 0x01;
+	uint8_t t[4];
+	int i;
+	pthread_once(&aes_once, aes_tables_init);
+	memcpy(w, k, AES128_KEY_SIZE);
+	for (i = AES128_KEY_SIZE; i < (AES128_ROUNDS + 1) * AES_BLOCK_SIZE;
+			i += 4) {
+		memcpy(t, &w[i - 4], 4);
+		if (i % AES128_KEY_SIZE == 0) {
+			/* RotWord, SubWord, Rcon */
+			t[0] = aes_sbox[w[i - 3]] ^ rcon;
+			t[1] = aes_sbox[w[i - 2]];
+			t[2] = aes_sbox[w[i - 1]];
+			t[3] = aes_sbox[w[i - 4]];
+			rcon = aes_xt(rcon);
+		}
+		w[i] = w[i - AES128_KEY_SIZE] ^ t[0];
+		w[i + 1] = w[i - AES128_KEY_SIZE + 1] ^ t[1];
+		w[i + 2] = w[i - AES128_KEY_SIZE + 2] ^ t[2];
+		w[i + 3] = w[i - AES128_KEY_SIZE + 3] ^ t[3];
+	}
+	/* equivalent inverse cipher uses them backwards, InvMixColumns-ed */
+	memcpy(key->dec[0], key->enc[AES128_ROUNDS], AES_BLOCK_SIZE);
+	for (i = 1; i < AES128_ROUNDS; i++) {
+		memcpy(key->dec[i], key->enc[AES128_ROUNDS - i],
+				AES_BLOCK_SIZE);
+		aes_inv_mix(key->dec[i]);
+	}
+	memcpy(key->dec[AES128_ROUNDS], key->enc[0], AES_BLOCK_SIZE);
+}
+
+/* aes_encrypt_block - encrypt one block in place. A round is four table
+ * lookups per column, row r of column c comes from column c + r.
+ */
+static void
+aes_encrypt_block(const struct aes128_key *key, uint8_t *p)
+{
+	uint32_t s[4];
+	uint32_t t[4];
+	int r, c;
+	for (c = 0; c < 4; c++) {
+		s[c] = get_le32(&p[4 * c]) ^ get_le32(&key->enc[0][4 * c]);
+	}
+	for (r = 1; r < AES128_ROUNDS; r++) {
+		for (c = 0; c < 4; c++) {
+			t[c] = aes_te[s[c] & 0xFF]
+				^ rol32(aes_te[(s[(c + 1) & 3] >> 8) & 0xFF], 8)
+				^ rol32(aes_te[(s[(c + 2) & 3] >> 16) & 0xFF],
+						16)
+				^ rol32(aes_te[s[(c + 3) & 3] >> 24], 24)
+				^ get_le32(&key->enc[r][4 * c]);
+		}
+		memcpy(s, t, sizeof(s));
+	}
+	for (c = 0; c < 4; c++) {
+		t[c] = aes_sbox[s[c] & 0xFF]
+			| ((uint32_t)aes_sbox[(s[(c + 1) & 3] >> 8) & 0xFF]
+					<< 8)
+			| ((uint32_t)aes_sbox[(s[(c + 2) & 3] >> 16) & 0xFF]
+					<< 16)
+			| ((uint32_t)aes_sbox[s[(c + 3) & 3] >> 24] << 24);
+		put_le32(&p[4 * c], t[c]
+				^ get_le32(&key->enc[AES128_ROUNDS][4 * c]));
+	}
+}
+
+/* aes_decrypt_block - decrypt one block in place with the equivalent
+ * inverse cipher, row r of column c comes from column c - r
+ */
+static void
+aes_decrypt_block(const struct aes128_key *key, uint8_t *p)
+{
+	uint32_t s[4];
+	uint32_t t[4];
+	int r, c;
+	for (c = 0; c < 4; c++) {
+		s[c] = get_le32(&p[4 * c]) ^ get_le32(&key->dec[0][4 * c]);
+	}
+	for (r = 1; r < AES128_ROUNDS; r++) {
+		for (c = 0; c < 4; c++) {
+			t[c] = aes_td[s[c] & 0xFF]
+				^ rol32(aes_td[(s[(c + 3) & 3] >> 8) & 0xFF], 8)
+				^ rol32(aes_td[(s[(c + 2) & 3] >> 16) & 0xFF],
+						16)
+				^ rol32(aes_td[s[(c + 1) & 3] >> 24], 24)
+				^ get_le32(&key->dec[r][4 * c]);
+		}
+		memcpy(s, t, sizeof(s));
+	}
+	for (c = 0; c < 4; c++) {
+		t[c] = aes_inv_sbox[s[c] & 0xFF]
+			| ((uint32_t)aes_inv_sbox[(s[(c + 3) & 3] >> 8) & 0xFF]
+					<< 8)
+			| ((uint32_t)aes_inv_sbox[(s[(c + 2) & 3] >> 16) & 0xFF]
+					<< 16)
+			| ((uint32_t)aes_inv_sbox[s[(c + 1) & 3] >> 24] << 24);
+		put_le32(&p[4 * c], t[c]
+				^ get_le32(&key->dec[AES128_ROUNDS][4 * c]));
+	}
+}
+
+static void
+aes128_cbc_encrypt_c(const struct aes128_key *key, const uint8_t *iv,
+		uint8_t *buf, size_t len)
+{
+	const uint8_t *prev = iv;
+	int i;
+	for (; len >= AES_BLOCK_SIZE; len -= AES_BLOCK_SIZE) {
+		for (i = 0; i < AES_BLOCK_SIZE; i++) {
+			buf[i] ^= prev[i];
+		}
+		aes_encrypt_block(key, buf);
+		prev = buf;
+		buf += AES_BLOCK_SIZE;
+	}
+}
+
+static void
+aes128_cbc_decrypt_c(const struct aes128_key *key, const uint8_t *iv,
+		uint8_t *buf, size_t len)
+{
+	uint8_t prev[AES_BLOCK_SIZE];
+	uint8_t c[AES_BLOCK_SIZE];
+	int i;
+	memcpy(prev, iv, AES_BLOCK_SIZE);
+	for (; len >= AES_BLOCK_SIZE; len -= AES_BLOCK_SIZE) {
+		memcpy(c, buf, AES_BLOCK_SIZE);
+		aes_decrypt_block(key, buf);
+		for (i = 0; i < AES_BLOCK_SIZE; i++) {
+			buf[i] ^= prev[i];
+		}
+		memcpy(prev, c, AES_BLOCK_SIZE);
+		buf += AES_BLOCK_SIZE;
+	}
+}
+
+#ifdef CRYPTO_X86
+/* SHA-1 with SHA extensions, four rounds per SHA1RNDS4. The message
+ * schedule of rounds 4g - 4g + 3 is finished as those rounds go.
+ */
+#define SHA1_NI(e_in, e_out, m, f) do { \
+		e_in = _mm_sha1nexte_epu32(e_in, m); \
+		e_out = abcd; \
+		abcd = _mm_sha1rnds4_epu32(abcd, e_in, f); \
+	} while (0)
+#define SHA1_NI_SCHED(e_in, e_out, m0, m1, m2, m3, f) do { \
+		SHA1_NI(e_in, e_out, m0, f); \
+		m1 = _mm_sha1msg2_epu32(m1, m0); \
+		m3 = _mm_sha1msg1_epu32(m3, m0); \
+		m2 = _mm_xor_si128(m2, m0); \
+	} while (0)
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void
+sha1_blocks_ni(uint32_t *h, const uint8_t *p, size_t blocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL,
+			0x08090A0B0C0D0E0FULL);
+	__m128i abcd, abcd_save, e0, e0_save, e1;
+	__m128i m0, m1, m2, m3;
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)h), 0x1B);
+	e0 = _mm_set_epi32(h[4], 0, 0, 0);
+	for (; blocks > 0; blocks--, p += HASH_BLOCK_SIZE) {
+		abcd_save = abcd;
+		e0_save = e0;
+		m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)p),
+				mask);
+		m1 = _mm_shuffle_epi8(
+				_mm_loadu_si128((const __m128i *)&p[16]),
+				mask);
+		m2 = _mm_shuffle_epi8(
+				_mm_loadu_si128((const __m128i *)&p[32]),
+				mask);
+		m3 = _mm_shuffle_epi8(
+				_mm_loadu_si128((const __m128i *)&p[48]),
+				mask);
+		/* rounds 0 - 11 */
+		e0 = _mm_add_epi32(e0, m0);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+		SHA1_NI(e1, e0, m1, 0);
+		m0 = _mm_sha1msg1_epu32(m0, m1);
+		SHA1_NI(e0, e1, m2, 0);
+		m1 = _mm_sha1msg1_epu32(m1, m2);
+		m0 = _mm_xor_si128(m0, m2);
+		/* rounds 12 - 67 */
+		SHA1_NI_SCHED(e1, e0, m3, m0, m1, m2, 0);
+		SHA1_NI_SCHED(e0, e1, m0, m1, m2, m3, 0);
+		SHA1_NI_SCHED(e1, e0, m1, m2, m3, m0, 1);
+		SHA1_NI_SCHED(e0, e1, m2, m3, m0, m1, 1);
+		SHA1_NI_SCHED(e1, e0, m3, m0, m1, m2, 1);
+		SHA1_NI_SCHED(e0, e1, m0, m1, m2, m3, 1);
+		SHA1_NI_SCHED(e1, e0, m1, m2, m3, m0, 1);
+		SHA1_NI_SCHED(e0, e1, m2, m3, m0, m1, 2);
+		SHA1_NI_SCHED(e1, e0, m3, m0, m1, m2, 2);
+		SHA1_NI_SCHED(e0, e1, m0, m1, m2, m3, 2);
+		SHA1_NI_SCHED(e1, e0, m1, m2, m3, m0, 2);
+		SHA1_NI_SCHED(e0, e1, m2, m3, m0, m1, 2);
+		SHA1_NI_SCHED(e1, e0, m3, m0, m1, m2, 3);
+		SHA1_NI_SCHED(e0, e1, m0, m1, m2, m3, 3);
+		/* rounds 68 - 79 */
+		SHA1_NI(e1, e0, m1, 3);
+		m2 = _mm_sha1msg2_epu32(m2, m1);
+		m3 = _mm_xor_si128(m3, m1);
+		SHA1_NI(e0, e1, m2, 3);
+		m3 = _mm_sha1msg2_epu32(m3, m2);
+		SHA1_NI(e1, e0, m3, 3);
+		e0 = _mm_sha1nexte_epu32(e0, e0_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+	}
+	_mm_storeu_si128((__m128i *)h, _mm_shuffle_epi32(abcd, 0x1B));
+	h[4] = _mm_extract_epi32(e0, 3);
+}
+
+/* SHA-256 with SHA extensions, two rounds per SHA256RNDS2. State is kept
+ * as ABEF and CDGH.
+ */
+#define SHA256_NI(m, k) do { \
+		msg = _mm_add_epi32(m, \
+				_mm_loadu_si128((const __m128i *)&sha256_k[k])); \
+		state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+		msg = _mm_shuffle_epi32(msg, 0x0E); \
+		state0 = _mm_sha256rnds2_epu32(state0, state1, msg); \
+	} while (0)
+#define SHA256_NI_MSG2(m, m_prev, m_next) do { \
+		m_next = _mm_add_epi32(m_next, _mm_alignr_epi8(m, m_prev, 4)); \
+		m_next = _mm_sha256msg2_epu32(m_next, m); \
+	} while (0)
+#define SHA256_NI_SCHED(m, m_prev, m_next, k) do { \
+		SHA256_NI(m, k); \
+		SHA256_NI_MSG2(m, m_prev, m_next); \
+		m_prev = _mm_sha256msg1_epu32(m_prev, m); \
+	} while (0)
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void
+sha256_blocks_ni(uint32_t *h, const uint8_t *p, size_t blocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0C0D0E0F08090A0BULL,
+			0x0405060700010203ULL);
+	__m128i state0, state1, save0, save1;
+	__m128i msg, tmp;
+	__m128i m0, m1, m2, m3;
+	tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)h), 0xB1);
+	state1 = _mm_shuffle_epi32(
+			_mm_loadu_si128((const __m128i *)&h[4]), 0x1B);
+	state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+	for (; blocks > 0; blocks--, p += HASH_BLOCK_SIZE) {
+		save0 = state0;
+		save1 = state1;
+		m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)p),
+				mask);
+		m1 = _mm_shuffle_epi8(
+				_mm_loadu_si128((const __m128i *)&p[16]),
+				mask);
+		m2 = _mm_shuffle_epi8(
+				_mm_loadu_si128((const __m128i *)&p[32]),
+				mask);
+		m3 = _mm_shuffle_epi8(
+				_mm_loadu_si128((const __m128i *)&p[48]),
+				mask);
+		SHA256_NI(m0, 0);
+		SHA256_NI(m1, 4);
+		m0 = _mm_sha256msg1_epu32(m0, m1);
+		SHA256_NI(m2, 8);
+		m1 = _mm_sha256msg1_epu32(m1, m2);
+		SHA256_NI_SCHED(m3, m2, m0, 12);
+		SHA256_NI_SCHED(m0, m3, m1, 16);
+		SHA256_NI_SCHED(m1, m0, m2, 20);
+		SHA256_NI_SCHED(m2, m1, m3, 24);
+		SHA256_NI_SCHED(m3, m2, m0, 28);
+		SHA256_NI_SCHED(m0, m3, m1, 32);
+		SHA256_NI_SCHED(m1, m0, m2, 36);
+		SHA256_NI_SCHED(m2, m1, m3, 40);
+		SHA256_NI_SCHED(m3, m2, m0, 44);
+		SHA256_NI_SCHED(m0, m3, m1, 48);
+		SHA256_NI(m1, 52);
+		SHA256_NI_MSG2(m1, m0, m2);
+		SHA256_NI(m2, 56);
+		SHA256_NI_MSG2(m2, m1, m3);
+		SHA256_NI(m3, 60);
+		state0 = _mm_add_epi32(state0, save0);
+		state1 = _mm_add_epi32(state1, save1);
+	}
+	tmp = _mm_shuffle_epi32(state0, 0x1B);
+	state1 = _mm_shuffle_epi32(state1, 0xB1);
+	state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+	state1 = _mm_alignr_epi8(state1, tmp, 8);
+	_mm_storeu_si128((__m128i *)h, state0);
+	_mm_storeu_si128((__m128i *)&h[4], state1);
+}
+
+__attribute__((target("aes,sse2")))
+static void
+aes128_cbc_encrypt_ni(const struct aes128_key *key, const uint8_t *iv,
+		uint8_t *buf, size_t len)
+{
+	__m128i rk[AES128_ROUNDS + 1];
+	__m128i x;
+	int r;
+	for (r = 0; r <= AES128_ROUNDS; r++) {
+		rk[r] = _mm_loadu_si128((const __m128i *)key->enc[r]);
+	}
+	x = _mm_loadu_si128((const __m128i *)iv);
+	for (; len >= AES_BLOCK_SIZE; len -= AES_BLOCK_SIZE) {
+		x = _mm_xor_si128(x, _mm_loadu_si128((const __m128i *)buf));
+		x = _mm_xor_si128(x, rk[0]);
+		for (r = 1; r < AES128_ROUNDS; r++) {
+			x = _mm_aesenc_si128(x, rk[r]);
+		}
+		x = _mm_aesenclast_si128(x, rk[AES128_ROUNDS]);
+		_mm_storeu_si128((__m128i *)buf, x);
+		buf += AES_BLOCK_SIZE;
+	}
+}
+
+/* CBC decryption doesn't chain, so four blocks go through the pipeline at
+ * once
+ */
+__attribute__((target("aes,sse2")))
+static void
+aes128_cbc_decrypt_ni(const struct aes128_key *key, const uint8_t *iv,
+		uint8_t *buf, size_t len)
+{
+	__m128i rk[AES128_ROUNDS + 1];
+	__m128i prev, c0, c1, c2, c3, x0, x1, x2, x3;
+	int r;
+	for (r = 0; r <= AES128_ROUNDS; r++) {
+		rk[r] = _mm_loadu_si128((const __m128i *)key->dec[r]);
+	}
+	prev = _mm_loadu_si128((const __m128i *)iv);
+	for (; len >= 4 * AES_BLOCK_SIZE; len -= 4 * AES_BLOCK_SIZE) {
+		c0 = _mm_loadu_si128((const __m128i *)buf);
+		c1 = _mm_loadu_si128((const __m128i *)&buf[16]);
+		c2 = _mm_loadu_si128((const __m128i *)&buf[32]);
+		c3 = _mm_loadu_si128((const __m128i *)&buf[48]);
+		x0 = _mm_xor_si128(c0, rk[0]);
+		x1 = _mm_xor_si128(c1, rk[0]);
+		x2 = _mm_xor_si128(c2, rk[0]);
+		x3 = _mm_xor_si128(c3, rk[0]);
+		for (r = 1; r < AES128_ROUNDS; r++) {
+			x0 = _mm_aesdec_si128(x0, rk[r]);
+			x1 = _mm_aesdec_si128(x1, rk[r]);
+			x2 = _mm_aesdec_si128(x2, rk[r]);
+			x3 = _mm_aesdec_si128(x3, rk[r]);
+		}
+		x0 = _mm_aesdeclast_si128(x0, rk[AES128_ROUNDS]);
+		x1 = _mm_aesdeclast_si128(x1, rk[AES128_ROUNDS]);
+		x2 = _mm_aesdeclast_si128(x2, rk[AES128_ROUNDS]);
+		x3 = _mm_aesdeclast_si128(x3, rk[AES128_ROUNDS]);
+		_mm_storeu_si128((__m128i *)buf, _mm_xor_si128(x0, prev));
+		_mm_storeu_si128((__m128i *)&buf[16], _mm_xor_si128(x1, c0));
+		_mm_storeu_si128((__m128i *)&buf[32], _mm_xor_si128(x2, c1));
+		_mm_storeu_si128((__m128i *)&buf[48], _mm_xor_si128(x3, c2));
+		prev = c3;
+		buf += 4 * AES_BLOCK_SIZE;
+	}
+	for (; len >= AES_BLOCK_SIZE; len -= AES_BLOCK_SIZE) {
+		c0 = _mm_loadu_si128((const __m128i *)buf);
+		x0 = _mm_xor_si128(c0, rk[0]);
+		for (r = 1; r < AES128_ROUNDS; r++) {
+			x0 = _mm_aesdec_si128(x0, rk[r]);
+		}
+		x0 = _mm_aesdeclast_si128(x0, rk[AES128_ROUNDS]);
+		_mm_storeu_si128((__m128i *)buf, _mm_xor_si128(x0, prev));
+		prev = c0;
+		buf += AES_BLOCK_SIZE;
+	}
+}
+
+/* crypto_cpu - returns accelerated implementations the CPU can run */
+static unsigned int
+crypto_cpu()
+{
+	unsigned int a, b, c, d;
+	unsigned int found = 0;
+	if (!__get_cpuid(1, &a, &b, &c, &d)
+			|| !(c & bit_SSSE3) || !(c & bit_SSE4_1)) {
+		return 0;
+	}
+	if (c & bit_AES) {
+		found |= CRYPTO_ACCEL_AES;
+	}
+	if (__get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & bit_SHA)) {
+		found |= CRYPTO_ACCEL_SHA;
+	}
+	return found;
+}
+#else
+static unsigned int
+crypto_cpu()
+{
+	return 0;
+}
+#endif
+
+/* crypto_init - pick implementations of hashes and ciphers. Not to be
+ * called while they're in use.
+ *
+ * @allow: CRYPTO_ACCEL_* which may be used, 0 for plain C only
+ *
+ * returns CRYPTO_ACCEL_* picked
+ */
+unsigned int
+crypto_init(unsigned int allow)
+{
+	unsigned int found = crypto_cpu() & allow;
+	hash_impls[HASH_SHA1].blocks = sha1_blocks_c;
+	hash_impls[HASH_SHA256].blocks = sha256_blocks_c;
+	aes128_cbc_encrypt_impl = aes128_cbc_encrypt_c;
+	aes128_cbc_decrypt_impl = aes128_cbc_decrypt_c;
+#ifdef CRYPTO_X86
+	if (found & CRYPTO_ACCEL_SHA) {
+		hash_impls[HASH_SHA1].blocks = sha1_blocks_ni;
+		hash_impls[HASH_SHA256].blocks = sha256_blocks_ni;
+	}
+	if (found & CRYPTO_ACCEL_AES) {
+		aes128_cbc_encrypt_impl = aes128_cbc_encrypt_ni;
+		aes128_cbc_decrypt_impl = aes128_cbc_decrypt_ni;
+	}
+#endif
+	return found;
+}
+
+/* aes128_cbc_encrypt - encrypt whole blocks in place.
+ *
+ * @key: expanded key
+ * @iv: initialization vector, may be right in front of buf
+ * @buf: data
+ * @len: length of data, multiple of AES_BLOCK_SIZE
+ */
+void
+aes128_cbc_encrypt(const struct aes128_key *key, const uint8_t *iv,
+		uint8_t *buf, size_t len)
+{
+	aes128_cbc_encrypt_impl(key, iv, buf, len);
+}
+
+/* aes128_cbc_decrypt - decrypt whole blocks in place, see
+ * aes128_cbc_encrypt()
+ */
+void
+aes128_cbc_decrypt(const struct aes128_key *key, const uint8_t *iv,
+		uint8_t *buf, size_t len)
+{
+	aes128_cbc_decrypt_impl(key, iv, buf, len);
+}
@@ -0,0 +1,133 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "fake-ipmistack/fake-ipmistack.h"
+#include "fake-ipmistack/dispatch.h"
+#include "fake-ipmistack/session.h"
+
+/* declare every handler listed in IPMI_COMMANDS */
+#define X(netfn, cmd, handler, min, max, priv) \
+	int handler(struct bmc *bmc, struct dummy_rq *req, \
+			struct dummy_rs *rsp);
+IPMI_COMMANDS(X)
+#undef X
+
+/* Registry indexed by [netfn >> 1][cmd], slots of commands which aren't
+ * implemented are left zeroed.
+ */
+#define X(netfn, cmd, handler, min, max, priv) \
+	[(netfn) >> 1][(cmd)] = { handler, min, max, priv, \
+		IPMI_CMD_ID_##netfn##_##cmd },
+static const struct ipmi_cmd ipmi_cmds[(NETFN_MAX >> 1) + 1][256] = {
+	IPMI_COMMANDS(X)
+};
+#undef X
+
+/* NetFn and Cmd of every command, indexed by enum ipmi_cmd_id */
+#define X(netfn, cmd, handler, min, max, priv) { netfn, cmd },
+static const uint8_t ipmi_cmd_keys[IPMI_CMD_COUNT][2] = {
+	IPMI_COMMANDS(X)
+};
+#undef X
+
+/* ipmi_cmd_lookup - find registry entry of given command.
+ *
+ * @netfn: request NetFn
+ * @cmd: command
+ *
+ * returns: pointer to registry entry, NULL when command isn't implemented
+ * or NetFn is a response one
+ */
+const struct ipmi_cmd *
+ipmi_cmd_lookup(uint8_t netfn, uint8_t cmd)
+{
+	const struct ipmi_cmd *entry;
+	if (netfn > NETFN_MAX || (netfn & 1)) {
+		return NULL;
+	}
+	entry = &ipmi_cmds[netfn >> 1][cmd];
+	return entry->handler != NULL ? entry : NULL;
+}
+
+/* ipmi_cmd_key - find NetFn and Cmd of command with given ID.
+ *
+ * @id: command ID, see enum ipmi_cmd_id
+ * @netfn: request NetFn
+ * @cmd: command
+ *
+ * returns: 0 on success, (-1) when ID is out of range
+ */
+int
+ipmi_cmd_key(uint16_t id, uint8_t *netfn, uint8_t *cmd)
+{
+	if (id >= IPMI_CMD_COUNT) {
+		return (-1);
+	}
+	*netfn = ipmi_cmd_keys[id][0];
+	*cmd = ipmi_cmd_keys[id][1];
+	return 0;
+}
+
+/* ipmi_dispatch - fill in response header, check request length and
+ * privilege level and call command's handler.
+ *
+ * @bmc: BMC the request is addressed to
+ * @req: request
+ * @rsp: response
+ *
+ * returns: handler's return code, (-1) when request has been rejected
+ */
+int
+ipmi_dispatch(struct bmc *bmc, struct dummy_rq *req, struct dummy_rs *rsp)
+{
+	const struct session_ctx *ctx = session_current();
+	const struct ipmi_cmd *entry;
+	rsp->msg.netfn = req->msg.netfn + 1;
+	rsp->msg.cmd = req->msg.cmd;
+	rsp->msg.seq = 0;
+	rsp->msg.lun = req->msg.lun;
+	rsp->ccode = CC_OK;
+	rsp->data_len = 0;
+	rsp->data = NULL;
+	entry = ipmi_cmd_lookup(req->msg.netfn, req->msg.cmd);
+	if (entry == NULL) {
+		rsp->ccode = CC_CMD_INV;
+		return (-1);
+	}
+	if (req->msg.data_len < entry->data_len_min
+			|| req->msg.data_len > entry->data_len_max) {
+		rsp->ccode = CC_DATA_LEN;
+		return (-1);
+	}
+	/* requests over the Unix socket aren't subject to privileges */
+	if (ctx != NULL && entry->priv > ctx->priv) {
+		rsp->ccode = CC_PRIV_INSUFFICIENT;
+		return (-1);
+	}
+	return entry->handler(bmc, req, rsp);
+}
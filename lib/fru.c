@@ -0,0 +1,247 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "fake-ipmistack/fake-ipmistack.h"
+#include "fake-ipmistack/fru.h"
+#include "fake-ipmistack/log.h"
+
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct fru_image {
+	int fd;
+	size_t size;
+	const uint8_t *base;
+};
+
+static struct fru_image fru_images[FRU_DEVICES_MAX];
+
+/* fru_image_load - map FRU image file as given FRU device of all BMCs.
+ *
+ * @dev_id: FRU device ID, 0 - FEh
+ * @path: image file, 1 - FRU_SIZE_MAX bytes
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+fru_image_load(uint8_t dev_id, const char *path)
+{
+	struct fru_image *image;
+	struct stat st;
+	void *base;
+	int fd;
+	if (dev_id >= FRU_DEVICES_MAX) {
+		log_error("FRU device ID must be 0-%i", FRU_DEVICES_MAX - 1);
+		return (-1);
+	}
+	image = &fru_images[dev_id];
+	if (image->base != NULL) {
+		log_error("FRU device %" PRIu8 " given twice.", dev_id);
+		return (-1);
+	}
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		perror(path);
+		return (-1);
+	}
+	if (fstat(fd, &st) != 0) {
+		perror("fstat");
+		close(fd);
+		return (-1);
+	}
+	if (st.st_size < 1 || st.st_size > FRU_SIZE_MAX) {
+		log_error("FRU image must be 1-%i bytes.", FRU_SIZE_MAX);
+		close(fd);
+		return (-1);
+	}
+	/* pages are faulted in on first read, start-up doesn't read files */
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (base == MAP_FAILED) {
+		perror("mmap");
+		close(fd);
+		return (-1);
+	}
+	/* fd is kept open for per-BMC private mappings */
+	image->fd = fd;
+	image->size = st.st_size;
+	image->base = base;
+	log_info("FRU device %" PRIu8 ": %zu bytes", dev_id, image->size);
+	return 0;
+}
+
+/* fru_dir_load - map every '<dev_id>.bin' file in directory.
+ *
+ * @dir: directory
+ *
+ * returns number of images loaded, (-1) on error
+ */
+int
+fru_dir_load(const char *dir)
+{
+	struct dirent *ent;
+	DIR *dp;
+	char path[4096];
+	char *end;
+	unsigned long dev_id;
+	int count = 0;
+	dp = opendir(dir);
+	if (dp == NULL) {
+		perror(dir);
+		return (-1);
+	}
+	while ((ent = readdir(dp)) != NULL) {
+		dev_id = strtoul(ent->d_name, &end, 10);
+		if (end == ent->d_name || strcmp(end, ".bin") != 0) {
+			continue;
+		}
+		snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+		if (dev_id >= FRU_DEVICES_MAX
+				|| fru_image_load(dev_id, path) != 0) {
+			log_error("Couldn't load FRU image '%s'.", path);
+			closedir(dp);
+			return (-1);
+		}
+		count++;
+	}
+	closedir(dp);
+	return count;
+}
+
+/* fru_ref_find - look up BMC's own FRU device.
+ *
+ * @fru: FRU state of the BMC
+ * @dev_id: FRU device ID
+ *
+ * returns FRU reference, NULL if BMC has no device of its own
+ */
+static const struct fru_ref *
+fru_ref_find(const struct fru_state *fru, uint8_t dev_id)
+{
+	uint32_t i;
+	for (i = 0; i < fru->ref_count; i++) {
+		if (fru->refs[i].dev_id == dev_id) {
+			return &fru->refs[i];
+		}
+	}
+	return NULL;
+}
+
+/* fru_size - returns size of FRU device of a BMC, 0 if there is no such
+ * device
+ */
+size_t
+fru_size(const struct fru_state *fru, uint8_t dev_id)
+{
+	const struct fru_ref *ref;
+	if (dev_id >= FRU_DEVICES_MAX) {
+		return 0;
+	}
+	ref = fru_ref_find(fru, dev_id);
+	if (ref != NULL) {
+		return ref->size;
+	}
+	return fru_images[dev_id].size;
+}
+
+/* fru_data - get FRU device contents as seen by one BMC.
+ *
+ * @fru: FRU state of the BMC
+ * @dev_id: FRU device ID
+ *
+ * returns pointer to fru_size() bytes, NULL if there is no such device
+ */
+const uint8_t *
+fru_data(struct fru_state *fru, uint8_t dev_id)
+{
+	const struct fru_ref *ref;
+	if (dev_id >= FRU_DEVICES_MAX) {
+		return NULL;
+	}
+	if (fru->private != NULL && fru->private[dev_id] != NULL) {
+		return fru->private[dev_id];
+	}
+	ref = fru_ref_find(fru, dev_id);
+	if (ref != NULL) {
+		return (const uint8_t *)fru->refs + ref->offset;
+	}
+	return fru_images[dev_id].base;
+}
+
+/* fru_data_writable - get FRU device contents of one BMC for writing,
+ * mapping them privately on the first call.
+ *
+ * @fru: FRU state of the BMC
+ * @dev_id: FRU device ID
+ *
+ * returns pointer to fru_size() bytes, NULL if there is no such device or
+ * it couldn't be mapped
+ */
+uint8_t *
+fru_data_writable(struct fru_state *fru, uint8_t dev_id)
+{
+	const struct fru_ref *ref;
+	struct fru_image *image;
+	void *base;
+	if (dev_id >= FRU_DEVICES_MAX || fru_size(fru, dev_id) == 0) {
+		return NULL;
+	}
+	if (fru->private == NULL) {
+		fru->private = calloc(FRU_DEVICES_MAX, sizeof(uint8_t *));
+		if (fru->private == NULL) {
+			perror("calloc fail");
+			return NULL;
+		}
+	}
+	if (fru->private[dev_id] != NULL) {
+		return fru->private[dev_id];
+	}
+	ref = fru_ref_find(fru, dev_id);
+	if (ref != NULL) {
+		/* there is no file to map, just the BMC's own copy */
+		base = malloc(ref->size);
+		if (base == NULL) {
+			perror("malloc fail");
+			return NULL;
+		}
+		memcpy(base, (const uint8_t *)fru->refs + ref->offset,
+				ref->size);
+		fru->private[dev_id] = base;
+		return base;
+	}
+	image = &fru_images[dev_id];
+	/* copy-on-write, untouched pages stay shared with the page cache */
+	base = mmap(NULL, image->size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+			image->fd, 0);
+	if (base == MAP_FAILED) {
+		perror("mmap");
+		return NULL;
+	}
+	fru->private[dev_id] = base;
+	return base;
+}
@@ -27,6 +27,7 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include <stdint.h>
+#include <time.h>
 
 /* is_valid_channel - check whether uint8_t is a valid IPMI channel number.
  *
@@ -60,3 +61,27 @@ is_valid_priv_limit(uint8_t priv_limit)
 		return (-1);
 	}
 }
+
+/* monotonic_ms - return monotonic time in milliseconds, meant for deadlines.
+ *
+ * returns: ms since unspecified point in the past
+ */
+uint64_t
+monotonic_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* monotonic_ns - return monotonic time in nanoseconds, meant for latency.
+ *
+ * returns: ns since unspecified point in the past
+ */
+uint64_t
+monotonic_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -0,0 +1,180 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "fake-ipmistack/histogram.h"
+
+/* hist_bucket - returns index of bucket given value belongs to */
+static unsigned int
+hist_bucket(uint64_t value)
+{
+	unsigned int shift;
+	if (value < (1 << HIST_SUB_BITS)) {
+		return value;
+	}
+	if (value >= (UINT64_C(1) << HIST_MAX_BITS)) {
+		return HIST_BUCKETS - 1;
+	}
+	shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+	return ((shift + 1) << HIST_SUB_BITS)
+		+ (value >> shift) - (1 << HIST_SUB_BITS);
+}
+
+/* hist_bucket_max - returns the highest value which falls into bucket */
+static uint64_t
+hist_bucket_max(unsigned int idx)
+{
+	unsigned int shift;
+	if (idx < (1 << HIST_SUB_BITS)) {
+		return idx;
+	}
+	shift = (idx >> HIST_SUB_BITS) - 1;
+	return (((uint64_t)(idx & ((1 << HIST_SUB_BITS) - 1))
+				+ (1 << HIST_SUB_BITS) + 1) << shift) - 1;
+}
+
+/* hist_record - add one value to histogram.
+ *
+ * @hist: histogram
+ * @value: value, e.g. latency in ns
+ */
+void
+hist_record(struct histogram *hist, uint64_t value)
+{
+	hist->buckets[hist_bucket(value)]++;
+	hist->count++;
+	hist->sum+= value;
+	if (value > hist->max) {
+		hist->max = value;
+	}
+}
+
+/* hist_add_relaxed - bump counter owned by the calling thread, which other
+ * threads may be reading at the same time.
+ */
+static inline void
+hist_add_relaxed(uint64_t *counter, uint64_t value)
+{
+	__atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED)
+			+ value, __ATOMIC_RELAXED);
+}
+
+/* hist_record_shared - add one value to histogram which is written by one
+ * thread and read by others through hist_merge_shared(). Readers never see
+ * torn counters, but may see a value counted in a bucket and not in sum.
+ *
+ * @hist: histogram
+ * @value: value, e.g. latency in ns
+ */
+void
+hist_record_shared(struct histogram *hist, uint64_t value)
+{
+	hist_add_relaxed(&hist->buckets[hist_bucket(value)], 1);
+	hist_add_relaxed(&hist->count, 1);
+	hist_add_relaxed(&hist->sum, value);
+	if (value > hist->max) {
+		__atomic_store_n(&hist->max, value, __ATOMIC_RELAXED);
+	}
+}
+
+/* hist_merge - add all values of one histogram to another.
+ *
+ * @dst: histogram to add to
+ * @src: histogram to add
+ */
+void
+hist_merge(struct histogram *dst, const struct histogram *src)
+{
+	int i;
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		dst->buckets[i]+= src->buckets[i];
+	}
+	dst->count+= src->count;
+	dst->sum+= src->sum;
+	if (src->max > dst->max) {
+		dst->max = src->max;
+	}
+}
+
+/* hist_percentile - estimate value below which given share of values lie.
+ *
+ * @hist: histogram
+ * @pct: percentile, 0 - 100
+ *
+ * returns upper bound of the bucket percentile falls into, never more than
+ * the largest recorded value; 0 for empty histogram
+ */
+uint64_t
+hist_percentile(const struct histogram *hist, double pct)
+{
+	uint64_t rank;
+	uint64_t seen = 0;
+	uint64_t value;
+	int i;
+	if (hist->count == 0) {
+		return 0;
+	}
+	rank = (uint64_t)(hist->count * pct / 100.0 + 0.5);
+	if (rank < 1) {
+		rank = 1;
+	}
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen+= hist->buckets[i];
+		if (seen >= rank) {
+			break;
+		}
+	}
+	value = hist_bucket_max(i);
+	return value < hist->max ? value : hist->max;
+}
+
+/* hist_merge_shared - hist_merge() for source histogram which is being
+ * written by another thread with hist_record_shared().
+ *
+ * @dst: histogram to add to
+ * @src: histogram to add
+ */
+void
+hist_merge_shared(struct histogram *dst, const struct histogram *src)
+{
+	uint64_t max;
+	uint64_t count = 0;
+	uint64_t n;
+	int i;
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		n = __atomic_load_n(&src->buckets[i], __ATOMIC_RELAXED);
+		dst->buckets[i]+= n;
+		count+= n;
+	}
+	/* count has to match buckets, or percentiles run off the end */
+	dst->count+= count;
+	dst->sum+= __atomic_load_n(&src->sum, __ATOMIC_RELAXED);
+	max = __atomic_load_n(&src->max, __ATOMIC_RELAXED);
+	if (max > dst->max) {
+		dst->max = max;
+	}
+}
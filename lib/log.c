@@ -0,0 +1,404 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "fake-ipmistack/log.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* Records are fixed-size and binary. Producers only copy format pointer
+ * and raw arguments into the ring, the logger thread does the formatting
+ * and the writing. Ring is a bounded MPSC queue - producers claim a slot
+ * by bumping log_ring_head and publish it by setting slot's sequence. When
+ * the ring is full, record is dropped rather than blocking the producer.
+ */
+# define LOG_ARGS_MAX 6
+# define LOG_STR_SIZE 48
+# define LOG_RING_SIZE 4096
+# define LOG_LINE_SIZE 512
+/* logger thread looks at the ring this often even if nobody wakes it up */
+# define LOG_IDLE_SECS 1
+
+struct log_record {
+	const char *fmt;
+	uint64_t args[LOG_ARGS_MAX];
+	uint8_t level;
+	/* %s arguments are copied here, NUL-terminated one after another */
+	char strs[LOG_STR_SIZE];
+};
+
+struct log_slot {
+	uint64_t seq;
+	struct log_record rec;
+};
+
+int g_log_level = LOG_LEVEL_DEFAULT;
+
+static const char *log_level_names[] = {
+	"ERROR", "WARN", "NOTICE", "INFO", "DEBUG"
+};
+static struct log_slot log_ring[LOG_RING_SIZE];
+static uint64_t log_ring_head = 0;
+static uint64_t log_ring_tail = 0;
+static uint64_t log_dropped = 0;
+static int log_running = 0;
+static pthread_t log_thread;
+/* Logger thread sleeps on log_wake once the ring is empty, producers only
+ * take log_lock to wake it up when log_sleeping is set.
+ */
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_wake;
+static int log_sleeping = 0;
+
+/* log_spec - parse conversion specification.
+ *
+ * @fmt: pointer right behind '%'
+ * @len: length modifier - 0 int, 'l' long, 'L' long long, 'z' size_t,
+ * 'j' intmax_t
+ *
+ * returns pointer to conversion character
+ */
+static const char *
+log_spec(const char *fmt, char *len)
+{
+	*len = 0;
+	while (*fmt != '\0' && strchr("-+ #0", *fmt) != NULL) {
+		fmt++;
+	}
+	while ((*fmt >= '0' && *fmt <= '9') || *fmt == '.') {
+		fmt++;
+	}
+	while (*fmt != '\0' && strchr("hlzjt", *fmt) != NULL) {
+		if (*fmt == 'l') {
+			*len = (*len == 'l') ? 'L' : 'l';
+		} else if (*fmt == 'z' || *fmt == 'j' || *fmt == 't') {
+			*len = *fmt;
+		}
+		fmt++;
+	}
+	return fmt;
+}
+
+/* log_format_record - format record and write it out as a single line.
+ *
+ * @rec: record
+ * @out: stream
+ */
+static void
+log_format_record(struct log_record *rec, FILE *out)
+{
+	char line[LOG_LINE_SIZE];
+	char spec[16];
+	const char *p;
+	const char *end;
+	char len;
+	size_t off;
+	size_t spec_len;
+	uint64_t arg;
+	int nargs = 0;
+	int rc;
+	off = snprintf(line, sizeof(line), "[%s] ",
+			log_level_names[rec->level]);
+	for (p = rec->fmt; *p != '\0' && off < sizeof(line) - 2; p++) {
+		if (*p != '%') {
+			line[off++] = *p;
+			continue;
+		}
+		if (*(p + 1) == '%') {
+			line[off++] = '%';
+			p++;
+			continue;
+		}
+		end = log_spec(p + 1, &len);
+		spec_len = end - p + 1;
+		if (*end == '\0' || nargs >= LOG_ARGS_MAX
+				|| spec_len >= sizeof(spec)) {
+			break;
+		}
+		memcpy(spec, p, spec_len);
+		spec[spec_len] = '\0';
+		arg = rec->args[nargs++];
+		if (*end == 's') {
+			rc = snprintf(line + off, sizeof(line) - off, spec,
+					rec->strs + (arg < LOG_STR_SIZE
+						? arg : LOG_STR_SIZE - 1));
+		} else if (*end == 'p') {
+			rc = snprintf(line + off, sizeof(line) - off, spec,
+					(void *)(uintptr_t)arg);
+		} else if (len == 'l') {
+			rc = snprintf(line + off, sizeof(line) - off, spec,
+					(long)arg);
+		} else if (len == 'L') {
+			rc = snprintf(line + off, sizeof(line) - off, spec,
+					(long long)arg);
+		} else if (len == 'z' || len == 't') {
+			rc = snprintf(line + off, sizeof(line) - off, spec,
+					(size_t)arg);
+		} else if (len == 'j') {
+			rc = snprintf(line + off, sizeof(line) - off, spec,
+					(intmax_t)arg);
+		} else {
+			rc = snprintf(line + off, sizeof(line) - off, spec,
+					(int)arg);
+		}
+		if (rc > 0) {
+			off+= rc;
+		}
+		p = end;
+	}
+	if (off > sizeof(line) - 2) {
+		off = sizeof(line) - 2;
+	}
+	line[off++] = '\n';
+	fwrite(line, 1, off, out);
+}
+
+/* log_drain - format and write out every published record.
+ *
+ * @out: stream
+ *
+ * returns number of records written
+ */
+static int
+log_drain(FILE *out)
+{
+	struct log_slot *slot;
+	uint64_t dropped;
+	uint64_t tail = log_ring_tail;
+	int count = 0;
+	while (1) {
+		slot = &log_ring[tail % LOG_RING_SIZE];
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != tail + 1) {
+			break;
+		}
+		log_format_record(&slot->rec, out);
+		/* hand the slot over to the producer of the next lap */
+		__atomic_store_n(&slot->seq, tail + LOG_RING_SIZE,
+				__ATOMIC_RELEASE);
+		tail++;
+		count++;
+	}
+	__atomic_store_n(&log_ring_tail, tail, __ATOMIC_RELEASE);
+	dropped = __atomic_exchange_n(&log_dropped, 0, __ATOMIC_RELAXED);
+	if (dropped > 0) {
+		fprintf(out, "[WARN] %" PRIu64 " log records dropped\n",
+				dropped);
+	}
+	return count;
+}
+
+/* log_pending - returns whether the next record has been published */
+static int
+log_pending()
+{
+	uint64_t tail = __atomic_load_n(&log_ring_tail, __ATOMIC_RELAXED);
+	return __atomic_load_n(&log_ring[tail % LOG_RING_SIZE].seq,
+			__ATOMIC_ACQUIRE) == tail + 1;
+}
+
+/* log_main - logger thread, writes records out and sleeps until there
+ * are more, see log_write()
+ */
+static void *
+log_main(void *arg)
+{
+	struct timespec until;
+	(void)arg;
+	while (1) {
+		if (log_drain(stdout) > 0) {
+			continue;
+		}
+		fflush(stdout);
+		pthread_mutex_lock(&log_lock);
+		__atomic_store_n(&log_sleeping, 1, __ATOMIC_RELAXED);
+		/* pairs with the fence in log_write(), either the record is
+		 * seen here or log_sleeping is seen there
+		 */
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (!log_pending()) {
+			clock_gettime(CLOCK_MONOTONIC, &until);
+			until.tv_sec+= LOG_IDLE_SECS;
+			pthread_cond_timedwait(&log_wake, &log_lock, &until);
+		}
+		__atomic_store_n(&log_sleeping, 0, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&log_lock);
+	}
+	return NULL;
+}
+
+/* log_init - start the logger thread. Until it is called, records are
+ * formatted and written synchronously.
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+log_init()
+{
+	pthread_condattr_t attr;
+	uint64_t i;
+	if (log_running) {
+		return 0;
+	}
+	for (i = 0; i < LOG_RING_SIZE; i++) {
+		log_ring[i].seq = i;
+	}
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&log_wake, &attr);
+	pthread_condattr_destroy(&attr);
+	if (pthread_create(&log_thread, NULL, log_main, NULL) != 0) {
+		perror("pthread_create");
+		return (-1);
+	}
+	__atomic_store_n(&log_running, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* log_flush - wait until every record queued so far has been written. */
+void
+log_flush()
+{
+	struct timespec idle = { 0, 100000 };
+	uint64_t head = __atomic_load_n(&log_ring_head, __ATOMIC_ACQUIRE);
+	if (log_running) {
+		while (__atomic_load_n(&log_ring_tail, __ATOMIC_ACQUIRE)
+				< head) {
+			nanosleep(&idle, NULL);
+		}
+	}
+	fflush(stdout);
+}
+
+/* log_set_level - change runtime log level.
+ *
+ * @level: LOG_LVL_*, messages above it are dropped
+ */
+void
+log_set_level(int level)
+{
+	if (level < LOG_LVL_ERROR) {
+		level = LOG_LVL_ERROR;
+	} else if (level > LOG_LVL_DEBUG) {
+		level = LOG_LVL_DEBUG;
+	}
+	g_log_level = level;
+}
+
+/* log_write - queue a record for the logger thread. Use log_*() macros
+ * instead, they skip the call when level is filtered out.
+ *
+ * @level: LOG_LVL_*
+ * @fmt: printf-like format, see log.h for limitations
+ */
+void
+log_write(int level, const char *fmt, ...)
+{
+	struct log_slot *slot;
+	struct log_record rec;
+	va_list ap;
+	const char *p;
+	const char *str;
+	char len;
+	size_t str_off = 0;
+	size_t n;
+	uint64_t head;
+	int nargs = 0;
+	rec.fmt = fmt;
+	rec.level = level;
+	rec.strs[0] = '\0';
+	va_start(ap, fmt);
+	for (p = fmt; *p != '\0' && nargs < LOG_ARGS_MAX; p++) {
+		if (*p != '%') {
+			continue;
+		}
+		if (*(p + 1) == '%') {
+			p++;
+			continue;
+		}
+		p = log_spec(p + 1, &len);
+		if (*p == 's') {
+			str = va_arg(ap, const char *);
+			if (str == NULL) {
+				str = "(null)";
+			}
+			n = 0;
+			if (str_off < LOG_STR_SIZE) {
+				n = strnlen(str, LOG_STR_SIZE - str_off - 1);
+				memcpy(rec.strs + str_off, str, n);
+				rec.strs[str_off + n] = '\0';
+			}
+			rec.args[nargs++] = str_off;
+			str_off+= n + 1;
+		} else if (*p == 'p') {
+			rec.args[nargs++] = (uintptr_t)va_arg(ap, void *);
+		} else if (len == 'l') {
+			rec.args[nargs++] = va_arg(ap, long);
+		} else if (len == 'L') {
+			rec.args[nargs++] = va_arg(ap, long long);
+		} else if (len == 'z' || len == 't') {
+			rec.args[nargs++] = va_arg(ap, size_t);
+		} else if (len == 'j') {
+			rec.args[nargs++] = va_arg(ap, intmax_t);
+		} else {
+			rec.args[nargs++] = va_arg(ap, int);
+		}
+		if (*p == '\0') {
+			break;
+		}
+	}
+	va_end(ap);
+
+	if (!__atomic_load_n(&log_running, __ATOMIC_ACQUIRE)) {
+		/* no logger thread, e.g. before log_init() */
+		log_format_record(&rec, stdout);
+		return;
+	}
+	head = __atomic_load_n(&log_ring_head, __ATOMIC_RELAXED);
+	do {
+		slot = &log_ring[head % LOG_RING_SIZE];
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != head) {
+			/* slot hasn't been consumed yet - ring is full */
+			__atomic_fetch_add(&log_dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	} while (!__atomic_compare_exchange_n(&log_ring_head, &head, head + 1,
+				1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	memcpy(&slot->rec, &rec, sizeof(rec));
+	__atomic_store_n(&slot->seq, head + 1, __ATOMIC_RELEASE);
+	/* see log_main() */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&log_sleeping, __ATOMIC_RELAXED)) {
+		pthread_mutex_lock(&log_lock);
+		pthread_cond_signal(&log_wake);
+		pthread_mutex_unlock(&log_lock);
+	}
+}
@@ -27,21 +27,21 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include "fake-ipmistack/fake-ipmistack.h"
+#include "fake-ipmistack/arena.h"
+#include "fake-ipmistack/bmc.h"
 #include "fake-ipmistack/helper.h"
+#include "fake-ipmistack/log.h"
+#include "fake-ipmistack/rmcp.h"
+#include "fake-ipmistack/scenario.h"
+#include "fake-ipmistack/session.h"
 
+#include <pthread.h>
 #include <string.h>
 
-struct ipmi_channel {
-	uint8_t number;
-	uint8_t ptype;
-	uint8_t mtype;
-	uint8_t sessions;
-	uint8_t capabilities;
-	uint8_t priv_level;
-	char desc[24];
-} ipmi_channels[] = {
+static const struct ipmi_channel ipmi_channels_default[CHANNEL_MAX] = {
 	{ 0x00, 0x02, 0x01, 0x00, 0x00, 0x00, "IPMBv1.0, no-session" },
-	{ 0x01, 0x02, 0x04, 0x80, 0x3A, 0x05, "802.3 LAN, m-session" },
+	{ 0x01, 0x02, 0x04, 0x80 | SESSION_MAX, 0x3A, 0x05,
+		"802.3 LAN, m-session" },
 	{ 0x02, 0x02, 0x05, 0x40, 0x00, 0x00, "Serial/Modem, s-session" },
 	{ 0x03, 0x02, 0x02, 0x00, 0x00, 0x00, "ICMB no-session" },
 	{ 0x04, 0x04, 0x09, 0x00, 0x00, 0x00, "IPMI-SMBus no-session" },
@@ -55,57 +55,204 @@ struct ipmi_channel {
 	{ 0x0C, 0xFF },
 	{ 0x0D, 0xFF },
 	{ 0x0E, 0xFF },
-	{ 0x0F, 0x05, 0x0C, 0x00, 0x00, 0x00, "KCS-SysIntf s-less" },
-	{ -1 }
+	{ 0x0F, 0x05, 0x0C, 0x00, 0x00, 0x00, "KCS-SysIntf s-less" }
 };
 
-#define UID_MAX 3
-#define UID_MIN 1
-#define UID_ENABLED 0x40
-#define UID_DISABLED 0x80
-
-struct ipmi_user {
-	uint8_t uid; /* [5:0] = 0..63 */
-	uint8_t name[17];
-	uint8_t password[21];
-	uint8_t password_size; /* password stored as 16b = 0; 20b = 1 */
-	/* channel_access - bitfield - [7] - reserved;
-	 * [6] - call-in call-back = 0, only call-b = 1;
-	 * [5] - disable link auth = 0; [4] - disable IPMI msg = 0;
-	 * [3:0] - user priv limit
-	 */ 
-	uint8_t channel_access;
-	uint8_t enabled; /* enabled = 0x40; disabled = 0x80 */
-} ipmi_users[] = {
-	{ 0x00 },
-	{ 0x01, "admin", "foo", 0, 0x34, UID_ENABLED },
-	{ 0x02, "test1", "bar", 1, 0x34, UID_DISABLED },
-	{ 0x03, "", "", 0, 0x00, UID_DISABLED },
-	{ -1 }
+/* Users of every BMC until it changes any; the rest of the UIDs are empty
+ * and have no access.
+ */
+static const struct user_db user_db_default = {
+	.users = {
+		[1] = { "admin", "foo", 0 },
+		[2] = { "test1", "bar", 1 }
+	},
+	.access = {
+		[1] = { [0 ... CHANNEL_MAX - 1] = 0x34 },
+		[2] = { [0 ... CHANNEL_MAX - 1] = 0x34 }
+	}
 };
+/* admin is enabled, test1 isn't */
+# define USERS_ENABLED_DEFAULT (1ULL << 1)
+
+/* Get Device ID response without a scenario, padded to the size it has
+ * always been sent with
+ */
+static const uint8_t device_id_default[14] = DEVICE_ID_DEFAULT;
+
+/* Keep users' HMAC keys between RAKP exchanges, see user_key() */
+static int user_key_cache = 1;
 
-int get_channel_by_number(uint8_t chan_num, struct ipmi_channel *ipmi_chan_ptr);
+/* BMCs with sessions, visited by app_run_timers() */
+static pthread_mutex_t timers_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct bmc *timers_head = NULL;
+/* app_run_timers() has nothing to do before this */
+static uint64_t timers_due = UINT64_MAX;
+
+int get_channel_by_number(struct bmc *bmc, uint8_t chan_num,
+		struct ipmi_channel *ipmi_chan_ptr);
+
+/* app_state_init - set App NetFn state of a BMC to defaults.
+ *
+ * @app: state to initialize
+ */
+void
+app_state_init(struct app_state *app)
+{
+	size_t i;
+	memcpy(app->channels, ipmi_channels_default, sizeof(app->channels));
+	app->users = NULL;
+	app->users_shared = &user_db_default;
+	app->users_enabled = USERS_ENABLED_DEFAULT;
+	app->users_named = 0;
+	app->user_keys = NULL;
+	memset(app->user_keys_valid, 0, sizeof(app->user_keys_valid));
+	for (i = UID_MIN; i <= UID_MAX; i++) {
+		if (user_db_default.users[i].name[0] != '\0') {
+			app->users_named |= 1ULL << i;
+		}
+	}
+	for (i = 0; i < sizeof(app->guid); i++) {
+		app->guid[i] = i;
+	}
+	app->device_id = device_id_default;
+	app->device_id_len = sizeof(device_id_default);
+	session_table_init(&app->sessions, (uintptr_t)app ^ monotonic_ns());
+}
+
+/* app_users - returns user database of a BMC, the shared one until it
+ * has been changed
+ */
+static const struct user_db *
+app_users(const struct app_state *app)
+{
+	return app->users != NULL ? app->users : app->users_shared;
+}
+
+/* app_users_own - give BMC its own copy of the user database before it is
+ * changed. Caller must hold bmc->lock.
+ *
+ * returns: user database which may be changed, NULL on allocation failure
+ */
+static struct user_db *
+app_users_own(struct app_state *app)
+{
+	if (app->users == NULL) {
+		app->users = malloc(sizeof(struct user_db));
+		if (app->users == NULL) {
+			log_error("Couldn't allocate user database: %s",
+					strerror(errno));
+			return NULL;
+		}
+		memcpy(app->users, app->users_shared, sizeof(struct user_db));
+	}
+	return app->users;
+}
+
+/* app_channel - resolve channel number 0Eh, the channel the request has
+ * come in over. That's the system interface unless it's LAN.
+ */
+static uint8_t
+app_channel(uint8_t channel)
+{
+	if (channel != 0x0E) {
+		return channel;
+	}
+	return session_current() != NULL ? session_current()->channel : 0x0F;
+}
+
+/* app_timer_arm - make app_run_timers() look at the BMC. Caller must not
+ * hold bmc->lock.
+ *
+ * @bmc: BMC with a session which has just been started
+ */
+void
+app_timer_arm(struct bmc *bmc)
+{
+	/* the new session can't expire any sooner */
+	uint64_t due = monotonic_ms() + SESSION_SETUP_MS;
+	pthread_mutex_lock(&timers_lock);
+	if (!bmc->app.timer_armed) {
+		bmc->app.timer_armed = 1;
+		bmc->app.timer_next = timers_head;
+		timers_head = bmc;
+	}
+	if (due < timers_due) {
+		__atomic_store_n(&timers_due, due, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&timers_lock);
+}
+
+/* app_run_timers - close timed out sessions of all BMCs. Meant to be
+ * called from the event loop; it costs a single load until the earliest
+ * session may have expired. Then sessions of every BMC which has any are
+ * reaped in bulk, at most once per SESSION_REAP_MS.
+ *
+ * returns: ms until the next deadline, (-1) when nothing is pending
+ */
+int
+app_run_timers()
+{
+	struct bmc **link;
+	struct bmc *bmc;
+	uint64_t bmc_next;
+	uint64_t next = UINT64_MAX;
+	uint64_t now = monotonic_ms();
+	uint64_t due = __atomic_load_n(&timers_due, __ATOMIC_RELAXED);
+	uint32_t closed = 0;
+	uint8_t used;
+	if (due == UINT64_MAX) {
+		return (-1);
+	}
+	if (due > now) {
+		return (due - now > INT32_MAX) ? INT32_MAX : (int)(due - now);
+	}
+	pthread_mutex_lock(&timers_lock);
+	link = &timers_head;
+	while (*link != NULL) {
+		bmc = *link;
+		pthread_mutex_lock(&bmc->lock);
+		closed += session_reap(&bmc->app.sessions, now);
+		bmc_next = bmc->app.sessions.next_expiry_ms;
+		used = bmc->app.sessions.used;
+		pthread_mutex_unlock(&bmc->lock);
+		if (used == 0) {
+			bmc->app.timer_armed = 0;
+			*link = bmc->app.timer_next;
+			continue;
+		}
+		if (bmc_next < next) {
+			next = bmc_next;
+		}
+		link = &bmc->app.timer_next;
+	}
+	if (next != UINT64_MAX && next < now + SESSION_REAP_MS) {
+		next = now + SESSION_REAP_MS;
+	}
+	__atomic_store_n(&timers_due, next, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&timers_lock);
+	if (closed > 0) {
+		log_debug("%" PRIu32 " session(s) timed out", closed);
+	}
+	return next == UINT64_MAX ? (-1) : (int)(next - now);
+}
 
 /* (22.23) Get Channel Access */
 int
-app_get_channel_access(struct dummy_rq *req, struct dummy_rs *rsp)
+app_get_channel_access(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
 	struct ipmi_channel channel_t;
 	uint8_t *data;
 	uint8_t data_len = 2 * sizeof(uint8_t);
-	if (req->msg.data_len != 2) {
-		rsp->ccode = CC_DATA_LEN;
-		return (-1);
-	}
 	req->msg.data[1]|= 0x3F;
 	if (req->msg.data[1] == 0x3F || req->msg.data[1] == 0xFF) {
 		rsp->ccode = CC_DATA_FIELD_INV;
 		return (-1);
 	}
-	data = malloc(data_len);
+	data = rsp_alloc(data_len);
 	if (data == NULL) {
 		rsp->ccode = CC_UNSPEC;
-		perror("malloc fail");
+		perror("rsp_alloc fail");
 		return (-1);
 	}
 	data[0] = req->msg.data[0] & 0x0F;
@@ -113,10 +260,8 @@ app_get_channel_access(struct dummy_rq *req, struct dummy_rs *rsp)
 		/* TODO - de-hard-code this */
 		data[0] = 0x0F;
 	}
-	if (get_channel_by_number(data[0], &channel_t) != 0) {
+	if (get_channel_by_number(bmc, data[0], &channel_t) != 0) {
 		rsp->ccode = CC_DATA_FIELD_INV;
-		free(data);
-		data = NULL;
 		return (-1);
 	}
 	/* TODO - don't ignore req->data[1] -> return non-/volatile ACL */
@@ -127,35 +272,90 @@ app_get_channel_access(struct dummy_rq *req, struct dummy_rs *rsp)
 	return 0;
 }
 
-/* (22.24) Get Channel Info */
+/* (22.13) Get Channel Authentication Capabilities */
 int
-app_get_channel_info(struct dummy_rq *req, struct dummy_rs *rsp)
+app_get_channel_auth_caps(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
+	const struct session_ctx *ctx = session_current();
 	struct ipmi_channel channel_t;
-	int8_t tmp = 0;
+	const struct ipmi_user *user;
+	uint64_t enabled;
 	uint8_t *data;
-	uint8_t data_len = 9 * sizeof(uint8_t);
-	if (req->msg.data_len != 1) {
-		rsp->ccode = CC_DATA_LEN;
+	uint8_t data_len = 8 * sizeof(uint8_t);
+	uint8_t channel = req->msg.data[0] & 0x0F;
+	uint8_t logins = 0;
+	if (channel == 0x0E) {
+		channel = ctx != NULL ? ctx->channel : CHANNEL_LAN;
+	}
+	if (get_channel_by_number(bmc, channel, &channel_t) != 0
+			|| channel_t.mtype != 0x04) {
+		rsp->ccode = CC_DATA_FIELD_INV;
 		return (-1);
 	}
-	data = malloc(data_len);
+	data = rsp_alloc(data_len);
 	if (data == NULL) {
 		rsp->ccode = CC_UNSPEC;
-		perror("malloc fail");
+		perror("rsp_alloc fail");
 		return (-1);
 	}
-	data[0] = req->msg.data[0];
-	if (data[0] == 0x0E) {
-		/* TODO - de-hard-code this */
-		data[0] = 0x0F;
+	pthread_mutex_lock(&bmc->lock);
+	for (enabled = bmc->app.users_enabled; enabled != 0;
+			enabled &= enabled - 1) {
+		user = &app_users(&bmc->app)->users[__builtin_ctzll(enabled)];
+		if (user->name[0] != '\0') {
+			/* non-null usernames */
+			logins |= 0x04;
+		} else if (user->password[0] != '\0') {
+			/* null username, non-null password */
+			logins |= 0x02;
+		} else {
+			/* anonymous */
+			logins |= 0x01;
+		}
 	}
-	printf("[DEBUG] Channel is: %x\n", data[0]);
-	if (get_channel_by_number(data[0], &channel_t) != 0) {
-		printf("[ERROR] get channel by number\n");
+	pthread_mutex_unlock(&bmc->lock);
+	data[0] = channel;
+	/* none, straight password */
+	data[1] = (1 << IPMI_AUTH_NONE) | (1 << IPMI_AUTH_PASSWORD);
+	if (req->msg.data[0] & 0x80) {
+		/* IPMI v2.0+ extended capabilities */
+		data[1] |= 0x80;
+	}
+	/* per-message and user level authentication enabled */
+	data[2] = logins;
+	/* IPMI v1.5 and v2.0 connections */
+	data[3] = (req->msg.data[0] & 0x80) ? 0x03 : 0x00;
+	/* no OEM ID, no OEM auxiliary data */
+	data[4] = 0;
+	data[5] = 0;
+	data[6] = 0;
+	data[7] = 0;
+	rsp->data = data;
+	rsp->data_len = data_len;
+	return 0;
+}
+
+/* (22.24) Get Channel Info */
+int
+app_get_channel_info(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	struct ipmi_channel channel_t;
+	int8_t tmp = 0;
+	uint8_t *data;
+	uint8_t data_len = 9 * sizeof(uint8_t);
+	data = rsp_alloc(data_len);
+	if (data == NULL) {
+		rsp->ccode = CC_UNSPEC;
+		perror("rsp_alloc fail");
+		return (-1);
+	}
+	data[0] = app_channel(req->msg.data[0]);
+	log_debug("Channel is: %x", data[0]);
+	if (get_channel_by_number(bmc, data[0], &channel_t) != 0) {
+		log_error("get channel by number");
 		rsp->ccode = CC_DATA_FIELD_INV;
-		free(data);
-		data = NULL;
 		return (-1);
 	}
 	data[1] = channel_t.mtype;
@@ -179,16 +379,14 @@ app_get_channel_info(struct dummy_rq *req, struct dummy_rs *rsp)
 }
 
 /* (22.22) Set Channel Access */
-uint8_t
-app_set_channel_access(struct dummy_rq *req, struct dummy_rs *rsp)
+int
+app_set_channel_access(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
 	uint8_t channel = 0;
 	uint8_t change_access = 0;
 	uint8_t change_privs = 0;
-	if (req->msg.data_len != 3) {
-		rsp->ccode = CC_DATA_LEN;
-		return (-1);
-	}
+	struct ipmi_channel *chan;
 	channel = req->msg.data[0] & 0x0F;
 	change_access = req->msg.data[1] & 0xC0;
 	change_privs = req->msg.data[2] & 0xC0;
@@ -200,112 +398,513 @@ app_set_channel_access(struct dummy_rq *req, struct dummy_rs *rsp)
 	/* Note: since there is no volatile/non-volatile settings split,
 	 * it doesn't matter to us.
 	 */
-	printf("[INFO] Channel: %x\n", channel);
-	printf("[INFO] Channel Access: %x\n",
-			ipmi_channels[channel].capabilities);
-	printf("[INFO] Channel Privileges: %x\n",
-			ipmi_channels[channel].priv_level);
+	chan = &bmc->app.channels[channel];
+	pthread_mutex_lock(&bmc->lock);
+	log_info("Channel: %x", channel);
+	log_info("Channel Access: %x",
+			chan->capabilities);
+	log_info("Channel Privileges: %x",
+			chan->priv_level);
 	if (change_access != 0) {
-		printf("[INFO] New Channel Access: %x\n",
+		log_info("New Channel Access: %x",
 				req->msg.data[1] & 0x3F);
-		ipmi_channels[channel].capabilities = req->msg.data[1] & 0x3F;
+		chan->capabilities = req->msg.data[1] & 0x3F;
 	}
 	if (change_privs != 0) {
-		printf("[INFO] New Channel Privileges: %x\n",
+		log_info("New Channel Privileges: %x",
 				req->msg.data[2] & 0x0F);
-		ipmi_channels[channel].priv_level = req->msg.data[2] & 0x0F;
+		chan->priv_level = req->msg.data[2] & 0x0F;
 	}
+	pthread_mutex_unlock(&bmc->lock);
 	rsp->ccode = CC_OK;
 	return 0;
 }
 
-/* count_enabled_users - return count of enabled IPMI users.
+/* (22.16) Get Session Challenge */
+int
+app_get_session_challenge(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	const struct session_ctx *ctx = session_current();
+	struct session *session;
+	uint8_t auth_type = req->msg.data[0] & 0x0F;
+	uint8_t *data;
+	uint8_t data_len = 20 * sizeof(uint8_t);
+	int uid;
+	int i;
+	if (ctx == NULL) {
+		/* sessions are established over LAN only */
+		rsp->ccode = CC_EXEC_NA_STATE;
+		return (-1);
+	}
+	if (auth_type != IPMI_AUTH_NONE && auth_type != IPMI_AUTH_PASSWORD) {
+		rsp->ccode = CC_DATA_FIELD_INV;
+		return (-1);
+	}
+	data = rsp_alloc(data_len);
+	if (data == NULL) {
+		perror("rsp_alloc fail");
+		rsp->ccode = CC_UNSPEC;
+		return (-1);
+	}
+	pthread_mutex_lock(&bmc->lock);
+	uid = user_by_name(&bmc->app, &req->msg.data[1], 16);
+	if (uid < 0 || user_session_priv(&bmc->app, uid, ctx->channel) == 0) {
+		pthread_mutex_unlock(&bmc->lock);
+		/* invalid user name, or null user name not enabled */
+		rsp->ccode = 0x82;
+		for (i = 1; i <= 16; i++) {
+			if (req->msg.data[i] != '\0') {
+				rsp->ccode = 0x81;
+				break;
+			}
+		}
+		return (-1);
+	}
+	session = session_new(&bmc->app.sessions, ctx->channel,
+			monotonic_ms());
+	if (session == NULL) {
+		pthread_mutex_unlock(&bmc->lock);
+		rsp->ccode = CC_NO_SPACE;
+		return (-1);
+	}
+	session->uid = uid;
+	session->auth_type = auth_type;
+	session->addr = ctx->addr;
+	session->port = ctx->port;
+	/* temporary session ID, LS byte first */
+	for (i = 0; i < 4; i++) {
+		data[i] = session->id >> (8 * i);
+	}
+	memcpy(&data[4], session->challenge, 16);
+	pthread_mutex_unlock(&bmc->lock);
+	app_timer_arm(bmc);
+	rsp->data = data;
+	rsp->data_len = data_len;
+	return 0;
+}
+
+/* (22.17) Activate Session */
+int
+app_activate_session(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	const struct session_ctx *ctx = session_current();
+	struct session *session;
+	uint64_t now = monotonic_ms();
+	uint32_t out_seq = 0;
+	uint32_t in_seq = 0;
+	uint8_t max_priv = req->msg.data[1] & 0x0F;
+	uint8_t *data;
+	uint8_t data_len = 10 * sizeof(uint8_t);
+	int i;
+	int rc;
+	if (ctx == NULL || ctx->id == 0) {
+		/* invalid session ID */
+		rsp->ccode = 0x85;
+		return (-1);
+	}
+	for (i = 0; i < 4; i++) {
+		out_seq |= (uint32_t)req->msg.data[18 + i] << (8 * i);
+	}
+	if (out_seq == 0) {
+		/* session sequence number out of range */
+		rsp->ccode = 0x84;
+		return (-1);
+	}
+	data = rsp_alloc(data_len);
+	if (data == NULL) {
+		perror("rsp_alloc fail");
+		rsp->ccode = CC_UNSPEC;
+		return (-1);
+	}
+	pthread_mutex_lock(&bmc->lock);
+	session = session_find(&bmc->app.sessions, ctx->id, now);
+	if (session == NULL || session->state != SESSION_PENDING
+			|| session->auth_type == IPMI_AUTH_RMCP_PLUS) {
+		pthread_mutex_unlock(&bmc->lock);
+		rsp->ccode = 0x85;
+		return (-1);
+	}
+	if ((req->msg.data[0] & 0x0F) != session->auth_type
+			|| memcmp(&req->msg.data[2], session->challenge,
+				16) != 0) {
+		pthread_mutex_unlock(&bmc->lock);
+		rsp->ccode = CC_DATA_FIELD_INV;
+		return (-1);
+	}
+	if (max_priv < PRIV_CALLBACK || max_priv > user_session_priv(
+				&bmc->app, session->uid, session->channel)) {
+		pthread_mutex_unlock(&bmc->lock);
+		/* exceeds user and/or channel privilege limit */
+		rsp->ccode = 0x86;
+		return (-1);
+	}
+	rc = session_activate(&bmc->app.sessions, session, session->uid,
+			user_get(&bmc->app, session->uid)->session_limit & 0x0F,
+			bmc->app.channels[session->channel].sessions & 0x3F,
+			now);
+	if (rc != 0) {
+		pthread_mutex_unlock(&bmc->lock);
+		/* no session slot available, or none for given user */
+		rsp->ccode = rc == SESSION_ERR_USER ? 0x82 : 0x81;
+		return (-1);
+	}
+	while (in_seq == 0) {
+		session_random(&bmc->app.sessions, (uint8_t *)&in_seq,
+				sizeof(in_seq));
+	}
+	session->in_seq = in_seq - 1;
+	session->seq_mask = 1;
+	session->out_seq = out_seq;
+	session->max_priv = max_priv;
+	session->priv = max_priv < PRIV_USER ? max_priv : PRIV_USER;
+	data[0] = session->auth_type;
+	for (i = 0; i < 4; i++) {
+		data[1 + i] = session->id >> (8 * i);
+		data[5 + i] = in_seq >> (8 * i);
+	}
+	data[9] = max_priv;
+	pthread_mutex_unlock(&bmc->lock);
+	log_info("Session %" PRIx32 " of UID %" PRIu8 " activated",
+			ctx->id, session->uid);
+	rsp->data = data;
+	rsp->data_len = data_len;
+	return 0;
+}
+
+/* (22.18) Set Session Privilege Level */
+int
+app_set_session_priv(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	const struct session_ctx *ctx = session_current();
+	struct session *session;
+	uint8_t priv = req->msg.data[0] & 0x0F;
+	uint8_t *data;
+	uint8_t data_len = 1 * sizeof(uint8_t);
+	if (ctx == NULL || ctx->id == 0) {
+		rsp->ccode = CC_EXEC_NA_STATE;
+		return (-1);
+	}
+	data = rsp_alloc(data_len);
+	if (data == NULL) {
+		perror("rsp_alloc fail");
+		rsp->ccode = CC_UNSPEC;
+		return (-1);
+	}
+	pthread_mutex_lock(&bmc->lock);
+	session = session_find(&bmc->app.sessions, ctx->id, monotonic_ms());
+	if (session == NULL || session->state != SESSION_ACTIVE) {
+		pthread_mutex_unlock(&bmc->lock);
+		rsp->ccode = CC_EXEC_NA_STATE;
+		return (-1);
+	}
+	/* 0 only asks for the present level */
+	if (priv != 0) {
+		if (priv < PRIV_CALLBACK) {
+			pthread_mutex_unlock(&bmc->lock);
+			rsp->ccode = CC_DATA_FIELD_INV;
+			return (-1);
+		}
+		if (priv > session->max_priv) {
+			pthread_mutex_unlock(&bmc->lock);
+			/* exceeds channel and/or user privilege limit */
+			rsp->ccode = 0x81;
+			return (-1);
+		}
+		session->priv = priv;
+	}
+	data[0] = session->priv;
+	pthread_mutex_unlock(&bmc->lock);
+	rsp->data = data;
+	rsp->data_len = data_len;
+	return 0;
+}
+
+/* (22.19) Close Session */
+int
+app_close_session(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	const struct session_ctx *ctx = session_current();
+	struct session *session;
+	uint64_t now = monotonic_ms();
+	uint32_t id = 0;
+	int i;
+	for (i = 0; i < 4; i++) {
+		id |= (uint32_t)req->msg.data[i] << (8 * i);
+	}
+	if (id == 0 && req->msg.data_len < 5) {
+		rsp->ccode = CC_DATA_LEN;
+		return (-1);
+	}
+	pthread_mutex_lock(&bmc->lock);
+	if (id != 0) {
+		session = session_find(&bmc->app.sessions, id, now);
+	} else {
+		session = session_by_handle(&bmc->app.sessions,
+				req->msg.data[4], now);
+	}
+	if (session == NULL) {
+		pthread_mutex_unlock(&bmc->lock);
+		/* invalid session ID or handle */
+		rsp->ccode = id != 0 ? 0x87 : 0x88;
+		return (-1);
+	}
+	/* others' sessions may be closed by administrators only */
+	if (ctx != NULL && session->id != ctx->id && ctx->priv < PRIV_ADMIN) {
+		pthread_mutex_unlock(&bmc->lock);
+		rsp->ccode = CC_PRIV_INSUFFICIENT;
+		return (-1);
+	}
+	log_info("Session %" PRIx32 " of UID %" PRIu8 " closed",
+			session->id, session->uid);
+	session_close(&bmc->app.sessions, session);
+	pthread_mutex_unlock(&bmc->lock);
+	return 0;
+}
+
+/* (22.20) Get Session Info */
+int
+app_get_session_info(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	const struct session_ctx *ctx = session_current();
+	struct session_table *table = &bmc->app.sessions;
+	struct session *session = NULL;
+	uint64_t now = monotonic_ms();
+	uint32_t id = 0;
+	uint16_t port;
+	uint8_t channel;
+	uint8_t index = req->msg.data[0];
+	uint8_t *data;
+	uint8_t data_len = 18 * sizeof(uint8_t);
+	int i;
+	if ((index == 0xFF && req->msg.data_len != 5)
+			|| (index == 0xFE && req->msg.data_len != 2)
+			|| (index < 0xFE && req->msg.data_len != 1)) {
+		rsp->ccode = CC_DATA_LEN;
+		return (-1);
+	}
+	data = rsp_alloc(data_len);
+	if (data == NULL) {
+		perror("rsp_alloc fail");
+		rsp->ccode = CC_UNSPEC;
+		return (-1);
+	}
+	pthread_mutex_lock(&bmc->lock);
+	if (index == 0xFF) {
+		for (i = 0; i < 4; i++) {
+			id |= (uint32_t)req->msg.data[1 + i] << (8 * i);
+		}
+		session = session_find(table, id, now);
+	} else if (index == 0xFE) {
+		session = session_by_handle(table, req->msg.data[1], now);
+	} else if (index == 0) {
+		if (ctx != NULL) {
+			session = session_find(table, ctx->id, now);
+		}
+	} else {
+		session = session_nth_active(table, index, now);
+	}
+	if (session != NULL && session->state != SESSION_ACTIVE) {
+		session = NULL;
+	}
+	if (session != NULL) {
+		channel = session->channel;
+	} else {
+		channel = ctx != NULL ? ctx->channel : CHANNEL_LAN;
+	}
+	data[0] = session != NULL ? session_handle(table, session) : 0;
+	data[1] = bmc->app.channels[channel].sessions & 0x3F;
+	data[2] = table->pool != NULL
+		? table->pool->channel_active[channel] : 0;
+	if (session == NULL) {
+		/* nothing more about sessions which aren't active */
+		pthread_mutex_unlock(&bmc->lock);
+		rsp->data = data;
+		rsp->data_len = 3;
+		return 0;
+	}
+	data[3] = session->uid;
+	data[4] = session->priv;
+	/* [7:4] IPMI v1.5 = 0, v2.0 = 1, [3:0] channel */
+	data[5] = session->auth_type == IPMI_AUTH_RMCP_PLUS ? 0x10 : 0x00;
+	data[5] |= channel;
+	/* console IP address MS byte first, MAC address isn't known */
+	memcpy(&data[6], &session->addr, 4);
+	memset(&data[10], 0, 6);
+	/* console port LS byte first */
+	port = ntohs(session->port);
+	data[16] = port & 0xFF;
+	data[17] = port >> 8;
+	pthread_mutex_unlock(&bmc->lock);
+	rsp->data = data;
+	rsp->data_len = data_len;
+	return 0;
+}
+
+/* user_get - look up user by UID. Caller must hold bmc->lock.
  *
- * returns: count of enabled IPMI users
+ * @app: App NetFn state of a BMC
+ * @uid: UID
+ *
+ * returns: user, NULL when UID is out of range
  */
-uint8_t
-count_enabled_users()
+const struct ipmi_user *
+user_get(const struct app_state *app, uint8_t uid)
 {
-	int i = 0;
-	uint8_t counter = 0;
-	for (i = UID_MIN; i <= UID_MAX; i++) {
-		if (ipmi_users[i].uid < UID_MIN || ipmi_users[i].uid > UID_MAX) {
-			continue;
-		}
-		if (ipmi_users[i].enabled == UID_ENABLED) {
-			counter++;
+	if (uid < UID_MIN || uid > UID_MAX) {
+		return NULL;
+	}
+	return &app_users(app)->users[uid];
+}
+
+/* user_by_name - look up enabled user by name. Caller must hold bmc->lock.
+ *
+ * @app: App NetFn state of a BMC
+ * @name: user name, need not be terminated, all '\0' is the null user
+ * @name_len: length of name, at most 16
+ *
+ * returns: UID, (-1) when there is no such enabled user
+ */
+int
+user_by_name(struct app_state *app, const uint8_t *name, size_t name_len)
+{
+	const struct user_db *db = app_users(app);
+	uint64_t enabled;
+	uint8_t padded[16];
+	int uid;
+	if (name_len > sizeof(padded)) {
+		return (-1);
+	}
+	memset(padded, '\0', sizeof(padded));
+	memcpy(padded, name, name_len);
+	for (enabled = app->users_enabled; enabled != 0;
+			enabled &= enabled - 1) {
+		uid = __builtin_ctzll(enabled);
+		if (memcmp(db->users[uid].name, padded,
+					sizeof(padded)) == 0) {
+			return uid;
 		}
 	}
-	return counter;
+	return (-1);
 }
 
-/* count_fixed_name_users() - counts number of IPMI users with fixed name.
+/* user_session_priv - highest privilege level user may have in a session
+ * over given channel. Caller must hold bmc->lock.
  *
- * returns: count of IPMI users with fixed name
+ * returns: privilege level, 0 when user can't establish sessions at all
  */
 uint8_t
-count_fixed_name_users()
+user_session_priv(struct app_state *app, uint8_t uid, uint8_t channel)
 {
-	int i = 0;
-	uint8_t counter = 0;
-	for (i = UID_MIN; i <= UID_MAX; i++) {
-		if (ipmi_users[i].uid < UID_MIN || ipmi_users[i].uid > UID_MAX) {
-			continue;
+	uint8_t access;
+	uint8_t priv;
+	if (uid < UID_MIN || uid > UID_MAX || channel >= CHANNEL_MAX
+			|| !(app->users_enabled & (1ULL << uid))) {
+		return 0;
+	}
+	access = app_users(app)->access[uid][channel];
+	/* [4] - IPMI messaging enabled */
+	if (!(access & 0x10)) {
+		return 0;
+	}
+	priv = access & 0x0F;
+	if (priv > app->channels[channel].priv_level) {
+		priv = app->channels[channel].priv_level;
+	}
+	return priv > PRIV_ADMIN ? 0 : priv;
+}
+
+/* user_key - returns HMAC key of user's password, K_UID of RAKP. The key
+ * is kept per BMC, UID and hash until the password changes, so a handshake
+ * only hashes its own nonces. Caller must hold bmc->lock.
+ *
+ * @app: App NetFn state of BMC
+ * @uid: valid UID
+ * @alg: hash algorithm, HASH_*
+ * @scratch: where the key is computed when it can't be kept
+ */
+const struct hmac_key *
+user_key(struct app_state *app, uint8_t uid, uint8_t alg,
+		struct hmac_key *scratch)
+{
+	struct hmac_key *key = scratch;
+	if (user_key_cache && app->user_keys == NULL) {
+		app->user_keys = malloc(sizeof(struct hmac_key)
+				* (UID_MAX + 1) * HASH_ALGS);
+		if (app->user_keys == NULL) {
+			log_error("Couldn't allocate user keys: %s",
+					strerror(errno));
 		}
-		if (strcmp(ipmi_users[i].name, "") == 0) {
-			continue;
-		} else {
-			counter++;
+	}
+	if (user_key_cache && app->user_keys != NULL) {
+		key = &app->user_keys[uid * HASH_ALGS + alg];
+		if (app->user_keys_valid[alg] & (1ULL << uid)) {
+			return key;
 		}
 	}
-	return counter;
+	/* 16 byte passwords are padded with zeros to 20 bytes */
+	hmac_key_init(key, alg, user_get(app, uid)->password, 20);
+	if (key != scratch) {
+		app->user_keys_valid[alg] |= 1ULL << uid;
+	}
+	return key;
+}
+
+/* user_key_cache_enable - whether user_key() keeps keys, for benchmarks */
+void
+user_key_cache_enable(int enable)
+{
+	user_key_cache = enable;
 }
 
 /* get_channel_by_number - return ipmi_channel structure based on given IPMI
  * Channel number.
  *
+ * @bmc: BMC
  * @chan_num: IPMI Channel number(needle)
  * @*ipmi_chan_ptr: pointer to ipmi_channel structure
  *
  * returns: 0 when channel is found, (-1) when it isn't/error
  */
 int
-get_channel_by_number(uint8_t chan_num, struct ipmi_channel *ipmi_chan_ptr)
+get_channel_by_number(struct bmc *bmc, uint8_t chan_num,
+		struct ipmi_channel *ipmi_chan_ptr)
 {
 	int i = 0;
 	int rc = (-1);
-	for (i = 0; ipmi_channels[i].number != (-1); i++) {
-		if (ipmi_channels[i].number == chan_num
-				&& ipmi_channels[i].ptype != 0x0F) {
-			memcpy(ipmi_chan_ptr, &ipmi_channels[i],
+	pthread_mutex_lock(&bmc->lock);
+	for (i = 0; i < CHANNEL_MAX; i++) {
+		if (bmc->app.channels[i].number == chan_num
+				&& bmc->app.channels[i].ptype != 0x0F) {
+			memcpy(ipmi_chan_ptr, &bmc->app.channels[i],
 					sizeof(struct ipmi_channel));
 			rc = 0;
 			break;
 		}
 	}
+	pthread_mutex_unlock(&bmc->lock);
 	return rc;
 }
 
 /* (20.1) BMC Get Device ID */
 int
-mc_get_device_id(struct dummy_rq *req, struct dummy_rs *rsp)
+mc_get_device_id(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
-	int data_len = 14 * sizeof(uint8_t);
+	int data_len = bmc->app.device_id_len;
 	uint8_t *data;
-	data = malloc(data_len);
+	data = rsp_alloc(data_len);
 	if (data == NULL) {
 		rsp->ccode = CC_UNSPEC;
-		perror("malloc fail");
+		perror("rsp_alloc fail");
 		return (-1);
 	}
-	memset(data, 0, data_len);
-	data[0] = 12;
-	data[1] = 0x80;
-	data[2] = 0;
-	data[5] = 0xff;
-        data[6] = 0xcc;
-        data[7] = 0x9b;
-	/* TODO */
+	/* set once at start-up, never changes */
+	memcpy(data, bmc->app.device_id, data_len);
 	/* data[0] - Device ID
 	 * data[1] - Device Revision
 	 * 	[7] - 1/0 - device provides SDRs
@@ -337,23 +936,23 @@ mc_get_device_id(struct dummy_rq *req, struct dummy_rs *rsp)
 }
 /* (20.8) Get Device GUID */
 int
-mc_get_device_guid(struct dummy_rq *req, struct dummy_rs *rsp)
+mc_get_device_guid(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
 	/* TODO - GUID generator ???
 	 * http://download.intel.com/design/archives/wfm/downloads/base20.pdf
 	 */
-	int i = 0;
 	int data_len = 16;
 	uint8_t *data = NULL;
-	data = malloc(data_len);
+	data = rsp_alloc(data_len);
 	if (data == NULL) {
-		perror("malloc fail");
+		perror("rsp_alloc fail");
 		rsp->ccode = CC_UNSPEC;
 		return (-1);
 	}
-	for (i = 0; i < data_len; i++) {
-		data[i] = i;
-	}
+	pthread_mutex_lock(&bmc->lock);
+	memcpy(data, bmc->app.guid, data_len);
+	pthread_mutex_unlock(&bmc->lock);
 	rsp->data_len = data_len;
 	rsp->data = data;
 	return 0;
@@ -361,7 +960,8 @@ mc_get_device_guid(struct dummy_rq *req, struct dummy_rs *rsp)
 
 /* (20.2) BMC Cold and (20.3) Warm Reset */
 int
-mc_reset(struct dummy_rq *req, struct dummy_rs *rsp)
+mc_reset(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
 	rsp->data_len = 0;
 	if (req->msg.cmd == BMC_RESET_COLD) {
@@ -369,7 +969,7 @@ mc_reset(struct dummy_rq *req, struct dummy_rs *rsp)
 	} else if (req->msg.cmd == BMC_RESET_WARM) {
 		/* do nothing */
 	} else {
-		printf("[ERROR] Invalid command '%u'.\n",
+		log_error("Invalid command '%u'.",
 				req->msg.cmd);
 		rsp->ccode = CC_CMD_INV;
 		return (-1);
@@ -379,13 +979,14 @@ mc_reset(struct dummy_rq *req, struct dummy_rs *rsp)
 
 /* (20.4) BMC Selftest */
 int
-mc_selftest(struct dummy_rq *req, struct dummy_rs *rsp)
+mc_selftest(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
 	uint8_t *data;
 	uint8_t data_len = 2 * sizeof(uint8_t);
-	data = malloc(data_len);
+	data = rsp_alloc(data_len);
 	if (data == NULL) {
-		perror("malloc fail");
+		perror("rsp_alloc fail");
 		rsp->ccode = CC_UNSPEC;
 		return (-1);
 	}
@@ -398,21 +999,18 @@ mc_selftest(struct dummy_rq *req, struct dummy_rs *rsp)
 
 /* (22.27) Get User Access Command */
 int
-user_get_access(struct dummy_rq *req, struct dummy_rs *rsp)
+user_get_access(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
 	uint8_t *data;
 	uint8_t data_len = 4 * sizeof(uint8_t);
 	uint8_t uid = 0;
-	if (req->msg.data_len != 2) {
-		rsp->ccode = CC_DATA_LEN;
-		return (-1);
-	}
 	/* [0][7:4] - reserved, [3:0] - channel */
 	req->msg.data[0] &= 0x0F;
 	/* [1][7:6] - reserved, [5:0] - uid */
 	uid = req->msg.data[1] & 0x3F;
-	printf("Channel: %" PRIu8 "\n", req->msg.data[0]);
-	printf("UID: %" PRIu8 "\n", uid);
+	log_info("Channel: %" PRIu8, req->msg.data[0]);
+	log_info("UID: %" PRIu8, uid);
 	if (is_valid_channel(req->msg.data[0])) {
 		rsp->ccode = CC_PARAM_OOR;
 		return (-1);
@@ -421,9 +1019,9 @@ user_get_access(struct dummy_rq *req, struct dummy_rs *rsp)
 		rsp->ccode = CC_PARAM_OOR;
 		return (-1);
 	}
-	data = malloc(data_len);
+	data = rsp_alloc(data_len);
 	if (data == NULL) {
-		perror("malloc fail");
+		perror("rsp_alloc fail");
 		rsp->ccode = CC_UNSPEC;
 		return (-1);
 	}
@@ -434,10 +1032,14 @@ user_get_access(struct dummy_rq *req, struct dummy_rs *rsp)
 	 * [4] - bitfield
 	 */
 	data[0] = 0x3F & UID_MAX;
-	data[1] = ipmi_users[uid].enabled;
-	data[1] |= count_enabled_users();
-	data[2] = count_fixed_name_users();
-	data[3] = ipmi_users[uid].channel_access;
+	pthread_mutex_lock(&bmc->lock);
+	data[1] = (bmc->app.users_enabled & (1ULL << uid))
+		? UID_ENABLED : UID_DISABLED;
+	data[1] |= __builtin_popcountll(bmc->app.users_enabled);
+	data[2] = __builtin_popcountll(bmc->app.users_named);
+	data[3] = app_users(&bmc->app)->access[uid][app_channel(
+			req->msg.data[0])];
+	pthread_mutex_unlock(&bmc->lock);
 	rsp->data_len = data_len;
 	rsp->data = data;
 	rsp->ccode = CC_OK;
@@ -446,29 +1048,28 @@ user_get_access(struct dummy_rq *req, struct dummy_rs *rsp)
 
 /* (22.29) Get User Name Command */
 int
-user_get_name(struct dummy_rq *req, struct dummy_rs *rsp)
+user_get_name(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
 	uint8_t uid = 0;
 	uint8_t *data;
 	uint8_t data_len = 16 * sizeof(uint8_t);
-	if (req->msg.data_len != 1) {
-		rsp->ccode = CC_DATA_LEN;
-		return (-1);
-	}
-	uid = req->msg.data[0] & 0x1F;
-	printf("[INFO] UID: %" PRIu8 "\n", uid);
+	uid = req->msg.data[0] & 0x3F;
+	log_info("UID: %" PRIu8, uid);
 	if (uid < UID_MIN || uid > UID_MAX) {
 		rsp->ccode = CC_PARAM_OOR;
 		return (-1);
 	}
-	data = malloc(data_len);
+	data = rsp_alloc(data_len);
 	if (data == NULL) {
-		perror("malloc fail");
+		perror("rsp_alloc fail");
 		rsp->ccode = CC_UNSPEC;
 		return (-1);
 	}
 	memset(data, '\0', data_len);
-	memcpy(data, ipmi_users[uid].name, data_len);
+	pthread_mutex_lock(&bmc->lock);
+	memcpy(data, user_get(&bmc->app, uid)->name, data_len);
+	pthread_mutex_unlock(&bmc->lock);
 	rsp->data = data;
 	rsp->data_len = data_len;
 	rsp->ccode = CC_OK;
@@ -477,23 +1078,20 @@ user_get_name(struct dummy_rq *req, struct dummy_rs *rsp)
 
 /* (22.26) Set User Access Command */
 int
-user_set_access(struct dummy_rq *req, struct dummy_rs *rsp)
+user_set_access(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
+	struct user_db *db;
+	uint8_t *access;
 	uint8_t change_bit = 0;
 	uint8_t channel = 0;
 	uint8_t session_limit = 0;
 	uint8_t priv_limit = 0;
 	uint8_t uid = 0;
-	if (req->msg.data_len != 4) {
-		rsp->ccode = CC_DATA_LEN;
-		return (-1);
-	}
 	channel = req->msg.data[0] & 0x0F;
-	uid = req->msg.data[1] & 0x1F;
+	uid = req->msg.data[1] & 0x3F;
 	session_limit = req->msg.data[3] & 0x0F;
-	/* Session Limit isn't supported - at the moment. */
-	if (uid < UID_MIN || uid > UID_MAX || session_limit != 0
-			|| is_valid_channel(channel)) {
+	if (uid < UID_MIN || uid > UID_MAX || is_valid_channel(channel)) {
 		rsp->ccode = CC_PARAM_OOR;
 		return (-1);
 	}
@@ -503,80 +1101,100 @@ user_set_access(struct dummy_rq *req, struct dummy_rs *rsp)
 		return (-1);
 	}
 	change_bit = req->msg.data[0] & 0x80;
+	pthread_mutex_lock(&bmc->lock);
+	db = app_users_own(&bmc->app);
+	if (db == NULL) {
+		pthread_mutex_unlock(&bmc->lock);
+		rsp->ccode = CC_UNSPEC;
+		return (-1);
+	}
+	access = &db->access[uid][app_channel(channel)];
 	if (change_bit == 0x80) {
-		ipmi_users[uid].channel_access = req->msg.data[0] & 0x70;
+		*access = req->msg.data[0] & 0x70;
 	}
-	ipmi_users[uid].channel_access &= 0xF0;
-	ipmi_users[uid].channel_access |= priv_limit;
-	printf("Channel Access: %x\n", ipmi_users[uid].channel_access);
+	*access &= 0xF0;
+	*access |= priv_limit;
+	/* takes effect with the next session, open ones are left alone */
+	db->users[uid].session_limit = session_limit;
+	log_info("Channel Access: %x", *access);
+	pthread_mutex_unlock(&bmc->lock);
 	rsp->ccode = CC_OK;
 	return 0;
 }
 
 /* (22.28) Set User Name Command */
 int
-user_set_name(struct dummy_rq *req, struct dummy_rs *rsp)
+user_set_name(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
+	struct user_db *db;
 	uint8_t uid;
 	uint8_t *name_ptr;
-	if (req->msg.data_len < 2 || req->msg.data_len > 17) {
-		rsp->ccode = CC_DATA_LEN;
-		return (-1);
-	}
-	uid = req->msg.data[0] & 0x1F;
-	printf("[INFO] UID: %" PRIu8 "\n", uid);
+	uid = req->msg.data[0] & 0x3F;
+	log_info("UID: %" PRIu8, uid);
 	if (uid < UID_MIN || uid > UID_MAX) {
 		rsp->ccode = CC_PARAM_OOR;
 		return (-1);
 	}
 	name_ptr = &req->msg.data[1];
-	memset(ipmi_users[uid].name, '\0', 17);
-	memcpy(ipmi_users[uid].name, name_ptr, (req->msg.data_len - 1));
+	pthread_mutex_lock(&bmc->lock);
+	db = app_users_own(&bmc->app);
+	if (db == NULL) {
+		pthread_mutex_unlock(&bmc->lock);
+		rsp->ccode = CC_UNSPEC;
+		return (-1);
+	}
+	memset(db->users[uid].name, '\0', 17);
+	memcpy(db->users[uid].name, name_ptr, (req->msg.data_len - 1));
+	if (db->users[uid].name[0] != '\0') {
+		bmc->app.users_named |= 1ULL << uid;
+	} else {
+		bmc->app.users_named &= ~(1ULL << uid);
+	}
+	pthread_mutex_unlock(&bmc->lock);
 	rsp->ccode = CC_OK;
 	return 0;
 }
 
 /* (22.30) Set User Password Command */
 int
-user_set_password(struct dummy_rq *req, struct dummy_rs *rsp)
+user_set_password(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
 	int i = 0;
 	int j = 0;
 	int rc = 0;
 	uint8_t password_size = 0;
 	uint8_t uid = 0;
-	uint8_t *password_ptr;
-	if (req->msg.data_len < 2) {
-		rsp->ccode = CC_DATA_LEN;
-		return (-1);
-	}
+	uint8_t password[20];
+	const struct ipmi_user *user;
+	struct user_db *db;
 	password_size = (req->msg.data[0] & 0x80) == 0x80 ? 1 : 0;
-	uid = req->msg.data[0] & 0x1F;
+	uid = req->msg.data[0] & 0x3F;
 	req->msg.data[1] &= 0x03;
-	printf("[INFO] Password size: %" PRIu8 "\n", password_size);
-	printf("[INFO] UID: %" PRIu8 "\n", uid);
-	printf("[INFO] Operation: %" PRIu8 "\n", req->msg.data[1]);
+	log_info("Password size: %" PRIu8, password_size);
+	log_info("UID: %" PRIu8, uid);
+	log_info("Operation: %" PRIu8, req->msg.data[1]);
 
 	if (uid < UID_MIN || uid > UID_MAX) {
 		rsp->ccode = CC_PARAM_OOR;
 		return (-1);
 	}
-	printf("[INFO] DB Entry:\n");
-	printf("[INFO] Name: %s\n", ipmi_users[uid].name);
-	printf("[INFO] Password: %s\n", ipmi_users[uid].password);
-	printf("[INFO] Password_size: %" PRIu8 "\n", ipmi_users[uid].password_size);
-	printf("[INFO] ACL: %" PRIu8 "\n", ipmi_users[uid].channel_access);
+	pthread_mutex_lock(&bmc->lock);
+	user = user_get(&bmc->app, uid);
+	log_debug("DB Entry: name '%s', password '%s', size %" PRIu8,
+			user->name, user->password, user->password_size);
 
 	switch (req->msg.data[1]) {
 	case 0x00:
 		/* disable user */
-		ipmi_users[uid].enabled = UID_DISABLED;
+		bmc->app.users_enabled &= ~(1ULL << uid);
 		rsp->ccode = CC_OK;
 		rc = 0;
 		break;
 	case 0x01:
 		/* enable user */
-		ipmi_users[uid].enabled = UID_ENABLED;
+		bmc->app.users_enabled |= 1ULL << uid;
 		rsp->ccode = CC_OK;
 		rc = 0;
 		break;
@@ -589,11 +1207,22 @@ user_set_password(struct dummy_rq *req, struct dummy_rs *rsp)
 			rc = (-1);
 			break;
 		}
-		ipmi_users[uid].password_size = password_size;
+		db = app_users_own(&bmc->app);
+		if (db == NULL) {
+			rsp->ccode = CC_UNSPEC;
+			rc = (-1);
+			break;
+		}
+		db->users[uid].password_size = password_size;
+		memset(db->users[uid].password, '\0',
+				sizeof(db->users[uid].password));
 		for (i = 2, j = 0; i < req->msg.data_len; i++, j++) {
-			ipmi_users[uid].password[j] = req->msg.data[i];
+			db->users[uid].password[j] = req->msg.data[i];
+		}
+		for (i = 0; i < HASH_ALGS; i++) {
+			bmc->app.user_keys_valid[i] &= ~(1ULL << uid);
 		}
-		printf("[INFO] Password: '%s'\n", ipmi_users[uid].password);
+		log_info("Password: '%s'", db->users[uid].password);
 		rsp->ccode = CC_OK;
 		rc = 0;
 		break;
@@ -606,15 +1235,20 @@ user_set_password(struct dummy_rq *req, struct dummy_rs *rsp)
 			rc = (-1);
 			break;
 		}
-		printf("[INFO] Password size: %" PRIu8 ":%" PRIu8 "\n",
-				password_size, ipmi_users[uid].password_size);
-		if (password_size != ipmi_users[uid].password_size) {
+		log_info("Password size: %" PRIu8 ":%" PRIu8,
+				password_size, user->password_size);
+		if (password_size != user->password_size) {
 			rsp->ccode = 0x81;
 			rc = (-1);
 			break;
 		}
-		password_ptr = &req->msg.data[2];
-		if (strcmp(ipmi_users[uid].password, password_ptr) != 0) {
+		/* request data isn't NUL-terminated, password field is
+		 * 16 or 20 bytes padded with NULs, the same as stored ones
+		 */
+		memset(password, '\0', sizeof(password));
+		memcpy(password, &req->msg.data[2], req->msg.data_len - 2);
+		if (memcmp(user->password, password,
+					password_size == 1 ? 20 : 16) != 0) {
 			rsp->ccode = 0x80;
 			rc = (-1);
 			break;
@@ -627,60 +1261,6 @@ user_set_password(struct dummy_rq *req, struct dummy_rs *rsp)
 		rc = (-1);
 		break;
 	}
-	return rc;
-}
-
-int
-netfn_app_main(struct dummy_rq *req, struct dummy_rs *rsp)
-{
-	int rc = 0;
-	rsp->msg.netfn = req->msg.netfn + 1;
-	rsp->msg.cmd = req->msg.cmd;
-	rsp->msg.lun = req->msg.lun;
-	rsp->ccode = CC_OK;
-	rsp->data_len = 0;
-	rsp->data = NULL;
-	switch (req->msg.cmd) {
-	case APP_GET_CHANNEL_ACCESS:
-		rc = app_get_channel_access(req, rsp);
-		break;
-	case APP_GET_CHANNEL_INFO:
-		rc = app_get_channel_info(req, rsp);
-		break;
-	case APP_SET_CHANNEL_ACCESS:
-		rc = app_set_channel_access(req, rsp);
-		break;
-	case BMC_GET_DEVICE_ID:
-		rc = mc_get_device_id(req, rsp);
-		break;
-	case BMC_RESET_COLD:
-	case BMC_RESET_WARM:
-		rc = mc_reset(req, rsp);
-		break;
-	case BMC_SELFTEST:
-		rc = mc_selftest(req, rsp);
-		break;
-	case BMC_GET_DEVICE_GUID:
-		rc = mc_get_device_guid(req, rsp);
-		break;
-	case USER_GET_ACCESS:
-		rc = user_get_access(req, rsp);
-		break;
-	case USER_GET_NAME:
-		rc = user_get_name(req, rsp);
-		break;
-	case USER_SET_ACCESS:
-		rc = user_set_access(req, rsp);
-		break;
-	case USER_SET_NAME:
-		rc = user_set_name(req, rsp);
-		break;
-	case USER_SET_PASSWORD:
-		rc = user_set_password(req, rsp);
-		break;
-	default:
-		rsp->ccode = CC_CMD_INV;
-		rc = (-1);
-	}
+	pthread_mutex_unlock(&bmc->lock);
 	return rc;
 }
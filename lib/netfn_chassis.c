@@ -27,16 +27,51 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include "fake-ipmistack/fake-ipmistack.h"
+#include "fake-ipmistack/arena.h"
+#include "fake-ipmistack/bmc.h"
+#include "fake-ipmistack/helper.h"
+#include "fake-ipmistack/log.h"
+#include "fake-ipmistack/param.h"
 
-static uint8_t g_fp_buttons = 0x00;
-static uint8_t g_host_power_state = 0;
-static uint8_t g_led_identify = 0;
-static uint8_t g_pwr_restore_pol = 0x00;
-static uint8_t g_pwr_cycle_int = 0;
-/* 0x0-0xB */
-static uint8_t g_sys_restart_cause = 0xF1;
-static uint8_t g_poh_mins_pcount = 60;
-static uint32_t g_poh_counter = 28;
+#include <pthread.h>
+#include <string.h>
+
+# define SOFT_OFF_DELAY_MS 5000
+
+static const uint8_t boot_flags[] = { 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+/* (28.13) Boot Option Parameters */
+static const struct param_desc boot_param_desc[] = {
+	/* Service Partition Selector */
+	[1] = { 1, 0, 1, 0, NULL },
+	/* Service Partition Scan */
+	[2] = { 1, 0, 1, 0, NULL },
+	/* BMC Boot Flag Valid Bit Clearing */
+	[3] = { 1, 0, 1, 0, NULL },
+	/* Boot Info Acknowledge */
+	[4] = { 2, 0, 1, 0, NULL },
+	/* Boot Flags */
+	[5] = { 5, 0, 1, 0, boot_flags },
+	/* Boot Initiator Info */
+	[6] = { 9, 0, 1, 0, NULL },
+	/* Boot Initiator Mailbox, block selector and up to 16 bytes */
+	[7] = { 17, PARAM_VAR, 5, 0, NULL },
+};
+
+static struct param_family boot_params = {
+	.name = "Boot",
+	.revision = 0x01,
+	.count = sizeof(boot_param_desc) / sizeof(boot_param_desc[0]),
+	.desc = boot_param_desc,
+};
+
+/* BMCs with a power transition or Identify interval pending. Lock order is
+ * timers_lock, then bmc->lock.
+ */
+static pthread_mutex_t timers_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct bmc *timers_head = NULL;
+/* chassis_run_timers() has nothing to do before this */
+static uint64_t timers_due = UINT64_MAX;
 
 struct chassis_status {
 	uint8_t fp_buttons;
@@ -46,64 +81,226 @@ struct chassis_status {
 	uint8_t sys_restart_cause;
 };
 
-/* (28.3) Chassis Control */
+/* chassis_state_init - set Chassis NetFn state of a BMC to defaults.
+ *
+ * @chassis: state to initialize
+ */
+void
+chassis_state_init(struct chassis_state *chassis)
+{
+	memset(chassis, 0, sizeof(struct chassis_state));
+	chassis->pwr_transition = PWR_IDLE;
+	chassis->sys_restart_cause = 0xF1;
+	chassis->poh_mins_pcount = 60;
+	chassis->poh_counter = 28;
+	param_store_init(&chassis->boot, &boot_params);
+}
+
+/* chassis_timer_arm - make chassis_run_timers() look at the BMC. Caller
+ * must not hold bmc->lock.
+ *
+ * @bmc: BMC with a deadline pending
+ * @due: the deadline, ms
+ */
+static void
+chassis_timer_arm(struct bmc *bmc, uint64_t due)
+{
+	pthread_mutex_lock(&timers_lock);
+	if (!bmc->chassis.timer_armed) {
+		bmc->chassis.timer_armed = 1;
+		bmc->chassis.timer_next = timers_head;
+		timers_head = bmc;
+	}
+	if (due < timers_due) {
+		__atomic_store_n(&timers_due, due, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&timers_lock);
+}
+
+/* chassis_pending - return the earliest deadline of the BMC. Caller must
+ * hold bmc->lock.
+ *
+ * @bmc: BMC
+ *
+ * returns: deadline in ms, UINT64_MAX when nothing is pending
+ */
+static uint64_t
+chassis_pending(struct bmc *bmc)
+{
+	uint64_t next = UINT64_MAX;
+	if (bmc->chassis.pwr_transition != PWR_IDLE) {
+		next = bmc->chassis.pwr_deadline;
+	}
+	if (bmc->chassis.led_identify == 1
+			&& bmc->chassis.led_deadline < next) {
+		next = bmc->chassis.led_deadline;
+	}
+	return next;
+}
+
+/* chassis_expire - finish transitions whose deadline has passed. Caller must
+ * hold bmc->lock.
+ *
+ * @bmc: BMC
+ * @now: current time in ms, see monotonic_ms()
+ */
+static void
+chassis_expire(struct bmc *bmc, uint64_t now)
+{
+	struct chassis_state *chassis = &bmc->chassis;
+	if (chassis->pwr_transition != PWR_IDLE
+			&& now >= chassis->pwr_deadline) {
+		switch (chassis->pwr_transition) {
+		case PWR_CYCLE:
+		case PWR_HARD_RESET:
+			log_info("Host Power Up - %s done",
+					chassis->pwr_transition == PWR_CYCLE
+					? "Power Cycle" : "Hard Reset");
+			chassis->host_power_state = 1;
+			chassis->sys_restart_cause = 0xF1;
+			break;
+		case PWR_SOFT_OFF:
+			log_info("Host Power Off - Soft Shutdown done");
+			chassis->host_power_state = 0;
+			chassis->sys_restart_cause = 0xF1;
+			break;
+		default:
+			break;
+		}
+		chassis->pwr_transition = PWR_IDLE;
+	}
+	if (chassis->led_identify == 1 && now >= chassis->led_deadline) {
+		log_info("LED Identify - Off - interval expired");
+		chassis->led_identify = 0;
+	}
+}
+
+/* chassis_run_timers - finish expired power transitions and turn off
+ * Identify LEDs of all BMCs. Meant to be called from the event loop; it
+ * costs a single load until the earliest deadline has passed, then only
+ * BMCs with a deadline pending are visited.
+ *
+ * returns: ms until the next deadline, (-1) when nothing is pending
+ */
 int
-chassis_control(struct dummy_rq *req, struct dummy_rs *rsp)
+chassis_run_timers()
 {
-	if (req->msg.data_len != 1) {
-		rsp->ccode = CC_DATA_LEN;
+	struct bmc **link;
+	struct bmc *bmc;
+	uint64_t bmc_next;
+	uint64_t next = UINT64_MAX;
+	uint64_t now = monotonic_ms();
+	uint64_t due = __atomic_load_n(&timers_due, __ATOMIC_RELAXED);
+	if (due == UINT64_MAX) {
+		return (-1);
+	}
+	if (due > now) {
+		return (due - now > INT32_MAX) ? INT32_MAX : (int)(due - now);
+	}
+	pthread_mutex_lock(&timers_lock);
+	link = &timers_head;
+	while (*link != NULL) {
+		bmc = *link;
+		pthread_mutex_lock(&bmc->lock);
+		chassis_expire(bmc, now);
+		bmc_next = chassis_pending(bmc);
+		pthread_mutex_unlock(&bmc->lock);
+		if (bmc_next == UINT64_MAX) {
+			bmc->chassis.timer_armed = 0;
+			*link = bmc->chassis.timer_next;
+			continue;
+		}
+		if (bmc_next < next) {
+			next = bmc_next;
+		}
+		link = &bmc->chassis.timer_next;
+	}
+	__atomic_store_n(&timers_due, next, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&timers_lock);
+	if (next == UINT64_MAX) {
 		return (-1);
 	}
+	if (next <= now) {
+		return 0;
+	}
+	return (next - now > INT32_MAX) ? INT32_MAX : (int)(next - now);
+}
+
+/* (28.3) Chassis Control */
+int
+chassis_control(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	struct chassis_state *chassis = &bmc->chassis;
+	uint64_t due;
+	uint64_t now;
 	req->msg.data[0]|= 0xF0;
+	now = monotonic_ms();
+	pthread_mutex_lock(&bmc->lock);
+	chassis_expire(bmc, now);
 	switch (req->msg.data[0]) {
 	case 0xF0:
-		printf("[INFO] Host Power Off\n");
-		g_host_power_state = 0;
-		g_sys_restart_cause = 0xF1;
+		log_info("Host Power Off");
+		chassis->pwr_transition = PWR_IDLE;
+		chassis->host_power_state = 0;
+		chassis->sys_restart_cause = 0xF1;
 		break;
 	case 0xF1:
-		printf("[INFO] Host Power Up\n");
-		g_host_power_state = 1;
+		log_info("Host Power Up");
+		chassis->pwr_transition = PWR_IDLE;
+		chassis->host_power_state = 1;
 		break;
 	case 0xF2:
-		printf("[INFO] Host Power Cycle\n");
-		if (g_host_power_state == 0) {
+		log_info("Host Power Cycle");
+		if (chassis->host_power_state == 0) {
 			rsp->ccode = CC_EXEC_NA_STATE;
+			break;
 		}
-		g_sys_restart_cause = 0xF1;
-		sleep(g_pwr_cycle_int);
+		/* power goes off now and back on after the interval */
+		chassis->host_power_state = 0;
+		chassis->pwr_transition = PWR_CYCLE;
+		chassis->pwr_deadline = now + chassis->pwr_cycle_int * 1000ULL;
 		break;
 	case 0xF3:
-		printf("[INFO] Host Hard Reset\n");
-		g_sys_restart_cause = 0xF1;
-		sleep(g_pwr_cycle_int);
+		log_info("Host Hard Reset");
+		chassis->host_power_state = 0;
+		chassis->pwr_transition = PWR_HARD_RESET;
+		chassis->pwr_deadline = now + chassis->pwr_cycle_int * 1000ULL;
 		break;
 	case 0xF4:
-		printf("[INFO] Host Pulse Diag\n");
-		g_sys_restart_cause = 0xF1;
+		log_info("Host Pulse Diag");
+		chassis->sys_restart_cause = 0xF1;
 		break;
 	case 0xF5:
-		printf("[INFO] Host Soft Shutdown\n");
-		sleep(5);
-		g_host_power_state = 0;
-		g_sys_restart_cause = 0xF1;
+		log_info("Host Soft Shutdown");
+		if (chassis->host_power_state == 0) {
+			break;
+		}
+		chassis->pwr_transition = PWR_SOFT_OFF;
+		chassis->pwr_deadline = now + SOFT_OFF_DELAY_MS;
 		break;
 	default:
 		rsp->ccode = CC_DATA_FIELD_INV;
 		break;
 	}
+	due = chassis_pending(bmc);
+	pthread_mutex_unlock(&bmc->lock);
+	if (due != UINT64_MAX) {
+		chassis_timer_arm(bmc, due);
+	}
 	return 0;
 }
 
 /* (28.1) Get Chassis Capabilities */
 int
-chassis_get_capa(struct dummy_rq *req, struct dummy_rs *rsp)
+chassis_get_capa(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
 	uint8_t *data;
 	uint8_t data_len = 5 * sizeof(uint8_t);
-	data = malloc(data_len);
+	data = rsp_alloc(data_len);
 	if (data == NULL) {
-		perror("malloc fail");
+		perror("rsp_alloc fail");
 		rsp->ccode = CC_UNSPEC;
 		return (-1);
 	}
@@ -120,21 +317,25 @@ chassis_get_capa(struct dummy_rq *req, struct dummy_rs *rsp)
 
 /* (28.14) Get POH Counter */
 int
-chassis_get_poh_counter(struct dummy_rq *req, struct dummy_rs *rsp)
+chassis_get_poh_counter(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
+	struct chassis_state *chassis = &bmc->chassis;
 	uint8_t *data;
 	uint8_t data_len = 5 * sizeof(uint8_t);
-	data = malloc(data_len);
+	data = rsp_alloc(data_len);
 	if (data == NULL) {
-		perror("malloc fail");
+		perror("rsp_alloc fail");
 		rsp->ccode = CC_UNSPEC;
 		return (-1);
 	}
-	data[0] = g_poh_mins_pcount;
-	data[1] = g_poh_counter >> 0;
-	data[2] = g_poh_counter >> 8;
-	data[3] = g_poh_counter >> 16;
-	data[4] = g_poh_counter >> 24;
+	pthread_mutex_lock(&bmc->lock);
+	data[0] = chassis->poh_mins_pcount;
+	data[1] = chassis->poh_counter >> 0;
+	data[2] = chassis->poh_counter >> 8;
+	data[3] = chassis->poh_counter >> 16;
+	data[4] = chassis->poh_counter >> 24;
+	pthread_mutex_unlock(&bmc->lock);
 	rsp->data = data;
 	rsp->data_len = data_len;
 	return 0;
@@ -142,22 +343,30 @@ chassis_get_poh_counter(struct dummy_rq *req, struct dummy_rs *rsp)
 
 /* (28.2) Get Chassis Status */
 int
-chassis_get_status(struct dummy_rq *req, struct dummy_rs *rsp)
+chassis_get_status(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
-	/* TODO */
+	struct chassis_state *chassis = &bmc->chassis;
 	uint8_t *data;
 	uint8_t data_len = 4 * sizeof(uint8_t);
-	data = malloc(data_len);
+	data = rsp_alloc(data_len);
 	if (data == NULL) {
-		perror("malloc fail");
+		perror("rsp_alloc fail");
 		rsp->ccode = CC_UNSPEC;
 		return (-1);
 	}
-	data[0] = 0;
+	pthread_mutex_lock(&bmc->lock);
+	chassis_expire(bmc, monotonic_ms());
+	/* [0] - [6:5] restore policy, [0] power is on */
+	data[0] = (chassis->pwr_restore_pol << 5)
+		| (chassis->host_power_state & 0x01);
 	data[1] = 0;
-	data[2] = 0;
-	data[3] = 0;
-	data[4] = g_fp_buttons;
+	/* [2] - [5:4] identify state - off, temporary on, indefinite on */
+	data[2] = (chassis->led_identify & 0x03) << 4;
+	/* [6] - identify state is reported */
+	data[2]|= 0x40;
+	data[3] = chassis->fp_buttons;
+	pthread_mutex_unlock(&bmc->lock);
 	rsp->data = data;
 	rsp->data_len = data_len;
 	return 0;
@@ -165,25 +374,56 @@ chassis_get_status(struct dummy_rq *req, struct dummy_rs *rsp)
 
 /* (28.13) Get System Boot Options */
 int
-chassis_get_sysboot_opts(struct dummy_rq *req, struct dummy_rs *rsp)
+chassis_get_sysboot_opts(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
-	rsp->ccode = CC_EXEC_NA_PARAM;
+	struct chassis_state *chassis = &bmc->chassis;
+	uint8_t *data;
+	uint8_t selector = req->msg.data[0] & 0x7F;
+	uint8_t len = 0;
+	uint8_t ccode;
+	data = rsp_alloc(2 + PARAM_LEN_MAX);
+	if (data == NULL) {
+		perror("rsp_alloc fail");
+		rsp->ccode = CC_UNSPEC;
+		return (-1);
+	}
+	data[0] = chassis->boot.family->revision;
+	data[1] = selector;
+	pthread_mutex_lock(&bmc->lock);
+	ccode = param_get(&chassis->boot, selector, req->msg.data[1], &data[2],
+			&len);
+	if (selector < 32 && (chassis->boot_invalid & (1U << selector))) {
+		data[1] |= 0x80;
+	}
+	pthread_mutex_unlock(&bmc->lock);
+	if (ccode != CC_OK) {
+		rsp->ccode = ccode;
+		return (-1);
+	}
+	rsp->data = data;
+	rsp->data_len = 2 + len;
 	return 0;
 }
 
 /* (28.11) Get System Restart Cause */
 int
-chassis_get_sysres_cause(struct dummy_rq *req, struct dummy_rs *rsp)
+chassis_get_sysres_cause(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
+	struct chassis_state *chassis = &bmc->chassis;
 	uint8_t *data;
 	uint8_t data_len = 2 * sizeof(uint8_t);
-	data = malloc(data_len);
+	data = rsp_alloc(data_len);
 	if (data == NULL) {
-		perror("malloc fail");
+		perror("rsp_alloc fail");
 		rsp->ccode = CC_UNSPEC;
 		return (-1);
 	}
-	data[0] = g_sys_restart_cause;
+	pthread_mutex_lock(&bmc->lock);
+	chassis_expire(bmc, monotonic_ms());
+	data[0] = chassis->sys_restart_cause;
+	pthread_mutex_unlock(&bmc->lock);
 	data[1] = 0;
 	rsp->data = data;
 	rsp->data_len = data_len;
@@ -191,18 +431,16 @@ chassis_get_sysres_cause(struct dummy_rq *req, struct dummy_rs *rsp)
 }
 
 /* (28.5) Chassis Identify
- * Note: It would require a thread to turn LED Off after N seconds
- * Note: This is rather simplified logic of Chasiss Identify
+ * Note: LED is turned off by chassis_run_timers() once interval expires.
  */
 int
-chassis_identify(struct dummy_rq *req, struct dummy_rs *rsp)
+chassis_identify(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
+	struct chassis_state *chassis = &bmc->chassis;
+	uint64_t due;
 	int interval = 15;
 	int force = 0;
-	if (req->msg.data_len > 2) {
-		rsp->ccode = CC_DATA_FIELD_LEN;
-		return (-1);
-	}
 	if (req->msg.data_len >= 1) {
 		interval = req->msg.data[0];
 	}
@@ -210,27 +448,31 @@ chassis_identify(struct dummy_rq *req, struct dummy_rs *rsp)
 		force = req->msg.data[1];
 	}
 	force|= 0xFE;
-	/* Do pretty much nothing, because Identify LED should
-	 * be turned off by BMC after N seconds. And we can't
-	 * do that.
-	 * Except turning LED Off :o)
-	 */
+	pthread_mutex_lock(&bmc->lock);
 	if (force == 0xFF) {
-		printf("[INFO] LED Identify - Force On\n");
-		g_led_identify = 1;
+		log_info("LED Identify - Force On");
+		chassis->led_identify = 2;
 	} else if (interval == 0) {
-		printf("[INFO] LED Identify - Off\n");
-		g_led_identify = 0;
+		log_info("LED Identify - Off");
+		chassis->led_identify = 0;
 	} else if (interval > 0) {
-		printf("[INFO] LED Identify - On - %i seconds\n",
+		log_info("LED Identify - On - %i seconds",
 				interval);
+		chassis->led_identify = 1;
+		chassis->led_deadline = monotonic_ms() + interval * 1000ULL;
+	}
+	due = chassis_pending(bmc);
+	pthread_mutex_unlock(&bmc->lock);
+	if (due != UINT64_MAX) {
+		chassis_timer_arm(bmc, due);
 	}
 	return 0;
 }
 
 /* (28.4) Chassis Reset - superseded by (28.3) Chassis Control */
 int
-chassis_reset(struct dummy_rq *req, struct dummy_rs *rsp)
+chassis_reset(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
 	rsp->ccode = CC_EXEC_NA_PARAM;
 	return 0;
@@ -238,7 +480,8 @@ chassis_reset(struct dummy_rq *req, struct dummy_rs *rsp)
 
 /* (28.7) Set Chassis Capabilities */
 int
-chassis_set_capa(struct dummy_rq *req, struct dummy_rs *rsp)
+chassis_set_capa(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
 	/* TODO */
 	rsp->ccode = CC_EXEC_NA_PARAM;
@@ -247,102 +490,100 @@ chassis_set_capa(struct dummy_rq *req, struct dummy_rs *rsp)
 
 /* (28.6) Set Front Panel Enables */
 int
-chassis_set_fp_buttons(struct dummy_rq *req, struct dummy_rs *rsp)
+chassis_set_fp_buttons(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
+	struct chassis_state *chassis = &bmc->chassis;
 	uint8_t tmp_fpb;
-	if (req->msg.data_len != 1) {
-		rsp->ccode = CC_DATA_LEN;
-		return (-1);
-	}
 	req->msg.data[0]|= 0xF0;
+	pthread_mutex_lock(&bmc->lock);
 	/* disable/enable Stand by */
 	if ((req->msg.data[0] & 0x08) == 0x08) {
-		g_fp_buttons|= 0xF8;
+		chassis->fp_buttons|= 0xF8;
 	} else {
-		tmp_fpb = ~g_fp_buttons;
+		tmp_fpb = ~chassis->fp_buttons;
 		tmp_fpb|= 0x08;
-		g_fp_buttons = ~tmp_fpb;
+		chassis->fp_buttons = ~tmp_fpb;
 	}
 	/* disable/enable Diagnostic */
 	if ((req->msg.data[0] & 0x04) == 0x04) {
-		g_fp_buttons|= 0xF4;
+		chassis->fp_buttons|= 0xF4;
 	} else {
-		tmp_fpb = ~g_fp_buttons;
+		tmp_fpb = ~chassis->fp_buttons;
 		tmp_fpb|= 0x04;
-		g_fp_buttons = ~tmp_fpb;
+		chassis->fp_buttons = ~tmp_fpb;
 	}
 	/* disable/enable Reset */
 	if ((req->msg.data[0] & 0x02) == 0x02) {
-		g_fp_buttons|= 0xF2;
+		chassis->fp_buttons|= 0xF2;
 	} else {
-		tmp_fpb = ~g_fp_buttons;
+		tmp_fpb = ~chassis->fp_buttons;
 		tmp_fpb|= 0x02;
-		g_fp_buttons = ~tmp_fpb;
+		chassis->fp_buttons = ~tmp_fpb;
 	}
 	/* disable/enable Power off */
 	if ((req->msg.data[0] & 0x01) == 0x01) {
-		g_fp_buttons|=0xF1;
+		chassis->fp_buttons|=0xF1;
 	} else {
-		tmp_fpb = ~g_fp_buttons;
+		tmp_fpb = ~chassis->fp_buttons;
 		tmp_fpb|= 0x01;
-		g_fp_buttons = ~tmp_fpb;
+		chassis->fp_buttons = ~tmp_fpb;
 	}
+	pthread_mutex_unlock(&bmc->lock);
 	return 0;
 }
 
 /* (28.9) Set Power Cycle Interval */
 int
-chassis_set_pwr_cycle_int(struct dummy_rq *req, struct dummy_rs *rsp)
+chassis_set_pwr_cycle_int(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
-	if (req->msg.data_len != 1) {
-		rsp->ccode = CC_DATA_LEN;
-		return (-1);
-	}
-	g_pwr_cycle_int = rsp->data[0];
+	struct chassis_state *chassis = &bmc->chassis;
+	pthread_mutex_lock(&bmc->lock);
+	chassis->pwr_cycle_int = req->msg.data[0];
+	pthread_mutex_unlock(&bmc->lock);
 	return 0;
 }
 
 /* (28.8) Set Power Restore Policy */
 int
-chassis_set_pwr_restore_pol(struct dummy_rq *req, struct dummy_rs *rsp)
+chassis_set_pwr_restore_pol(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
+	struct chassis_state *chassis = &bmc->chassis;
 	uint8_t *data;
 	uint8_t data_len = 1 * sizeof(uint8_t);
-	if (req->msg.data_len != 1) {
-		rsp->ccode = CC_DATA_LEN;
-		return (-1);
-	}
-	data = malloc(data_len);
+	data = rsp_alloc(data_len);
 	if (data == NULL) {
-		perror("malloc fail");
+		perror("rsp_alloc fail");
 		rsp->ccode = CC_UNSPEC;
 		return (-1);
 	}
 	req->msg.data[0]|= 0xF8;
+	pthread_mutex_lock(&bmc->lock);
 	switch (req->msg.data[0]) {
 	case 0xFB:
 		/* do nothing */
 		break;
 	case 0xFA:
-		printf("[INFO] PWR Restore Policy - On\n");
-		g_pwr_restore_pol = 0x02;
+		log_info("PWR Restore Policy - On");
+		chassis->pwr_restore_pol = 0x02;
 		break;
 	case 0xF9:
-		printf("[INFO] PWR Restore Policy - Last\n");
-		g_pwr_restore_pol = 0x01;
+		log_info("PWR Restore Policy - Last");
+		chassis->pwr_restore_pol = 0x01;
 		break;
 	case 0xF8:
-		printf("[INFO] PWR Restore Policy - Off\n");
-		g_pwr_restore_pol = 0x00;
+		log_info("PWR Restore Policy - Off");
+		chassis->pwr_restore_pol = 0x00;
 		break;
 	default:
 		rsp->ccode = CC_DATA_FIELD_INV;
 		break;
 	}
+	pthread_mutex_unlock(&bmc->lock);
 
 	if (rsp->ccode != 0) {
-		free(data);
-		data = NULL;
 		return (-1);
 	}
 	data[0] = 0xFF;
@@ -353,66 +594,28 @@ chassis_set_pwr_restore_pol(struct dummy_rq *req, struct dummy_rs *rsp)
 
 /* (28.12) Set System Boot Options */
 int
-chassis_set_sysboot_opts(struct dummy_rq *req, struct dummy_rs *rsp)
+chassis_set_sysboot_opts(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
-	/* TODO */
-	rsp->ccode = CC_EXEC_NA_PARAM;
-	return 0;
-}
-
-int
-netfn_chassis_main(struct dummy_rq *req, struct dummy_rs *rsp)
-{
-	int rc = 0;
-	rsp->msg.netfn = req->msg.netfn + 1;
-	rsp->msg.cmd = req->msg.cmd;
-	rsp->msg.lun = req->msg.lun;
-	rsp->ccode = CC_OK;
-	rsp->data_len = 0;
-	rsp->data = NULL;
-	switch (req->msg.cmd) {
-	case CHASSIS_CONTROL:
-		rc = chassis_control(req, rsp);
-		break;
-	case CHASSIS_GET_CAPA:
-		rc = chassis_get_capa(req, rsp);
-		break;
-	case CHASSIS_GET_POH_COUNTER:
-		rc = chassis_get_poh_counter(req, rsp);
-		break;
-	case CHASSIS_GET_STATUS:
-		rc = chassis_get_status(req, rsp);
-		break;
-	case CHASSIS_GET_SYSBOOT_OPTS:
-		rc = chassis_get_sysboot_opts(req, rsp);
-		break;
-	case CHASSIS_GET_SYSRES_CAUSE:
-		rc = chassis_get_sysres_cause(req, rsp);
-		break;
-	case CHASSIS_IDENTIFY:
-		rc = chassis_identify(req, rsp);
-		break;
-	case CHASSIS_RESET:
-		rc = chassis_reset(req, rsp);
-		break;
-	case CHASSIS_SET_CAPA:
-		rc = chassis_set_capa(req, rsp);
-		break;
-	case CHASSIS_SET_FP_BUTTONS:
-		rc = chassis_set_fp_buttons(req, rsp);
-		break;
-	case CHASSIS_SET_PWR_CYCLE_INT:
-		rc = chassis_set_pwr_cycle_int(req, rsp);
-		break;
-	case CHASSIS_SET_PWR_RESTORE_POL:
-		rc = chassis_set_pwr_restore_pol(req, rsp);
-		break;
-	case CHASSIS_SET_SYSBOOT_OPTS:
-		rc = chassis_set_sysboot_opts(req, rsp);
-		break;
-	default:
-		rsp->ccode = CC_CMD_INV;
-		rc = (-1);
+	struct chassis_state *chassis = &bmc->chassis;
+	uint8_t selector = req->msg.data[0] & 0x7F;
+	uint8_t ccode;
+	if (req->msg.data_len > 1 + PARAM_LEN_MAX) {
+		rsp->ccode = CC_DATA_LEN;
+		return (-1);
+	}
+	pthread_mutex_lock(&bmc->lock);
+	ccode = param_set(&chassis->boot, selector, &req->msg.data[1],
+			req->msg.data_len - 1);
+	/* bit 7 - mark parameter invalid/locked */
+	if (ccode == CC_OK && selector < 32) {
+		if (req->msg.data[0] & 0x80) {
+			chassis->boot_invalid |= 1U << selector;
+		} else {
+			chassis->boot_invalid &= ~(1U << selector);
+		}
 	}
-	return rc;
+	pthread_mutex_unlock(&bmc->lock);
+	rsp->ccode = ccode;
+	return ccode == CC_OK ? 0 : (-1);
 }
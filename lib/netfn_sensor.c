@@ -27,47 +27,375 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include "fake-ipmistack/fake-ipmistack.h"
+#include "fake-ipmistack/arena.h"
+#include "fake-ipmistack/bmc.h"
+#include "fake-ipmistack/helper.h"
+#include "fake-ipmistack/log.h"
+#include "fake-ipmistack/netfn_sensor.h"
+#include "fake-ipmistack/netfn_storage.h"
+#include "fake-ipmistack/param.h"
+#include "fake-ipmistack/sensor.h"
+
+# define PEF_FILTERS 8
+# define PEF_POLICIES 8
+# define PEF_ALERT_STRINGS 2
+
+static const uint8_t pef_control[] = { 0x01 };
+static const uint8_t pef_startup_delay[] = { 0x3C };
+static const uint8_t pef_filters[] = { PEF_FILTERS };
+static const uint8_t pef_policies[] = { PEF_POLICIES };
+static const uint8_t pef_alert_strings[] = { PEF_ALERT_STRINGS };
+
+/* (30.4) PEF Configuration Parameters */
+static const struct param_desc pef_param_desc[] = {
+	/* PEF Control */
+	[1] = { 1, 0, 1, 0, pef_control },
+	/* PEF Action Global Control */
+	[2] = { 1, 0, 1, 0, NULL },
+	/* PEF Startup Delay */
+	[3] = { 1, 0, 1, 0, pef_startup_delay },
+	/* PEF Alert Startup Delay */
+	[4] = { 1, 0, 1, 0, pef_startup_delay },
+	/* Number of Event Filters */
+	[5] = { 1, PARAM_RO, 1, 0, pef_filters },
+	/* Event Filter Table */
+	[6] = { 21, 0, PEF_FILTERS, 1, NULL },
+	/* Event Filter Table Data 1 */
+	[7] = { 2, 0, PEF_FILTERS, 1, NULL },
+	/* Number of Alert Policy Entries */
+	[8] = { 1, PARAM_RO, 1, 0, pef_policies },
+	/* Alert Policy Table */
+	[9] = { 4, 0, PEF_POLICIES, 1, NULL },
+	/* System GUID */
+	[10] = { 17, 0, 1, 0, NULL },
+	/* Number of Alert Strings */
+	[11] = { 1, PARAM_RO, 1, 0, pef_alert_strings },
+	/* Alert String Keys, set 0 is volatile */
+	[12] = { 3, 0, PEF_ALERT_STRINGS + 1, 0, NULL },
+};
+
+static struct param_family pef_params = {
+	.name = "PEF",
+	.revision = 0x11,
+	.count = sizeof(pef_param_desc) / sizeof(pef_param_desc[0]),
+	.desc = pef_param_desc,
+};
+
+/* sensor_state_init - set Sensor/Event NetFn state of a BMC to defaults.
+ * Sensor table itself is allocated on the first request for a sensor.
+ *
+ * @sensor: state to initialize
+ */
+void
+sensor_state_init(struct sensor_state *sensor)
+{
+	memset(sensor, 0, sizeof(struct sensor_state));
+	param_store_init(&sensor->pef, &pef_params);
+}
+
+/* sensor_resolve - find index of the requested sensor in BMC's table,
+ * allocating the table if needed. Caller holds bmc->lock.
+ *
+ * returns sensor index, SENSOR_NONE with ccode set on error
+ */
+static uint16_t
+sensor_resolve(struct bmc *bmc, struct dummy_rq *req, struct dummy_rs *rsp)
+{
+	uint16_t idx;
+	idx = sensor_lookup(req->msg.lun, req->msg.data[0]);
+	if (idx == SENSOR_NONE) {
+		rsp->ccode = CC_SDR_NA;
+		return SENSOR_NONE;
+	}
+	if (sensor_table_alloc(&bmc->sensor.table, bmc->sensor.presets,
+				bmc->sensor.preset_count) != 0) {
+		rsp->ccode = CC_UNSPEC;
+		return SENSOR_NONE;
+	}
+	return idx;
+}
+
+/* sensor_settle - evaluate thresholds of a range of sensors and log
+ * crossings to BMC's SEL. Caller holds bmc->lock.
+ */
+static void
+sensor_settle(struct bmc *bmc, uint32_t from, uint32_t to)
+{
+	struct sensor_table *table = &bmc->sensor.table;
+	sensor_eval(table, from, to);
+	if (sensor_log_events(table, from, to, sel_time_now(bmc),
+				&bmc->storage.sel) < 0) {
+		log_warn("BMC %" PRIu32 ": sensor events lost.", bmc->id);
+	}
+}
+
+/* sensor_scan - bring readings of all sensors following a generator up to
+ * date and log threshold crossings, at most once per SENSOR_SCAN_MS. It is
+ * called whenever SEL is looked at, so events of sensors nobody reads show
+ * up too. Caller holds bmc->lock.
+ *
+ * @bmc: BMC
+ */
+void
+sensor_scan(struct bmc *bmc)
+{
+	struct sensor_table *table = &bmc->sensor.table;
+	uint64_t now;
+	uint32_t i;
+	if (table->gen == NULL) {
+		/* nothing changes on its own */
+		return;
+	}
+	now = monotonic_ms();
+	if (now - bmc->sensor.scan_ms < SENSOR_SCAN_MS) {
+		return;
+	}
+	bmc->sensor.scan_ms = now;
+	for (i = 0; i < table->count; i++) {
+		sensor_update(table, i, now);
+	}
+	sensor_settle(bmc, 0, table->count);
+}
 
 /* (30.1) PEF Get Capabilities Command */
 int
-pef_get_capabilities(struct dummy_rq *req, struct dummy_rs *rsp)
+pef_get_capabilities(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
 	uint8_t *data;
 	uint8_t data_len = 3 * sizeof(uint8_t);
-	data = malloc(data_len);
+	data = rsp_alloc(data_len);
 	if (data == NULL) {
 		rsp->ccode = CC_UNSPEC;
-		perror("malloc fail");
+		perror("rsp_alloc fail");
 		return (-1);
 	}
 	/* v1.5 */
 	data[0] = 0x51;
 	/* support everything */
 	data[1] = 0xBF;
-	data[2] = 1;
+	data[2] = PEF_FILTERS;
 	rsp->data = data;
 	rsp->data_len = data_len;
 	rsp->ccode = CC_OK;
 	return 0;
 }
 
+/* (35.9) Get Sensor Thresholds Command */
 int
-netfn_sensor_main(struct dummy_rq *req, struct dummy_rs *rsp)
+sensor_get_thresholds(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
-	int rc = 0;
-	rsp->msg.netfn = req->msg.netfn + 1;
-	rsp->msg.cmd = req->msg.cmd;
-	rsp->msg.lun = req->msg.lun;
+	struct sensor_table *table = &bmc->sensor.table;
+	uint8_t *data;
+	uint8_t data_len = (1 + SENSOR_THR_COUNT) * sizeof(uint8_t);
+	uint16_t idx;
+	int t;
+	data = rsp_alloc(data_len);
+	if (data == NULL) {
+		rsp->ccode = CC_UNSPEC;
+		perror("rsp_alloc fail");
+		return (-1);
+	}
+	pthread_mutex_lock(&bmc->lock);
+	idx = sensor_resolve(bmc, req, rsp);
+	if (idx == SENSOR_NONE) {
+		pthread_mutex_unlock(&bmc->lock);
+		return (-1);
+	}
+	data[0] = SENSOR_THR_READABLE;
+	for (t = 0; t < SENSOR_THR_COUNT; t++) {
+		data[1 + t] = table->thr[t][idx];
+	}
+	pthread_mutex_unlock(&bmc->lock);
+	rsp->data = data;
+	rsp->data_len = data_len;
 	rsp->ccode = CC_OK;
-	rsp->data_len = 0;
-	rsp->data = NULL;
-	switch (req->msg.cmd) {
-	case PEF_GET_CAPABILITIES:
-		rc = pef_get_capabilities(req, rsp);
-		break;
-	default:
-		rsp->ccode = CC_CMD_INV;
-		rc = (-1);
-	}
-	return rc;
+	return 0;
+}
+
+/* (35.13) Get Sensor Event Status Command */
+int
+sensor_get_event_status(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	struct sensor_table *table = &bmc->sensor.table;
+	uint8_t *data;
+	uint8_t data_len = 5 * sizeof(uint8_t);
+	uint16_t events = 0;
+	uint16_t idx;
+	uint8_t status;
+	int t;
+	data = rsp_alloc(data_len);
+	if (data == NULL) {
+		rsp->ccode = CC_UNSPEC;
+		perror("rsp_alloc fail");
+		return (-1);
+	}
+	pthread_mutex_lock(&bmc->lock);
+	idx = sensor_resolve(bmc, req, rsp);
+	if (idx == SENSOR_NONE) {
+		pthread_mutex_unlock(&bmc->lock);
+		return (-1);
+	}
+	sensor_update(table, idx, monotonic_ms());
+	sensor_settle(bmc, idx, idx + 1);
+	data[0] = table->flags[idx];
+	status = table->status[idx];
+	pthread_mutex_unlock(&bmc->lock);
+	/* event bit 2t is going-low, 2t + 1 going-high of threshold t */
+	for (t = 0; t < SENSOR_THR_COUNT; t++) {
+		if (!(status & (1 << t))) {
+			continue;
+		}
+		if (t <= SENSOR_THR_LNR) {
+			events |= 1 << (2 * t);
+		} else {
+			events |= 1 << (2 * t + 1);
+		}
+	}
+	data[1] = events & 0xFF;
+	data[2] = events >> 8;
+	/* nothing has been deasserted */
+	data[3] = 0;
+	data[4] = 0;
+	rsp->data = data;
+	rsp->data_len = data_len;
+	rsp->ccode = CC_OK;
+	return 0;
+}
+
+/* (35.14) Get Sensor Reading Command */
+int
+sensor_get_reading(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	struct sensor_table *table = &bmc->sensor.table;
+	uint8_t *data;
+	uint8_t data_len = 3 * sizeof(uint8_t);
+	uint16_t idx;
+	data = rsp_alloc(data_len);
+	if (data == NULL) {
+		rsp->ccode = CC_UNSPEC;
+		perror("rsp_alloc fail");
+		return (-1);
+	}
+	pthread_mutex_lock(&bmc->lock);
+	idx = sensor_resolve(bmc, req, rsp);
+	if (idx == SENSOR_NONE) {
+		pthread_mutex_unlock(&bmc->lock);
+		return (-1);
+	}
+	sensor_update(table, idx, monotonic_ms());
+	sensor_settle(bmc, idx, idx + 1);
+	data[0] = table->raw[idx];
+	data[1] = table->flags[idx];
+	data[2] = table->status[idx];
+	pthread_mutex_unlock(&bmc->lock);
+	rsp->data = data;
+	rsp->data_len = data_len;
+	rsp->ccode = CC_OK;
+	return 0;
+}
+
+/* Set Sensor Generator, OEM extension of Sensor/Event NetFn
+ *
+ * Request: sensor number, generator kind, base reading, amplitude, period
+ * in ms LS byte first and, for SENSOR_GEN_TRACE, 1 to SENSOR_TRACE_MAX
+ * samples.
+ */
+int
+sensor_set_generator(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	struct sensor_gen gen;
+	uint16_t idx;
+	int rc;
+	memset(&gen, 0, sizeof(gen));
+	gen.kind = req->msg.data[1];
+	gen.base = req->msg.data[2];
+	gen.amplitude = req->msg.data[3];
+	gen.period_ms = req->msg.data[4] | (req->msg.data[5] << 8)
+		| (req->msg.data[6] << 16)
+		| ((uint32_t)req->msg.data[7] << 24);
+	if (gen.kind >= SENSOR_GEN_COUNT
+			|| (gen.kind != SENSOR_GEN_CONST && gen.period_ms == 0)) {
+		rsp->ccode = CC_DATA_FIELD_INV;
+		return (-1);
+	}
+	if (gen.kind == SENSOR_GEN_TRACE) {
+		if (req->msg.data_len == 8) {
+			rsp->ccode = CC_DATA_LEN;
+			return (-1);
+		}
+		gen.trace = &req->msg.data[8];
+		gen.trace_len = req->msg.data_len - 8;
+	}
+	pthread_mutex_lock(&bmc->lock);
+	idx = sensor_resolve(bmc, req, rsp);
+	if (idx == SENSOR_NONE) {
+		pthread_mutex_unlock(&bmc->lock);
+		return (-1);
+	}
+	rc = sensor_gen_attach(&bmc->sensor.table, idx, &gen,
+			monotonic_ms());
+	if (rc == 0) {
+		sensor_settle(bmc, idx, idx + 1);
+	}
+	pthread_mutex_unlock(&bmc->lock);
+	if (rc != 0) {
+		rsp->ccode = CC_UNSPEC;
+		return (-1);
+	}
+	rsp->ccode = CC_OK;
+	return 0;
+}
+
+/* (30.3) Set PEF Configuration Parameters */
+int
+pef_set_config(struct bmc *bmc, struct dummy_rq *req, struct dummy_rs *rsp)
+{
+	uint8_t ccode;
+	if (req->msg.data_len > 1 + PARAM_LEN_MAX) {
+		rsp->ccode = CC_DATA_LEN;
+		return (-1);
+	}
+	pthread_mutex_lock(&bmc->lock);
+	ccode = param_set(&bmc->sensor.pef, req->msg.data[0] & 0x7F,
+			&req->msg.data[1], req->msg.data_len - 1);
+	pthread_mutex_unlock(&bmc->lock);
+	rsp->ccode = ccode;
+	return ccode == CC_OK ? 0 : (-1);
+}
+
+/* (30.4) Get PEF Configuration Parameters */
+int
+pef_get_config(struct bmc *bmc, struct dummy_rq *req, struct dummy_rs *rsp)
+{
+	struct param_store *store = &bmc->sensor.pef;
+	uint8_t *data;
+	uint8_t len = 0;
+	uint8_t ccode;
+	data = rsp_alloc(1 + PARAM_LEN_MAX);
+	if (data == NULL) {
+		rsp->ccode = CC_UNSPEC;
+		perror("rsp_alloc fail");
+		return (-1);
+	}
+	data[0] = store->family->revision;
+	/* bit 7 - get parameter revision only */
+	if (!(req->msg.data[0] & 0x80)) {
+		pthread_mutex_lock(&bmc->lock);
+		ccode = param_get(store, req->msg.data[0], req->msg.data[1],
+				&data[1], &len);
+		pthread_mutex_unlock(&bmc->lock);
+		if (ccode != CC_OK) {
+			rsp->ccode = ccode;
+			return (-1);
+		}
+	}
+	rsp->data = data;
+	rsp->data_len = 1 + len;
+	rsp->ccode = CC_OK;
+	return 0;
 }
@@ -27,81 +27,575 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include "fake-ipmistack/fake-ipmistack.h"
+#include "fake-ipmistack/arena.h"
+#include "fake-ipmistack/bmc.h"
+#include "fake-ipmistack/log.h"
+#include "fake-ipmistack/sdr.h"
+
+#include <pthread.h>
+#include <string.h>
 #include <time.h>
 
-static uint8_t bmc_time[4];
+/* storage_state_init - set Storage NetFn state of a BMC to defaults.
+ *
+ * @storage: state to initialize
+ */
+void
+storage_state_init(struct storage_state *storage)
+{
+	memset(storage, 0, sizeof(struct storage_state));
+	sel_init(&storage->sel);
+}
 
-/* (31.10) Get SEL Time */
+/* sel_time_now - returns SEL time of BMC, caller holds bmc->lock */
+uint32_t
+sel_time_now(struct bmc *bmc)
+{
+	return bmc->storage.sel_time[0] | (bmc->storage.sel_time[1] << 8)
+		| (bmc->storage.sel_time[2] << 16)
+		| ((uint32_t)bmc->storage.sel_time[3] << 24);
+}
+
+/* (34.1) Get FRU Inventory Area Info */
 int
-sel_get_time(struct dummy_rq *req, struct dummy_rs *rsp)
+fru_get_area_info(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
-	static char tbuf[40];
+	size_t size;
 	uint8_t *data;
-	uint8_t data_len = 4 * sizeof(uint8_t);
-	data = malloc(data_len);
+	uint8_t data_len = 3 * sizeof(uint8_t);
+	size = fru_size(&bmc->storage.fru, req->msg.data[0]);
+	if (size == 0) {
+		rsp->ccode = CC_SDR_NA;
+		return (-1);
+	}
+	data = rsp_alloc(data_len);
 	if (data == NULL) {
 		rsp->ccode = CC_UNSPEC;
-		perror("malloc fail");
+		perror("rsp_alloc fail");
 		return (-1);
 	}
-	data[0] = bmc_time[0];
-	data[1] = bmc_time[1];
-	data[2] = bmc_time[2];
-	data[3] = bmc_time[3];
+	data[0] = size & 0xFF;
+	data[1] = size >> 8;
+	/* accessed by bytes */
+	data[2] = 0x00;
 	rsp->data = data;
 	rsp->data_len = data_len;
-	rsp->ccode = CC_OK;
+	return 0;
+}
 
-	strftime(tbuf, sizeof(tbuf), "%m/%d/%Y %H:%M:%S",
-			gmtime((time_t *)data));
-	printf("Time sent to client: %s\n", tbuf);
+/* (34.2) Read FRU Data */
+int
+fru_read_data(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	const uint8_t *fru;
+	size_t size;
+	uint16_t offset;
+	uint8_t *data;
+	uint8_t count;
+	uint8_t dev_id = req->msg.data[0];
+	offset = req->msg.data[1] | (req->msg.data[2] << 8);
+	count = req->msg.data[3];
+	size = fru_size(&bmc->storage.fru, dev_id);
+	if (size == 0) {
+		rsp->ccode = CC_SDR_NA;
+		return (-1);
+	}
+	if (offset >= size) {
+		rsp->ccode = CC_PARAM_OOR;
+		return (-1);
+	}
+	if (offset + count > size) {
+		count = size - offset;
+	}
+	data = rsp_alloc(1 + count);
+	if (data == NULL) {
+		rsp->ccode = CC_UNSPEC;
+		perror("rsp_alloc fail");
+		return (-1);
+	}
+	pthread_mutex_lock(&bmc->lock);
+	fru = fru_data(&bmc->storage.fru, dev_id);
+	memcpy(data + 1, fru + offset, count);
+	pthread_mutex_unlock(&bmc->lock);
+	data[0] = count;
+	rsp->data = data;
+	rsp->data_len = 1 + count;
 	return 0;
 }
 
-/* (31.11) Set SEL Time */
+/* (34.3) Write FRU Data */
+int
+fru_write_data(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	uint8_t *fru;
+	size_t size;
+	uint16_t offset;
+	uint8_t *data;
+	uint8_t count;
+	uint8_t dev_id = req->msg.data[0];
+	offset = req->msg.data[1] | (req->msg.data[2] << 8);
+	count = req->msg.data_len - 3;
+	size = fru_size(&bmc->storage.fru, dev_id);
+	if (size == 0) {
+		rsp->ccode = CC_SDR_NA;
+		return (-1);
+	}
+	if (offset >= size) {
+		rsp->ccode = CC_PARAM_OOR;
+		return (-1);
+	}
+	if (offset + count > size) {
+		count = size - offset;
+	}
+	data = rsp_alloc(1);
+	if (data == NULL) {
+		rsp->ccode = CC_UNSPEC;
+		perror("rsp_alloc fail");
+		return (-1);
+	}
+	pthread_mutex_lock(&bmc->lock);
+	fru = fru_data_writable(&bmc->storage.fru, dev_id);
+	if (fru == NULL) {
+		pthread_mutex_unlock(&bmc->lock);
+		rsp->ccode = CC_UNSPEC;
+		return (-1);
+	}
+	memcpy(fru + offset, req->msg.data + 3, count);
+	pthread_mutex_unlock(&bmc->lock);
+	log_info("FRU device %" PRIu8 ": %" PRIu8 " bytes written at %"
+			PRIu16, dev_id, count, offset);
+	data[0] = count;
+	rsp->data = data;
+	rsp->data_len = 1;
+	return 0;
+}
+
+/* (33.9) Get SDR Repository Info */
+int
+sdr_get_info(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	const struct sdr_repo *repo = sdr_repo();
+	uint8_t *data;
+	uint8_t data_len = 14 * sizeof(uint8_t);
+	data = rsp_alloc(data_len);
+	if (data == NULL) {
+		rsp->ccode = CC_UNSPEC;
+		perror("rsp_alloc fail");
+		return (-1);
+	}
+	data[0] = SDR_VERSION;
+	data[1] = repo->count & 0xFF;
+	data[2] = (repo->count >> 8) & 0xFF;
+	/* repository is read-only, there is no free space */
+	data[3] = 0x00;
+	data[4] = 0x00;
+	data[5] = repo->add_ts & 0xFF;
+	data[6] = (repo->add_ts >> 8) & 0xFF;
+	data[7] = (repo->add_ts >> 16) & 0xFF;
+	data[8] = repo->add_ts >> 24;
+	data[9] = repo->erase_ts & 0xFF;
+	data[10] = (repo->erase_ts >> 8) & 0xFF;
+	data[11] = (repo->erase_ts >> 16) & 0xFF;
+	data[12] = repo->erase_ts >> 24;
+	data[13] = SDR_OP_RESERVE | SDR_OP_ALLOC_INFO;
+	rsp->data = data;
+	rsp->data_len = data_len;
+	return 0;
+}
+
+/* (33.10) Get SDR Repository Allocation Info */
+int
+sdr_get_alloc_info(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	const struct sdr_repo *repo = sdr_repo();
+	uint32_t units = repo->units > 0xFFFE ? 0xFFFE : repo->units;
+	uint8_t *data;
+	uint8_t data_len = 9 * sizeof(uint8_t);
+	data = rsp_alloc(data_len);
+	if (data == NULL) {
+		rsp->ccode = CC_UNSPEC;
+		perror("rsp_alloc fail");
+		return (-1);
+	}
+	memset(data, 0, data_len);
+	data[0] = units & 0xFF;
+	data[1] = units >> 8;
+	data[2] = SDR_ALLOC_UNIT;
+	data[3] = 0x00;
+	/* data[4-7] - no free units, no free block */
+	data[8] = (SDR_RECORD_MAX + SDR_ALLOC_UNIT - 1) / SDR_ALLOC_UNIT;
+	rsp->data = data;
+	rsp->data_len = data_len;
+	return 0;
+}
+
+/* (33.11) Reserve SDR Repository */
+int
+sdr_reserve(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	uint16_t resv;
+	uint8_t *data;
+	uint8_t data_len = 2 * sizeof(uint8_t);
+	data = rsp_alloc(data_len);
+	if (data == NULL) {
+		rsp->ccode = CC_UNSPEC;
+		perror("rsp_alloc fail");
+		return (-1);
+	}
+	pthread_mutex_lock(&bmc->lock);
+	bmc->storage.sdr_resv_last++;
+	if (bmc->storage.sdr_resv_last == 0) {
+		bmc->storage.sdr_resv_last = 1;
+	}
+	resv = bmc->storage.sdr_resv = bmc->storage.sdr_resv_last;
+	pthread_mutex_unlock(&bmc->lock);
+	data[0] = resv & 0xFF;
+	data[1] = resv >> 8;
+	rsp->data = data;
+	rsp->data_len = data_len;
+	return 0;
+}
+
+/* (33.12) Get SDR */
+int
+sdr_get_record(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	const uint8_t *rec;
+	uint16_t id;
+	uint16_t len;
+	uint16_t next;
+	uint16_t resv;
+	uint8_t *data;
+	uint8_t count;
+	uint8_t offset;
+	resv = req->msg.data[0] | (req->msg.data[1] << 8);
+	id = req->msg.data[2] | (req->msg.data[3] << 8);
+	offset = req->msg.data[4];
+	count = req->msg.data[5];
+	/* reservation is needed for partial reads only */
+	if (offset != 0) {
+		pthread_mutex_lock(&bmc->lock);
+		if (resv == 0 || resv != bmc->storage.sdr_resv) {
+			pthread_mutex_unlock(&bmc->lock);
+			rsp->ccode = CC_RESV_INV;
+			return (-1);
+		}
+		pthread_mutex_unlock(&bmc->lock);
+	}
+	rec = sdr_lookup(id, &next, &len);
+	if (rec == NULL) {
+		rsp->ccode = CC_SDR_NA;
+		return (-1);
+	}
+	if (count == 0xFF && offset < len) {
+		count = len - offset;
+	}
+	if (offset + count > len) {
+		rsp->ccode = CC_BYTES_NA;
+		return (-1);
+	}
+	data = rsp_alloc(2 + count);
+	if (data == NULL) {
+		rsp->ccode = CC_UNSPEC;
+		perror("rsp_alloc fail");
+		return (-1);
+	}
+	data[0] = next & 0xFF;
+	data[1] = next >> 8;
+	memcpy(data + 2, rec + offset, count);
+	rsp->data = data;
+	rsp->data_len = 2 + count;
+	return 0;
+}
+
+/* (31.2) Get SEL Info */
 int
-sel_set_time(struct dummy_rq *req, struct dummy_rs *rsp)
+sel_get_info(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
-	static char tbuf[40];
-	if (req->msg.data_len != 4) {
-		rsp->ccode = CC_DATA_LEN;
+	struct sel *sel = &bmc->storage.sel;
+	uint32_t free_space;
+	uint8_t *data;
+	uint8_t data_len = 14 * sizeof(uint8_t);
+	data = rsp_alloc(data_len);
+	if (data == NULL) {
+		rsp->ccode = CC_UNSPEC;
+		perror("rsp_alloc fail");
 		return (-1);
 	}
-	printf("[0]: '%i'\n", req->msg.data[0]);
-	printf("[1]: '%i'\n", req->msg.data[1]);
-	printf("[2]: '%i'\n", req->msg.data[2]);
-	printf("[3]: '%i'\n", req->msg.data[3]);
-	bmc_time[0] = req->msg.data[0];
-	bmc_time[1] = req->msg.data[1];
-	bmc_time[2] = req->msg.data[2];
-	bmc_time[3] = req->msg.data[3];
+	pthread_mutex_lock(&bmc->lock);
+	sensor_scan(bmc);
+	free_space = (SEL_ENTRIES_MAX - sel->entries) * SEL_RECORD_SIZE;
+	if (free_space > 0xFFFF) {
+		free_space = 0xFFFF;
+	}
+	data[0] = SEL_VERSION;
+	data[1] = sel->entries & 0xFF;
+	data[2] = sel->entries >> 8;
+	data[3] = free_space & 0xFF;
+	data[4] = free_space >> 8;
+	data[5] = sel->add_ts & 0xFF;
+	data[6] = (sel->add_ts >> 8) & 0xFF;
+	data[7] = (sel->add_ts >> 16) & 0xFF;
+	data[8] = sel->add_ts >> 24;
+	data[9] = sel->erase_ts & 0xFF;
+	data[10] = (sel->erase_ts >> 8) & 0xFF;
+	data[11] = (sel->erase_ts >> 16) & 0xFF;
+	data[12] = sel->erase_ts >> 24;
+	data[13] = SEL_OP_DELETE | SEL_OP_RESERVE
+		| (sel->overflow ? SEL_OP_OVERFLOW : 0);
+	pthread_mutex_unlock(&bmc->lock);
+	rsp->data = data;
+	rsp->data_len = data_len;
+	return 0;
+}
 
-	strftime(tbuf, sizeof(tbuf), "%m/%d/%Y %H:%M:%S",
-			gmtime((time_t *)bmc_time));
-	printf("Time received from client: %s\n", tbuf);
+/* (31.4) Reserve SEL */
+int
+sel_reserve(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	uint16_t resv;
+	uint8_t *data;
+	uint8_t data_len = 2 * sizeof(uint8_t);
+	data = rsp_alloc(data_len);
+	if (data == NULL) {
+		rsp->ccode = CC_UNSPEC;
+		perror("rsp_alloc fail");
+		return (-1);
+	}
+	pthread_mutex_lock(&bmc->lock);
+	resv = sel_new_reservation(&bmc->storage.sel);
+	pthread_mutex_unlock(&bmc->lock);
+	data[0] = resv & 0xFF;
+	data[1] = resv >> 8;
+	rsp->data = data;
+	rsp->data_len = data_len;
 	return 0;
 }
 
+/* (31.5) Get SEL Entry */
 int
-netfn_storage_main(struct dummy_rq *req, struct dummy_rs *rsp)
+sel_get_entry(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
-	int rc = 0;
-	rsp->msg.netfn = req->msg.netfn + 1;
-	rsp->msg.cmd = req->msg.cmd;
-	rsp->msg.lun = req->msg.lun;
+	struct sel *sel = &bmc->storage.sel;
+	const uint8_t *rec;
+	uint16_t id;
+	uint16_t next;
+	uint16_t resv;
+	uint8_t *data;
+	uint8_t count;
+	uint8_t offset;
+	resv = req->msg.data[0] | (req->msg.data[1] << 8);
+	id = req->msg.data[2] | (req->msg.data[3] << 8);
+	offset = req->msg.data[4];
+	count = req->msg.data[5];
+	if (count == 0xFF) {
+		count = SEL_RECORD_SIZE - offset;
+	}
+	if (offset >= SEL_RECORD_SIZE
+			|| offset + count > SEL_RECORD_SIZE) {
+		rsp->ccode = CC_BYTES_NA;
+		return (-1);
+	}
+	data = rsp_alloc(2 + count);
+	if (data == NULL) {
+		rsp->ccode = CC_UNSPEC;
+		perror("rsp_alloc fail");
+		return (-1);
+	}
+	pthread_mutex_lock(&bmc->lock);
+	sensor_scan(bmc);
+	/* reservation is needed for partial reads only */
+	if (offset != 0 && (resv == 0 || resv != sel->resv)) {
+		pthread_mutex_unlock(&bmc->lock);
+		rsp->ccode = CC_RESV_INV;
+		return (-1);
+	}
+	rec = sel_get(sel, id, &next);
+	if (rec == NULL) {
+		pthread_mutex_unlock(&bmc->lock);
+		rsp->ccode = CC_SDR_NA;
+		return (-1);
+	}
+	memcpy(data + 2, rec + offset, count);
+	pthread_mutex_unlock(&bmc->lock);
+	data[0] = next & 0xFF;
+	data[1] = next >> 8;
+	rsp->data = data;
+	rsp->data_len = 2 + count;
+	return 0;
+}
+
+/* (31.6) Add SEL Entry */
+int
+sel_add_entry(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	uint16_t id;
+	uint8_t *data;
+	uint8_t data_len = 2 * sizeof(uint8_t);
+	int rc;
+	data = rsp_alloc(data_len);
+	if (data == NULL) {
+		rsp->ccode = CC_UNSPEC;
+		perror("rsp_alloc fail");
+		return (-1);
+	}
+	pthread_mutex_lock(&bmc->lock);
+	rc = sel_add(&bmc->storage.sel, req->msg.data, sel_time_now(bmc),
+			&id);
+	pthread_mutex_unlock(&bmc->lock);
+	if (rc != 0) {
+		rsp->ccode = CC_NO_SPACE;
+		return (-1);
+	}
+	log_debug("SEL record %" PRIu16 " added.", id);
+	data[0] = id & 0xFF;
+	data[1] = id >> 8;
+	rsp->data = data;
+	rsp->data_len = data_len;
+	return 0;
+}
+
+/* (31.8) Delete SEL Entry */
+int
+sel_delete_entry(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	struct sel *sel = &bmc->storage.sel;
+	uint16_t id;
+	uint16_t deleted;
+	uint16_t resv;
+	uint8_t *data;
+	uint8_t data_len = 2 * sizeof(uint8_t);
+	resv = req->msg.data[0] | (req->msg.data[1] << 8);
+	id = req->msg.data[2] | (req->msg.data[3] << 8);
+	data = rsp_alloc(data_len);
+	if (data == NULL) {
+		rsp->ccode = CC_UNSPEC;
+		perror("rsp_alloc fail");
+		return (-1);
+	}
+	pthread_mutex_lock(&bmc->lock);
+	if (resv == 0 || resv != sel->resv) {
+		pthread_mutex_unlock(&bmc->lock);
+		rsp->ccode = CC_RESV_INV;
+		return (-1);
+	}
+	if (sel_delete(sel, id, &deleted) != 0) {
+		pthread_mutex_unlock(&bmc->lock);
+		rsp->ccode = CC_SDR_NA;
+		return (-1);
+	}
+	/* deletion cancels reservation */
+	sel->resv = 0;
+	pthread_mutex_unlock(&bmc->lock);
+	log_info("SEL record %" PRIu16 " deleted.", deleted);
+	data[0] = deleted & 0xFF;
+	data[1] = deleted >> 8;
+	rsp->data = data;
+	rsp->data_len = data_len;
+	return 0;
+}
+
+/* (31.9) Clear SEL */
+int
+sel_clear(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	struct sel *sel = &bmc->storage.sel;
+	uint16_t resv;
+	uint8_t *data;
+	uint8_t data_len = 1 * sizeof(uint8_t);
+	resv = req->msg.data[0] | (req->msg.data[1] << 8);
+	if (req->msg.data[2] != 'C' || req->msg.data[3] != 'L'
+			|| req->msg.data[4] != 'R'
+			|| (req->msg.data[5] != 0x00
+				&& req->msg.data[5] != 0xAA)) {
+		rsp->ccode = CC_DATA_FIELD_INV;
+		return (-1);
+	}
+	data = rsp_alloc(data_len);
+	if (data == NULL) {
+		rsp->ccode = CC_UNSPEC;
+		perror("rsp_alloc fail");
+		return (-1);
+	}
+	pthread_mutex_lock(&bmc->lock);
+	if (resv == 0 || resv != sel->resv) {
+		pthread_mutex_unlock(&bmc->lock);
+		rsp->ccode = CC_RESV_INV;
+		return (-1);
+	}
+	if (req->msg.data[5] == 0xAA) {
+		sel_erase(sel, sel_time_now(bmc));
+		sel->resv = 0;
+		log_info("SEL cleared.");
+	}
+	pthread_mutex_unlock(&bmc->lock);
+	/* erasure is instant, always report it completed */
+	data[0] = 0x01;
+	rsp->data = data;
+	rsp->data_len = data_len;
+	return 0;
+}
+
+/* (31.10) Get SEL Time */
+int
+sel_get_time(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	uint32_t t;
+	uint8_t *data;
+	uint8_t data_len = 4 * sizeof(uint8_t);
+	data = rsp_alloc(data_len);
+	if (data == NULL) {
+		rsp->ccode = CC_UNSPEC;
+		perror("rsp_alloc fail");
+		return (-1);
+	}
+	pthread_mutex_lock(&bmc->lock);
+	data[0] = bmc->storage.sel_time[0];
+	data[1] = bmc->storage.sel_time[1];
+	data[2] = bmc->storage.sel_time[2];
+	data[3] = bmc->storage.sel_time[3];
+	pthread_mutex_unlock(&bmc->lock);
+	rsp->data = data;
+	rsp->data_len = data_len;
 	rsp->ccode = CC_OK;
-	rsp->data_len = 0;
-	rsp->data = NULL;
-	switch (req->msg.cmd) {
-	case SEL_GET_TIME:
-		rc = sel_get_time(req, rsp);
-		break;
-	case SEL_SET_TIME:
-		rc = sel_set_time(req, rsp);
-		break;
-	default:
-		rsp->ccode = CC_CMD_INV;
-		rc = (-1);
-	}
-	return rc;
+
+	t = data[0] | (data[1] << 8) | (data[2] << 16)
+		| ((uint32_t)data[3] << 24);
+	log_info("Time sent to client: %" PRIu32, t);
+	return 0;
+}
+
+/* (31.11) Set SEL Time */
+int
+sel_set_time(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	uint32_t t;
+	log_debug("Data: '%i' '%i' '%i' '%i'", req->msg.data[0],
+			req->msg.data[1], req->msg.data[2], req->msg.data[3]);
+	pthread_mutex_lock(&bmc->lock);
+	bmc->storage.sel_time[0] = req->msg.data[0];
+	bmc->storage.sel_time[1] = req->msg.data[1];
+	bmc->storage.sel_time[2] = req->msg.data[2];
+	bmc->storage.sel_time[3] = req->msg.data[3];
+	pthread_mutex_unlock(&bmc->lock);
+
+	t = req->msg.data[0] | (req->msg.data[1] << 8)
+		| (req->msg.data[2] << 16) | ((uint32_t)req->msg.data[3] << 24);
+	log_info("Time received from client: %" PRIu32, t);
+	return 0;
 }
@@ -27,70 +27,193 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include "fake-ipmistack/fake-ipmistack.h"
+#include "fake-ipmistack/arena.h"
+#include "fake-ipmistack/bmc.h"
 #include "fake-ipmistack/helper.h"
+#include "fake-ipmistack/log.h"
+#include "fake-ipmistack/param.h"
 
-static uint16_t g_ip_addr_err_rx = 300;
-static uint16_t g_ip_frag_rx = 203;
-static uint16_t g_ip_hdr_err_rx = 504;
-static uint16_t g_ip_pkts_rx = 305;
-static uint16_t g_ip_pkts_tx = 6280;
-static uint16_t g_rcmp_pkts_rx = 58;
-static uint16_t g_udp_pkts_rx = 2345;
-static uint16_t g_udp_proxy_rx = 183;
-static uint16_t g_udp_proxy_drop = 197;
+#include <pthread.h>
+
+static const uint8_t lan_auth_types[] = { 0x15 };
+static const uint8_t lan_auth_enables[] = { 0x15, 0x15, 0x15, 0x15, 0x15 };
+static const uint8_t lan_ip_addr[] = { 192, 168, 1, 100 };
+static const uint8_t lan_ip_src[] = { 0x01 };
+static const uint8_t lan_mac_addr[] = { 0x00, 0x00, 0x5E, 0x00, 0x53, 0x01 };
+static const uint8_t lan_netmask[] = { 255, 255, 255, 0 };
+static const uint8_t lan_ipv4_hdr[] = { 0x40, 0x40, 0x10 };
+static const uint8_t lan_garp_interval[] = { 0x04 };
+static const uint8_t lan_gw_addr[] = { 192, 168, 1, 1 };
+static const uint8_t lan_community[18] = "public";
+static const uint8_t lan_dest_count[] = { 0x04 };
+static const uint8_t lan_cipher_count[] = { 0x05 };
+static const uint8_t lan_ciphers[] = { 0x00, 0x00, 0x01, 0x02, 0x03, 0x11 };
+static const uint8_t lan_cipher_privs[] = {
+	0x00, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44
+};
+
+/* (23.1) LAN Configuration Parameters */
+static const struct param_desc lan_param_desc[] = {
+	/* Authentication Type Support */
+	[1] = { 1, PARAM_RO, 1, 0, lan_auth_types },
+	/* Authentication Type Enables */
+	[2] = { 5, 0, 1, 0, lan_auth_enables },
+	/* IP Address */
+	[3] = { 4, 0, 1, 0, lan_ip_addr },
+	/* IP Address Source */
+	[4] = { 1, 0, 1, 0, lan_ip_src },
+	/* MAC Address */
+	[5] = { 6, 0, 1, 0, lan_mac_addr },
+	/* Subnet Mask */
+	[6] = { 4, 0, 1, 0, lan_netmask },
+	/* IPv4 Header Parameters */
+	[7] = { 3, 0, 1, 0, lan_ipv4_hdr },
+	/* BMC-generated ARP control */
+	[10] = { 1, 0, 1, 0, NULL },
+	/* Gratuitous ARP interval */
+	[11] = { 1, 0, 1, 0, lan_garp_interval },
+	/* Default Gateway Address */
+	[12] = { 4, 0, 1, 0, lan_gw_addr },
+	/* Default Gateway MAC Address */
+	[13] = { 6, 0, 1, 0, NULL },
+	/* Backup Gateway Address */
+	[14] = { 4, 0, 1, 0, NULL },
+	/* Backup Gateway MAC Address */
+	[15] = { 6, 0, 1, 0, NULL },
+	/* Community String */
+	[16] = { 18, 0, 1, 0, lan_community },
+	/* Number of Destinations */
+	[17] = { 1, PARAM_RO, 1, 0, lan_dest_count },
+	/* Destination Type, set 0 is volatile */
+	[18] = { 4, 0, 5, 0, NULL },
+	/* Destination Addresses */
+	[19] = { 13, 0, 5, 0, NULL },
+	/* 802.1q VLAN ID */
+	[20] = { 2, 0, 1, 0, NULL },
+	/* 802.1q VLAN Priority */
+	[21] = { 1, 0, 1, 0, NULL },
+	/* RMCP+ Messaging Cipher Suite Entry Support */
+	[22] = { 1, PARAM_RO, 1, 0, lan_cipher_count },
+	/* RMCP+ Messaging Cipher Suite Entries */
+	[23] = { 6, PARAM_RO, 1, 0, lan_ciphers },
+	/* RMCP+ Messaging Cipher Suite Privilege Levels */
+	[24] = { 9, 0, 1, 0, lan_cipher_privs },
+};
+
+static struct param_family lan_params = {
+	.name = "LAN",
+	.revision = 0x11,
+	.count = sizeof(lan_param_desc) / sizeof(lan_param_desc[0]),
+	.desc = lan_param_desc,
+};
+
+static const uint8_t sol_enable[] = { 0x01 };
+static const uint8_t sol_auth[] = { 0x02 };
+static const uint8_t sol_accumulate[] = { 0x0C, 0x60 };
+static const uint8_t sol_retry[] = { 0x06, 0x14 };
+static const uint8_t sol_bit_rate[] = { 0x0A };
+static const uint8_t sol_channel[] = { 0x01 };
+static const uint8_t sol_port[] = { 0x6F, 0x02 };
+
+/* (26.3) SOL Configuration Parameters */
+static const struct param_desc sol_param_desc[] = {
+	/* SOL Enable */
+	[1] = { 1, 0, 1, 0, sol_enable },
+	/* SOL Authentication */
+	[2] = { 1, 0, 1, 0, sol_auth },
+	/* Character Accumulate Interval & Send Threshold */
+	[3] = { 2, 0, 1, 0, sol_accumulate },
+	/* SOL Retry */
+	[4] = { 2, 0, 1, 0, sol_retry },
+	/* SOL non-volatile bit rate, 115.2 kbps */
+	[5] = { 1, 0, 1, 0, sol_bit_rate },
+	/* SOL volatile bit rate */
+	[6] = { 1, 0, 1, 0, sol_bit_rate },
+	/* SOL Payload Channel */
+	[7] = { 1, PARAM_RO, 1, 0, sol_channel },
+	/* SOL Payload Port Number, 623 */
+	[8] = { 2, PARAM_RO, 1, 0, sol_port },
+};
+
+static struct param_family sol_params = {
+	.name = "SOL",
+	.revision = 0x11,
+	.count = sizeof(sol_param_desc) / sizeof(sol_param_desc[0]),
+	.desc = sol_param_desc,
+};
+
+/* transport_state_init - set Transport NetFn state of a BMC to defaults.
+ *
+ * @transport: state to initialize
+ */
+void
+transport_state_init(struct transport_state *transport)
+{
+	transport->ip_addr_err_rx = 300;
+	transport->ip_frag_rx = 203;
+	transport->ip_hdr_err_rx = 504;
+	transport->ip_pkts_rx = 305;
+	transport->ip_pkts_tx = 6280;
+	transport->rcmp_pkts_rx = 58;
+	transport->udp_pkts_rx = 2345;
+	transport->udp_proxy_rx = 183;
+	transport->udp_proxy_drop = 197;
+	param_store_init(&transport->lan, &lan_params);
+	param_store_init(&transport->sol, &sol_params);
+}
 
 /* (23.4) Get IP/UDP/RMCP Statistics */
 int
-transport_get_ip_stats(struct dummy_rq *req, struct dummy_rs *rsp)
+transport_get_ip_stats(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
+	struct transport_state *ts = &bmc->transport;
 	uint8_t *data;
 	uint8_t data_len = 18 * sizeof(uint8_t);
-	if (req->msg.data_len != 2) {
-		rsp->ccode = CC_DATA_LEN;
-		return (-1);
-	}
 	/* Channel actually doesn't matter to us. */
-	req->msg.data[0]|= 0xF0;
+	req->msg.data[0]&= 0x0F;
 	if (is_valid_channel(req->msg.data[0])) {
 		rsp->ccode = CC_PARAM_OOR;
 		return (-1);
 	}
-	data = malloc(data_len);
+	data = rsp_alloc(data_len);
 	if (data == NULL) {
-		perror("malloc fail");
+		perror("rsp_alloc fail");
 		rsp->ccode = CC_UNSPEC;
 		return (-1);
 	}
+	pthread_mutex_lock(&bmc->lock);
 	if ((req->msg.data[1] | 0xFE) == 0xFF) {
-		printf("[INFO] LAN stats reset.\n");
-		g_ip_pkts_rx = 0;
-		g_ip_hdr_err_rx = 0;
-		g_ip_addr_err_rx = 0;
-		g_ip_frag_rx = 0;
-		g_ip_pkts_tx = 0;
-		g_udp_pkts_rx = 0;
-		g_rcmp_pkts_rx = 0;
-		g_udp_proxy_rx = 0;
-		g_udp_proxy_drop = 0;
+		log_info("LAN stats reset.");
+		ts->ip_pkts_rx = 0;
+		ts->ip_hdr_err_rx = 0;
+		ts->ip_addr_err_rx = 0;
+		ts->ip_frag_rx = 0;
+		ts->ip_pkts_tx = 0;
+		ts->udp_pkts_rx = 0;
+		ts->rcmp_pkts_rx = 0;
+		ts->udp_proxy_rx = 0;
+		ts->udp_proxy_drop = 0;
 	}
-	data[0] = g_ip_pkts_rx >> 8;
-	data[1] = g_ip_pkts_rx >> 0;
-	data[2] = g_ip_hdr_err_rx >> 8;
-	data[3] = g_ip_hdr_err_rx >> 0;
-	data[4] = g_ip_addr_err_rx >> 8;
-	data[5] = g_ip_addr_err_rx >> 0;
-	data[6] = g_ip_frag_rx >> 8;
-	data[7] = g_ip_frag_rx >> 0;
-	data[8] = g_ip_pkts_tx >> 8;
-	data[9] = g_ip_pkts_tx >> 0;
-	data[10] = g_udp_pkts_rx >> 8;
-	data[11] = g_udp_pkts_rx >> 0;
-	data[12] = g_rcmp_pkts_rx >> 8;
-	data[13] = g_rcmp_pkts_rx >> 0;
-	data[14] = g_udp_proxy_rx >> 8;
-	data[15] = g_udp_proxy_rx >> 0;
-	data[16] = g_udp_proxy_drop >> 8;
-	data[17] = g_udp_proxy_drop >> 0;
+	data[0] = ts->ip_pkts_rx >> 8;
+	data[1] = ts->ip_pkts_rx >> 0;
+	data[2] = ts->ip_hdr_err_rx >> 8;
+	data[3] = ts->ip_hdr_err_rx >> 0;
+	data[4] = ts->ip_addr_err_rx >> 8;
+	data[5] = ts->ip_addr_err_rx >> 0;
+	data[6] = ts->ip_frag_rx >> 8;
+	data[7] = ts->ip_frag_rx >> 0;
+	data[8] = ts->ip_pkts_tx >> 8;
+	data[9] = ts->ip_pkts_tx >> 0;
+	data[10] = ts->udp_pkts_rx >> 8;
+	data[11] = ts->udp_pkts_rx >> 0;
+	data[12] = ts->rcmp_pkts_rx >> 8;
+	data[13] = ts->rcmp_pkts_rx >> 0;
+	data[14] = ts->udp_proxy_rx >> 8;
+	data[15] = ts->udp_proxy_rx >> 0;
+	data[16] = ts->udp_proxy_drop >> 8;
+	data[17] = ts->udp_proxy_drop >> 0;
+	pthread_mutex_unlock(&bmc->lock);
 	rsp->data = data;
 	rsp->data_len = data_len;
 	return 0;
@@ -98,17 +221,14 @@ transport_get_ip_stats(struct dummy_rq *req, struct dummy_rs *rsp)
 
 /* (23.3) Suspend BMC ARPs Command */
 int
-transport_suspend_bmc_arp(struct dummy_rq *req, struct dummy_rs *rsp)
+transport_suspend_bmc_arp(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
 	uint8_t *data = NULL;
 	uint8_t arp_rsp = 0;
 	uint8_t arp_suspend = 0;
 	uint8_t channel = 0;
 	uint8_t data_len = 1 * sizeof(uint8_t);
-	if (req->msg.data_len != 2) {
-		rsp->ccode = CC_DATA_LEN;
-		return (-1);
-	}
 	channel = req->msg.data[0] & 0x0F;
 	if (is_valid_channel(channel)) {
 		rsp->ccode = CC_PARAM_OOR;
@@ -116,8 +236,14 @@ transport_suspend_bmc_arp(struct dummy_rq *req, struct dummy_rs *rsp)
 	}
 	arp_rsp = req->msg.data[1] & 0x02;
 	arp_suspend = req->msg.data[1] & 0x01;
-	printf("[INFO] ARP responses: %" PRIu8 "\n", arp_rsp);
-	printf("[INFO] ARP suspended: %" PRIu8 "\n", arp_suspend);
+	log_info("ARP responses: %" PRIu8, arp_rsp);
+	log_info("ARP suspended: %" PRIu8, arp_suspend);
+	data = rsp_alloc(data_len);
+	if (data == NULL) {
+		perror("rsp_alloc fail");
+		rsp->ccode = CC_UNSPEC;
+		return (-1);
+	}
 	data[0] = 0x00;
 	data[0] |= arp_rsp;
 	data[0] |= arp_suspend;
@@ -127,35 +253,118 @@ transport_suspend_bmc_arp(struct dummy_rq *req, struct dummy_rs *rsp)
 	return 0;
 }
 
+/* (23.2) Get LAN Configuration Parameters */
+int
+transport_get_lan_cfg(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	struct param_store *store = &bmc->transport.lan;
+	uint8_t *data;
+	uint8_t len = 0;
+	uint8_t ccode;
+	if (is_valid_channel(req->msg.data[0] & 0x0F)) {
+		rsp->ccode = CC_PARAM_OOR;
+		return (-1);
+	}
+	data = rsp_alloc(1 + PARAM_LEN_MAX);
+	if (data == NULL) {
+		perror("rsp_alloc fail");
+		rsp->ccode = CC_UNSPEC;
+		return (-1);
+	}
+	data[0] = store->family->revision;
+	/* bit 7 - get parameter revision only */
+	if (!(req->msg.data[0] & 0x80)) {
+		pthread_mutex_lock(&bmc->lock);
+		ccode = param_get(store, req->msg.data[1], req->msg.data[2],
+				&data[1], &len);
+		pthread_mutex_unlock(&bmc->lock);
+		if (ccode != CC_OK) {
+			rsp->ccode = ccode;
+			return (-1);
+		}
+	}
+	rsp->data = data;
+	rsp->data_len = 1 + len;
+	return 0;
+}
+
+/* (23.1) Set LAN Configuration Parameters */
 int
-netfn_transport_main(struct dummy_rq *req, struct dummy_rs *rsp)
+transport_set_lan_cfg(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
 {
-	int rc;
-	rsp->msg.netfn = req->msg.netfn + 1;
-	rsp->msg.cmd = req->msg.cmd;
-	rsp->msg.lun = req->msg.lun;
-	rsp->ccode = CC_OK;
-	rsp->data_len = 0;
-	rsp->data = NULL;
-	switch (req->msg.cmd) {
-	case TRANSPORT_GET_IP_STATS:
-		rc = transport_get_ip_stats(req, rsp);
-		break;
-	case TRANSPORT_GET_LAN_CFG:
-		rsp->ccode = CC_CMD_INV;
-		rc = (-1);
-		break;
-	case TRANSPORT_SET_LAN_CFG:
-		rsp->ccode = CC_CMD_INV;
-		rc = (-1);
-		break;
-	case TRANSPORT_SUSPEND_BMC_ARP:
-		rc = transport_suspend_bmc_arp(req, rsp);
-		break;
-	default:
-		rsp->ccode = CC_CMD_INV;
-		rc = (-1);
-		break;
+	uint8_t ccode;
+	if (is_valid_channel(req->msg.data[0] & 0x0F)) {
+		rsp->ccode = CC_PARAM_OOR;
+		return (-1);
+	}
+	if (req->msg.data_len > 2 + PARAM_LEN_MAX) {
+		rsp->ccode = CC_DATA_LEN;
+		return (-1);
+	}
+	pthread_mutex_lock(&bmc->lock);
+	ccode = param_set(&bmc->transport.lan, req->msg.data[1],
+			&req->msg.data[2], req->msg.data_len - 2);
+	pthread_mutex_unlock(&bmc->lock);
+	rsp->ccode = ccode;
+	return ccode == CC_OK ? 0 : (-1);
+}
+
+/* (26.3) Get SOL Configuration Parameters */
+int
+transport_get_sol_cfg(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	struct param_store *store = &bmc->transport.sol;
+	uint8_t *data;
+	uint8_t len = 0;
+	uint8_t ccode;
+	if (is_valid_channel(req->msg.data[0] & 0x0F)) {
+		rsp->ccode = CC_PARAM_OOR;
+		return (-1);
+	}
+	data = rsp_alloc(1 + PARAM_LEN_MAX);
+	if (data == NULL) {
+		perror("rsp_alloc fail");
+		rsp->ccode = CC_UNSPEC;
+		return (-1);
+	}
+	data[0] = store->family->revision;
+	/* bit 7 - get parameter revision only */
+	if (!(req->msg.data[0] & 0x80)) {
+		pthread_mutex_lock(&bmc->lock);
+		ccode = param_get(store, req->msg.data[1], req->msg.data[2],
+				&data[1], &len);
+		pthread_mutex_unlock(&bmc->lock);
+		if (ccode != CC_OK) {
+			rsp->ccode = ccode;
+			return (-1);
+		}
+	}
+	rsp->data = data;
+	rsp->data_len = 1 + len;
+	return 0;
+}
+
+/* (26.2) Set SOL Configuration Parameters */
+int
+transport_set_sol_cfg(struct bmc *bmc, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	uint8_t ccode;
+	if (is_valid_channel(req->msg.data[0] & 0x0F)) {
+		rsp->ccode = CC_PARAM_OOR;
+		return (-1);
+	}
+	if (req->msg.data_len > 2 + PARAM_LEN_MAX) {
+		rsp->ccode = CC_DATA_LEN;
+		return (-1);
 	}
-	return rc;
+	pthread_mutex_lock(&bmc->lock);
+	ccode = param_set(&bmc->transport.sol, req->msg.data[1],
+			&req->msg.data[2], req->msg.data_len - 2);
+	pthread_mutex_unlock(&bmc->lock);
+	rsp->ccode = ccode;
+	return ccode == CC_OK ? 0 : (-1);
 }
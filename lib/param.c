@@ -0,0 +1,227 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "fake-ipmistack/fake-ipmistack.h"
+#include "fake-ipmistack/param.h"
+
+/* param_family_init - lay out values of a family. Does nothing if family
+ * has been laid out already. Descriptors must not be longer than
+ * PARAM_LEN_MAX, nor more than PARAM_SELECTORS_MAX.
+ *
+ * @family: family with name, revision and descriptors filled in
+ */
+void
+param_family_init(struct param_family *family)
+{
+	uint16_t size = 0;
+	int i;
+	if (family->size != 0) {
+		return;
+	}
+	for (i = 0; i < family->count; i++) {
+		family->offset[i] = size;
+		size += family->desc[i].blocks * (1 + family->desc[i].len);
+	}
+	family->size = size;
+}
+
+/* param_store_init - set parameters of a BMC to family defaults.
+ *
+ * @store: store to initialize
+ * @family: family of parameters, laid out if needed
+ */
+void
+param_store_init(struct param_store *store, struct param_family *family)
+{
+	param_family_init(family);
+	store->family = family;
+	store->values = NULL;
+	store->set_state = PARAM_SET_COMPLETE;
+}
+
+/* param_default - write default value of a parameter block to slot */
+static void
+param_default(const struct param_desc *desc, uint8_t block, uint8_t *slot)
+{
+	slot[0] = desc->len;
+	if (desc->def != NULL) {
+		memcpy(&slot[1], desc->def, desc->len);
+	} else {
+		memset(&slot[1], 0, desc->len);
+	}
+	if (desc->blocks > 1) {
+		slot[1] = desc->block_base + block;
+	}
+}
+
+/* param_block - check selector and block of a request.
+ *
+ * @store: parameters of a BMC
+ * @selector: parameter selector
+ * @block: set/block selector, turned into block index
+ *
+ * returns CC_OK or completion code to respond with
+ */
+static uint8_t
+param_block(struct param_store *store, uint8_t selector, uint8_t *block)
+{
+	const struct param_desc *desc;
+	if (selector >= store->family->count
+			|| store->family->desc[selector].len == 0) {
+		return CC_PARAM_NOT_SUPPORTED;
+	}
+	desc = &store->family->desc[selector];
+	if (desc->blocks == 1) {
+		*block = 0;
+		return CC_OK;
+	}
+	if (*block < desc->block_base
+			|| *block - desc->block_base >= desc->blocks) {
+		return CC_PARAM_OOR;
+	}
+	*block -= desc->block_base;
+	return CC_OK;
+}
+
+/* param_get - read value of a parameter.
+ *
+ * @store: parameters of a BMC
+ * @selector: parameter selector
+ * @block: set/block selector, ignored by single-block parameters
+ * @value: buffer of PARAM_LEN_MAX bytes
+ * @len: length of value
+ *
+ * returns CC_OK or completion code to respond with
+ */
+uint8_t
+param_get(struct param_store *store, uint8_t selector, uint8_t block,
+		uint8_t *value, uint8_t *len)
+{
+	const struct param_desc *desc;
+	uint8_t slot[1 + PARAM_LEN_MAX];
+	uint8_t *src;
+	uint8_t ccode;
+	if (selector == PARAM_SET_IN_PROGRESS) {
+		value[0] = store->set_state;
+		*len = 1;
+		return CC_OK;
+	}
+	ccode = param_block(store, selector, &block);
+	if (ccode != CC_OK) {
+		return ccode;
+	}
+	desc = &store->family->desc[selector];
+	if (store->values != NULL) {
+		src = &store->values[store->family->offset[selector]
+			+ block * (1 + desc->len)];
+	} else {
+		param_default(desc, block, slot);
+		src = slot;
+	}
+	memcpy(value, &src[1], src[0]);
+	*len = src[0];
+	return CC_OK;
+}
+
+/* param_set - change value of a parameter. Block of multi-block parameters
+ * is the first byte of value.
+ *
+ * @store: parameters of a BMC
+ * @selector: parameter selector
+ * @value: new value
+ * @len: length of value
+ *
+ * returns CC_OK or completion code to respond with
+ */
+uint8_t
+param_set(struct param_store *store, uint8_t selector, const uint8_t *value,
+		uint8_t len)
+{
+	const struct param_family *family = store->family;
+	const struct param_desc *desc;
+	uint8_t *slot;
+	uint8_t block;
+	uint8_t ccode;
+	int b;
+	int i;
+	if (selector == PARAM_SET_IN_PROGRESS) {
+		if (len != 1) {
+			return CC_DATA_LEN;
+		}
+		switch (value[0] & 0x03) {
+		case PARAM_SET_COMPLETE:
+			store->set_state = PARAM_SET_COMPLETE;
+			return CC_OK;
+		case PARAM_SET_LOCKED:
+			if (store->set_state == PARAM_SET_LOCKED) {
+				return CC_PARAM_SET_IN_PROGRESS;
+			}
+			store->set_state = PARAM_SET_LOCKED;
+			return CC_OK;
+		case PARAM_SET_COMMIT:
+			/* values take effect as they are written */
+			return CC_OK;
+		default:
+			return CC_DATA_FIELD_INV;
+		}
+	}
+	if (len == 0) {
+		return CC_DATA_LEN;
+	}
+	block = value[0];
+	ccode = param_block(store, selector, &block);
+	if (ccode != CC_OK) {
+		return ccode;
+	}
+	desc = &family->desc[selector];
+	if (desc->flags & PARAM_RO) {
+		return CC_PARAM_READ_ONLY;
+	}
+	if (len > desc->len || (len < desc->len && !(desc->flags & PARAM_VAR))) {
+		return CC_DATA_LEN;
+	}
+	if (store->values == NULL) {
+		store->values = malloc(family->size);
+		if (store->values == NULL) {
+			perror("malloc fail");
+			return CC_UNSPEC;
+		}
+		for (i = 0; i < family->count; i++) {
+			for (b = 0; b < family->desc[i].blocks; b++) {
+				param_default(&family->desc[i], b,
+						&store->values[family->offset[i]
+						+ b * (1 + family->desc[i].len)]);
+			}
+		}
+	}
+	slot = &store->values[family->offset[selector]
+		+ block * (1 + desc->len)];
+	slot[0] = len;
+	memcpy(&slot[1], value, len);
+	return CC_OK;
+}
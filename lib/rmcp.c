@@ -0,0 +1,996 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "fake-ipmistack/fake-ipmistack.h"
+#include "fake-ipmistack/bmc.h"
+#include "fake-ipmistack/crypto.h"
+#include "fake-ipmistack/dispatch.h"
+#include "fake-ipmistack/helper.h"
+#include "fake-ipmistack/log.h"
+#include "fake-ipmistack/rmcp.h"
+#include "fake-ipmistack/session.h"
+#include "fake-ipmistack/stats.h"
+
+#include <pthread.h>
+
+/* RMCP datagrams as they come off the wire [bytes]
+ * [0:3] RMCP header - version, reserved, sequence number, class
+ * ASF class:
+ *   [4:7] IANA 4542, [8] message type, [9] tag, [10] reserved,
+ *   [11] data length, [12:N] data
+ * IPMI class, v1.5 session:
+ *   [4] auth type, [5:8] session sequence, [9:12] session ID,
+ *   [13:28] auth code unless auth type is none, message length, message
+ * IPMI class, v2.0 session:
+ *   [4] auth type 06h, [5] payload type, [6:11] OEM IANA and payload ID
+ *   of OEM payloads only, session ID, session sequence, 2 bytes payload
+ *   length, payload, integrity trailer of authenticated payloads
+ * Multi-byte session fields are LS byte first.
+ *
+ * v1.5 sessions are set up by Get Session Challenge and Activate Session,
+ * which are plain commands, see netfn_app.c. RMCP+ sessions are set up by
+ * Open Session and RAKP messages, which are payloads of their own and are
+ * served here. Packets of sessions the BMC doesn't know, or which fail
+ * authentication or the sequence number check, are dropped silently.
+ *
+ * v1.5 has straight password authentication only. RMCP+ has RAKP-none,
+ * RAKP-HMAC-SHA1 and -SHA256, HMAC-SHA1-96 and HMAC-SHA256-128 integrity
+ * and AES-CBC-128 confidentiality, i.e. cipher suites 0 - 3 and 15 - 17.
+ * There's no BMC key (K_G), so the Session Integrity Key is derived from
+ * the user's password, as the spec has it for a null K_G.
+ */
+
+/* RMCP+ algorithms served, bit per algorithm number */
+#define RMCP_AUTH_ALGS ((1U << RMCP_AUTH_RAKP_NONE) \
+		| (1U << RMCP_AUTH_RAKP_HMAC_SHA1) \
+		| (1U << RMCP_AUTH_RAKP_HMAC_SHA256))
+#define RMCP_INTEGRITY_ALGS ((1U << RMCP_INTEGRITY_NONE) \
+		| (1U << RMCP_INTEGRITY_HMAC_SHA1_96) \
+		| (1U << RMCP_INTEGRITY_HMAC_SHA256_128))
+#define RMCP_CONF_ALGS ((1U << RMCP_CONF_NONE) \
+		| (1U << RMCP_CONF_AES_CBC_128))
+
+/* Keys of the session a packet belongs to. They are copied off the
+ * session, so that the response can be protected even after Close Session
+ * has gone through.
+ */
+struct rmcp_keys {
+	/* length of AuthCode, 0 when payloads aren't authenticated */
+	size_t icv_size;
+	struct hmac_key k1;
+	int encrypted;
+	struct aes128_key k2;
+	/* IV of the response */
+	uint8_t iv[AES_BLOCK_SIZE];
+};
+
+/* ipmi_csum - returns two's complement checksum of given bytes */
+static uint8_t
+ipmi_csum(const uint8_t *buf, size_t len)
+{
+	uint8_t sum = 0;
+	size_t i;
+	for (i = 0; i < len; i++) {
+		sum += buf[i];
+	}
+	return -sum;
+}
+
+/* get_le32 - returns 32-bit LS byte first value */
+static uint32_t
+get_le32(const uint8_t *buf)
+{
+	return buf[0] | (buf[1] << 8) | (buf[2] << 16)
+		| ((uint32_t)buf[3] << 24);
+}
+
+/* put_le32 - store 32-bit value LS byte first */
+static void
+put_le32(uint8_t *buf, uint32_t value)
+{
+	buf[0] = value & 0xFF;
+	buf[1] = (value >> 8) & 0xFF;
+	buf[2] = (value >> 16) & 0xFF;
+	buf[3] = value >> 24;
+}
+
+/* rmcp_asf_ping - answer ASF Presence Ping with Presence Pong.
+ *
+ * returns length of response, 0 if there's nothing to send
+ */
+static size_t
+rmcp_asf_ping(const uint8_t *pkt, size_t len, uint8_t *out, size_t out_size)
+{
+	static const uint8_t asf_iana[4] = { 0x00, 0x00, 0x11, 0xBE };
+	if (len < RMCP_HEADER_SIZE + 8 || out_size < RMCP_HEADER_SIZE + 8 + 16
+			|| memcmp(&pkt[4], asf_iana, 4) != 0
+			|| pkt[8] != ASF_TYPE_PING) {
+		return 0;
+	}
+	memcpy(out, pkt, RMCP_HEADER_SIZE);
+	memset(&out[RMCP_HEADER_SIZE], 0, 8 + 16);
+	memcpy(&out[4], asf_iana, 4);
+	out[8] = ASF_TYPE_PONG;
+	/* message tag */
+	out[9] = pkt[9];
+	out[11] = 16;
+	/* IANA again, no OEM data */
+	memcpy(&out[12], asf_iana, 4);
+	/* IPMI supported, ASF v1.0 */
+	out[20] = 0x81;
+	return RMCP_HEADER_SIZE + 8 + 16;
+}
+
+/* rmcp_ipmi_msg - dispatch IPMI LAN message and build the response.
+ *
+ * @bmc: BMC the message is addressed to
+ * @ctx: session the message has come in
+ * @msg: request message, rsAddr to checksum 2, data may be modified
+ * @len: length of request message
+ * @out: response message
+ * @out_size: room for response message
+ *
+ * returns length of response message, 0 if request should be dropped
+ */
+static size_t
+rmcp_ipmi_msg(struct bmc *bmc, const struct session_ctx *ctx, uint8_t *msg,
+		size_t len, uint8_t *out, size_t out_size)
+{
+	struct dummy_rq req;
+	struct dummy_rs rsp;
+	uint64_t start;
+	size_t rsp_len;
+	if (len < IPMI_LAN_MSG_MIN || ipmi_csum(msg, 2) != msg[2]
+			|| ipmi_csum(&msg[3], len - 4) != msg[len - 1]) {
+		log_debug("RMCP: malformed IPMI message dropped.");
+		return 0;
+	}
+	memset(&req, 0, sizeof(req));
+	memset(&rsp, 0, sizeof(rsp));
+	req.msg.netfn = msg[1] >> 2;
+	req.msg.lun = msg[1] & 0x03;
+	req.msg.cmd = msg[5];
+	req.msg.data = &msg[6];
+	req.msg.data_len = len - IPMI_LAN_MSG_MIN;
+	start = monotonic_ns();
+	session_use(ctx);
+	ipmi_dispatch(bmc, &req, &rsp);
+	session_use(NULL);
+	stats_record(req.msg.netfn, req.msg.cmd, rsp.ccode,
+			monotonic_ns() - start);
+	if ((size_t)(IPMI_LAN_MSG_MIN + 1 + rsp.data_len) > out_size) {
+		rsp.ccode = CC_BYTES_NA;
+		rsp.data_len = 0;
+	}
+	/* requester and responder swap places */
+	out[0] = msg[3];
+	out[1] = (rsp.msg.netfn << 2) | (msg[4] & 0x03);
+	out[2] = ipmi_csum(out, 2);
+	out[3] = msg[0];
+	out[4] = (msg[4] & 0xFC) | req.msg.lun;
+	out[5] = req.msg.cmd;
+	out[6] = rsp.ccode;
+	if (rsp.data_len > 0) {
+		memcpy(&out[7], rsp.data, rsp.data_len);
+	}
+	rsp_len = 7 + rsp.data_len;
+	out[rsp_len] = ipmi_csum(&out[3], rsp_len - 3);
+	return rsp_len + 1;
+}
+
+/* rmcp_session15 - check v1.5 packet against its session and fill in
+ * session context. Caller must hold bmc->lock.
+ *
+ * @bmc: BMC
+ * @ctx: session context to fill in
+ * @pkt: packet
+ * @auth_code: auth code of the response
+ * @out_seq: session sequence number of the response
+ *
+ * returns 0 when packet should be served, otherwise (-1)
+ */
+static int
+rmcp_session15(struct bmc *bmc, struct session_ctx *ctx, const uint8_t *pkt,
+		uint8_t *auth_code, uint32_t *out_seq)
+{
+	struct session *session;
+	uint64_t now = monotonic_ms();
+	session = session_find(&bmc->app.sessions, ctx->id, now);
+	if (session == NULL || session->auth_type != ctx->auth_type) {
+		return (-1);
+	}
+	if (session->auth_type == IPMI_AUTH_PASSWORD) {
+		memcpy(auth_code, user_get(&bmc->app, session->uid)->password,
+				16);
+		if (memcmp(&pkt[13], auth_code, 16) != 0) {
+			return (-1);
+		}
+	}
+	if (session->state == SESSION_PENDING) {
+		/* only Activate Session gets through */
+		ctx->priv = PRIV_NONE;
+		*out_seq = 0;
+		return 0;
+	}
+	if (session_seq_check(session, get_le32(&pkt[5])) != 0) {
+		return (-1);
+	}
+	session_touch(&bmc->app.sessions, session, now);
+	ctx->priv = session->priv;
+	*out_seq = session->out_seq++;
+	if (session->out_seq == 0) {
+		session->out_seq = 1;
+	}
+	return 0;
+}
+
+/* rmcp_ipmi15 - serve IPMI v1.5 session packet */
+static size_t
+rmcp_ipmi15(struct bmc *bmc, struct session_ctx *ctx, uint8_t *pkt,
+		size_t len, uint8_t *out, size_t out_size)
+{
+	uint8_t auth_code[16];
+	uint32_t out_seq = 0;
+	size_t hdr;
+	size_t msg_len;
+	int rc = 0;
+	ctx->auth_type = pkt[4] & 0x0F;
+	/* auth type, session sequence and ID, auth code, message length */
+	hdr = RMCP_HEADER_SIZE + 10;
+	if (ctx->auth_type != IPMI_AUTH_NONE) {
+		hdr += sizeof(auth_code);
+	}
+	if (len < hdr || out_size < hdr) {
+		return 0;
+	}
+	msg_len = pkt[hdr - 1];
+	if (hdr + msg_len > len) {
+		return 0;
+	}
+	ctx->id = get_le32(&pkt[9]);
+	memset(auth_code, 0, sizeof(auth_code));
+	if (ctx->id != 0) {
+		pthread_mutex_lock(&bmc->lock);
+		rc = rmcp_session15(bmc, ctx, pkt, auth_code, &out_seq);
+		pthread_mutex_unlock(&bmc->lock);
+	} else if (ctx->auth_type != IPMI_AUTH_NONE) {
+		rc = (-1);
+	}
+	if (rc != 0) {
+		log_debug("RMCP: v1.5 packet of session %" PRIx32
+				" dropped.", ctx->id);
+		return 0;
+	}
+	msg_len = rmcp_ipmi_msg(bmc, ctx, &pkt[hdr], msg_len, &out[hdr],
+			out_size - hdr);
+	if (msg_len == 0 || msg_len > 0xFF) {
+		return 0;
+	}
+	memcpy(out, pkt, RMCP_HEADER_SIZE);
+	out[4] = ctx->auth_type;
+	put_le32(&out[5], out_seq);
+	put_le32(&out[9], ctx->id);
+	if (ctx->auth_type != IPMI_AUTH_NONE) {
+		memcpy(&out[13], auth_code, sizeof(auth_code));
+	}
+	out[hdr - 1] = msg_len;
+	return hdr + msg_len;
+}
+
+/* rmcp_alg - check algorithm payload of Open Session Request.
+ *
+ * @rec: 8 bytes of payload - type, 2 reserved, length, algorithm, 3 reserved
+ * @type: payload type expected
+ * @supported: algorithms served, bit per algorithm
+ * @alg: algorithm picked
+ *
+ * returns 0 when the algorithm is supported, otherwise (-1)
+ */
+static int
+rmcp_alg(const uint8_t *rec, uint8_t type, uint32_t supported, uint8_t *alg)
+{
+	if (rec[0] != type) {
+		return (-1);
+	}
+	if (rec[3] == 0) {
+		/* empty payload leaves the choice to the BMC, strongest */
+		*alg = 31 - __builtin_clz(supported);
+		return 0;
+	}
+	*alg = rec[4] & 0x3F;
+	return *alg < 32 && (supported & (1U << *alg)) ? 0 : (-1);
+}
+
+/* rmcp_auth_hash - returns hash of RAKP authentication algorithm */
+static uint8_t
+rmcp_auth_hash(uint8_t auth_alg)
+{
+	return auth_alg == RMCP_AUTH_RAKP_HMAC_SHA256
+		? HASH_SHA256 : HASH_SHA1;
+}
+
+/* rmcp_integrity_hash - returns hash of integrity algorithm */
+static uint8_t
+rmcp_integrity_hash(uint8_t integrity_alg)
+{
+	return integrity_alg == RMCP_INTEGRITY_HMAC_SHA256_128
+		? HASH_SHA256 : HASH_SHA1;
+}
+
+/* rmcp_icv_size - returns length HMACs of given hash are truncated to in
+ * RAKP 4 and integrity trailers, HMAC-SHA1-96 or HMAC-SHA256-128
+ */
+static size_t
+rmcp_icv_size(uint8_t hash)
+{
+	return hash == HASH_SHA256 ? 16 : 12;
+}
+
+/* rmcp_rakp_user - store role, name length and name of RAKP 1, the tail of
+ * all RAKP-HMAC inputs.
+ *
+ * returns number of bytes stored
+ */
+static size_t
+rmcp_rakp_user(const struct session *session, uint8_t *buf)
+{
+	buf[0] = session->role;
+	buf[1] = session->name_len;
+	memcpy(&buf[2], session->name, session->name_len);
+	return 2 + session->name_len;
+}
+
+/* rmcp_mac_equal - compare authentication codes in constant time */
+static int
+rmcp_mac_equal(const uint8_t *a, const uint8_t *b, size_t len)
+{
+	uint8_t diff = 0;
+	size_t i;
+	for (i = 0; i < len; i++) {
+		diff |= a[i] ^ b[i];
+	}
+	return diff == 0;
+}
+
+/* rmcp_keyed - returns integrity or confidentiality algorithms which go
+ * with authentication algorithm. RAKP-none exchanges no keys, so only none
+ * does.
+ */
+static uint32_t
+rmcp_keyed(uint8_t auth_alg, uint32_t supported)
+{
+	return auth_alg == RMCP_AUTH_RAKP_NONE ? 1U : supported;
+}
+
+/* rmcp_open_session - answer RMCP+ Open Session Request.
+ *
+ * @bmc: BMC
+ * @ctx: session context of the request
+ * @rq: request payload
+ * @len: length of request payload
+ * @rs: response payload, 36 bytes
+ *
+ * returns length of response payload, 0 if there's nothing to send
+ */
+static size_t
+rmcp_open_session(struct bmc *bmc, const struct session_ctx *ctx,
+		const uint8_t *rq, size_t len, uint8_t *rs)
+{
+	struct session *session;
+	uint8_t algs[3];
+	uint8_t status = RMCP_STATUS_OK;
+	uint8_t role;
+	int i;
+	if (len < 32) {
+		return 0;
+	}
+	role = rq[1] & 0x0F;
+	memset(rs, 0, 36);
+	rs[0] = rq[0];
+	memcpy(&rs[4], &rq[4], 4);
+	if (role > PRIV_ADMIN) {
+		status = RMCP_STATUS_ROLE_INV;
+	} else if (get_le32(&rq[4]) == 0) {
+		status = RMCP_STATUS_PARAM_ILLEGAL;
+	} else if (rmcp_alg(&rq[8], RMCP_ALG_AUTH, RMCP_AUTH_ALGS,
+				&algs[0]) != 0) {
+		status = RMCP_STATUS_AUTH_ALG_INV;
+	} else if (rmcp_alg(&rq[16], RMCP_ALG_INTEGRITY,
+				rmcp_keyed(algs[0], RMCP_INTEGRITY_ALGS),
+				&algs[1]) != 0) {
+		status = RMCP_STATUS_INTEGRITY_ALG_INV;
+	} else if (rmcp_alg(&rq[24], RMCP_ALG_CONF,
+				rmcp_keyed(algs[0], RMCP_CONF_ALGS),
+				&algs[2]) != 0) {
+		status = RMCP_STATUS_CONF_ALG_INV;
+	}
+	if (status != RMCP_STATUS_OK) {
+		rs[1] = status;
+		return 8;
+	}
+	pthread_mutex_lock(&bmc->lock);
+	session = session_new(&bmc->app.sessions, ctx->channel,
+			monotonic_ms());
+	if (session == NULL) {
+		pthread_mutex_unlock(&bmc->lock);
+		rs[1] = RMCP_STATUS_NO_RESOURCES;
+		return 8;
+	}
+	session->auth_type = IPMI_AUTH_RMCP_PLUS;
+	session->remote_id = get_le32(&rq[4]);
+	session->max_priv = role != 0 ? role : PRIV_ADMIN;
+	session->auth_alg = algs[0];
+	session->integrity_alg = algs[1];
+	session->conf_alg = algs[2];
+	session->addr = ctx->addr;
+	session->port = ctx->port;
+	put_le32(&rs[8], session->id);
+	pthread_mutex_unlock(&bmc->lock);
+	app_timer_arm(bmc);
+	rs[2] = role != 0 ? role : PRIV_ADMIN;
+	for (i = 0; i < 3; i++) {
+		rs[12 + 8 * i] = i;
+		rs[15 + 8 * i] = 8;
+		rs[16 + 8 * i] = algs[i];
+	}
+	return 36;
+}
+
+/* rmcp_rakp1 - answer RAKP Message 1 with RAKP Message 2. Caller must hold
+ * bmc->lock.
+ *
+ * @bmc: BMC
+ * @rq: request payload
+ * @len: length of request payload
+ * @rs: response payload, 72 bytes
+ *
+ * returns length of response payload, 0 if there's nothing to send
+ */
+static size_t
+rmcp_rakp1(struct bmc *bmc, const uint8_t *rq, size_t len, uint8_t *rs)
+{
+	struct hmac_key scratch;
+	struct session *session;
+	/* SIDm, SIDc, Rm, Rc, GUIDc, ROLEm, ULENGTHm, UNAMEm */
+	uint8_t buf[74];
+	uint8_t hash;
+	size_t n;
+	uint8_t name_len;
+	uint8_t priv;
+	uint8_t limit;
+	int uid;
+	if (len < 28) {
+		return 0;
+	}
+	memset(rs, 0, 40);
+	rs[0] = rq[0];
+	session = session_find(&bmc->app.sessions, get_le32(&rq[4]),
+			monotonic_ms());
+	if (session == NULL || session->state != SESSION_PENDING
+			|| session->auth_type != IPMI_AUTH_RMCP_PLUS) {
+		rs[1] = RMCP_STATUS_SESSION_INV;
+		return 8;
+	}
+	put_le32(&rs[4], session->remote_id);
+	priv = rq[24] & 0x0F;
+	name_len = rq[27];
+	if (name_len > sizeof(session->name)
+			|| 28 + (size_t)name_len > len) {
+		rs[1] = RMCP_STATUS_NAME_LEN_INV;
+		return 8;
+	}
+	if (priv < PRIV_CALLBACK || priv > session->max_priv) {
+		rs[1] = RMCP_STATUS_ROLE_INV;
+		return 8;
+	}
+	uid = user_by_name(&bmc->app, &rq[28], name_len);
+	limit = uid < 0 ? 0 : user_session_priv(&bmc->app, uid,
+			session->channel);
+	if (limit == 0) {
+		rs[1] = RMCP_STATUS_NAME_UNAUTH;
+		return 8;
+	}
+	if (priv > limit) {
+		rs[1] = RMCP_STATUS_ROLE_UNAUTH;
+		return 8;
+	}
+	session->uid = uid;
+	session->role = rq[24];
+	session->max_priv = priv;
+	session->name_len = name_len;
+	memcpy(session->name, &rq[28], name_len);
+	memcpy(session->remote_random, &rq[8], 16);
+	session_random(&bmc->app.sessions, session->challenge, 16);
+	memcpy(&rs[8], session->challenge, 16);
+	memcpy(&rs[24], bmc->app.guid, 16);
+	if (session->auth_alg == RMCP_AUTH_RAKP_NONE) {
+		/* no key exchange authentication code */
+		return 40;
+	}
+	hash = rmcp_auth_hash(session->auth_alg);
+	put_le32(&buf[0], session->remote_id);
+	put_le32(&buf[4], session->id);
+	memcpy(&buf[8], session->remote_random, 16);
+	memcpy(&buf[24], session->challenge, 16);
+	memcpy(&buf[40], bmc->app.guid, 16);
+	n = 56 + rmcp_rakp_user(session, &buf[56]);
+	hmac(user_key(&bmc->app, uid, hash, &scratch), buf, n, &rs[40]);
+	return 40 + hash_size(hash);
+}
+
+/* rmcp_rakp_hmac - check RAKP 3 key exchange authentication code of
+ * RAKP-HMAC-SHA1 or -SHA256, derive session keys and store RAKP 4
+ * integrity check value. Caller must hold bmc->lock.
+ *
+ * @bmc: BMC
+ * @session: session being set up
+ * @code: authentication code of RAKP 3, digest size of the hash
+ * @icv: integrity check value of RAKP 4, 16 bytes
+ *
+ * returns length of integrity check value, (-1) when the console doesn't
+ * know the password
+ */
+static int
+rmcp_rakp_hmac(struct bmc *bmc, struct session *session,
+		const uint8_t *code, uint8_t *icv)
+{
+	const struct hmac_key *key;
+	struct hmac_key scratch;
+	uint8_t hash = rmcp_auth_hash(session->auth_alg);
+	uint8_t buf[56];
+	uint8_t mac[HASH_MAX_SIZE];
+	size_t size = hash_size(hash);
+	size_t n;
+	key = user_key(&bmc->app, session->uid, hash, &scratch);
+	/* Rc, SIDm, ROLEm, ULENGTHm, UNAMEm */
+	memcpy(&buf[0], session->challenge, 16);
+	put_le32(&buf[16], session->remote_id);
+	n = 20 + rmcp_rakp_user(session, &buf[20]);
+	hmac(key, buf, n, mac);
+	if (!rmcp_mac_equal(mac, code, size)) {
+		return (-1);
+	}
+	/* SIK over Rm, Rc, ROLEm, ULENGTHm, UNAMEm, keyed by K_G = K_UID */
+	memcpy(&buf[0], session->remote_random, 16);
+	memcpy(&buf[16], session->challenge, 16);
+	n = 32 + rmcp_rakp_user(session, &buf[32]);
+	hmac(key, buf, n, session->sik);
+	hmac_key_init(&scratch, hash, session->sik, size);
+	/* integrity check value over Rm, SIDc, GUIDc */
+	memcpy(&buf[0], session->remote_random, 16);
+	put_le32(&buf[16], session->id);
+	memcpy(&buf[20], bmc->app.guid, 16);
+	hmac(&scratch, buf, 36, mac);
+	memcpy(icv, mac, rmcp_icv_size(hash));
+	/* K1 and K2 are keyed by SIK too, over 20 bytes of 01h and 02h */
+	if (session->integrity_alg != RMCP_INTEGRITY_NONE) {
+		memset(buf, 0x01, 20);
+		hmac(&scratch, buf, 20, mac);
+		hmac_key_init(&session->k1,
+				rmcp_integrity_hash(session->integrity_alg),
+				mac, size);
+	}
+	if (session->conf_alg != RMCP_CONF_NONE) {
+		memset(buf, 0x02, 20);
+		hmac(&scratch, buf, 20, mac);
+		aes128_key_init(&session->k2, mac);
+	}
+	return rmcp_icv_size(hash);
+}
+
+/* rmcp_rakp3 - answer RAKP Message 3 with RAKP Message 4 and activate the
+ * session. Caller must hold bmc->lock.
+ *
+ * @bmc: BMC
+ * @rq: request payload
+ * @len: length of request payload
+ * @rs: response payload, 24 bytes
+ *
+ * returns length of response payload, 0 if there's nothing to send
+ */
+static size_t
+rmcp_rakp3(struct bmc *bmc, const uint8_t *rq, size_t len, uint8_t *rs)
+{
+	struct session *session;
+	uint64_t now = monotonic_ms();
+	size_t rs_len = 8;
+	int icv_len;
+	int rc;
+	if (len < 8) {
+		return 0;
+	}
+	memset(rs, 0, 8);
+	rs[0] = rq[0];
+	session = session_find(&bmc->app.sessions, get_le32(&rq[4]), now);
+	if (session == NULL || session->state != SESSION_PENDING
+			|| session->auth_type != IPMI_AUTH_RMCP_PLUS
+			|| session->uid == 0) {
+		rs[1] = RMCP_STATUS_SESSION_INV;
+		return 8;
+	}
+	if (rq[1] != RMCP_STATUS_OK) {
+		/* console gives up */
+		session_close(&bmc->app.sessions, session);
+		return 0;
+	}
+	put_le32(&rs[4], session->remote_id);
+	if (session->auth_alg != RMCP_AUTH_RAKP_NONE) {
+		icv_len = (-1);
+		if (len >= 8 + hash_size(rmcp_auth_hash(session->auth_alg))) {
+			icv_len = rmcp_rakp_hmac(bmc, session, &rq[8],
+					&rs[8]);
+		}
+		if (icv_len < 0) {
+			log_info("Session %" PRIx32 " of UID %" PRIu8
+					" failed authentication",
+					session->id, session->uid);
+			session_close(&bmc->app.sessions, session);
+			rs[1] = RMCP_STATUS_INTEGRITY_INV;
+			return 8;
+		}
+		rs_len += icv_len;
+	}
+	rc = session_activate(&bmc->app.sessions, session, session->uid,
+			user_get(&bmc->app, session->uid)->session_limit & 0x0F,
+			bmc->app.channels[session->channel].sessions & 0x3F,
+			now);
+	if (rc != 0) {
+		session_close(&bmc->app.sessions, session);
+		rs[1] = RMCP_STATUS_NO_RESOURCES;
+		return 8;
+	}
+	session->priv = session->max_priv < PRIV_USER
+		? session->max_priv : PRIV_USER;
+	/* console starts at 1, so does the BMC */
+	session->in_seq = 0;
+	session->seq_mask = 1;
+	session->out_seq = 1;
+	log_info("Session %" PRIx32 " of UID %" PRIu8 " activated",
+			session->id, session->uid);
+	return rs_len;
+}
+
+/* rmcp_verify - check integrity trailer of authenticated v2.0 packet: FFh
+ * pad to make auth type through next header a multiple of 4 bytes, pad
+ * length, next header and AuthCode.
+ *
+ * @k1: integrity key of session
+ * @icv_size: length of AuthCode
+ * @pkt: datagram
+ * @len: length of datagram
+ *
+ * returns 0 when the packet is intact, otherwise (-1)
+ */
+static int
+rmcp_verify(const struct hmac_key *k1, size_t icv_size, const uint8_t *pkt,
+		size_t len)
+{
+	const size_t hdr = RMCP_HEADER_SIZE + 12;
+	uint8_t mac[HASH_MAX_SIZE];
+	size_t end;
+	size_t pad;
+	if (len < hdr + 2 + icv_size) {
+		return (-1);
+	}
+	end = len - icv_size;
+	pad = pkt[end - 2];
+	if (pkt[end - 1] != RMCP_NEXT_HEADER
+			|| (end - RMCP_HEADER_SIZE) % 4 != 0
+			|| hdr + (pkt[14] | (pkt[15] << 8)) + pad + 2 != end) {
+		return (-1);
+	}
+	hmac(k1, &pkt[RMCP_HEADER_SIZE], end - RMCP_HEADER_SIZE, mac);
+	return rmcp_mac_equal(mac, &pkt[end], icv_size) ? 0 : (-1);
+}
+
+/* rmcp_sign - append integrity trailer to v2.0 packet, see rmcp_verify().
+ *
+ * returns length of packet with the trailer
+ */
+static size_t
+rmcp_sign(const struct rmcp_keys *keys, uint8_t *out, size_t len)
+{
+	uint8_t mac[HASH_MAX_SIZE];
+	size_t pad = (4 - (len - RMCP_HEADER_SIZE + 2) % 4) % 4;
+	memset(&out[len], 0xFF, pad);
+	len += pad;
+	out[len++] = pad;
+	out[len++] = RMCP_NEXT_HEADER;
+	hmac(&keys->k1, &out[RMCP_HEADER_SIZE], len - RMCP_HEADER_SIZE, mac);
+	memcpy(&out[len], mac, keys->icv_size);
+	return len + keys->icv_size;
+}
+
+/* rmcp_decrypt - decrypt AES-CBC-128 payload in place. Payload is the IV
+ * followed by the encrypted message, pad bytes 01h, 02h, ... and number of
+ * pad bytes.
+ *
+ * @k2: confidentiality key of session
+ * @payload: payload, message starts AES_BLOCK_SIZE bytes into it
+ * @len: length of payload, length of message on return
+ *
+ * returns 0 on success, (-1) when the payload is malformed
+ */
+static int
+rmcp_decrypt(const struct aes128_key *k2, uint8_t *payload, size_t *len)
+{
+	uint8_t *data = &payload[AES_BLOCK_SIZE];
+	size_t data_len;
+	size_t pad;
+	size_t i;
+	if (*len < 2 * AES_BLOCK_SIZE || *len % AES_BLOCK_SIZE != 0) {
+		return (-1);
+	}
+	data_len = *len - AES_BLOCK_SIZE;
+	aes128_cbc_decrypt(k2, payload, data, data_len);
+	pad = data[data_len - 1];
+	if (pad >= AES_BLOCK_SIZE) {
+		return (-1);
+	}
+	for (i = 0; i < pad; i++) {
+		if (data[data_len - 1 - pad + i] != i + 1) {
+			return (-1);
+		}
+	}
+	*len = data_len - 1 - pad;
+	return 0;
+}
+
+/* rmcp_encrypt - pad and encrypt message in place, see rmcp_decrypt().
+ *
+ * @keys: keys of session
+ * @payload: payload, message starts AES_BLOCK_SIZE bytes into it and has
+ * room for another AES_BLOCK_SIZE bytes after it
+ * @len: length of message
+ *
+ * returns length of payload
+ */
+static size_t
+rmcp_encrypt(const struct rmcp_keys *keys, uint8_t *payload, size_t len)
+{
+	uint8_t *data = &payload[AES_BLOCK_SIZE];
+	size_t pad = (AES_BLOCK_SIZE - (len + 1) % AES_BLOCK_SIZE)
+		% AES_BLOCK_SIZE;
+	size_t i;
+	for (i = 1; i <= pad; i++) {
+		data[len++] = i;
+	}
+	data[len++] = pad;
+	memcpy(payload, keys->iv, AES_BLOCK_SIZE);
+	aes128_cbc_encrypt(&keys->k2, payload, data, len);
+	return AES_BLOCK_SIZE + len;
+}
+
+/* rmcp_session20 - check v2.0 packet against its session and fill in
+ * session context. Caller must hold bmc->lock.
+ *
+ * @bmc: BMC
+ * @ctx: session context to fill in
+ * @pkt: datagram
+ * @len: length of datagram
+ * @keys: keys of the session
+ * @remote_id: console's session ID
+ * @out_seq: session sequence number of the response
+ *
+ * returns 0 when packet should be served, otherwise (-1)
+ */
+static int
+rmcp_session20(struct bmc *bmc, struct session_ctx *ctx, const uint8_t *pkt,
+		size_t len, struct rmcp_keys *keys, uint32_t *remote_id,
+		uint32_t *out_seq)
+{
+	struct session *session;
+	uint64_t now = monotonic_ms();
+	session = session_find(&bmc->app.sessions, ctx->id, now);
+	if (session == NULL || session->state != SESSION_ACTIVE
+			|| session->auth_type != IPMI_AUTH_RMCP_PLUS) {
+		return (-1);
+	}
+	/* payloads are protected the way the session has been set up */
+	if (!(pkt[5] & IPMI_PAYLOAD_AUTHENTICATED)
+			!= (session->integrity_alg == RMCP_INTEGRITY_NONE)
+			|| !(pkt[5] & IPMI_PAYLOAD_ENCRYPTED)
+			!= (session->conf_alg == RMCP_CONF_NONE)) {
+		return (-1);
+	}
+	if (session->integrity_alg != RMCP_INTEGRITY_NONE) {
+		keys->icv_size = rmcp_icv_size(
+				rmcp_integrity_hash(session->integrity_alg));
+		if (rmcp_verify(&session->k1, keys->icv_size, pkt,
+					len) != 0) {
+			return (-1);
+		}
+		keys->k1 = session->k1;
+	}
+	if (session_seq_check(session, get_le32(&pkt[10])) != 0) {
+		return (-1);
+	}
+	if (session->conf_alg != RMCP_CONF_NONE) {
+		keys->encrypted = 1;
+		keys->k2 = session->k2;
+		session_random(&bmc->app.sessions, keys->iv,
+				sizeof(keys->iv));
+	}
+	session_touch(&bmc->app.sessions, session, now);
+	ctx->priv = session->priv;
+	*remote_id = session->remote_id;
+	*out_seq = session->out_seq++;
+	if (session->out_seq == 0) {
+		session->out_seq = 1;
+	}
+	return 0;
+}
+
+/* rmcp_ipmi20 - serve IPMI v2.0/RMCP+ session packet. Encrypted messages
+ * are decrypted where they are in pkt, and responses are built and
+ * encrypted where they go in out.
+ */
+static size_t
+rmcp_ipmi20(struct bmc *bmc, struct session_ctx *ctx, uint8_t *pkt,
+		size_t len, uint8_t *out, size_t out_size)
+{
+	/* auth type, payload type, session ID and sequence, length */
+	const size_t hdr = RMCP_HEADER_SIZE + 12;
+	/* IV and cipher pad, integrity pad, pad length, next header and
+	 * AuthCode
+	 */
+	const size_t trailer = 2 * AES_BLOCK_SIZE + 3 + 2 + HASH_MAX_SIZE;
+	struct rmcp_keys keys;
+	uint32_t remote_id = 0;
+	uint32_t out_seq = 0;
+	uint8_t payload;
+	uint8_t type;
+	uint8_t *msg;
+	size_t msg_len;
+	size_t rs_hdr = hdr;
+	int rc = 0;
+	if (len < hdr || out_size < hdr + trailer + 40 + HASH_MAX_SIZE) {
+		return 0;
+	}
+	payload = pkt[5];
+	type = payload & IPMI_PAYLOAD_TYPE;
+	/* set-up payloads are never protected */
+	if (type != IPMI_PAYLOAD_IPMI && payload != type) {
+		log_debug("RMCP: payload %" PRIx8 " not served.", payload);
+		return 0;
+	}
+	keys.icv_size = 0;
+	keys.encrypted = 0;
+	ctx->auth_type = IPMI_AUTH_RMCP_PLUS;
+	ctx->id = get_le32(&pkt[6]);
+	msg = &pkt[hdr];
+	msg_len = pkt[14] | (pkt[15] << 8);
+	if (hdr + msg_len > len) {
+		return 0;
+	}
+	switch (type) {
+	case IPMI_PAYLOAD_IPMI:
+		if (ctx->id != 0) {
+			pthread_mutex_lock(&bmc->lock);
+			rc = rmcp_session20(bmc, ctx, pkt, len, &keys,
+					&remote_id, &out_seq);
+			pthread_mutex_unlock(&bmc->lock);
+		} else if (payload != type) {
+			/* no keys outside of a session */
+			rc = (-1);
+		}
+		if (rc == 0 && keys.encrypted) {
+			rc = rmcp_decrypt(&keys.k2, msg, &msg_len);
+			msg += AES_BLOCK_SIZE;
+			rs_hdr += AES_BLOCK_SIZE;
+		}
+		if (rc != 0) {
+			log_debug("RMCP: v2.0 packet of session %" PRIx32
+					" dropped.", ctx->id);
+			return 0;
+		}
+		msg_len = rmcp_ipmi_msg(bmc, ctx, msg, msg_len, &out[rs_hdr],
+				out_size - hdr - trailer);
+		if (msg_len > 0 && keys.encrypted) {
+			msg_len = rmcp_encrypt(&keys, &out[hdr], msg_len);
+		}
+		break;
+	case IPMI_PAYLOAD_OPEN_SESSION_RQ:
+		msg_len = rmcp_open_session(bmc, ctx, msg, msg_len, &out[hdr]);
+		break;
+	case IPMI_PAYLOAD_RAKP1:
+		pthread_mutex_lock(&bmc->lock);
+		msg_len = rmcp_rakp1(bmc, msg, msg_len, &out[hdr]);
+		pthread_mutex_unlock(&bmc->lock);
+		break;
+	case IPMI_PAYLOAD_RAKP3:
+		pthread_mutex_lock(&bmc->lock);
+		msg_len = rmcp_rakp3(bmc, msg, msg_len, &out[hdr]);
+		pthread_mutex_unlock(&bmc->lock);
+		break;
+	default:
+		log_debug("RMCP: payload %" PRIx8 " not served.", payload);
+		return 0;
+	}
+	if (msg_len == 0) {
+		return 0;
+	}
+	memcpy(out, pkt, RMCP_HEADER_SIZE);
+	out[4] = IPMI_AUTH_RMCP_PLUS;
+	/* responses of set-up payloads are next to their requests */
+	out[5] = type == IPMI_PAYLOAD_IPMI ? payload : payload + 1;
+	put_le32(&out[6], remote_id);
+	put_le32(&out[10], out_seq);
+	out[14] = msg_len & 0xFF;
+	out[15] = msg_len >> 8;
+	if (keys.icv_size > 0) {
+		return rmcp_sign(&keys, out, hdr + msg_len);
+	}
+	return hdr + msg_len;
+}
+
+/* rmcp_handle - serve one RMCP datagram.
+ *
+ * @bmc: BMC the datagram has been sent to
+ * @peer: sender of the datagram, may be NULL
+ * @pkt: datagram, modified in place
+ * @len: length of datagram
+ * @out: buffer for response datagram
+ * @out_size: size of out
+ *
+ * Response data is allocated from the current arena, see arena_use().
+ *
+ * returns length of response, 0 if there's nothing to send
+ */
+int
+rmcp_handle(struct bmc *bmc, const struct sockaddr_in *peer, uint8_t *pkt,
+		size_t len, uint8_t *out, size_t out_size)
+{
+	struct session_ctx ctx;
+	if (len < RMCP_HEADER_SIZE + 1 || pkt[0] != RMCP_VERSION) {
+		return 0;
+	}
+	/* ACKs of our own messages, we don't ask for any */
+	if (pkt[3] & 0x80) {
+		return 0;
+	}
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.channel = CHANNEL_LAN;
+	ctx.priv = PRIV_NONE;
+	if (peer != NULL) {
+		ctx.addr = peer->sin_addr.s_addr;
+		ctx.port = peer->sin_port;
+	}
+	switch (pkt[3] & 0x1F) {
+	case RMCP_CLASS_ASF:
+		return rmcp_asf_ping(pkt, len, out, out_size);
+	case RMCP_CLASS_IPMI:
+		if (pkt[4] == IPMI_AUTH_RMCP_PLUS) {
+			return rmcp_ipmi20(bmc, &ctx, pkt, len, out,
+					out_size);
+		}
+		return rmcp_ipmi15(bmc, &ctx, pkt, len, out, out_size);
+	default:
+		return 0;
+	}
+}
@@ -0,0 +1,315 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "fake-ipmistack/fake-ipmistack.h"
+#include "fake-ipmistack/bmc.h"
+#include "fake-ipmistack/log.h"
+#include "fake-ipmistack/scenario.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Mapping is read-only and stays for the lifetime of the server, BMCs
+ * point into it. Whatever a BMC changes is copied first, see
+ * app_users_own() and fru_data_writable().
+ */
+static const uint8_t *scenario_base = NULL;
+static size_t scenario_size = 0;
+
+/* scenario_ptr - returns pointer to section of mapped scenario, NULL if
+ * there is no such section
+ */
+static const void *
+scenario_ptr(uint64_t offset, uint64_t len)
+{
+	if (offset == 0 || offset % SCENARIO_ALIGN != 0
+			|| offset > scenario_size
+			|| len > scenario_size - offset) {
+		return NULL;
+	}
+	return scenario_base + offset;
+}
+
+/* scenario_check_profile - returns whether everything profile refers to
+ * is within the file and makes sense
+ */
+static int
+scenario_check_profile(const struct scenario_profile *prof)
+{
+	const struct ipmi_channel *channels;
+	const struct fru_ref *refs;
+	int64_t pos;
+	uint32_t i;
+	if (prof->device_id_len < DEVICE_ID_LEN_MIN
+			|| prof->device_id_len > DEVICE_ID_LEN_MAX
+			|| prof->channel_count > CHANNEL_MAX
+			|| prof->sensor_count > SENSOR_LUNS * SENSOR_NUMBERS
+			|| prof->fru_count > FRU_DEVICES_MAX) {
+		return 0;
+	}
+	if (prof->users != 0 && scenario_ptr(prof->users,
+				sizeof(struct user_db)) == NULL) {
+		return 0;
+	}
+	if (prof->sensor_count > 0 && scenario_ptr(prof->sensors,
+				(uint64_t)prof->sensor_count
+				* sizeof(struct sensor_preset)) == NULL) {
+		return 0;
+	}
+	if (prof->channel_count > 0) {
+		channels = scenario_ptr(prof->channels, prof->channel_count
+				* sizeof(struct ipmi_channel));
+		if (channels == NULL) {
+			return 0;
+		}
+		for (i = 0; i < prof->channel_count; i++) {
+			if (channels[i].number >= CHANNEL_MAX) {
+				return 0;
+			}
+		}
+	}
+	if (prof->fru_count == 0) {
+		return 1;
+	}
+	refs = scenario_ptr(prof->frus, prof->fru_count
+			* sizeof(struct fru_ref));
+	if (refs == NULL) {
+		return 0;
+	}
+	for (i = 0; i < prof->fru_count; i++) {
+		pos = (int64_t)prof->frus + refs[i].offset;
+		if (refs[i].dev_id >= FRU_DEVICES_MAX || refs[i].size < 1
+				|| refs[i].size > FRU_SIZE_MAX || pos < 0
+				|| (uint64_t)pos > scenario_size
+				|| refs[i].size > scenario_size - pos) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* scenario_check - returns why mapped file isn't a scenario this build
+ * can use, NULL if it is one
+ */
+static const char *
+scenario_check(const struct scenario_header *hdr, size_t size)
+{
+	const struct scenario_profile *profiles;
+	uint32_t first = 0;
+	uint32_t i;
+	if (memcmp(hdr->magic, SCENARIO_MAGIC, sizeof(hdr->magic)) != 0) {
+		return "not a scenario";
+	}
+	if (hdr->byte_order != SCENARIO_BYTE_ORDER) {
+		return "scenario of another byte order";
+	}
+	if (hdr->version != SCENARIO_VERSION
+			|| hdr->profile_size != sizeof(struct scenario_profile)
+			|| hdr->user_db_size != sizeof(struct user_db)
+			|| hdr->channel_size != sizeof(struct ipmi_channel)
+			|| hdr->preset_size != sizeof(struct sensor_preset)
+			|| hdr->fru_ref_size != sizeof(struct fru_ref)) {
+		return "scenario of another version, compile it again";
+	}
+	if (hdr->size != size || hdr->profile_count < 1
+			|| hdr->bmc_count < 1
+			|| hdr->bmc_count > BMC_COUNT_MAX) {
+		return "scenario is damaged";
+	}
+	profiles = scenario_ptr(hdr->profiles, (uint64_t)hdr->profile_count
+			* sizeof(struct scenario_profile));
+	if (profiles == NULL) {
+		return "scenario is damaged";
+	}
+	for (i = 0; i < hdr->profile_count; i++) {
+		if (profiles[i].first_bmc != first || profiles[i].bmcs < 1
+				|| profiles[i].bmcs > hdr->bmc_count - first
+				|| !scenario_check_profile(&profiles[i])) {
+			return "scenario is damaged";
+		}
+		first += profiles[i].bmcs;
+	}
+	if (first != hdr->bmc_count) {
+		return "scenario is damaged";
+	}
+	return NULL;
+}
+
+/* scenario_map - map compiled scenario to apply to BMCs later on.
+ *
+ * @path: scenario file, see fake-ipmistack-scenario
+ *
+ * returns number of BMCs the scenario describes, (-1) on error
+ */
+long
+scenario_map(const char *path)
+{
+	const struct scenario_header *hdr;
+	const char *err;
+	struct stat st;
+	void *base;
+	int fd;
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		perror(path);
+		return (-1);
+	}
+	if (fstat(fd, &st) != 0) {
+		perror("fstat");
+		close(fd);
+		return (-1);
+	}
+	if ((size_t)st.st_size < sizeof(struct scenario_header)) {
+		log_error("%s: not a scenario", path);
+		close(fd);
+		return (-1);
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		perror("mmap");
+		return (-1);
+	}
+	scenario_base = base;
+	scenario_size = st.st_size;
+	hdr = base;
+	err = scenario_check(hdr, st.st_size);
+	if (err != NULL) {
+		log_error("%s: %s", path, err);
+		munmap(base, st.st_size);
+		scenario_base = NULL;
+		scenario_size = 0;
+		return (-1);
+	}
+	log_info("Scenario %s: %" PRIu32 " profile(s), %" PRIu32 " BMC(s)",
+			path, hdr->profile_count, hdr->bmc_count);
+	return hdr->bmc_count;
+}
+
+/* scenario_identity - tells which scenario BMCs are of, for snapshots
+ * to be restored on the same one only. Both are 0 if there is none.
+ */
+void
+scenario_identity(uint64_t *size, uint64_t *hash)
+{
+	const struct scenario_header *hdr;
+	*size = 0;
+	*hash = 0;
+	if (scenario_base != NULL) {
+		hdr = (const struct scenario_header *)scenario_base;
+		*size = hdr->size;
+		*hash = hdr->hash;
+	}
+}
+
+/* scenario_apply_bmc - make BMC one of its profile.
+ *
+ * @bmc: BMC as bmc_pool_init() left it
+ * @prof: profile
+ * @nth: which BMC of the profile it is
+ */
+static void
+scenario_apply_bmc(struct bmc *bmc, const struct scenario_profile *prof,
+		uint32_t nth)
+{
+	const struct ipmi_channel *channels;
+	uint32_t node;
+	uint32_t i;
+	bmc->app.device_id = prof->device_id;
+	bmc->app.device_id_len = prof->device_id_len;
+	channels = scenario_ptr(prof->channels, prof->channel_count
+			* sizeof(struct ipmi_channel));
+	for (i = 0; i < prof->channel_count; i++) {
+		memcpy(&bmc->app.channels[channels[i].number], &channels[i],
+				sizeof(struct ipmi_channel));
+	}
+	if (prof->users != 0) {
+		bmc->app.users_shared = scenario_ptr(prof->users,
+				sizeof(struct user_db));
+		bmc->app.users_enabled = prof->users_enabled;
+		bmc->app.users_named = prof->users_named;
+	}
+	if (prof->flags & SCENARIO_GUID) {
+		memcpy(bmc->app.guid, prof->guid, sizeof(bmc->app.guid));
+		node = ((uint32_t)prof->guid[12] << 24)
+			| ((uint32_t)prof->guid[13] << 16)
+			| ((uint32_t)prof->guid[14] << 8) | prof->guid[15];
+		node += nth;
+		bmc->app.guid[12] = node >> 24;
+		bmc->app.guid[13] = node >> 16;
+		bmc->app.guid[14] = node >> 8;
+		bmc->app.guid[15] = node;
+	}
+	if (prof->sensor_count > 0) {
+		bmc->sensor.presets = scenario_ptr(prof->sensors,
+				(uint64_t)prof->sensor_count
+				* sizeof(struct sensor_preset));
+		bmc->sensor.preset_count = prof->sensor_count;
+	}
+	if (prof->fru_count > 0) {
+		bmc->storage.fru.refs = scenario_ptr(prof->frus,
+				prof->fru_count * sizeof(struct fru_ref));
+		bmc->storage.fru.ref_count = prof->fru_count;
+	}
+}
+
+/* scenario_apply - give every BMC identity of its profile. BMC N is of the
+ * profile which describes BMC N modulo the number of BMCs the scenario
+ * describes: a pool larger than the scenario repeats it, GUIDs of every
+ * repetition following those of the previous one. Has to be called after
+ * bmc_pool_init() and before BMCs are restored from a snapshot.
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+scenario_apply()
+{
+	const struct scenario_header *hdr;
+	const struct scenario_profile *profiles;
+	uint32_t count = bmc_count();
+	uint32_t i;
+	uint32_t j = 0;
+	uint32_t nth = 0;
+	if (scenario_base == NULL) {
+		log_error("No scenario has been mapped");
+		return (-1);
+	}
+	hdr = (const struct scenario_header *)scenario_base;
+	profiles = scenario_ptr(hdr->profiles, (uint64_t)hdr->profile_count
+			* sizeof(struct scenario_profile));
+	for (i = 0; i < count; i++) {
+		if (nth == profiles[j].bmcs) {
+			nth = 0;
+			j = (j + 1) % hdr->profile_count;
+		}
+		scenario_apply_bmc(bmc_get(i), &profiles[j], nth
+				+ i / hdr->bmc_count * profiles[j].bmcs);
+		nth++;
+	}
+	return 0;
+}
@@ -0,0 +1,288 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "fake-ipmistack/fake-ipmistack.h"
+#include "fake-ipmistack/log.h"
+#include "fake-ipmistack/sdr.h"
+
+/* Full Sensor Record is generated for each sensor from one of these, in
+ * turn. Readings are raw values, converted as (M * raw) * 10^R_exp.
+ */
+struct sdr_sensor_tmpl {
+	const char *name;
+	uint8_t entity;
+	uint8_t type;
+	uint8_t unit;
+	uint8_t m;
+	/* R exponent in upper nibble, B exponent in lower, 4-bit signed */
+	uint8_t exps;
+	uint8_t nominal;
+	/* upper non-recoverable, critical, non-critical, then lower ones */
+	uint8_t thresholds[6];
+};
+
+static const struct sdr_sensor_tmpl sdr_sensor_tmpls[] = {
+	{ "Temp", 0x03, 0x01, 0x01, 1, 0x00, 45,
+		{ 100, 95, 85, 0, 5, 10 } },
+	{ "Fan", 0x1D, 0x04, 0x12, 100, 0x00, 60,
+		{ 200, 190, 180, 5, 10, 15 } },
+	{ "12V", 0x07, 0x02, 0x04, 6, 0xE0, 200,
+		{ 230, 220, 215, 170, 180, 185 } },
+};
+
+static struct sdr_repo sdr = { NULL, 0, 0, NULL, 0, 0, 0, 0, 0 };
+
+/* sdr_find - binary search the index.
+ *
+ * @id: record ID
+ *
+ * returns position of record with given ID, or of the first record with
+ * greater ID if there is none
+ */
+static uint32_t
+sdr_find(uint16_t id)
+{
+	uint32_t lo = 0;
+	uint32_t hi = sdr.count;
+	uint32_t mid;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (sdr.index[mid].id < id) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/* sdr_add - store record and index it.
+ *
+ * @rec: record, its ID is taken from the first two bytes
+ * @len: length of the record including header
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+static int
+sdr_add(const uint8_t *rec, uint16_t len)
+{
+	struct sdr_index *index;
+	uint8_t *buf;
+	uint32_t pos;
+	uint16_t id = rec[0] | (rec[1] << 8);
+	if (sdr.len + len > sdr.size) {
+		buf = realloc(sdr.buf, sdr.size * 2 + SDR_RECORD_MAX);
+		if (buf == NULL) {
+			perror("realloc fail");
+			return (-1);
+		}
+		sdr.buf = buf;
+		sdr.size = sdr.size * 2 + SDR_RECORD_MAX;
+	}
+	if (sdr.count == sdr.index_size) {
+		index = realloc(sdr.index, (sdr.index_size * 2 + 16)
+				* sizeof(struct sdr_index));
+		if (index == NULL) {
+			perror("realloc fail");
+			return (-1);
+		}
+		sdr.index = index;
+		sdr.index_size = sdr.index_size * 2 + 16;
+	}
+	pos = sdr_find(id);
+	if (pos < sdr.count && sdr.index[pos].id == id) {
+		log_error("Duplicate SDR record ID %" PRIu16 ".", id);
+		return (-1);
+	}
+	memmove(&sdr.index[pos + 1], &sdr.index[pos],
+			(sdr.count - pos) * sizeof(struct sdr_index));
+	sdr.index[pos].id = id;
+	sdr.index[pos].len = len;
+	sdr.index[pos].offset = sdr.len;
+	memcpy(sdr.buf + sdr.len, rec, len);
+	sdr.len+= len;
+	sdr.count++;
+	sdr.units+= (len + SDR_ALLOC_UNIT - 1) / SDR_ALLOC_UNIT;
+	return 0;
+}
+
+/* sdr_mc_locator - build Management Controller Device Locator Record.
+ *
+ * @rec: buffer of SDR_RECORD_MAX bytes
+ * @id: record ID
+ *
+ * returns length of the record
+ */
+static uint16_t
+sdr_mc_locator(uint8_t *rec, uint16_t id)
+{
+	const char *name = "fake-ipmistack";
+	size_t name_len = strlen(name);
+	memset(rec, 0, SDR_RECORD_MAX);
+	rec[0] = id & 0xFF;
+	rec[1] = id >> 8;
+	rec[2] = SDR_VERSION;
+	rec[3] = SDR_TYPE_MC_LOCATOR;
+	rec[4] = 11 + name_len;
+	rec[5] = 0x20;
+	/* sensor, SDR repository and SEL device */
+	rec[8] = 0x07;
+	rec[12] = 0x06;
+	rec[13] = 0x01;
+	rec[15] = 0xC0 | name_len;
+	memcpy(rec + 16, name, name_len);
+	return SDR_HEADER_SIZE + rec[4];
+}
+
+/* sdr_full_sensor - build Full Sensor Record.
+ *
+ * @rec: buffer of SDR_RECORD_MAX bytes
+ * @id: record ID
+ * @n: sequence number of the sensor, 0 - SDR_SENSORS_MAX
+ *
+ * returns length of the record
+ */
+static uint16_t
+sdr_full_sensor(uint8_t *rec, uint16_t id, uint32_t n)
+{
+	const struct sdr_sensor_tmpl *tmpl;
+	int name_len;
+	tmpl = &sdr_sensor_tmpls[n % (sizeof(sdr_sensor_tmpls)
+			/ sizeof(sdr_sensor_tmpls[0]))];
+	memset(rec, 0, SDR_RECORD_MAX);
+	rec[0] = id & 0xFF;
+	rec[1] = id >> 8;
+	rec[2] = SDR_VERSION;
+	rec[3] = SDR_TYPE_FULL_SENSOR;
+	/* 255 sensor numbers per LUN, 4 LUNs per owner */
+	rec[5] = 0x20 + 2 * (n / 1020);
+	rec[6] = (n / 255) % 4;
+	rec[7] = n % 255;
+	rec[8] = tmpl->entity;
+	rec[9] = 1 + (n / 3) % 0x7F;
+	rec[10] = 0x7F;
+	rec[11] = 0x68;
+	rec[12] = tmpl->type;
+	/* threshold based */
+	rec[13] = 0x01;
+	rec[14] = 0x95;
+	rec[15] = 0x0A;
+	rec[16] = 0x95;
+	rec[17] = 0x0A;
+	rec[18] = 0x3F;
+	rec[19] = 0x3F;
+	rec[21] = tmpl->unit;
+	rec[24] = tmpl->m;
+	rec[29] = tmpl->exps;
+	/* nominal, normal max and normal min are specified */
+	rec[30] = 0x07;
+	rec[31] = tmpl->nominal;
+	rec[32] = tmpl->thresholds[2];
+	rec[33] = tmpl->thresholds[5];
+	rec[34] = 0xFF;
+	rec[35] = 0x00;
+	memcpy(rec + 36, tmpl->thresholds, 6);
+	rec[42] = 2;
+	rec[43] = 2;
+	name_len = snprintf((char *)rec + 48, 17, "%s %" PRIu32,
+			tmpl->name, 1 + n / 3);
+	if (name_len > 16) {
+		name_len = 16;
+	}
+	rec[47] = 0xC0 | name_len;
+	rec[4] = 43 + name_len;
+	return SDR_HEADER_SIZE + rec[4];
+}
+
+/* sdr_repo_init - build repository with MC locator and given number of
+ * sensors.
+ *
+ * @sensors: number of Full Sensor Records, 0 - SDR_SENSORS_MAX
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+sdr_repo_init(uint32_t sensors)
+{
+	uint8_t rec[SDR_RECORD_MAX];
+	uint32_t i;
+	if (sensors > SDR_SENSORS_MAX) {
+		log_error("SDR sensors must be 0-%i", SDR_SENSORS_MAX);
+		return (-1);
+	}
+	if (sdr_add(rec, sdr_mc_locator(rec, 1)) != 0) {
+		return (-1);
+	}
+	for (i = 0; i < sensors; i++) {
+		if (sdr_add(rec, sdr_full_sensor(rec, i + 2, i)) != 0) {
+			return (-1);
+		}
+	}
+	sdr.add_ts = 0;
+	sdr.erase_ts = 0xFFFFFFFF;
+	log_info("SDR repository: %" PRIu32 " records, %zu bytes", sdr.count,
+			sdr.len);
+	return 0;
+}
+
+/* sdr_repo - returns the repository, for reporting its parameters */
+const struct sdr_repo *
+sdr_repo()
+{
+	return &sdr;
+}
+
+/* sdr_lookup - look up record by its ID.
+ *
+ * @id: record ID, SDR_ID_FIRST or SDR_ID_LAST
+ * @next: where to store ID of the following record, SDR_ID_LAST if none
+ * @len: where to store length of the record
+ *
+ * returns pointer to the record, NULL when there is no such record
+ */
+const uint8_t *
+sdr_lookup(uint16_t id, uint16_t *next, uint16_t *len)
+{
+	uint32_t pos;
+	if (sdr.count == 0) {
+		return NULL;
+	}
+	if (id == SDR_ID_FIRST) {
+		pos = 0;
+	} else if (id == SDR_ID_LAST) {
+		pos = sdr.count - 1;
+	} else {
+		pos = sdr_find(id);
+		if (pos == sdr.count || sdr.index[pos].id != id) {
+			return NULL;
+		}
+	}
+	*next = pos + 1 < sdr.count ? sdr.index[pos + 1].id : SDR_ID_LAST;
+	*len = sdr.index[pos].len;
+	return sdr.buf + sdr.index[pos].offset;
+}
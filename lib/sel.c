@@ -0,0 +1,234 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "fake-ipmistack/fake-ipmistack.h"
+#include "fake-ipmistack/log.h"
+#include "fake-ipmistack/sel.h"
+
+/* sel_slot_id - returns record ID stored in given slot, 0 when deleted */
+static inline uint16_t
+sel_slot_id(struct sel *sel, uint32_t slot)
+{
+	return sel->records[slot][0] | (sel->records[slot][1] << 8);
+}
+
+/* sel_trim - drop deleted records from both ends of the ring. */
+static void
+sel_trim(struct sel *sel)
+{
+	while (sel->span > 0 && sel_slot_id(sel, sel->head) == 0) {
+		sel->head = (sel->head + 1) % SEL_ENTRIES_MAX;
+		sel->span--;
+	}
+	while (sel->span > 0 && sel_slot_id(sel,
+				(sel->head + sel->span - 1) % SEL_ENTRIES_MAX)
+			== 0) {
+		sel->span--;
+	}
+	if (sel->span == 0) {
+		sel->head = 0;
+	}
+}
+
+/* sel_offset - find position of record relative to the oldest one.
+ *
+ * @sel: SEL
+ * @id: record ID, SEL_ID_FIRST or SEL_ID_LAST
+ *
+ * returns offset from head, (-1) when there is no such record
+ */
+static int32_t
+sel_offset(struct sel *sel, uint16_t id)
+{
+	uint32_t offset;
+	if (sel->entries == 0) {
+		return (-1);
+	}
+	/* both ends are never deleted records, see sel_trim() */
+	if (id == SEL_ID_FIRST) {
+		return 0;
+	} else if (id == SEL_ID_LAST) {
+		return sel->span - 1;
+	}
+	offset = (id - 1 + SEL_ENTRIES_MAX - sel->head) % SEL_ENTRIES_MAX;
+	if (offset >= sel->span || sel_slot_id(sel, id - 1) == 0) {
+		return (-1);
+	}
+	return offset;
+}
+
+/* sel_init - set up empty SEL.
+ *
+ * @sel: SEL
+ */
+void
+sel_init(struct sel *sel)
+{
+	memset(sel, 0, sizeof(struct sel));
+	sel->add_ts = 0xFFFFFFFF;
+	sel->erase_ts = 0xFFFFFFFF;
+}
+
+/* sel_add - append record, overwriting the oldest one when SEL is full.
+ *
+ * @sel: SEL
+ * @record: SEL_RECORD_SIZE bytes, record ID is filled in by SEL
+ * @ts: current SEL time, stamped on system and OEM timestamped records
+ * @id: where to store ID of the new record
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+sel_add(struct sel *sel, const uint8_t *record, uint32_t ts, uint16_t *id)
+{
+	uint8_t *rec;
+	uint32_t slot;
+	if (sel->records == NULL) {
+		sel->records = calloc(SEL_ENTRIES_MAX, SEL_RECORD_SIZE);
+		if (sel->records == NULL) {
+			perror("calloc fail");
+			return (-1);
+		}
+	}
+	if (sel->span == SEL_ENTRIES_MAX) {
+		/* head is never a deleted record */
+		sel->head = (sel->head + 1) % SEL_ENTRIES_MAX;
+		sel->span--;
+		sel->entries--;
+		sel->overflow = 1;
+		sel_trim(sel);
+	}
+	slot = (sel->head + sel->span) % SEL_ENTRIES_MAX;
+	rec = sel->records[slot];
+	memcpy(rec, record, SEL_RECORD_SIZE);
+	rec[0] = (slot + 1) & 0xFF;
+	rec[1] = (slot + 1) >> 8;
+	/* system event records and timestamped OEM records */
+	if (rec[2] == 0x02 || (rec[2] >= 0xC0 && rec[2] <= 0xDF)) {
+		rec[3] = ts & 0xFF;
+		rec[4] = (ts >> 8) & 0xFF;
+		rec[5] = (ts >> 16) & 0xFF;
+		rec[6] = ts >> 24;
+	}
+	sel->span++;
+	sel->entries++;
+	sel->add_ts = ts;
+	*id = slot + 1;
+	return 0;
+}
+
+/* sel_get - look up record by its ID.
+ *
+ * @sel: SEL
+ * @id: record ID, SEL_ID_FIRST or SEL_ID_LAST
+ * @next: where to store ID of the following record, SEL_ID_LAST if none
+ *
+ * returns pointer to the record, NULL when there is no such record
+ */
+const uint8_t *
+sel_get(struct sel *sel, uint16_t id, uint16_t *next)
+{
+	int32_t offset;
+	uint32_t i;
+	uint32_t slot;
+	offset = sel_offset(sel, id);
+	if (offset < 0) {
+		return NULL;
+	}
+	slot = (sel->head + offset) % SEL_ENTRIES_MAX;
+	*next = SEL_ID_LAST;
+	/* skipped deleted records are never visited again while iterating,
+	 * so walking the whole SEL stays linear
+	 */
+	for (i = offset + 1; i < sel->span; i++) {
+		*next = sel_slot_id(sel, (sel->head + i) % SEL_ENTRIES_MAX);
+		if (*next != 0) {
+			break;
+		}
+	}
+	return sel->records[slot];
+}
+
+/* sel_delete - delete record.
+ *
+ * @sel: SEL
+ * @id: record ID, SEL_ID_FIRST or SEL_ID_LAST
+ * @deleted: where to store ID of deleted record
+ *
+ * returns 0 on success, (-1) when there is no such record
+ */
+int
+sel_delete(struct sel *sel, uint16_t id, uint16_t *deleted)
+{
+	int32_t offset;
+	uint32_t slot;
+	offset = sel_offset(sel, id);
+	if (offset < 0) {
+		return (-1);
+	}
+	slot = (sel->head + offset) % SEL_ENTRIES_MAX;
+	*deleted = slot + 1;
+	sel->records[slot][0] = 0;
+	sel->records[slot][1] = 0;
+	sel->entries--;
+	sel_trim(sel);
+	return 0;
+}
+
+/* sel_erase - delete all records and clear overflow flag.
+ *
+ * @sel: SEL
+ * @ts: current SEL time
+ */
+void
+sel_erase(struct sel *sel, uint32_t ts)
+{
+	/* slots outside of span are never looked at, no need to wipe them */
+	sel->head = 0;
+	sel->span = 0;
+	sel->entries = 0;
+	sel->overflow = 0;
+	sel->erase_ts = ts;
+}
+
+/* sel_new_reservation - cancel current reservation and make a new one.
+ *
+ * @sel: SEL
+ *
+ * returns new reservation ID, never 0
+ */
+uint16_t
+sel_new_reservation(struct sel *sel)
+{
+	sel->resv_last++;
+	if (sel->resv_last == 0) {
+		sel->resv_last = 1;
+	}
+	sel->resv = sel->resv_last;
+	return sel->resv;
+}
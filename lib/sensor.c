@@ -0,0 +1,564 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "fake-ipmistack/fake-ipmistack.h"
+#include "fake-ipmistack/log.h"
+#include "fake-ipmistack/sdr.h"
+#include "fake-ipmistack/sensor.h"
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+/* Sensors are described by Full Sensor Records in SDR repository, which is
+ * shared by all BMCs, so the number -> index map and the defaults are too.
+ */
+static uint16_t sensor_map[SENSOR_LUNS][SENSOR_NUMBERS];
+static const uint8_t **sensor_sdrs = NULL;
+static uint32_t sensors = 0;
+
+/* sensor_engine_init - index Full Sensor Records of SDR repository. Has to
+ * be called after sdr_repo_init().
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+sensor_engine_init()
+{
+	const struct sdr_repo *repo = sdr_repo();
+	const uint8_t *rec;
+	uint16_t id = SDR_ID_FIRST;
+	uint16_t len;
+	uint16_t next;
+	memset(sensor_map, 0xFF, sizeof(sensor_map));
+	sensor_sdrs = calloc(repo->count + 1, sizeof(uint8_t *));
+	if (sensor_sdrs == NULL) {
+		perror("calloc fail");
+		return (-1);
+	}
+	sensors = 0;
+	while (repo->count > 0) {
+		rec = sdr_lookup(id, &next, &len);
+		if (rec == NULL) {
+			break;
+		}
+		if (rec[3] == SDR_TYPE_FULL_SENSOR) {
+			/* only BMC's own sensors can be asked for */
+			if (rec[5] == 0x20 && rec[7] < SENSOR_NUMBERS) {
+				sensor_map[rec[6] & 0x03][rec[7]] = sensors;
+			}
+			sensor_sdrs[sensors++] = rec;
+		}
+		if (next == SDR_ID_LAST) {
+			break;
+		}
+		id = next;
+	}
+	log_info("Sensor engine: %" PRIu32 " sensors", sensors);
+	return 0;
+}
+
+/* sensor_count - returns number of sensors of every BMC */
+uint32_t
+sensor_count()
+{
+	return sensors;
+}
+
+/* sensor_lookup - find sensor index of BMC's sensor.
+ *
+ * @lun: LUN the request has been sent to
+ * @number: sensor number
+ *
+ * returns sensor index, SENSOR_NONE if there is no such sensor
+ */
+uint16_t
+sensor_lookup(uint8_t lun, uint8_t number)
+{
+	if (number >= SENSOR_NUMBERS) {
+		return SENSOR_NONE;
+	}
+	return sensor_map[lun & 0x03][number];
+}
+
+/* sensor_table_size - returns size of the block holding all arrays of a
+ * sensor table, see sensor_table_attach()
+ */
+size_t
+sensor_table_size()
+{
+	size_t stride;
+	stride = (sensors + SENSOR_ALIGN - 1) & ~(size_t)(SENSOR_ALIGN - 1);
+	/* raw, status, pending, flags, hysteresis and thresholds */
+	return stride * (6 + SENSOR_THR_COUNT);
+}
+
+/* sensor_table_attach - lay arrays of sensor table out in a block.
+ *
+ * @table: table of one BMC
+ * @block: sensor_table_size() bytes, SENSOR_ALIGN aligned
+ *
+ * Block is taken as it is, that is how a saved table is brought back.
+ */
+void
+sensor_table_attach(struct sensor_table *table, uint8_t *block)
+{
+	size_t stride = sensor_table_size() / (6 + SENSOR_THR_COUNT);
+	int t;
+	table->count = sensors;
+	table->raw = block;
+	table->status = block + stride;
+	table->pending = block + 2 * stride;
+	table->flags = block + 3 * stride;
+	table->hyst_pos = block + 4 * stride;
+	table->hyst_neg = block + 5 * stride;
+	for (t = 0; t < SENSOR_THR_COUNT; t++) {
+		table->thr[t] = block + (6 + t) * stride;
+	}
+}
+
+/* sensor_table_alloc - allocate sensor table and fill it in with nominal
+ * readings and thresholds from SDR repository, then with presets. Does
+ * nothing if the table has been allocated already.
+ *
+ * @table: table of one BMC
+ * @presets: presets of the BMC, presets of unknown sensors are ignored
+ * @preset_count: number of presets
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+sensor_table_alloc(struct sensor_table *table,
+		const struct sensor_preset *presets, uint32_t preset_count)
+{
+	const uint8_t *rec;
+	uint8_t *block;
+	uint32_t i;
+	uint16_t idx;
+	int t;
+	if (table->raw != NULL || sensors == 0) {
+		return 0;
+	}
+	if (posix_memalign((void **)&block, SENSOR_ALIGN,
+				sensor_table_size()) != 0) {
+		perror("posix_memalign fail");
+		return (-1);
+	}
+	sensor_table_attach(table, block);
+	for (i = 0; i < sensors; i++) {
+		rec = sensor_sdrs[i];
+		/* nominal reading */
+		table->raw[i] = rec[31];
+		table->flags[i] = SENSOR_EVENTS_ENABLED
+			| SENSOR_SCANNING_ENABLED;
+		/* SDR lists them upper non-recoverable first */
+		table->thr[SENSOR_THR_UNR][i] = rec[36];
+		table->thr[SENSOR_THR_UC][i] = rec[37];
+		table->thr[SENSOR_THR_UNC][i] = rec[38];
+		table->thr[SENSOR_THR_LNR][i] = rec[39];
+		table->thr[SENSOR_THR_LC][i] = rec[40];
+		table->thr[SENSOR_THR_LNC][i] = rec[41];
+		table->hyst_pos[i] = rec[42];
+		table->hyst_neg[i] = rec[43];
+		table->status[i] = 0;
+	}
+	for (i = 0; i < preset_count; i++) {
+		idx = sensor_lookup(presets[i].lun, presets[i].number);
+		if (idx == SENSOR_NONE) {
+			continue;
+		}
+		if (presets[i].mask & SENSOR_PRESET_RAW) {
+			table->raw[idx] = presets[i].raw;
+		}
+		for (t = 0; t < SENSOR_THR_COUNT; t++) {
+			if (presets[i].mask & (1 << t)) {
+				table->thr[t][idx] = presets[i].thr[t];
+			}
+		}
+	}
+	sensor_eval(table, 0, sensors);
+	/* whatever is out of range at power on isn't logged */
+	memset(table->pending, 0, sensors);
+	return 0;
+}
+
+/* sensor_eval_scalar - compare readings against thresholds and update
+ * status, one sensor at a time.
+ *
+ * @table: table of one BMC
+ * @from: first sensor index
+ * @to: one past the last sensor index
+ *
+ * Lower thresholds assert at or below, upper ones at or above. Asserted
+ * threshold deasserts only once the reading is past it by more than
+ * hysteresis. Bits which have changed are added to pending.
+ */
+void
+sensor_eval_scalar(struct sensor_table *table, uint32_t from, uint32_t to)
+{
+	uint32_t i;
+	uint8_t prev;
+	uint8_t next;
+	int limit;
+	int raw;
+	int t;
+	for (i = from; i < to; i++) {
+		raw = table->raw[i];
+		prev = table->status[i];
+		next = 0;
+		for (t = SENSOR_THR_LNC; t <= SENSOR_THR_LNR; t++) {
+			limit = table->thr[t][i];
+			if (prev & (1 << t)) {
+				limit += table->hyst_pos[i];
+			}
+			if (raw <= limit) {
+				next |= 1 << t;
+			}
+		}
+		for (t = SENSOR_THR_UNC; t <= SENSOR_THR_UNR; t++) {
+			limit = table->thr[t][i];
+			if (prev & (1 << t)) {
+				limit -= table->hyst_neg[i];
+			}
+			if (raw >= limit) {
+				next |= 1 << t;
+			}
+		}
+		table->status[i] = next;
+		table->pending[i] |= prev ^ next;
+	}
+}
+
+#ifdef __SSE2__
+/* sensor_eval_simd - sensor_eval_scalar() for 16 sensors at a time.
+ *
+ * SSE2 has no unsigned byte compare, a <= b is max(a, b) == b. Saturating
+ * add and subtract of hysteresis keep it in range the same way int
+ * arithmetic of the scalar version does.
+ */
+void
+sensor_eval_simd(struct sensor_table *table, uint32_t from, uint32_t to)
+{
+	__m128i raw;
+	__m128i prev;
+	__m128i next;
+	__m128i hyst_pos;
+	__m128i hyst_neg;
+	__m128i bit;
+	__m128i held;
+	__m128i thr;
+	__m128i limit;
+	__m128i hit;
+	uint32_t i;
+	int t;
+	for (i = from; i + 16 <= to; i += 16) {
+		raw = _mm_loadu_si128((const __m128i *)&table->raw[i]);
+		prev = _mm_loadu_si128((const __m128i *)&table->status[i]);
+		hyst_pos = _mm_loadu_si128(
+				(const __m128i *)&table->hyst_pos[i]);
+		hyst_neg = _mm_loadu_si128(
+				(const __m128i *)&table->hyst_neg[i]);
+		next = _mm_setzero_si128();
+		for (t = 0; t < SENSOR_THR_COUNT; t++) {
+			bit = _mm_set1_epi8(1 << t);
+			held = _mm_cmpeq_epi8(_mm_and_si128(prev, bit), bit);
+			thr = _mm_loadu_si128((const __m128i *)&table->thr[t][i]);
+			if (t <= SENSOR_THR_LNR) {
+				limit = _mm_or_si128(
+						_mm_andnot_si128(held, thr),
+						_mm_and_si128(held,
+							_mm_adds_epu8(thr,
+								hyst_pos)));
+				/* raw <= limit */
+				hit = _mm_cmpeq_epi8(
+						_mm_max_epu8(raw, limit),
+						limit);
+			} else {
+				limit = _mm_or_si128(
+						_mm_andnot_si128(held, thr),
+						_mm_and_si128(held,
+							_mm_subs_epu8(thr,
+								hyst_neg)));
+				/* raw >= limit */
+				hit = _mm_cmpeq_epi8(
+						_mm_max_epu8(raw, limit),
+						raw);
+			}
+			next = _mm_or_si128(next, _mm_and_si128(hit, bit));
+		}
+		_mm_storeu_si128((__m128i *)&table->status[i], next);
+		_mm_storeu_si128((__m128i *)&table->pending[i],
+				_mm_or_si128(
+					_mm_loadu_si128(
+						(const __m128i *)&table->pending[i]),
+					_mm_xor_si128(prev, next)));
+	}
+	sensor_eval_scalar(table, i, to);
+}
+#else
+/* sensor_eval_simd - no SIMD on this target, same as sensor_eval_scalar() */
+void
+sensor_eval_simd(struct sensor_table *table, uint32_t from, uint32_t to)
+{
+	sensor_eval_scalar(table, from, to);
+}
+#endif
+
+/* sensor_eval - compare readings against thresholds and update status,
+ * using SIMD when available. See sensor_eval_scalar().
+ */
+void
+sensor_eval(struct sensor_table *table, uint32_t from, uint32_t to)
+{
+	sensor_eval_simd(table, from, to);
+}
+
+/* sensor_log_events - append a platform event record to SEL for every
+ * pending threshold crossing and clear pending.
+ *
+ * @table: table of one BMC
+ * @from: first sensor index
+ * @to: one past the last sensor index
+ * @ts: SEL timestamp
+ * @sel: SEL of the same BMC
+ *
+ * returns number of records added, (-1) when SEL couldn't be allocated
+ */
+int
+sensor_log_events(struct sensor_table *table, uint32_t from, uint32_t to,
+		uint32_t ts, struct sel *sel)
+{
+	const uint8_t *sdr;
+	uint64_t word;
+	uint32_t i = from;
+	uint16_t id;
+	uint8_t rec[SEL_RECORD_SIZE];
+	uint8_t changed;
+	int count = 0;
+	int t;
+	while (i < to) {
+		/* crossings are rare, skip quiet sensors 8 at a time */
+		if (i + 8 <= to) {
+			memcpy(&word, &table->pending[i], sizeof(word));
+			if (word == 0) {
+				i += 8;
+				continue;
+			}
+		}
+		changed = table->pending[i];
+		if (changed == 0) {
+			i++;
+			continue;
+		}
+		sdr = sensor_sdrs[i];
+		memset(rec, 0, sizeof(rec));
+		/* system event record */
+		rec[2] = 0x02;
+		/* generator is the sensor owner */
+		rec[7] = sdr[5];
+		rec[8] = sdr[6] & 0x03;
+		/* IPMI v1.5+ event message */
+		rec[9] = 0x04;
+		rec[10] = sdr[12];
+		rec[11] = sdr[7];
+		rec[14] = table->raw[i];
+		for (t = 0; t < SENSOR_THR_COUNT; t++) {
+			if (!(changed & (1 << t))) {
+				continue;
+			}
+			/* deassertion has bit 7 set */
+			rec[12] = sdr[13];
+			if (!(table->status[i] & (1 << t))) {
+				rec[12] |= 0x80;
+			}
+			/* trigger reading and threshold in data 2 and 3,
+			 * offset going-low of lower, going-high of upper
+			 */
+			rec[13] = 0x50 | (t <= SENSOR_THR_LNR ? 2 * t
+					: 2 * t + 1);
+			rec[15] = table->thr[t][i];
+			if (sel_add(sel, rec, ts, &id) != 0) {
+				return (-1);
+			}
+			count++;
+		}
+		table->pending[i] = 0;
+		i++;
+	}
+	return count;
+}
+
+/* sin() of the first quadrant in 64 steps, scaled to 127 */
+static const uint8_t sensor_sine_q[65] = {
+	0, 3, 6, 9, 12, 16, 19, 22, 25, 28, 31, 34, 37, 40, 43, 46,
+	49, 51, 54, 57, 60, 63, 65, 68, 71, 73, 76, 78, 81, 83, 85, 88,
+	90, 92, 94, 96, 98, 100, 102, 104, 106, 107, 109, 111, 112, 113, 115, 116,
+	117, 118, 120, 121, 122, 122, 123, 124, 125, 125, 126, 126, 126, 127, 127, 127,
+	127
+};
+
+/* sensor_sine - returns sin() of phase / 256 of a cycle, scaled to 127 */
+static int
+sensor_sine(uint8_t phase)
+{
+	uint8_t i = phase & 0x3F;
+	switch (phase >> 6) {
+	case 0:
+		return sensor_sine_q[i];
+	case 1:
+		return sensor_sine_q[64 - i];
+	case 2:
+		return -sensor_sine_q[i];
+	default:
+		return -sensor_sine_q[64 - i];
+	}
+}
+
+/* sensor_clamp - returns value clamped to range of raw reading */
+static uint8_t
+sensor_clamp(int value)
+{
+	if (value < 0) {
+		return 0;
+	}
+	if (value > 0xFF) {
+		return 0xFF;
+	}
+	return value;
+}
+
+/* sensor_gen_attach - make sensor follow a generator from now on. Like
+ * sensor_update(), doesn't evaluate thresholds.
+ *
+ * @table: allocated table of one BMC
+ * @idx: sensor index
+ * @gen: generator, trace samples are copied
+ * @now_ms: monotonic time in ms
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+sensor_gen_attach(struct sensor_table *table, uint16_t idx,
+		const struct sensor_gen *gen, uint64_t now_ms)
+{
+	struct sensor_gen *g;
+	uint8_t *trace = NULL;
+	if (table->gen == NULL) {
+		table->gen = calloc(table->count, sizeof(struct sensor_gen));
+		if (table->gen == NULL) {
+			perror("calloc fail");
+			return (-1);
+		}
+	}
+	if (gen->kind == SENSOR_GEN_TRACE) {
+		trace = malloc(gen->trace_len);
+		if (trace == NULL) {
+			perror("malloc fail");
+			return (-1);
+		}
+		memcpy(trace, gen->trace, gen->trace_len);
+	}
+	g = &table->gen[idx];
+	free(g->trace);
+	*g = *gen;
+	g->trace = trace;
+	g->start_ms = now_ms;
+	g->last_ms = now_ms;
+	/* xorshift must not be seeded with 0 */
+	if (g->seed == 0) {
+		g->seed = idx + 1;
+	}
+	/* every generator starts at its base */
+	table->raw[idx] = trace != NULL ? trace[0] : g->base;
+	return 0;
+}
+
+/* sensor_update - bring reading of a sensor up to date with its generator.
+ * Thresholds are left to sensor_eval(), so that many sensors can be updated
+ * first and evaluated in one go.
+ *
+ * @table: allocated table of one BMC
+ * @idx: sensor index
+ * @now_ms: monotonic time in ms
+ */
+void
+sensor_update(struct sensor_table *table, uint16_t idx, uint64_t now_ms)
+{
+	struct sensor_gen *g;
+	uint64_t elapsed;
+	uint64_t steps;
+	int lo;
+	int hi;
+	int value;
+	if (table->gen == NULL) {
+		return;
+	}
+	g = &table->gen[idx];
+	elapsed = now_ms - g->start_ms;
+	switch (g->kind) {
+	case SENSOR_GEN_SINE:
+		value = g->base + g->amplitude * sensor_sine(
+				(elapsed % g->period_ms) * 256 / g->period_ms)
+			/ 127;
+		break;
+	case SENSOR_GEN_RAMP:
+		value = g->base + (elapsed % g->period_ms)
+			* (g->amplitude + 1) / g->period_ms;
+		break;
+	case SENSOR_GEN_WALK:
+		steps = (now_ms - g->last_ms) / g->period_ms;
+		if (steps == 0) {
+			return;
+		}
+		g->last_ms += steps * g->period_ms;
+		if (steps > SENSOR_WALK_STEPS_MAX) {
+			steps = SENSOR_WALK_STEPS_MAX;
+		}
+		lo = g->base - g->amplitude;
+		hi = g->base + g->amplitude;
+		value = table->raw[idx];
+		while (steps-- > 0) {
+			g->seed ^= g->seed << 13;
+			g->seed ^= g->seed >> 17;
+			g->seed ^= g->seed << 5;
+			value += (int)(g->seed % 3) - 1;
+			if (value < lo) {
+				value = lo;
+			} else if (value > hi) {
+				value = hi;
+			}
+		}
+		break;
+	case SENSOR_GEN_TRACE:
+		value = g->trace[(elapsed / g->period_ms) % g->trace_len];
+		break;
+	default:
+		return;
+	}
+	table->raw[idx] = sensor_clamp(value);
+}
@@ -0,0 +1,443 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "fake-ipmistack/fake-ipmistack.h"
+#include "fake-ipmistack/log.h"
+#include "fake-ipmistack/session.h"
+
+/* Session IDs are picked by the BMC at random and looked up in an open
+ * addressing hash index with linear probing. The index has twice as many
+ * slots as there are sessions, so a lookup touches a slot or two. Closing
+ * a session shifts the following entries of its run back, there are no
+ * tombstones. Expired sessions aren't looked for on every packet; they are
+ * ignored by lookups and freed in bulk by session_reap(), which rebuilds
+ * the index once.
+ */
+
+/* Session the request of this thread is served in, see session_use() */
+static __thread const struct session_ctx *session_ctx_current = NULL;
+
+/* session_rng_next - returns next number of table's xorshift64* generator */
+static uint64_t
+session_rng_next(struct session_table *table)
+{
+	uint64_t x = table->rng;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	table->rng = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+/* session_hash - returns home index slot of session ID */
+static uint32_t
+session_hash(uint32_t id)
+{
+	return (uint32_t)(id * 2654435761U) >> (32 - SESSION_HASH_BITS);
+}
+
+/* session_index_find - returns index slot holding session ID, (-1) if the
+ * ID isn't there
+ */
+static int
+session_index_find(const struct session_pool *pool, uint32_t id)
+{
+	uint32_t i = session_hash(id);
+	while (pool->index[i] != 0) {
+		if (pool->slot[pool->index[i] - 1].id == id) {
+			return i;
+		}
+		i = (i + 1) & (SESSION_HASH_SIZE - 1);
+	}
+	return (-1);
+}
+
+/* session_index_add - add session in given pool slot to the index */
+static void
+session_index_add(struct session_pool *pool, int slot)
+{
+	uint32_t i = session_hash(pool->slot[slot].id);
+	while (pool->index[i] != 0) {
+		i = (i + 1) & (SESSION_HASH_SIZE - 1);
+	}
+	pool->index[i] = slot + 1;
+}
+
+/* session_index_del - remove index slot and move entries which probed
+ * past it back, so that every entry stays reachable from its home slot.
+ */
+static void
+session_index_del(struct session_pool *pool, uint32_t hole)
+{
+	uint32_t home;
+	uint32_t i = hole;
+	while (1) {
+		i = (i + 1) & (SESSION_HASH_SIZE - 1);
+		if (pool->index[i] == 0) {
+			break;
+		}
+		home = session_hash(pool->slot[pool->index[i] - 1].id);
+		/* entry stays if its home lies cyclically in (hole, i] */
+		if (((i - home) & (SESSION_HASH_SIZE - 1))
+				< ((i - hole) & (SESSION_HASH_SIZE - 1))) {
+			continue;
+		}
+		pool->index[hole] = pool->index[i];
+		hole = i;
+	}
+	pool->index[hole] = 0;
+}
+
+/* session_expiry_lower - make sure next_expiry_ms isn't later than given
+ * time
+ */
+static void
+session_expiry_lower(struct session_table *table, uint64_t expires_ms)
+{
+	if (expires_ms < table->next_expiry_ms) {
+		table->next_expiry_ms = expires_ms;
+	}
+}
+
+/* session_free - release slot of a session, index is left to the caller */
+static void
+session_free(struct session_table *table, struct session *session)
+{
+	struct session_pool *pool = table->pool;
+	if (session->state == SESSION_ACTIVE) {
+		pool->channel_active[session->channel % SESSION_CHANNELS]--;
+		pool->user_active[session->uid % SESSION_UIDS]--;
+		table->active--;
+	}
+	memset(session, 0, sizeof(struct session));
+	table->used--;
+}
+
+/* session_table_init - set up empty session table.
+ *
+ * @table: table
+ * @seed: seed of session IDs and random numbers, anything but the same
+ * for every BMC
+ */
+void
+session_table_init(struct session_table *table, uint64_t seed)
+{
+	memset(table, 0, sizeof(struct session_table));
+	table->next_expiry_ms = UINT64_MAX;
+	/* splitmix64 finalizer, never 0 */
+	seed += 0x9E3779B97F4A7C15ULL;
+	seed = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	seed = (seed ^ (seed >> 27)) * 0x94D049BB133111EBULL;
+	table->rng = (seed ^ (seed >> 31)) | 1;
+}
+
+/* session_random - fill buffer with random bytes of the table's generator.
+ * Good enough for a simulator, not for anything else.
+ */
+void
+session_random(struct session_table *table, uint8_t *buf, size_t len)
+{
+	uint64_t x;
+	size_t n;
+	while (len > 0) {
+		x = session_rng_next(table);
+		n = len < sizeof(x) ? len : sizeof(x);
+		memcpy(buf, &x, n);
+		buf += n;
+		len -= n;
+	}
+}
+
+/* session_new - start setting up a session.
+ *
+ * @table: sessions of the BMC
+ * @channel: channel the session is being established over
+ * @now_ms: monotonic time
+ *
+ * Session gets a new random ID and challenge, it is pending until
+ * session_activate() and lasts SESSION_SETUP_MS until then. When all
+ * slots are taken, expired sessions are reaped first.
+ *
+ * returns pending session, NULL when there is no free slot
+ */
+struct session *
+session_new(struct session_table *table, uint8_t channel, uint64_t now_ms)
+{
+	struct session_pool *pool = table->pool;
+	struct session *session;
+	uint32_t id;
+	int i;
+	if (pool == NULL) {
+		pool = calloc(1, sizeof(struct session_pool));
+		if (pool == NULL) {
+			log_error("Couldn't allocate sessions: %s",
+					strerror(errno));
+			return NULL;
+		}
+		table->pool = pool;
+	}
+	if (table->used == SESSION_MAX
+			&& session_reap(table, now_ms) == 0) {
+		return NULL;
+	}
+	for (i = 0; pool->slot[i].state != SESSION_FREE; i++) {
+		;
+	}
+	do {
+		id = (uint32_t)(session_rng_next(table) >> 32);
+	} while (id == 0 || session_index_find(pool, id) >= 0);
+	session = &pool->slot[i];
+	session->id = id;
+	session->state = SESSION_PENDING;
+	session->channel = channel;
+	session->expires_ms = now_ms + SESSION_SETUP_MS;
+	session_random(table, session->challenge,
+			sizeof(session->challenge));
+	session_index_add(pool, i);
+	table->used++;
+	session_expiry_lower(table, session->expires_ms);
+	return session;
+}
+
+/* session_find - look up live session by its ID.
+ *
+ * returns session, NULL if there is no such session or it has expired
+ */
+struct session *
+session_find(struct session_table *table, uint32_t id, uint64_t now_ms)
+{
+	struct session *session;
+	int i;
+	if (table->pool == NULL || id == 0) {
+		return NULL;
+	}
+	i = session_index_find(table->pool, id);
+	if (i < 0) {
+		return NULL;
+	}
+	session = &table->pool->slot[table->pool->index[i] - 1];
+	return session->expires_ms > now_ms ? session : NULL;
+}
+
+/* session_by_handle - look up live session by its handle.
+ *
+ * returns session, NULL if there is no such session or it has expired
+ */
+struct session *
+session_by_handle(struct session_table *table, uint8_t handle,
+		uint64_t now_ms)
+{
+	struct session *session;
+	if (table->pool == NULL || handle < 1 || handle > SESSION_MAX) {
+		return NULL;
+	}
+	session = &table->pool->slot[handle - 1];
+	if (session->state == SESSION_FREE || session->expires_ms <= now_ms) {
+		return NULL;
+	}
+	return session;
+}
+
+/* session_nth_active - returns Nth live active session, counted from 1 in
+ * order of handles, or NULL
+ */
+struct session *
+session_nth_active(struct session_table *table, uint8_t nth,
+		uint64_t now_ms)
+{
+	struct session *session;
+	int i;
+	if (table->pool == NULL) {
+		return NULL;
+	}
+	for (i = 0; i < SESSION_MAX; i++) {
+		session = &table->pool->slot[i];
+		if (session->state != SESSION_ACTIVE
+				|| session->expires_ms <= now_ms) {
+			continue;
+		}
+		if (--nth == 0) {
+			return session;
+		}
+	}
+	return NULL;
+}
+
+/* session_handle - returns handle of given session */
+uint8_t
+session_handle(struct session_table *table, const struct session *session)
+{
+	return (uint8_t)(session - table->pool->slot) + 1;
+}
+
+/* session_activate - make pending session active.
+ *
+ * @table: sessions of the BMC
+ * @session: pending session
+ * @uid: user the session belongs to
+ * @user_limit: active sessions the user may have, 0 means no limit
+ * @channel_limit: active sessions the channel may have, 0 means no limit
+ * @now_ms: monotonic time
+ *
+ * returns 0 on success, SESSION_ERR_CHANNEL or SESSION_ERR_USER when the
+ * respective limit has been reached
+ */
+int
+session_activate(struct session_table *table, struct session *session,
+		uint8_t uid, uint8_t user_limit, uint8_t channel_limit,
+		uint64_t now_ms)
+{
+	struct session_pool *pool = table->pool;
+	uint8_t channel = session->channel % SESSION_CHANNELS;
+	uid %= SESSION_UIDS;
+	if (channel_limit != 0
+			&& pool->channel_active[channel] >= channel_limit) {
+		return SESSION_ERR_CHANNEL;
+	}
+	if (user_limit != 0 && pool->user_active[uid] >= user_limit) {
+		return SESSION_ERR_USER;
+	}
+	session->state = SESSION_ACTIVE;
+	session->uid = uid;
+	pool->channel_active[channel]++;
+	pool->user_active[uid]++;
+	table->active++;
+	session_touch(table, session, now_ms);
+	return 0;
+}
+
+/* session_seq_check - accept inbound sequence number of active session.
+ *
+ * Numbers ahead of the highest one so far are always taken, those up to
+ * SESSION_SEQ_WINDOW behind it once each.
+ *
+ * returns 0 when the packet should be served, (-1) when it is a replay or
+ * too old
+ */
+int
+session_seq_check(struct session *session, uint32_t seq)
+{
+	int32_t delta = (int32_t)(seq - session->in_seq);
+	if (delta > 0) {
+		session->seq_mask = delta >= 32 ? 0 : session->seq_mask << delta;
+		session->seq_mask |= 1;
+		session->in_seq = seq;
+		return 0;
+	}
+	delta = -delta;
+	if (delta >= SESSION_SEQ_WINDOW
+			|| (session->seq_mask & (1U << delta))) {
+		return (-1);
+	}
+	session->seq_mask |= 1U << delta;
+	return 0;
+}
+
+/* session_touch - restart idle timeout of active session */
+void
+session_touch(struct session_table *table, struct session *session,
+		uint64_t now_ms)
+{
+	/* next_expiry_ms only has to be a lower bound, it stays */
+	session->expires_ms = now_ms + SESSION_TIMEOUT_MS;
+	session_expiry_lower(table, session->expires_ms);
+}
+
+/* session_close - close session and release its slot */
+void
+session_close(struct session_table *table, struct session *session)
+{
+	int i = session_index_find(table->pool, session->id);
+	if (i >= 0) {
+		session_index_del(table->pool, i);
+	}
+	session_free(table, session);
+}
+
+/* session_reap - close every session which has expired.
+ *
+ * @table: sessions of the BMC
+ * @now_ms: monotonic time
+ *
+ * Returns right away unless next_expiry_ms has passed. Slots are freed in
+ * one pass and the index is rebuilt once afterwards.
+ *
+ * returns number of sessions closed
+ */
+uint32_t
+session_reap(struct session_table *table, uint64_t now_ms)
+{
+	struct session_pool *pool = table->pool;
+	struct session *session;
+	uint64_t next = UINT64_MAX;
+	uint32_t closed = 0;
+	int i;
+	if (pool == NULL || now_ms < table->next_expiry_ms) {
+		return 0;
+	}
+	for (i = 0; i < SESSION_MAX; i++) {
+		session = &pool->slot[i];
+		if (session->state == SESSION_FREE) {
+			continue;
+		}
+		if (session->expires_ms <= now_ms) {
+			session_free(table, session);
+			closed++;
+		} else if (session->expires_ms < next) {
+			next = session->expires_ms;
+		}
+	}
+	if (closed > 0) {
+		memset(pool->index, 0, sizeof(pool->index));
+		for (i = 0; i < SESSION_MAX; i++) {
+			if (pool->slot[i].state != SESSION_FREE) {
+				session_index_add(pool, i);
+			}
+		}
+	}
+	table->next_expiry_ms = next;
+	return closed;
+}
+
+/* session_use - set session the requests of this thread come from.
+ *
+ * @ctx: session context, NULL for requests which aren't subject to
+ * sessions, i.e. the Unix socket
+ */
+void
+session_use(const struct session_ctx *ctx)
+{
+	session_ctx_current = ctx;
+}
+
+/* session_current - returns session context set by session_use() */
+const struct session_ctx *
+session_current()
+{
+	return session_ctx_current;
+}
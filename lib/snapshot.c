@@ -0,0 +1,759 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "fake-ipmistack/fake-ipmistack.h"
+#include "fake-ipmistack/bmc.h"
+#include "fake-ipmistack/fru.h"
+#include "fake-ipmistack/log.h"
+#include "fake-ipmistack/param.h"
+#include "fake-ipmistack/scenario.h"
+#include "fake-ipmistack/sel.h"
+#include "fake-ipmistack/sensor.h"
+#include "fake-ipmistack/snapshot.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Snapshot file, all numbers in host byte order:
+ *
+ * struct snapshot_header
+ * struct snapshot_bmc per BMC, from header's 'records' on
+ * sections, SNAPSHOT_ALIGN aligned, at offsets given by the records
+ *
+ * Nothing refers to anything by pointer, so the file can be mapped
+ * wherever mmap() puts it. Restored BMCs point right into the private
+ * mapping: their user databases, parameters, sensor tables and FRU data
+ * are paged in when first touched and copied by the kernel when first
+ * written, start-up doesn't read them. SEL is the exception, only records
+ * in use are saved, oldest first, and they are copied into a new ring, so
+ * a BMC with a few events doesn't take a whole ring of the file.
+ */
+# define SNAPSHOT_ALIGN SENSOR_ALIGN
+# define SNAPSHOT_BYTE_ORDER 0x01020304
+/* boot options, PEF, LAN and SOL parameters, see snapshot_stores() */
+# define SNAPSHOT_PARAMS 4
+
+struct snapshot_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint64_t size;
+	uint64_t records;
+	uint32_t bmc_count;
+	uint32_t record_size;
+	/* scenario BMCs were of, see scenario_identity(), 0 if none */
+	uint64_t scenario_size;
+	uint64_t scenario_hash;
+	/* sizes of sections, which depend on build and command line */
+	uint32_t user_db_size;
+	uint32_t sensor_count;
+	uint16_t param_size[SNAPSHOT_PARAMS];
+};
+
+/* Members of struct bmc saved as they are, field of struct snapshot_bmc
+ * and the member
+ */
+#define SNAPSHOT_FIELDS(X) \
+	X(channels, app.channels) \
+	X(users_enabled, app.users_enabled) \
+	X(users_named, app.users_named) \
+	X(guid, app.guid) \
+	X(poh_counter, chassis.poh_counter) \
+	X(boot_invalid, chassis.boot_invalid) \
+	X(fp_buttons, chassis.fp_buttons) \
+	X(host_power_state, chassis.host_power_state) \
+	X(led_identify, chassis.led_identify) \
+	X(pwr_restore_pol, chassis.pwr_restore_pol) \
+	X(pwr_cycle_int, chassis.pwr_cycle_int) \
+	X(sys_restart_cause, chassis.sys_restart_cause) \
+	X(poh_mins_pcount, chassis.poh_mins_pcount) \
+	X(sel_head, storage.sel.head) \
+	X(sel_span, storage.sel.span) \
+	X(sel_entries, storage.sel.entries) \
+	X(sel_add_ts, storage.sel.add_ts) \
+	X(sel_erase_ts, storage.sel.erase_ts) \
+	X(sel_overflow, storage.sel.overflow) \
+	X(sel_time, storage.sel_time) \
+	X(ip_addr_err_rx, transport.ip_addr_err_rx) \
+	X(ip_frag_rx, transport.ip_frag_rx) \
+	X(ip_hdr_err_rx, transport.ip_hdr_err_rx) \
+	X(ip_pkts_rx, transport.ip_pkts_rx) \
+	X(ip_pkts_tx, transport.ip_pkts_tx) \
+	X(rcmp_pkts_rx, transport.rcmp_pkts_rx) \
+	X(udp_pkts_rx, transport.udp_pkts_rx) \
+	X(udp_proxy_rx, transport.udp_proxy_rx) \
+	X(udp_proxy_drop, transport.udp_proxy_drop)
+
+/* What one BMC remembers across restarts */
+struct snapshot_bmc {
+	struct ipmi_channel channels[CHANNEL_MAX];
+	uint64_t users_enabled;
+	uint64_t users_named;
+	uint8_t guid[16];
+	uint32_t poh_counter;
+	uint32_t boot_invalid;
+	uint8_t fp_buttons;
+	uint8_t host_power_state;
+	uint8_t led_identify;
+	uint8_t pwr_restore_pol;
+	uint8_t pwr_cycle_int;
+	uint8_t sys_restart_cause;
+	uint8_t poh_mins_pcount;
+	uint32_t sel_head;
+	uint32_t sel_span;
+	uint32_t sel_entries;
+	uint32_t sel_add_ts;
+	uint32_t sel_erase_ts;
+	uint8_t sel_overflow;
+	uint8_t sel_time[4];
+	uint16_t ip_addr_err_rx;
+	uint16_t ip_frag_rx;
+	uint16_t ip_hdr_err_rx;
+	uint16_t ip_pkts_rx;
+	uint16_t ip_pkts_tx;
+	uint16_t rcmp_pkts_rx;
+	uint16_t udp_pkts_rx;
+	uint16_t udp_proxy_rx;
+	uint16_t udp_proxy_drop;
+	uint32_t fru_count;
+	/* offsets of sections, 0 - none, BMC has the defaults */
+	uint64_t users;
+	uint64_t params[SNAPSHOT_PARAMS];
+	uint64_t sel;
+	uint64_t sensors;
+	/* fru_count times struct snapshot_fru */
+	uint64_t fru;
+};
+
+#define SNAPSHOT_CHECK(name, member) \
+	_Static_assert(sizeof(((struct snapshot_bmc *)0)->name) \
+			== sizeof(((struct bmc *)0)->member), #name);
+SNAPSHOT_FIELDS(SNAPSHOT_CHECK)
+
+/* Snapshot being written. Sections go through 'buf', records are
+ * collected in 'recs' and written in batches at their place.
+ */
+# define SNAPSHOT_BUF_SIZE (1024 * 1024)
+# define SNAPSHOT_RECS 256
+
+struct snapshot_out {
+	int fd;
+	/* file offset of buf[0] */
+	uint64_t offset;
+	size_t len;
+	uint8_t buf[SNAPSHOT_BUF_SIZE];
+	struct snapshot_bmc recs[SNAPSHOT_RECS];
+};
+
+/* FRU device written to, see fru_data_writable() */
+struct snapshot_fru {
+	uint64_t offset;
+	uint32_t size;
+	uint8_t dev_id;
+};
+
+/* mapping of the snapshot restored from, kept for good */
+static uint8_t *snapshot_base = NULL;
+static size_t snapshot_size = 0;
+
+/* snapshot_stores - fill in parameter stores of BMC, SNAPSHOT_PARAMS */
+static void
+snapshot_stores(struct bmc *bmc, struct param_store **stores)
+{
+	stores[0] = &bmc->chassis.boot;
+	stores[1] = &bmc->sensor.pef;
+	stores[2] = &bmc->transport.lan;
+	stores[3] = &bmc->transport.sol;
+}
+
+/* snapshot_align - returns offset rounded up to SNAPSHOT_ALIGN */
+static uint64_t
+snapshot_align(uint64_t offset)
+{
+	return (offset + SNAPSHOT_ALIGN - 1)
+		& ~(uint64_t)(SNAPSHOT_ALIGN - 1);
+}
+
+/* snapshot_write - write whole buffer at given offset of file.
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+static int
+snapshot_write(int fd, const void *buf, size_t len, uint64_t offset)
+{
+	const uint8_t *p = buf;
+	ssize_t rc;
+	while (len > 0) {
+		rc = pwrite(fd, p, len, offset);
+		if (rc < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("pwrite");
+			return (-1);
+		}
+		p += rc;
+		len -= rc;
+		offset += rc;
+	}
+	return 0;
+}
+
+/* snapshot_flush - write out what has been buffered.
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+static int
+snapshot_flush(struct snapshot_out *out)
+{
+	if (snapshot_write(out->fd, out->buf, out->len, out->offset) != 0) {
+		return (-1);
+	}
+	out->offset += out->len;
+	out->len = 0;
+	return 0;
+}
+
+/* snapshot_append - append data to snapshot being saved.
+ *
+ * returns offset the data has been put at, 0 on error
+ */
+static uint64_t
+snapshot_append(struct snapshot_out *out, const void *buf, size_t len)
+{
+	uint64_t offset;
+	if (out->len + len > SNAPSHOT_BUF_SIZE && snapshot_flush(out) != 0) {
+		return 0;
+	}
+	offset = out->offset + out->len;
+	if (len > SNAPSHOT_BUF_SIZE) {
+		if (snapshot_write(out->fd, buf, len, offset) != 0) {
+			return 0;
+		}
+		out->offset += len;
+		return offset;
+	}
+	memcpy(&out->buf[out->len], buf, len);
+	out->len += len;
+	return offset;
+}
+
+/* snapshot_section - append SNAPSHOT_ALIGN aligned section to snapshot
+ * being saved.
+ *
+ * returns offset of the section, 0 on error
+ */
+static uint64_t
+snapshot_section(struct snapshot_out *out, const void *buf, size_t len)
+{
+	static const uint8_t zeros[SNAPSHOT_ALIGN];
+	uint64_t end = out->offset + out->len;
+	if (snapshot_align(end) > end && snapshot_append(out, zeros,
+				snapshot_align(end) - end) == 0) {
+		return 0;
+	}
+	return snapshot_append(out, buf, len);
+}
+
+/* snapshot_sel - append records of SEL ring in use, oldest first.
+ *
+ * returns offset of the records, 0 on error
+ */
+static uint64_t
+snapshot_sel(struct snapshot_out *out, const struct sel *sel)
+{
+	uint64_t offset;
+	uint32_t first = sel->span;
+	if (sel->head + sel->span > SEL_ENTRIES_MAX) {
+		first = SEL_ENTRIES_MAX - sel->head;
+	}
+	offset = snapshot_section(out, sel->records[sel->head],
+			(size_t)first * SEL_RECORD_SIZE);
+	if (offset == 0 || (first < sel->span && snapshot_append(out,
+					sel->records[0],
+					(size_t)(sel->span - first)
+						* SEL_RECORD_SIZE) == 0)) {
+		return 0;
+	}
+	return offset;
+}
+
+/* snapshot_save_bmc - fill in record of BMC and append its sections.
+ * Caller holds bmc->lock.
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+static int
+snapshot_save_bmc(struct snapshot_out *out, struct bmc *bmc,
+		struct snapshot_bmc *rec)
+{
+	struct param_store *stores[SNAPSHOT_PARAMS];
+	struct snapshot_fru frus[FRU_DEVICES_MAX];
+	struct sensor_table *table = &bmc->sensor.table;
+	uint8_t **private = bmc->storage.fru.private;
+	struct snapshot_fru *fru;
+	int i;
+	memset(rec, 0, sizeof(struct snapshot_bmc));
+#define SNAPSHOT_SAVE(name, member) \
+	memcpy(&rec->name, &bmc->member, sizeof(rec->name));
+	SNAPSHOT_FIELDS(SNAPSHOT_SAVE)
+#undef SNAPSHOT_SAVE
+	if (bmc->app.users != NULL) {
+		rec->users = snapshot_section(out, bmc->app.users,
+				sizeof(struct user_db));
+		if (rec->users == 0) {
+			return (-1);
+		}
+	}
+	snapshot_stores(bmc, stores);
+	for (i = 0; i < SNAPSHOT_PARAMS; i++) {
+		if (stores[i]->values == NULL) {
+			continue;
+		}
+		rec->params[i] = snapshot_section(out, stores[i]->values,
+				stores[i]->family->size);
+		if (rec->params[i] == 0) {
+			return (-1);
+		}
+	}
+	if (bmc->storage.sel.records != NULL) {
+		rec->sel = snapshot_sel(out, &bmc->storage.sel);
+		if (rec->sel == 0) {
+			return (-1);
+		}
+	}
+	if (table->raw != NULL) {
+		rec->sensors = snapshot_section(out, table->raw,
+				sensor_table_size());
+		if (rec->sensors == 0) {
+			return (-1);
+		}
+	}
+	for (i = 0; private != NULL && i < FRU_DEVICES_MAX; i++) {
+		if (private[i] == NULL) {
+			continue;
+		}
+		fru = &frus[rec->fru_count++];
+		memset(fru, 0, sizeof(struct snapshot_fru));
+		fru->size = fru_size(&bmc->storage.fru, i);
+		fru->dev_id = i;
+		fru->offset = snapshot_section(out, private[i], fru->size);
+		if (fru->offset == 0) {
+			return (-1);
+		}
+	}
+	if (rec->fru_count > 0) {
+		rec->fru = snapshot_section(out, frus,
+				rec->fru_count * sizeof(struct snapshot_fru));
+		if (rec->fru == 0) {
+			return (-1);
+		}
+	}
+	return 0;
+}
+
+/* snapshot_save_out - write snapshot of all BMCs.
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+static int
+snapshot_save_out(struct snapshot_out *out)
+{
+	struct snapshot_header hdr;
+	struct param_store *stores[SNAPSHOT_PARAMS];
+	struct bmc *bmc;
+	uint64_t first;
+	uint32_t count = bmc_count();
+	uint32_t i;
+	int rc;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic));
+	hdr.version = SNAPSHOT_VERSION;
+	hdr.byte_order = SNAPSHOT_BYTE_ORDER;
+	hdr.records = snapshot_align(sizeof(hdr));
+	hdr.bmc_count = count;
+	hdr.record_size = sizeof(struct snapshot_bmc);
+	scenario_identity(&hdr.scenario_size, &hdr.scenario_hash);
+	hdr.user_db_size = sizeof(struct user_db);
+	hdr.sensor_count = sensor_count();
+	snapshot_stores(bmc_get(0), stores);
+	for (i = 0; i < SNAPSHOT_PARAMS; i++) {
+		hdr.param_size[i] = stores[i]->family->size;
+	}
+	out->offset = snapshot_align(hdr.records
+			+ (uint64_t)count * sizeof(struct snapshot_bmc));
+	out->len = 0;
+	for (i = 0; i < count; i++) {
+		/* each BMC is consistent, the whole pool isn't frozen */
+		bmc = bmc_get(i);
+		pthread_mutex_lock(&bmc->lock);
+		rc = snapshot_save_bmc(out, bmc, &out->recs[i % SNAPSHOT_RECS]);
+		pthread_mutex_unlock(&bmc->lock);
+		if (rc != 0) {
+			return (-1);
+		}
+		if ((i + 1) % SNAPSHOT_RECS != 0 && i + 1 < count) {
+			continue;
+		}
+		/* batch of records, from BMC 'first' to this one */
+		first = i - i % SNAPSHOT_RECS;
+		if (snapshot_write(out->fd, out->recs, (i - first + 1)
+					* sizeof(struct snapshot_bmc),
+					hdr.records + first
+					* sizeof(struct snapshot_bmc)) != 0) {
+			return (-1);
+		}
+	}
+	if (snapshot_flush(out) != 0) {
+		return (-1);
+	}
+	hdr.size = out->offset;
+	/* header goes last, a file cut short is never taken for a snapshot */
+	if (snapshot_write(out->fd, &hdr, sizeof(hdr), 0) != 0) {
+		return (-1);
+	}
+	if (fsync(out->fd) != 0) {
+		perror("fsync");
+		return (-1);
+	}
+	return 0;
+}
+
+/* snapshot_save - save snapshot of all BMCs. It is written next to the
+ * file and renamed over it, never written in place: BMCs restored from
+ * the old file still map it.
+ *
+ * @path: snapshot file
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+snapshot_save(const char *path)
+{
+	struct snapshot_out *out;
+	char tmp[4096];
+	int rc;
+	out = malloc(sizeof(struct snapshot_out));
+	if (out == NULL) {
+		perror("malloc fail");
+		return (-1);
+	}
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	out->fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (out->fd < 0) {
+		perror(tmp);
+		free(out);
+		return (-1);
+	}
+	rc = snapshot_save_out(out);
+	close(out->fd);
+	free(out);
+	if (rc == 0 && rename(tmp, path) != 0) {
+		perror(path);
+		rc = (-1);
+	}
+	if (rc != 0) {
+		unlink(tmp);
+	}
+	return rc;
+}
+
+/* snapshot_check - returns why mapped file isn't a snapshot this build
+ * can restore, NULL if it is one. Scenario, if any, must have been mapped
+ * already: restored users and FRU data are only of use on the same one.
+ */
+static const char *
+snapshot_check(const struct snapshot_header *hdr, size_t size)
+{
+	uint64_t scenario_size;
+	uint64_t scenario_hash;
+	if (memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic)) != 0) {
+		return "not a snapshot";
+	}
+	if (hdr->byte_order != SNAPSHOT_BYTE_ORDER) {
+		return "snapshot of another byte order";
+	}
+	if (hdr->version != SNAPSHOT_VERSION
+			|| hdr->record_size != sizeof(struct snapshot_bmc)
+			|| hdr->user_db_size != sizeof(struct user_db)) {
+		return "snapshot of another version";
+	}
+	if (hdr->size != size || hdr->bmc_count < 1
+			|| hdr->bmc_count > BMC_COUNT_MAX
+			|| hdr->records % SNAPSHOT_ALIGN != 0
+			|| hdr->records > size
+			|| (uint64_t)hdr->bmc_count * hdr->record_size
+				> size - hdr->records) {
+		return "snapshot is damaged";
+	}
+	scenario_identity(&scenario_size, &scenario_hash);
+	if (hdr->scenario_size != scenario_size
+			|| hdr->scenario_hash != scenario_hash) {
+		if (hdr->scenario_size == 0) {
+			return "snapshot taken without scenario";
+		}
+		return scenario_size == 0
+			? "snapshot taken on a scenario, none given"
+			: "snapshot taken on another scenario";
+	}
+	return NULL;
+}
+
+/* snapshot_map - map snapshot file to restore BMCs from later on.
+ *
+ * @path: snapshot file
+ *
+ * returns number of BMCs in the snapshot, 0 if there is no such file yet,
+ * (-1) on error
+ */
+long
+snapshot_map(const char *path)
+{
+	const char *err;
+	struct stat st;
+	void *base;
+	int fd;
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		if (errno == ENOENT) {
+			log_notice("%s doesn't exist, starting from defaults",
+					path);
+			return 0;
+		}
+		perror(path);
+		return (-1);
+	}
+	if (fstat(fd, &st) != 0) {
+		perror("fstat");
+		close(fd);
+		return (-1);
+	}
+	if ((size_t)st.st_size < sizeof(struct snapshot_header)) {
+		log_error("%s: not a snapshot", path);
+		close(fd);
+		return (-1);
+	}
+	/* private, BMCs write to their own copies of pages */
+	base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+			fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		perror("mmap");
+		return (-1);
+	}
+	err = snapshot_check(base, st.st_size);
+	if (err != NULL) {
+		log_error("%s: %s", path, err);
+		munmap(base, st.st_size);
+		return (-1);
+	}
+	snapshot_base = base;
+	snapshot_size = st.st_size;
+	return ((struct snapshot_header *)base)->bmc_count;
+}
+
+/* snapshot_ptr - returns pointer to section of mapped snapshot, NULL if
+ * there is no such section
+ */
+static void *
+snapshot_ptr(uint64_t offset, uint64_t len)
+{
+	if (offset == 0 || offset % SNAPSHOT_ALIGN != 0
+			|| offset > snapshot_size
+			|| len > snapshot_size - offset) {
+		return NULL;
+	}
+	return snapshot_base + offset;
+}
+
+/* snapshot_restore_bmc - bring BMC back from its record.
+ *
+ * @bmc: BMC as bmc_pool_init() left it
+ * @rec: record of the BMC
+ * @sensors_fit: whether saved sensor tables fit SDR repository
+ * @fru_dropped: incremented per FRU device which doesn't fit
+ *
+ * returns 0 on success, (-1) if the record is damaged
+ */
+static int
+snapshot_restore_bmc(struct bmc *bmc, const struct snapshot_bmc *rec,
+		int sensors_fit, uint32_t *fru_dropped)
+{
+	struct param_store *stores[SNAPSHOT_PARAMS];
+	struct sel *sel = &bmc->storage.sel;
+	const struct snapshot_fru *frus;
+	uint8_t **private = NULL;
+	uint8_t *block;
+	uint32_t first;
+	uint32_t i;
+	int j;
+#define SNAPSHOT_RESTORE(name, member) \
+	memcpy(&bmc->member, &rec->name, sizeof(rec->name));
+	SNAPSHOT_FIELDS(SNAPSHOT_RESTORE)
+#undef SNAPSHOT_RESTORE
+	/* deadlines went away with the process which set them */
+	if (bmc->chassis.led_identify == 1) {
+		bmc->chassis.led_identify = 0;
+	}
+	if (rec->users != 0) {
+		bmc->app.users = snapshot_ptr(rec->users,
+				sizeof(struct user_db));
+		if (bmc->app.users == NULL) {
+			return (-1);
+		}
+	}
+	snapshot_stores(bmc, stores);
+	for (j = 0; j < SNAPSHOT_PARAMS; j++) {
+		if (rec->params[j] == 0) {
+			continue;
+		}
+		stores[j]->values = snapshot_ptr(rec->params[j],
+				stores[j]->family->size);
+		if (stores[j]->values == NULL) {
+			return (-1);
+		}
+	}
+	if (sel->head >= SEL_ENTRIES_MAX || sel->span > SEL_ENTRIES_MAX
+			|| sel->entries > sel->span) {
+		return (-1);
+	}
+	if (rec->sel != 0) {
+		block = snapshot_ptr(rec->sel,
+				(uint64_t)sel->span * SEL_RECORD_SIZE);
+		if (block == NULL) {
+			return (-1);
+		}
+		sel->records = calloc(SEL_ENTRIES_MAX, SEL_RECORD_SIZE);
+		if (sel->records == NULL) {
+			perror("calloc fail");
+			return (-1);
+		}
+		first = sel->span;
+		if (sel->head + sel->span > SEL_ENTRIES_MAX) {
+			first = SEL_ENTRIES_MAX - sel->head;
+		}
+		memcpy(sel->records[sel->head], block,
+				(size_t)first * SEL_RECORD_SIZE);
+		memcpy(sel->records[0], block + first * SEL_RECORD_SIZE,
+				(size_t)(sel->span - first) * SEL_RECORD_SIZE);
+	} else if (sel->span > 0) {
+		return (-1);
+	}
+	if (rec->sensors != 0 && sensors_fit) {
+		block = snapshot_ptr(rec->sensors, sensor_table_size());
+		if (block == NULL) {
+			return (-1);
+		}
+		sensor_table_attach(&bmc->sensor.table, block);
+	}
+	if (rec->fru_count == 0) {
+		return 0;
+	}
+	frus = snapshot_ptr(rec->fru,
+			(uint64_t)rec->fru_count * sizeof(struct snapshot_fru));
+	if (frus == NULL || rec->fru_count > FRU_DEVICES_MAX) {
+		return (-1);
+	}
+	for (i = 0; i < rec->fru_count; i++) {
+		/* image given on command line has changed */
+		if (frus[i].size == 0 || fru_size(&bmc->storage.fru,
+					frus[i].dev_id) != frus[i].size) {
+			(*fru_dropped)++;
+			continue;
+		}
+		block = snapshot_ptr(frus[i].offset, frus[i].size);
+		if (block == NULL) {
+			return (-1);
+		}
+		if (private == NULL) {
+			private = calloc(FRU_DEVICES_MAX, sizeof(uint8_t *));
+			if (private == NULL) {
+				perror("calloc fail");
+				return (-1);
+			}
+			bmc->storage.fru.private = private;
+		}
+		private[frus[i].dev_id] = block;
+	}
+	return 0;
+}
+
+/* snapshot_restore - restore all BMCs from snapshot_map()-ed file. Has to
+ * be called after bmc_pool_init(), sensor_engine_init() and loading FRU
+ * images, before BMCs are served.
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+snapshot_restore()
+{
+	const struct snapshot_header *hdr;
+	const struct snapshot_bmc *rec;
+	struct param_store *stores[SNAPSHOT_PARAMS];
+	uint32_t fru_dropped = 0;
+	uint32_t i;
+	int sensors_fit;
+	int j;
+	if (snapshot_base == NULL) {
+		return 0;
+	}
+	hdr = (const struct snapshot_header *)snapshot_base;
+	if (hdr->bmc_count != bmc_count()) {
+		log_error("snapshot holds %" PRIu32 " BMC(s), not %" PRIu32,
+				hdr->bmc_count, bmc_count());
+		return (-1);
+	}
+	snapshot_stores(bmc_get(0), stores);
+	for (j = 0; j < SNAPSHOT_PARAMS; j++) {
+		if (hdr->param_size[j] != stores[j]->family->size) {
+			log_error("snapshot: %s parameters of another version",
+					stores[j]->family->name);
+			return (-1);
+		}
+	}
+	sensors_fit = hdr->sensor_count == sensor_count();
+	if (!sensors_fit) {
+		log_warn("snapshot: SDR repository has changed, sensors start"
+				" from defaults");
+	}
+	for (i = 0; i < hdr->bmc_count; i++) {
+		rec = (const struct snapshot_bmc *)(snapshot_base
+				+ hdr->records
+				+ (uint64_t)i * hdr->record_size);
+		if (snapshot_restore_bmc(bmc_get(i), rec, sensors_fit,
+					&fru_dropped) != 0) {
+			log_error("snapshot: BMC %" PRIu32 " is damaged", i);
+			return (-1);
+		}
+	}
+	if (fru_dropped > 0) {
+		log_warn("snapshot: FRU images have changed, %" PRIu32
+				" device(s) start from the image", fru_dropped);
+	}
+	return 0;
+}
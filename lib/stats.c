@@ -0,0 +1,223 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "fake-ipmistack/fake-ipmistack.h"
+#include "fake-ipmistack/arena.h"
+#include "fake-ipmistack/dispatch.h"
+#include "fake-ipmistack/log.h"
+#include "fake-ipmistack/stats.h"
+
+/* Every thread which dispatches requests records into its own shard, so
+ * recording takes neither locks nor atomic read-modify-write. Readers sum
+ * up all shards on demand. Shards are never freed.
+ */
+struct stats_shard {
+	/* one per registered command, the last one for unknown commands */
+	struct cmd_stats cmds[IPMI_CMD_COUNT + 1];
+};
+
+_Static_assert(IPMI_CMD_COUNT < 0xFF, "command ID must fit into a byte");
+
+static struct stats_shard *stats_shards[STATS_SHARDS_MAX];
+static int stats_shard_count = 0;
+static __thread struct stats_shard *stats_local = NULL;
+
+/* stats_thread_init - give calling thread its own shard.
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+stats_thread_init()
+{
+	struct stats_shard *shard;
+	int idx;
+	if (stats_local != NULL) {
+		return 0;
+	}
+	shard = calloc(1, sizeof(struct stats_shard));
+	if (shard == NULL) {
+		perror("calloc fail");
+		return (-1);
+	}
+	idx = __atomic_fetch_add(&stats_shard_count, 1, __ATOMIC_RELAXED);
+	if (idx >= STATS_SHARDS_MAX) {
+		log_error("Too many threads for stats, at most %i.",
+				STATS_SHARDS_MAX);
+		free(shard);
+		return (-1);
+	}
+	__atomic_store_n(&stats_shards[idx], shard, __ATOMIC_RELEASE);
+	stats_local = shard;
+	return 0;
+}
+
+/* stats_record - count one dispatched request.
+ *
+ * @netfn: request NetFn
+ * @cmd: command
+ * @ccode: completion code of the response
+ * @latency_ns: time spent dispatching
+ */
+void
+stats_record(uint8_t netfn, uint8_t cmd, uint8_t ccode, uint64_t latency_ns)
+{
+	const struct ipmi_cmd *entry;
+	struct cmd_stats *stats;
+	if (stats_local == NULL) {
+		return;
+	}
+	entry = ipmi_cmd_lookup(netfn, cmd);
+	stats = &stats_local->cmds[entry != NULL ? entry->id : IPMI_CMD_COUNT];
+	hist_record_shared(&stats->latency, latency_ns);
+	__atomic_store_n(&stats->ccodes[ccode],
+			__atomic_load_n(&stats->ccodes[ccode],
+				__ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+}
+
+/* stats_snapshot - sum up statistics of one command over all threads.
+ *
+ * @id: command ID, IPMI_CMD_COUNT for unknown commands
+ * @out: where to store the sum, overwritten
+ *
+ * returns 0 on success, (-1) when ID is out of range
+ */
+int
+stats_snapshot(uint16_t id, struct cmd_stats *out)
+{
+	struct stats_shard *shard;
+	int count;
+	int i;
+	int j;
+	if (id > IPMI_CMD_COUNT) {
+		return (-1);
+	}
+	memset(out, 0, sizeof(struct cmd_stats));
+	count = __atomic_load_n(&stats_shard_count, __ATOMIC_ACQUIRE);
+	for (i = 0; i < count && i < STATS_SHARDS_MAX; i++) {
+		shard = __atomic_load_n(&stats_shards[i], __ATOMIC_ACQUIRE);
+		if (shard == NULL) {
+			continue;
+		}
+		hist_merge_shared(&out->latency, &shard->cmds[id].latency);
+		for (j = 0; j < 256; j++) {
+			out->ccodes[j]+= __atomic_load_n(
+					&shard->cmds[id].ccodes[j],
+					__ATOMIC_RELAXED);
+		}
+	}
+	return 0;
+}
+
+/* put_le64 - store 64-bit number LS byte first */
+static void
+put_le64(uint8_t *buf, uint64_t value)
+{
+	int i;
+	for (i = 0; i < 8; i++) {
+		buf[i] = (value >> (8 * i)) & 0xFF;
+	}
+}
+
+/* stats_get - (OEM) Get Stats, see stats.h for the response format.
+ *
+ * @req: request, data[0] is ID of the first command to report
+ * @rsp: response, header is expected to be filled in by caller
+ */
+void
+stats_get(struct dummy_rq *req, struct dummy_rs *rsp)
+{
+	struct cmd_stats stats;
+	uint8_t *data;
+	uint8_t *rec;
+	uint8_t netfn;
+	uint8_t cmd;
+	uint64_t allocs;
+	uint64_t heap_allocs;
+	uint16_t id;
+	int len = STATS_HEADER_SIZE;
+	int n;
+	int i;
+	if (req->msg.data_len != 1) {
+		rsp->ccode = CC_DATA_LEN;
+		return;
+	}
+	data = rsp_alloc(IPMI_BUF_SIZE);
+	if (data == NULL) {
+		perror("rsp_alloc fail");
+		rsp->ccode = CC_UNSPEC;
+		return;
+	}
+	data[0] = 0xFF;
+	arena_stats(&allocs, &heap_allocs);
+	put_le64(data + 1, allocs);
+	put_le64(data + 9, heap_allocs);
+	for (id = req->msg.data[0]; id <= IPMI_CMD_COUNT; id++) {
+		stats_snapshot(id, &stats);
+		if (stats.latency.count == 0) {
+			continue;
+		}
+		n = 0;
+		for (i = 0; i < 256; i++) {
+			n+= stats.ccodes[i] > 0;
+		}
+		if (n > STATS_CCODES_MAX) {
+			n = STATS_CCODES_MAX;
+		}
+		if (len + STATS_RECORD_SIZE + n * STATS_CCODE_SIZE
+				> IPMI_BUF_SIZE) {
+			data[0] = id;
+			break;
+		}
+		if (ipmi_cmd_key(id, &netfn, &cmd) != 0) {
+			netfn = STATS_UNKNOWN_CMD;
+			cmd = STATS_UNKNOWN_CMD;
+		}
+		rec = data + len;
+		rec[0] = netfn;
+		rec[1] = cmd;
+		rec[2] = n;
+		put_le64(rec + 3, stats.latency.count);
+		put_le64(rec + 11, stats.latency.sum);
+		put_le64(rec + 19, hist_percentile(&stats.latency, 50.0));
+		put_le64(rec + 27, hist_percentile(&stats.latency, 99.0));
+		put_le64(rec + 35, hist_percentile(&stats.latency, 99.9));
+		put_le64(rec + 43, stats.latency.max);
+		len+= STATS_RECORD_SIZE;
+		for (i = 0; i < 256 && n > 0; i++) {
+			if (stats.ccodes[i] == 0) {
+				continue;
+			}
+			data[len] = i;
+			put_le64(data + len + 1, stats.ccodes[i]);
+			len+= STATS_CCODE_SIZE;
+			n--;
+		}
+	}
+	rsp->data = data;
+	rsp->data_len = len;
+}
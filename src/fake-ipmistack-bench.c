@@ -0,0 +1,643 @@
+/* Copyright (c) 2013, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "fake-ipmistack/fake-ipmistack.h"
+#include "fake-ipmistack/histogram.h"
+#include "fake-ipmistack/stats.h"
+
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+
+/* Load generator for fake-ipmistack. Every connection is driven by its own
+ * thread, which replays the command mix request by request until the time
+ * is up, and records latency of every command. Results of all connections
+ * are merged and reported as throughput plus latency percentiles per
+ * command, either as text or as JSON, so runs against different builds can
+ * be compared. With -S it just fetches server-side per-command statistics
+ * instead.
+ */
+
+# define MIX_MAX 16
+# define MIX_WEIGHT_MAX 100
+
+struct bench_cmd {
+	const char *name;
+	uint8_t netfn;
+	uint8_t cmd;
+	uint8_t data_len;
+	uint8_t data[8];
+};
+
+static const struct bench_cmd bench_cmds[] = {
+	{ "device-id", NETFN_APP, BMC_GET_DEVICE_ID, 0, { 0 } },
+	{ "selftest", NETFN_APP, BMC_SELFTEST, 0, { 0 } },
+	{ "channel-info", NETFN_APP, APP_GET_CHANNEL_INFO, 1, { 0x01 } },
+	{ "user-access", NETFN_APP, USER_GET_ACCESS, 2, { 0x01, 0x02 } },
+	{ "user-name", NETFN_APP, USER_GET_NAME, 1, { 0x02 } },
+	{ "chassis-status", NETFN_CHASSIS, CHASSIS_GET_STATUS, 0, { 0 } },
+	{ "poh-counter", NETFN_CHASSIS, CHASSIS_GET_POH_COUNTER, 0, { 0 } },
+	{ "sensor-reading", NETFN_SENSOR, SENSOR_GET_READING, 1, { 0x01 } },
+	{ "sdr-info", NETFN_STORAGE, SDR_GET_INFO, 0, { 0 } },
+	{ "sdr-record", NETFN_STORAGE, SDR_GET_RECORD, 6,
+		{ 0x00, 0x00, 0x02, 0x00, 0x00, 0xFF } },
+	{ "sel-info", NETFN_STORAGE, SEL_GET_INFO, 0, { 0 } },
+	{ "sel-entry", NETFN_STORAGE, SEL_GET_ENTRY, 6,
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF } },
+	{ "sel-time", NETFN_STORAGE, SEL_GET_TIME, 0, { 0 } },
+	{ "lan-cfg", NETFN_TRANSPORT, TRANSPORT_GET_LAN_CFG, 4,
+		{ 0x01, 0x03, 0x00, 0x00 } },
+	{ "ip-stats", NETFN_TRANSPORT, TRANSPORT_GET_IP_STATS, 2,
+		{ 0x01, 0x00 } },
+	{ NULL, 0, 0, 0, { 0 } }
+};
+
+/* commands of the mix, in the order they've been given */
+struct mix_entry {
+	const struct bench_cmd *cmd;
+	int weight;
+};
+
+struct bench_conn {
+	pthread_t thread;
+	int fd;
+	int id;
+	int failed;
+	uint64_t requests;
+	/* one per mix entry */
+	struct histogram *hists;
+	uint64_t *errors;
+};
+
+static const char *socket_path = DUMMY_SOCKET_PATH;
+static volatile int bench_running = 1;
+static struct mix_entry mix[MIX_MAX];
+static int mix_count = 0;
+/* mix entry indexes, each repeated 'weight' times */
+static int *mix_seq = NULL;
+static int mix_seq_len = 0;
+
+/* full_io - read or write whole buffer, blocking.
+ *
+ * @fd: socket
+ * @buf: buffer
+ * @len: length of the buffer
+ * @do_write: 0 - read, otherwise write
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+full_io(int fd, void *buf, size_t len, int do_write)
+{
+	uint8_t *ptr = buf;
+	ssize_t rc;
+	while (len > 0) {
+		if (do_write) {
+			rc = write(fd, ptr, len);
+		} else {
+			rc = read(fd, ptr, len);
+		}
+		if (rc < 0 && errno == EINTR) {
+			continue;
+		} else if (rc <= 0) {
+			return (-1);
+		}
+		ptr+= rc;
+		len-= rc;
+	}
+	return 0;
+}
+
+/* bench_connect - open connection to the server.
+ *
+ * returns socket on success, otherwise (-1)
+ */
+int
+bench_connect()
+{
+	struct sockaddr_un address;
+	int fd;
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return (-1);
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+	if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+		perror("connect");
+		close(fd);
+		return (-1);
+	}
+	return fd;
+}
+
+/* bench_call - send one request and wait for its response.
+ *
+ * @fd: socket
+ * @cmd: command to send
+ * @ccode: completion code of the response
+ * @data: buffer for response data, IPMI_BUF_SIZE bytes
+ * @data_len: length of response data
+ *
+ * returns 0 on success, (-1) when connection has failed
+ */
+int
+bench_call(int fd, const struct bench_cmd *cmd, uint8_t *ccode,
+		uint8_t *data, int *data_len)
+{
+	uint8_t buf[sizeof(struct dummy_rq) + sizeof(cmd->data)];
+	struct dummy_rq req;
+	struct dummy_rs rsp;
+	memset(&req, 0, sizeof(req));
+	req.msg.netfn = cmd->netfn;
+	req.msg.cmd = cmd->cmd;
+	req.msg.data_len = cmd->data_len;
+	memcpy(buf, &req, sizeof(req));
+	memcpy(buf + sizeof(req), cmd->data, cmd->data_len);
+	if (full_io(fd, buf, sizeof(req) + cmd->data_len, 1) != 0
+			|| full_io(fd, &rsp, sizeof(rsp), 0) != 0) {
+		return (-1);
+	}
+	if (rsp.data_len < 0 || rsp.data_len > IPMI_BUF_SIZE
+			|| full_io(fd, data, rsp.data_len, 0) != 0) {
+		return (-1);
+	}
+	*ccode = rsp.ccode;
+	*data_len = rsp.data_len;
+	return 0;
+}
+
+/* now_ns - returns monotonic time in nanoseconds */
+uint64_t
+now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void *
+bench_conn_main(void *arg)
+{
+	struct bench_conn *conn = arg;
+	uint64_t start;
+	uint8_t data[IPMI_BUF_SIZE];
+	uint8_t ccode;
+	int data_len;
+	int idx;
+	/* connections start at different points of the mix */
+	int pos = conn->id % mix_seq_len;
+	while (bench_running) {
+		idx = mix_seq[pos];
+		pos = (pos + 1) % mix_seq_len;
+		start = now_ns();
+		if (bench_call(conn->fd, mix[idx].cmd, &ccode, data,
+					&data_len) != 0) {
+			conn->failed = 1;
+			break;
+		}
+		hist_record(&conn->hists[idx], now_ns() - start);
+		if (ccode != CC_OK) {
+			conn->errors[idx]++;
+		}
+		conn->requests++;
+	}
+	return NULL;
+}
+
+/* mix_parse - parse command mix, e.g. "device-id:4,sel-time".
+ *
+ * @spec: comma separated command names, each optionally followed by
+ * ':weight', 1 - MIX_WEIGHT_MAX, default 1
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+mix_parse(const char *spec)
+{
+	char buf[256];
+	char *save = NULL;
+	char *tok;
+	char *weight;
+	int i;
+	int j;
+	if (strlen(spec) >= sizeof(buf)) {
+		printf("Command mix is too long.\n");
+		return (-1);
+	}
+	strcpy(buf, spec);
+	mix_count = 0;
+	for (tok = strtok_r(buf, ",", &save); tok != NULL;
+			tok = strtok_r(NULL, ",", &save)) {
+		if (mix_count == MIX_MAX) {
+			printf("At most %i commands may be mixed.\n", MIX_MAX);
+			return (-1);
+		}
+		mix[mix_count].weight = 1;
+		weight = strchr(tok, ':');
+		if (weight != NULL) {
+			*weight++ = '\0';
+			mix[mix_count].weight = atoi(weight);
+			if (mix[mix_count].weight < 1
+					|| mix[mix_count].weight > MIX_WEIGHT_MAX) {
+				printf("Weight of '%s' must be 1-%i.\n", tok,
+						MIX_WEIGHT_MAX);
+				return (-1);
+			}
+		}
+		mix[mix_count].cmd = NULL;
+		for (i = 0; bench_cmds[i].name != NULL; i++) {
+			if (strcmp(bench_cmds[i].name, tok) == 0) {
+				mix[mix_count].cmd = &bench_cmds[i];
+				break;
+			}
+		}
+		if (mix[mix_count].cmd == NULL) {
+			printf("Unknown command '%s'.\n", tok);
+			return (-1);
+		}
+		mix_count++;
+	}
+	if (mix_count == 0) {
+		printf("Command mix is empty.\n");
+		return (-1);
+	}
+	mix_seq_len = 0;
+	for (i = 0; i < mix_count; i++) {
+		mix_seq_len+= mix[i].weight;
+	}
+	mix_seq = calloc(mix_seq_len, sizeof(int));
+	if (mix_seq == NULL) {
+		perror("calloc fail");
+		return (-1);
+	}
+	/* interleave, so that heavy commands don't come in long runs */
+	mix_seq_len = 0;
+	for (j = 0; j < MIX_WEIGHT_MAX; j++) {
+		for (i = 0; i < mix_count; i++) {
+			if (j < mix[i].weight) {
+				mix_seq[mix_seq_len++] = i;
+			}
+		}
+	}
+	return 0;
+}
+
+/* report_text - print results in human readable form, latency in us. */
+void
+report_text(struct histogram *hists, uint64_t *errors, int conn_count,
+		int failed, uint64_t total, double elapsed)
+{
+	int i;
+	printf("connections: %i\n", conn_count);
+	printf("requests: %" PRIu64 "\n", total);
+	printf("failed connections: %i\n", failed);
+	printf("throughput: %.0f req/s\n", total / elapsed);
+	printf("%-16s %10s %8s %9s %9s %9s %9s %9s\n", "command", "requests",
+			"errors", "mean[us]", "p50[us]", "p99[us]", "p999[us]",
+			"max[us]");
+	for (i = 0; i < mix_count; i++) {
+		printf("%-16s %10" PRIu64 " %8" PRIu64
+				" %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+				mix[i].cmd->name, hists[i].count, errors[i],
+				hists[i].count > 0 ? hists[i].sum / 1e3
+				/ hists[i].count : 0.0,
+				hist_percentile(&hists[i], 50.0) / 1e3,
+				hist_percentile(&hists[i], 99.0) / 1e3,
+				hist_percentile(&hists[i], 99.9) / 1e3,
+				hists[i].max / 1e3);
+	}
+}
+
+/* report_json - print results as a single JSON object, latency in ns. */
+void
+report_json(struct histogram *hists, uint64_t *errors, int conn_count,
+		int failed, uint64_t total, double elapsed)
+{
+	int i;
+	printf("{\"connections\": %i, \"requests\": %" PRIu64
+			", \"failed_connections\": %i, \"elapsed_s\": %.3f"
+			", \"throughput\": %.0f, \"commands\": [",
+			conn_count, total, failed, elapsed, total / elapsed);
+	for (i = 0; i < mix_count; i++) {
+		printf("%s\n  {\"name\": \"%s\", \"requests\": %" PRIu64
+				", \"errors\": %" PRIu64 ", \"mean_ns\": %"
+				PRIu64 ", \"p50_ns\": %" PRIu64
+				", \"p99_ns\": %" PRIu64 ", \"p999_ns\": %"
+				PRIu64 ", \"max_ns\": %" PRIu64 "}",
+				i > 0 ? "," : "", mix[i].cmd->name,
+				hists[i].count, errors[i],
+				hists[i].count > 0 ? hists[i].sum
+				/ hists[i].count : 0,
+				hist_percentile(&hists[i], 50.0),
+				hist_percentile(&hists[i], 99.0),
+				hist_percentile(&hists[i], 99.9),
+				hists[i].max);
+	}
+	printf("\n]}\n");
+}
+
+/* get_le64 - load 64-bit number stored LS byte first */
+uint64_t
+get_le64(const uint8_t *buf)
+{
+	uint64_t value = 0;
+	int i;
+	for (i = 7; i >= 0; i--) {
+		value = (value << 8) | buf[i];
+	}
+	return value;
+}
+
+/* server_stats - fetch and print server-side per-command statistics and
+ * response arena allocations.
+ *
+ * @json: 0 - text, latency in us, otherwise JSON, latency in ns
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+server_stats(int json)
+{
+	struct bench_cmd get_stats = {
+		"get-stats", DUMMY_NETFN, DUMMY_CMD_GET_STATS, 1, { 0 }
+	};
+	uint8_t data[IPMI_BUF_SIZE];
+	uint8_t *rec;
+	uint8_t ccode;
+	uint64_t requests;
+	uint64_t allocs = 0;
+	uint64_t heap_allocs = 0;
+	int count = 0;
+	int data_len;
+	int fd;
+	int i;
+	int off;
+	fd = bench_connect();
+	if (fd < 0) {
+		return (-1);
+	}
+	if (json) {
+		printf("{\"commands\": [");
+	} else {
+		printf("%-5s %-4s %10s %9s %9s %9s %9s %9s  %s\n", "netfn",
+				"cmd", "requests", "mean[us]", "p50[us]",
+				"p99[us]", "p999[us]", "max[us]", "ccodes");
+	}
+	do {
+		if (bench_call(fd, &get_stats, &ccode, data, &data_len) != 0
+				|| ccode != CC_OK
+				|| data_len < STATS_HEADER_SIZE) {
+			printf("Get Stats failed.\n");
+			close(fd);
+			return (-1);
+		}
+		allocs = get_le64(data + 1);
+		heap_allocs = get_le64(data + 9);
+		for (off = STATS_HEADER_SIZE;
+				off + STATS_RECORD_SIZE <= data_len;) {
+			rec = data + off;
+			off+= STATS_RECORD_SIZE + rec[2] * STATS_CCODE_SIZE;
+			if (off > data_len) {
+				break;
+			}
+			requests = get_le64(rec + 3);
+			if (json) {
+				printf("%s\n  {\"netfn\": %u, \"cmd\": %u"
+						", \"requests\": %" PRIu64
+						", \"mean_ns\": %" PRIu64
+						", \"p50_ns\": %" PRIu64
+						", \"p99_ns\": %" PRIu64
+						", \"p999_ns\": %" PRIu64
+						", \"max_ns\": %" PRIu64
+						", \"ccodes\": {",
+						count > 0 ? "," : "", rec[0],
+						rec[1], requests,
+						get_le64(rec + 11) / requests,
+						get_le64(rec + 19),
+						get_le64(rec + 27),
+						get_le64(rec + 35),
+						get_le64(rec + 43));
+			} else {
+				printf("0x%02x  0x%02x %10" PRIu64
+						" %9.1f %9.1f %9.1f %9.1f"
+						" %9.1f ", rec[0], rec[1],
+						requests,
+						get_le64(rec + 11) / 1e3
+						/ requests,
+						get_le64(rec + 19) / 1e3,
+						get_le64(rec + 27) / 1e3,
+						get_le64(rec + 35) / 1e3,
+						get_le64(rec + 43) / 1e3);
+			}
+			for (i = 0; i < rec[2]; i++) {
+				printf(json ? "%s\"0x%02x\": %" PRIu64
+						: "%s0x%02x:%" PRIu64,
+						i > 0 ? (json ? ", " : ",")
+						: (json ? "" : " "),
+						rec[STATS_RECORD_SIZE
+						+ i * STATS_CCODE_SIZE],
+						get_le64(rec
+							+ STATS_RECORD_SIZE
+							+ i * STATS_CCODE_SIZE
+							+ 1));
+			}
+			printf(json ? "}}" : "\n");
+			count++;
+		}
+		get_stats.data[0] = data[0];
+	} while (data[0] != 0xFF);
+	if (json) {
+		printf("\n], \"arena\": {\"allocs\": %" PRIu64
+				", \"heap_allocs\": %" PRIu64 "}}\n",
+				allocs, heap_allocs);
+	} else {
+		printf("arena allocations: %" PRIu64 ", heap: %" PRIu64 "\n",
+				allocs, heap_allocs);
+	}
+	close(fd);
+	return 0;
+}
+
+void
+usage(const char *progname)
+{
+	int i;
+	printf("Usage: %s [-c connections] [-d seconds] [-s socket]"
+			" [-b bmcs] [-m mix] [-j] [-S]\n", progname);
+	printf("  -c N     open N concurrent connections, default 16\n");
+	printf("  -d N     run for N seconds, default 5\n");
+	printf("  -s PATH  connect to PATH, default %s\n", DUMMY_SOCKET_PATH);
+	printf("  -b N     spread connections over BMCs 0 - N-1, default 1\n");
+	printf("  -m MIX   command mix, e.g. device-id:4,sel-time:1\n");
+	printf("  -j       print results as JSON\n");
+	printf("  -S       print server-side per-command stats and exit\n");
+	printf("Commands:");
+	for (i = 0; bench_cmds[i].name != NULL; i++) {
+		printf(" %s", bench_cmds[i].name);
+	}
+	printf("\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	static const struct bench_cmd select_bmc = {
+		"select-bmc", DUMMY_NETFN, DUMMY_CMD_SELECT_BMC, 2, { 0 }
+	};
+	struct bench_cmd select;
+	struct bench_conn *conns;
+	struct histogram *hists;
+	uint64_t *errors;
+	uint64_t total = 0;
+	uint64_t start;
+	double elapsed;
+	const char *mix_spec = "device-id,chassis-status,sel-time,user-name";
+	uint8_t data[IPMI_BUF_SIZE];
+	uint8_t ccode;
+	int bmcs = 1;
+	int conn_count = 16;
+	int duration = 5;
+	int failed = 0;
+	int i;
+	int j;
+	int data_len;
+	int json = 0;
+	int opt;
+	int stats = 0;
+	while ((opt = getopt(argc, argv, "b:c:d:jm:s:Sh")) != (-1)) {
+		switch (opt) {
+		case 'b':
+			bmcs = atoi(optarg);
+			break;
+		case 'c':
+			conn_count = atoi(optarg);
+			break;
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 'j':
+			json = 1;
+			break;
+		case 'm':
+			mix_spec = optarg;
+			break;
+		case 's':
+			socket_path = optarg;
+			break;
+		case 'S':
+			stats = 1;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (conn_count < 1 || duration < 1 || bmcs < 1 || bmcs > 65536) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (stats) {
+		return server_stats(json) == 0 ? 0 : 1;
+	}
+	if (mix_parse(mix_spec) != 0) {
+		return 1;
+	}
+	conns = calloc(conn_count, sizeof(struct bench_conn));
+	hists = calloc(mix_count, sizeof(struct histogram));
+	errors = calloc(mix_count, sizeof(uint64_t));
+	if (conns == NULL || hists == NULL || errors == NULL) {
+		perror("calloc fail");
+		return 1;
+	}
+	for (i = 0; i < conn_count; i++) {
+		conns[i].id = i;
+		conns[i].hists = calloc(mix_count, sizeof(struct histogram));
+		conns[i].errors = calloc(mix_count, sizeof(uint64_t));
+		if (conns[i].hists == NULL || conns[i].errors == NULL) {
+			perror("calloc fail");
+			return 1;
+		}
+		conns[i].fd = bench_connect();
+		if (conns[i].fd < 0) {
+			return 1;
+		}
+		if (bmcs == 1) {
+			continue;
+		}
+		select = select_bmc;
+		select.data[0] = (i % bmcs) & 0xFF;
+		select.data[1] = (i % bmcs) >> 8;
+		if (bench_call(conns[i].fd, &select, &ccode, data,
+					&data_len) != 0
+				|| ccode != CC_OK) {
+			printf("Couldn't select BMC %i.\n", i % bmcs);
+			return 1;
+		}
+	}
+	start = now_ns();
+	for (i = 0; i < conn_count; i++) {
+		if (pthread_create(&conns[i].thread, NULL, bench_conn_main,
+					&conns[i]) != 0) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+	sleep(duration);
+	bench_running = 0;
+	for (i = 0; i < conn_count; i++) {
+		pthread_join(conns[i].thread, NULL);
+		total+= conns[i].requests;
+		failed+= conns[i].failed;
+		for (j = 0; j < mix_count; j++) {
+			hist_merge(&hists[j], &conns[i].hists[j]);
+			errors[j]+= conns[i].errors[j];
+		}
+		close(conns[i].fd);
+		free(conns[i].hists);
+		free(conns[i].errors);
+	}
+	elapsed = (now_ns() - start) / 1e9;
+	if (json) {
+		report_json(hists, errors, conn_count, failed, total,
+				elapsed);
+	} else {
+		report_text(hists, errors, conn_count, failed, total,
+				elapsed);
+	}
+	free(hists);
+	free(errors);
+	free(conns);
+	free(mix_seq);
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,654 @@
+/* Copyright (c) 2013, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "fake-ipmistack/fake-ipmistack.h"
+#include "fake-ipmistack/arena.h"
+#include "fake-ipmistack/bmc.h"
+#include "fake-ipmistack/crypto.h"
+#include "fake-ipmistack/dispatch.h"
+#include "fake-ipmistack/helper.h"
+#include "fake-ipmistack/log.h"
+#include "fake-ipmistack/rmcp.h"
+#include "fake-ipmistack/sdr.h"
+#include "fake-ipmistack/sensor.h"
+
+#include <getopt.h>
+#include <time.h>
+
+/* In-process benchmark of command handlers. Every case is a pre-built
+ * request which is dispatched to a single BMC in a tight loop, exactly the
+ * way the server does it, minus the socket. Reports ns/op and arena/heap
+ * allocations per op, so handler cost can be told apart from I/O cost.
+ *
+ * Commands which change chassis power or arm timers are left out, they'd
+ * measure the timer list rather than the handler.
+ */
+
+struct micro_case {
+	const char *name;
+	uint8_t netfn;
+	uint8_t cmd;
+	uint8_t data_len;
+	uint8_t data[22];
+};
+
+static const struct micro_case micro_cases[] = {
+	{ "app-get-channel-access", NETFN_APP, APP_GET_CHANNEL_ACCESS,
+		2, { 0x01, 0x40 } },
+	{ "app-get-channel-info", NETFN_APP, APP_GET_CHANNEL_INFO,
+		1, { 0x01 } },
+	{ "app-set-channel-access", NETFN_APP, APP_SET_CHANNEL_ACCESS,
+		3, { 0x01, 0x00, 0x00 } },
+	{ "bmc-get-device-id", NETFN_APP, BMC_GET_DEVICE_ID, 0, { 0 } },
+	{ "bmc-get-device-guid", NETFN_APP, BMC_GET_DEVICE_GUID, 0, { 0 } },
+	{ "bmc-selftest", NETFN_APP, BMC_SELFTEST, 0, { 0 } },
+	{ "user-get-access", NETFN_APP, USER_GET_ACCESS,
+		2, { 0x01, 0x02 } },
+	{ "user-get-access-last", NETFN_APP, USER_GET_ACCESS,
+		2, { 0x01, 0x3F } },
+	{ "user-get-name", NETFN_APP, USER_GET_NAME, 1, { 0x02 } },
+	{ "user-set-access", NETFN_APP, USER_SET_ACCESS,
+		4, { 0x01, 0x02, 0x04, 0x00 } },
+	{ "user-set-name", NETFN_APP, USER_SET_NAME,
+		17, { 0x02, 't', 'e', 's', 't', '1' } },
+	{ "user-set-password", NETFN_APP, USER_SET_PASSWORD,
+		18, { 0x02, 0x02, 'p', 'a', 's', 's' } },
+	{ "chassis-get-capa", NETFN_CHASSIS, CHASSIS_GET_CAPA, 0, { 0 } },
+	{ "chassis-get-poh-counter", NETFN_CHASSIS, CHASSIS_GET_POH_COUNTER,
+		0, { 0 } },
+	{ "chassis-get-status", NETFN_CHASSIS, CHASSIS_GET_STATUS, 0, { 0 } },
+	{ "chassis-get-sysboot-opts", NETFN_CHASSIS, CHASSIS_GET_SYSBOOT_OPTS,
+		3, { 0x05, 0x00, 0x00 } },
+	{ "chassis-get-sysres-cause", NETFN_CHASSIS, CHASSIS_GET_SYSRES_CAUSE,
+		0, { 0 } },
+	{ "chassis-set-fp-buttons", NETFN_CHASSIS, CHASSIS_SET_FP_BUTTONS,
+		1, { 0x00 } },
+	{ "chassis-set-pwr-restore-pol", NETFN_CHASSIS,
+		CHASSIS_SET_PWR_RESTORE_POL, 1, { 0x03 } },
+	{ "pef-get-config", NETFN_SENSOR, PEF_GET_CONFIG,
+		3, { 0x01, 0x00, 0x00 } },
+	{ "pef-get-capabilities", NETFN_SENSOR, PEF_GET_CAPABILITIES,
+		0, { 0 } },
+	{ "sensor-get-event-status", NETFN_SENSOR, SENSOR_GET_EVENT_STATUS,
+		1, { 0x01 } },
+	{ "sensor-get-reading", NETFN_SENSOR, SENSOR_GET_READING,
+		1, { 0x01 } },
+	{ "sensor-get-thresholds", NETFN_SENSOR, SENSOR_GET_THRESHOLDS,
+		1, { 0x01 } },
+	/* sine on sensor 2, read back by the next case */
+	{ "sensor-set-generator", NETFN_SENSOR, SENSOR_SET_GENERATOR,
+		8, { 0x02, 0x01, 0xC8, 0x10, 0xE8, 0x03, 0x00, 0x00 } },
+	{ "sensor-get-reading-sine", NETFN_SENSOR, SENSOR_GET_READING,
+		1, { 0x02 } },
+	{ "sdr-get-info", NETFN_STORAGE, SDR_GET_INFO, 0, { 0 } },
+	{ "sdr-get-record", NETFN_STORAGE, SDR_GET_RECORD,
+		6, { 0x00, 0x00, 0x08, 0x00, 0x00, 0xFF } },
+	{ "sel-get-info", NETFN_STORAGE, SEL_GET_INFO, 0, { 0 } },
+	{ "sel-reserve", NETFN_STORAGE, SEL_RESERVE, 0, { 0 } },
+	{ "sel-add-entry", NETFN_STORAGE, SEL_ADD_ENTRY,
+		16, { 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00,
+			0x04, 0x01, 0x30, 0x01, 0x57, 0xFF, 0xFF } },
+	{ "sel-get-entry", NETFN_STORAGE, SEL_GET_ENTRY,
+		6, { 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF } },
+	{ "sel-get-time", NETFN_STORAGE, SEL_GET_TIME, 0, { 0 } },
+	{ "sel-set-time", NETFN_STORAGE, SEL_SET_TIME,
+		4, { 0x00, 0x00, 0x00, 0x52 } },
+	{ "transport-get-lan-cfg", NETFN_TRANSPORT, TRANSPORT_GET_LAN_CFG,
+		4, { 0x01, 0x03, 0x00, 0x00 } },
+	{ "transport-set-lan-cfg", NETFN_TRANSPORT, TRANSPORT_SET_LAN_CFG,
+		6, { 0x01, 0x03, 0x0A, 0x00, 0x00, 0x02 } },
+	{ "transport-get-ip-stats", NETFN_TRANSPORT, TRANSPORT_GET_IP_STATS,
+		2, { 0x01, 0x00 } },
+	{ "transport-suspend-bmc-arp", NETFN_TRANSPORT,
+		TRANSPORT_SUSPEND_BMC_ARP, 2, { 0x01, 0x00 } },
+	{ NULL, 0, 0, 0, { 0 } }
+};
+
+/* Threshold evaluation kernels, run over the whole sensor table of the BMC
+ * rather than dispatched. ns/op is per sensor.
+ */
+struct micro_kernel {
+	const char *name;
+	void (*eval)(struct sensor_table *table, uint32_t from, uint32_t to);
+};
+
+static const struct micro_kernel micro_kernels[] = {
+	{ "sensor-eval-scalar", sensor_eval_scalar },
+	{ "sensor-eval-simd", sensor_eval_simd },
+	{ NULL, NULL }
+};
+
+/* RMCP+ handshakes, Open Session Request through RAKP 4, served by
+ * rmcp_handle(). Users' keys are either kept by the BMC or hashed from the
+ * password for every RAKP message. ns/op is per handshake, the console's
+ * side of it isn't counted.
+ */
+struct micro_handshake {
+	const char *name;
+	uint8_t auth_alg;
+	int key_cache;
+};
+
+static const struct micro_handshake micro_handshakes[] = {
+	{ "rakp-hmac-sha1-cached", RMCP_AUTH_RAKP_HMAC_SHA1, 1 },
+	{ "rakp-hmac-sha1-uncached", RMCP_AUTH_RAKP_HMAC_SHA1, 0 },
+	{ "rakp-hmac-sha256-cached", RMCP_AUTH_RAKP_HMAC_SHA256, 1 },
+	{ "rakp-hmac-sha256-uncached", RMCP_AUTH_RAKP_HMAC_SHA256, 0 },
+	{ NULL, 0, 0 }
+};
+
+/* Per-packet work of RMCP+ sessions, over a payload as big as the largest
+ * SOL one, with what crypto_init() picks for the CPU and with plain C
+ * (-c). ns/op is per payload.
+ */
+#define MICRO_PAYLOAD 256
+
+enum micro_crypto_op {
+	MICRO_AES_ENCRYPT,
+	MICRO_AES_DECRYPT,
+	MICRO_HMAC
+};
+
+struct micro_crypto {
+	const char *name;
+	int op;
+	uint8_t hash;
+	unsigned int accel;
+};
+
+static const struct micro_crypto micro_cryptos[] = {
+	{ "aes-cbc-128-encrypt", MICRO_AES_ENCRYPT, 0, CRYPTO_ACCEL_AES },
+	{ "aes-cbc-128-encrypt-c", MICRO_AES_ENCRYPT, 0, 0 },
+	{ "aes-cbc-128-decrypt", MICRO_AES_DECRYPT, 0, CRYPTO_ACCEL_AES },
+	{ "aes-cbc-128-decrypt-c", MICRO_AES_DECRYPT, 0, 0 },
+	{ "hmac-sha1-96", MICRO_HMAC, HASH_SHA1, CRYPTO_ACCEL_SHA },
+	{ "hmac-sha1-96-c", MICRO_HMAC, HASH_SHA1, 0 },
+	{ "hmac-sha256-128", MICRO_HMAC, HASH_SHA256, CRYPTO_ACCEL_SHA },
+	{ "hmac-sha256-128-c", MICRO_HMAC, HASH_SHA256, 0 },
+	{ NULL, 0, 0, 0 }
+};
+
+/* now_ns - returns monotonic time in nanoseconds */
+uint64_t
+now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* micro_run - dispatch one case over and over.
+ *
+ * @bmc: BMC to dispatch to
+ * @arena: arena responses are allocated from
+ * @mc: case to run
+ * @iterations: number of dispatches
+ * @ccode: completion code of the last dispatch
+ *
+ * returns elapsed time in ns
+ */
+uint64_t
+micro_run(struct bmc *bmc, struct arena *arena, const struct micro_case *mc,
+		uint64_t iterations, uint8_t *ccode)
+{
+	struct dummy_rq req;
+	struct dummy_rs rsp;
+	uint8_t data[sizeof(mc->data)];
+	uint64_t start;
+	uint64_t i;
+	memset(&req, 0, sizeof(req));
+	req.msg.netfn = mc->netfn;
+	req.msg.cmd = mc->cmd;
+	req.msg.data_len = mc->data_len;
+	req.msg.data = data;
+	start = now_ns();
+	for (i = 0; i < iterations; i++) {
+		/* some handlers modify request data in place */
+		memcpy(data, mc->data, sizeof(data));
+		ipmi_dispatch(bmc, &req, &rsp);
+		arena_reset(arena);
+	}
+	*ccode = rsp.ccode;
+	return now_ns() - start;
+}
+
+/* micro_kernel_run - evaluate thresholds of all sensors over and over.
+ *
+ * @table: allocated sensor table
+ * @mk: kernel to run
+ * @passes: number of passes over the table
+ *
+ * returns elapsed time in ns
+ */
+uint64_t
+micro_kernel_run(struct sensor_table *table, const struct micro_kernel *mk,
+		uint64_t passes)
+{
+	uint64_t start;
+	uint64_t i;
+	start = now_ns();
+	for (i = 0; i < passes; i++) {
+		mk->eval(table, 0, table->count);
+	}
+	return now_ns() - start;
+}
+
+/* micro_rmcp - send RMCP+ set-up payload to BMC outside of a session.
+ *
+ * @bmc: BMC
+ * @type: payload type
+ * @payload: payload
+ * @len: length of payload
+ * @out: buffer for response, RMCP_PKT_MAX bytes
+ * @elapsed: time spent in rmcp_handle() is added here
+ *
+ * returns response payload, NULL if there's none
+ */
+const uint8_t *
+micro_rmcp(struct bmc *bmc, uint8_t type, const uint8_t *payload, size_t len,
+		uint8_t *out, uint64_t *elapsed)
+{
+	/* auth type, payload type, session ID and sequence, length */
+	const size_t hdr = RMCP_HEADER_SIZE + 12;
+	uint8_t pkt[RMCP_PKT_MAX];
+	uint64_t start;
+	int rc;
+	memset(pkt, 0, hdr);
+	pkt[0] = RMCP_VERSION;
+	pkt[2] = RMCP_SEQ_NO_ACK;
+	pkt[3] = RMCP_CLASS_IPMI;
+	pkt[4] = IPMI_AUTH_RMCP_PLUS;
+	pkt[5] = type;
+	pkt[14] = len;
+	memcpy(&pkt[hdr], payload, len);
+	start = now_ns();
+	rc = rmcp_handle(bmc, NULL, pkt, hdr + len, out, RMCP_PKT_MAX);
+	*elapsed += now_ns() - start;
+	return rc > (int)hdr ? &out[hdr] : NULL;
+}
+
+/* micro_handshake_run - set up and close RMCP+ sessions over and over.
+ *
+ * @bmc: BMC
+ * @mh: case to run
+ * @count: number of handshakes
+ * @status: RAKP 4 status of the last handshake, FFh if it didn't get there
+ *
+ * returns time spent by the BMC in ns
+ */
+uint64_t
+micro_handshake_run(struct bmc *bmc, const struct micro_handshake *mh,
+		uint64_t count, uint8_t *status)
+{
+	static const uint8_t name[] = "admin";
+	static const uint8_t password[20] = "foo";
+	const size_t name_len = sizeof(name) - 1;
+	uint8_t hash = mh->auth_alg == RMCP_AUTH_RAKP_HMAC_SHA256
+		? HASH_SHA256 : HASH_SHA1;
+	struct hmac_key key;
+	struct session *session;
+	const uint8_t *rs;
+	uint8_t out[RMCP_PKT_MAX];
+	uint8_t rq[64];
+	uint8_t buf[64];
+	uint8_t sid[4];
+	uint64_t elapsed = 0;
+	uint64_t i;
+	user_key_cache_enable(mh->key_cache);
+	hmac_key_init(&key, hash, password, sizeof(password));
+	*status = 0xFF;
+	for (i = 0; i < count; i++) {
+		*status = 0xFF;
+		/* console session ID 1, no integrity nor confidentiality */
+		memset(rq, 0, 32);
+		rq[1] = PRIV_ADMIN;
+		rq[4] = 0x01;
+		rq[8] = RMCP_ALG_AUTH;
+		rq[11] = 8;
+		rq[12] = mh->auth_alg;
+		rq[16] = RMCP_ALG_INTEGRITY;
+		rq[19] = 8;
+		rq[24] = RMCP_ALG_CONF;
+		rq[27] = 8;
+		rs = micro_rmcp(bmc, IPMI_PAYLOAD_OPEN_SESSION_RQ, rq, 32, out,
+				&elapsed);
+		if (rs == NULL || rs[1] != RMCP_STATUS_OK) {
+			break;
+		}
+		memcpy(sid, &rs[8], sizeof(sid));
+		memset(rq, 0, 28);
+		memcpy(&rq[4], sid, sizeof(sid));
+		memset(&rq[8], 0xA5, 16);
+		rq[24] = PRIV_ADMIN;
+		rq[27] = name_len;
+		memcpy(&rq[28], name, name_len);
+		rs = micro_rmcp(bmc, IPMI_PAYLOAD_RAKP1, rq, 28 + name_len, out,
+				&elapsed);
+		if (rs == NULL || rs[1] != RMCP_STATUS_OK) {
+			break;
+		}
+		/* HMAC over Rc, SIDm, ROLEm, ULENGTHm, UNAMEm */
+		memcpy(&buf[0], &rs[8], 16);
+		memset(&buf[16], 0, 4);
+		buf[16] = 0x01;
+		buf[20] = PRIV_ADMIN;
+		buf[21] = name_len;
+		memcpy(&buf[22], name, name_len);
+		memset(rq, 0, 8);
+		memcpy(&rq[4], sid, sizeof(sid));
+		hmac(&key, buf, 22 + name_len, &rq[8]);
+		rs = micro_rmcp(bmc, IPMI_PAYLOAD_RAKP3, rq,
+				8 + hash_size(hash), out, &elapsed);
+		if (rs == NULL) {
+			break;
+		}
+		*status = rs[1];
+		if (rs[1] != RMCP_STATUS_OK) {
+			break;
+		}
+		/* tear-down isn't part of the handshake */
+		pthread_mutex_lock(&bmc->lock);
+		session = session_find(&bmc->app.sessions,
+				sid[0] | (sid[1] << 8) | (sid[2] << 16)
+				| ((uint32_t)sid[3] << 24), monotonic_ms());
+		if (session != NULL) {
+			session_close(&bmc->app.sessions, session);
+		}
+		pthread_mutex_unlock(&bmc->lock);
+	}
+	user_key_cache_enable(1);
+	return elapsed;
+}
+
+/* micro_crypto_run - run one crypto case over and over.
+ *
+ * @mc: case to run
+ * @count: number of payloads
+ *
+ * returns elapsed time in ns
+ */
+uint64_t
+micro_crypto_run(const struct micro_crypto *mc, uint64_t count)
+{
+	static const uint8_t k[20] = "0123456789abcdefghij";
+	static uint8_t buf[MICRO_PAYLOAD];
+	struct aes128_key aes;
+	struct hmac_key key;
+	uint8_t iv[AES_BLOCK_SIZE];
+	uint8_t mac[HASH_MAX_SIZE];
+	uint64_t start;
+	uint64_t elapsed;
+	uint64_t i;
+	crypto_init(mc->accel);
+	aes128_key_init(&aes, k);
+	hmac_key_init(&key, mc->hash, k, sizeof(k));
+	memset(iv, 0xA5, sizeof(iv));
+	start = now_ns();
+	for (i = 0; i < count; i++) {
+		switch (mc->op) {
+		case MICRO_AES_ENCRYPT:
+			aes128_cbc_encrypt(&aes, iv, buf, sizeof(buf));
+			break;
+		case MICRO_AES_DECRYPT:
+			aes128_cbc_decrypt(&aes, iv, buf, sizeof(buf));
+			break;
+		default:
+			hmac(&key, buf, sizeof(buf), mac);
+			break;
+		}
+	}
+	elapsed = now_ns() - start;
+	crypto_init(CRYPTO_ACCEL_AES | CRYPTO_ACCEL_SHA);
+	return elapsed;
+}
+
+void
+usage(const char *progname)
+{
+	int i;
+	printf("Usage: %s [-n iterations] [-r sensors] [-j] [case ...]\n",
+			progname);
+	printf("  -n N  dispatch every case N times, default 1000000\n");
+	printf("  -r N  simulate N sensors, default %i\n",
+			SDR_SENSORS_DEFAULT);
+	printf("  -j    print results as JSON\n");
+	printf("Cases:");
+	for (i = 0; micro_cases[i].name != NULL; i++) {
+		printf(" %s", micro_cases[i].name);
+	}
+	for (i = 0; micro_kernels[i].name != NULL; i++) {
+		printf(" %s", micro_kernels[i].name);
+	}
+	for (i = 0; micro_cryptos[i].name != NULL; i++) {
+		printf(" %s", micro_cryptos[i].name);
+	}
+	for (i = 0; micro_handshakes[i].name != NULL; i++) {
+		printf(" %s", micro_handshakes[i].name);
+	}
+	printf("\n");
+}
+
+/* micro_selected - whether case has been asked for on the command line */
+int
+micro_selected(const char *name, int argc, char **argv)
+{
+	int i;
+	if (argc == 0) {
+		return 1;
+	}
+	for (i = 0; i < argc; i++) {
+		if (strstr(name, argv[i]) != NULL) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	const struct micro_case *mc;
+	const struct micro_kernel *mk;
+	const struct micro_crypto *mcr;
+	const struct micro_handshake *mh;
+	struct sensor_table *table;
+	struct arena arena;
+	struct bmc *bmc;
+	uint64_t allocs;
+	uint64_t elapsed;
+	uint64_t handshakes;
+	uint64_t payloads;
+	uint64_t heap_allocs;
+	uint64_t iterations = 1000000;
+	uint64_t passes;
+	uint32_t sensors = SDR_SENSORS_DEFAULT;
+	uint32_t i;
+	uint8_t ccode;
+	int count = 0;
+	int header = 0;
+	int json = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "jn:r:h")) != (-1)) {
+		switch (opt) {
+		case 'j':
+			json = 1;
+			break;
+		case 'n':
+			iterations = strtoull(optarg, NULL, 10);
+			break;
+		case 'r':
+			sensors = strtoul(optarg, NULL, 10);
+			if (sensors < 1 || sensors > SDR_SENSORS_MAX) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (iterations < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+	/* handlers' info/debug messages would measure the logger */
+	log_set_level(LOG_LVL_WARN);
+	if (log_init() != 0 || bmc_pool_init(1) != 0
+			|| sdr_repo_init(sensors) != 0
+			|| sensor_engine_init() != 0
+			|| arena_init(&arena, ARENA_SIZE) != 0) {
+		return 1;
+	}
+	crypto_init(CRYPTO_ACCEL_AES | CRYPTO_ACCEL_SHA);
+	bmc = bmc_get(0);
+	arena_use(&arena);
+	if (json) {
+		printf("{\"iterations\": %" PRIu64 ", \"cases\": [", iterations);
+	} else {
+		printf("%-28s %10s %10s %10s %6s\n", "case", "ns/op",
+				"allocs/op", "heap/op", "ccode");
+	}
+	for (mc = micro_cases; mc->name != NULL; mc++) {
+		if (!micro_selected(mc->name, argc - optind, argv + optind)) {
+			continue;
+		}
+		/* warm up caches and branch predictors */
+		micro_run(bmc, &arena, mc, iterations / 10 + 1, &ccode);
+		allocs = arena.allocs;
+		heap_allocs = arena.heap_allocs;
+		elapsed = micro_run(bmc, &arena, mc, iterations, &ccode);
+		allocs = arena.allocs - allocs;
+		heap_allocs = arena.heap_allocs - heap_allocs;
+		if (json) {
+			printf("%s\n  {\"name\": \"%s\", \"ns_per_op\": %.2f"
+					", \"allocs_per_op\": %.2f"
+					", \"heap_allocs_per_op\": %.2f"
+					", \"ccode\": %u}",
+					count > 0 ? "," : "", mc->name,
+					(double)elapsed / iterations,
+					(double)allocs / iterations,
+					(double)heap_allocs / iterations,
+					ccode);
+		} else {
+			printf("%-28s %10.2f %10.2f %10.2f %6x\n", mc->name,
+					(double)elapsed / iterations,
+					(double)allocs / iterations,
+					(double)heap_allocs / iterations,
+					ccode);
+		}
+		count++;
+	}
+	table = &bmc->sensor.table;
+	if (sensor_table_alloc(table, NULL, 0) != 0) {
+		return 1;
+	}
+	/* readings all over the place, so that scalar branches can't be
+	 * predicted
+	 */
+	for (i = 0; i < table->count; i++) {
+		table->raw[i] = (i * 167) & 0xFF;
+	}
+	passes = iterations / table->count + 1;
+	for (mk = micro_kernels; mk->name != NULL; mk++) {
+		if (!micro_selected(mk->name, argc - optind, argv + optind)) {
+			continue;
+		}
+		micro_kernel_run(table, mk, passes / 10 + 1);
+		elapsed = micro_kernel_run(table, mk, passes);
+		if (json) {
+			printf("%s\n  {\"name\": \"%s\", \"ns_per_op\": %.2f"
+					", \"allocs_per_op\": 0.00"
+					", \"heap_allocs_per_op\": 0.00"
+					", \"ccode\": 0}",
+					count > 0 ? "," : "", mk->name,
+					(double)elapsed / (passes * table->count));
+		} else {
+			printf("%-28s %10.2f %10.2f %10.2f %6x\n", mk->name,
+					(double)elapsed / (passes * table->count),
+					0.0, 0.0, 0);
+		}
+		count++;
+	}
+	payloads = iterations / 10 + 1;
+	for (mcr = micro_cryptos; mcr->name != NULL; mcr++) {
+		if (!micro_selected(mcr->name, argc - optind, argv + optind)) {
+			continue;
+		}
+		micro_crypto_run(mcr, payloads / 10 + 1);
+		elapsed = micro_crypto_run(mcr, payloads);
+		if (json) {
+			printf("%s\n  {\"name\": \"%s\", \"ns_per_op\": %.2f"
+					", \"allocs_per_op\": 0.00"
+					", \"heap_allocs_per_op\": 0.00"
+					", \"ccode\": 0}",
+					count > 0 ? "," : "", mcr->name,
+					(double)elapsed / payloads);
+		} else {
+			printf("%-28s %10.2f %10.2f %10.2f %6x\n", mcr->name,
+					(double)elapsed / payloads, 0.0, 0.0, 0);
+		}
+		count++;
+	}
+	handshakes = iterations / 100 + 1;
+	for (mh = micro_handshakes; mh->name != NULL; mh++) {
+		if (!micro_selected(mh->name, argc - optind, argv + optind)) {
+			continue;
+		}
+		micro_handshake_run(bmc, mh, handshakes / 10 + 1, &ccode);
+		elapsed = micro_handshake_run(bmc, mh, handshakes, &ccode);
+		if (json) {
+			printf("%s\n  {\"name\": \"%s\", \"ns_per_op\": %.2f"
+					", \"handshakes_per_sec\": %.0f"
+					", \"status\": %u}",
+					count > 0 ? "," : "", mh->name,
+					(double)elapsed / handshakes,
+					handshakes * 1e9 / elapsed, ccode);
+		} else {
+			if (!header) {
+				printf("\n%-28s %10s %12s %6s\n", "handshake",
+						"ns/op", "handshakes/s",
+						"status");
+				header = 1;
+			}
+			printf("%-28s %10.2f %12.0f %6x\n", mh->name,
+					(double)elapsed / handshakes,
+					handshakes * 1e9 / elapsed, ccode);
+		}
+		count++;
+	}
+	if (json) {
+		printf("\n]}\n");
+	}
+	arena_free(&arena);
+	log_flush();
+	return 0;
+}
@@ -0,0 +1,892 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "fake-ipmistack/fake-ipmistack.h"
+#include "fake-ipmistack/bmc.h"
+#include "fake-ipmistack/scenario.h"
+
+#include <libgen.h>
+#include <sys/stat.h>
+
+/* Compiler of scenarios for fake-ipmistack, see scenario.h. Scenario is
+ * a text file, a directive per line, numbers in C notation:
+ *
+ * profile NAME              starts a profile, all below belong to it
+ * bmcs N                    number of BMCs of the profile, default 1
+ * device-id N
+ * device-revision N         0 - 15
+ * firmware MAJOR.MINOR      e.g. 2.13
+ * ipmi-version MAJOR.MINOR  e.g. 2.0
+ * support BYTE              Device Support bits
+ * manufacturer N            IANA number, 20 bits
+ * product N
+ * aux-firmware N            4 bytes, MS byte first
+ * guid HEX                  32 hex digits as sent, '-' are ignored
+ * channel NUM PTYPE MTYPE SESSIONS CAPS PRIV [DESCRIPTION]
+ * user UID NAME PASSWORD [enabled] [access BYTE]
+ * sensor NUM [lun N] [reading N] [unr|uc|unc|lnr|lc|lnc N] ...
+ * fru DEV_ID FILE           relative to the scenario's directory
+ *
+ * Whatever a profile doesn't give is built-in. A profile with any user
+ * has those users only. Identical users, channels, sensors and FRU images
+ * of different profiles are stored once.
+ */
+
+# define LINE_MAX_LEN 1024
+# define TOKENS_MAX 32
+/* sections of the output are looked up by contents */
+# define SECTION_BUCKETS 65536
+# define FNV1A_BASIS 0xCBF29CE484222325ULL
+/* sensor numbers of one profile, each LUN */
+# define PRESETS_MAX (SENSOR_LUNS * SENSOR_NUMBERS)
+
+struct section {
+	uint64_t hash;
+	uint64_t offset;
+	uint32_t len;
+	int32_t next;
+};
+
+/* profile being compiled */
+struct builder {
+	struct scenario_profile prof;
+	struct user_db users;
+	int has_users;
+	struct ipmi_channel channels[CHANNEL_MAX];
+	struct sensor_preset sensors[PRESETS_MAX];
+	struct fru_ref frus[FRU_DEVICES_MAX];
+};
+
+static const char *src_path;
+static char src_dir[4096];
+static int src_line;
+
+/* sections, offsets are relative to the first one */
+static uint8_t *data;
+static uint64_t data_len;
+static uint64_t data_cap;
+static struct section *sections;
+static int32_t section_count;
+static int32_t section_cap;
+static int32_t section_heads[SECTION_BUCKETS];
+
+static struct scenario_profile *profiles;
+static uint32_t profile_count;
+static uint32_t profile_cap;
+static uint32_t bmc_total;
+
+/* fail - report what is wrong with the current line */
+void
+fail(const char *msg, const char *what)
+{
+	fprintf(stderr, "%s:%i: %s", src_path, src_line, msg);
+	if (what != NULL) {
+		fprintf(stderr, " '%s'", what);
+	}
+	fprintf(stderr, "\n");
+}
+
+/* hash_fnv1a - returns 64-bit FNV-1a hash of buffer, continued from hash,
+ * FNV1A_BASIS to start a new one
+ */
+uint64_t
+hash_fnv1a(uint64_t hash, const uint8_t *buf, size_t len)
+{
+	size_t i;
+	for (i = 0; i < len; i++) {
+		hash = (hash ^ buf[i]) * 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+/* section_add - add section to output, unless there is the same one.
+ *
+ * @buf: contents
+ * @len: size of contents
+ * @shared: whether an identical section may be used instead
+ *
+ * returns offset relative to the first section plus 1, 0 on error
+ */
+uint64_t
+section_add(const void *buf, uint32_t len, int shared)
+{
+	struct section *sect;
+	uint64_t hash = hash_fnv1a(FNV1A_BASIS, buf, len);
+	uint64_t offset;
+	int32_t bucket = hash % SECTION_BUCKETS;
+	int32_t i;
+	void *grown;
+	for (i = section_heads[bucket]; shared && i >= 0;
+			i = sections[i].next) {
+		sect = &sections[i];
+		if (sect->hash == hash && sect->len == len
+				&& memcmp(data + sect->offset, buf, len) == 0) {
+			return sect->offset + 1;
+		}
+	}
+	offset = (data_len + SCENARIO_ALIGN - 1)
+		& ~(uint64_t)(SCENARIO_ALIGN - 1);
+	if (offset + len > data_cap) {
+		data_cap = (offset + len) * 2;
+		grown = realloc(data, data_cap);
+		if (grown == NULL) {
+			perror("realloc fail");
+			return 0;
+		}
+		data = grown;
+	}
+	memset(data + data_len, 0, offset - data_len);
+	memcpy(data + offset, buf, len);
+	data_len = offset + len;
+	if (section_count == section_cap) {
+		section_cap = section_cap > 0 ? section_cap * 2 : 1024;
+		grown = realloc(sections, section_cap * sizeof(struct section));
+		if (grown == NULL) {
+			perror("realloc fail");
+			return 0;
+		}
+		sections = grown;
+	}
+	sect = &sections[section_count];
+	sect->hash = hash;
+	sect->offset = offset;
+	sect->len = len;
+	sect->next = section_heads[bucket];
+	section_heads[bucket] = section_count++;
+	return offset + 1;
+}
+
+/* parse_num - parse number of at most max.
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+parse_num(const char *tok, unsigned long max, unsigned long *val)
+{
+	char *end;
+	if (tok == NULL) {
+		fail("number expected", NULL);
+		return (-1);
+	}
+	errno = 0;
+	*val = strtoul(tok, &end, 0);
+	if (errno != 0 || end == tok || *end != '\0' || tok[0] == '-'
+			|| *val > max) {
+		fail("number out of range", tok);
+		return (-1);
+	}
+	return 0;
+}
+
+/* parse_version - parse MAJOR.MINOR where MINOR is decimal digits.
+ *
+ * @tok: version
+ * @major_max: most major may be
+ * @minor_digits: most digits minor may have
+ * @major: major, binary
+ * @minor: minor, BCD
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+parse_version(const char *tok, unsigned long major_max, int minor_digits,
+		unsigned long *major, uint8_t *minor)
+{
+	char buf[32];
+	char *dot;
+	int i;
+	if (tok == NULL || strlen(tok) >= sizeof(buf)) {
+		fail("version expected", tok);
+		return (-1);
+	}
+	strcpy(buf, tok);
+	dot = strchr(buf, '.');
+	if (dot == NULL || dot[1] == '\0'
+			|| strlen(dot + 1) > (size_t)minor_digits) {
+		fail("MAJOR.MINOR expected", tok);
+		return (-1);
+	}
+	*dot++ = '\0';
+	*minor = 0;
+	for (i = 0; dot[i] != '\0'; i++) {
+		if (dot[i] < '0' || dot[i] > '9') {
+			fail("decimal minor version expected", tok);
+			return (-1);
+		}
+		*minor = (*minor << 4) | (dot[i] - '0');
+	}
+	return parse_num(buf, major_max, major);
+}
+
+/* parse_guid - parse 32 hex digits, '-' anywhere in between.
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+parse_guid(const char *tok, uint8_t *guid)
+{
+	int digits = 0;
+	int nibble;
+	if (tok == NULL) {
+		fail("GUID expected", NULL);
+		return (-1);
+	}
+	for (; *tok != '\0'; tok++) {
+		if (*tok == '-') {
+			continue;
+		}
+		if (*tok >= '0' && *tok <= '9') {
+			nibble = *tok - '0';
+		} else if (*tok >= 'a' && *tok <= 'f') {
+			nibble = *tok - 'a' + 10;
+		} else if (*tok >= 'A' && *tok <= 'F') {
+			nibble = *tok - 'A' + 10;
+		} else {
+			digits = (-1);
+			break;
+		}
+		if (digits == 32) {
+			break;
+		}
+		guid[digits / 2] = (guid[digits / 2] << 4) | nibble;
+		digits++;
+	}
+	if (digits != 32 || *tok != '\0') {
+		fail("GUID must be 32 hex digits", NULL);
+		return (-1);
+	}
+	return 0;
+}
+
+/* read_file - read FRU image given relative to the scenario.
+ *
+ * returns contents, NULL on error
+ */
+uint8_t *
+read_file(const char *name, uint32_t *size)
+{
+	char path[8192];
+	struct stat st;
+	uint8_t *buf;
+	FILE *fp;
+	if (name[0] == '/') {
+		snprintf(path, sizeof(path), "%s", name);
+	} else {
+		snprintf(path, sizeof(path), "%s/%s", src_dir, name);
+	}
+	fp = fopen(path, "rb");
+	if (fp == NULL) {
+		perror(path);
+		return NULL;
+	}
+	if (fstat(fileno(fp), &st) != 0 || st.st_size < 1
+			|| st.st_size > FRU_SIZE_MAX) {
+		fail("FRU image must be 1-65535 bytes", path);
+		fclose(fp);
+		return NULL;
+	}
+	buf = malloc(st.st_size);
+	if (buf == NULL) {
+		perror("malloc fail");
+		fclose(fp);
+		return NULL;
+	}
+	if (fread(buf, 1, st.st_size, fp) != (size_t)st.st_size) {
+		perror(path);
+		free(buf);
+		fclose(fp);
+		return NULL;
+	}
+	fclose(fp);
+	*size = st.st_size;
+	return buf;
+}
+
+/* builder_start - start a new profile with built-in identity */
+void
+builder_start(struct builder *b, const char *name)
+{
+	static const uint8_t device_id[] = DEVICE_ID_DEFAULT;
+	memset(&b->prof, 0, sizeof(b->prof));
+	snprintf(b->prof.name, sizeof(b->prof.name), "%s", name);
+	b->prof.bmcs = 1;
+	b->prof.device_id_len = sizeof(device_id);
+	memcpy(b->prof.device_id, device_id, sizeof(device_id));
+	memset(&b->users, 0, sizeof(b->users));
+	b->has_users = 0;
+}
+
+/* builder_finish - write sections of the profile and add it to the
+ * profile table.
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+builder_finish(struct builder *b)
+{
+	struct scenario_profile *prof = &b->prof;
+	uint64_t frus;
+	uint32_t i;
+	void *grown;
+	if (prof->bmcs > BMC_COUNT_MAX - bmc_total) {
+		fail("scenario describes too many BMCs", prof->name);
+		return (-1);
+	}
+	prof->first_bmc = bmc_total;
+	bmc_total += prof->bmcs;
+	if (b->has_users) {
+		prof->users = section_add(&b->users, sizeof(b->users), 1);
+		if (prof->users == 0) {
+			return (-1);
+		}
+	}
+	if (prof->channel_count > 0) {
+		prof->channels = section_add(b->channels, prof->channel_count
+				* sizeof(struct ipmi_channel), 1);
+		if (prof->channels == 0) {
+			return (-1);
+		}
+	}
+	if (prof->sensor_count > 0) {
+		prof->sensors = section_add(b->sensors, prof->sensor_count
+				* sizeof(struct sensor_preset), 1);
+		if (prof->sensors == 0) {
+			return (-1);
+		}
+	}
+	if (prof->fru_count > 0) {
+		/* data offsets become relative to where refs are about to
+		 * be, refs can't be shared
+		 */
+		frus = (data_len + SCENARIO_ALIGN - 1)
+			& ~(uint64_t)(SCENARIO_ALIGN - 1);
+		for (i = 0; i < prof->fru_count; i++) {
+			b->frus[i].offset -= frus;
+		}
+		prof->frus = section_add(b->frus, prof->fru_count
+				* sizeof(struct fru_ref), 0);
+		if (prof->frus == 0) {
+			return (-1);
+		}
+	}
+	if (profile_count == profile_cap) {
+		profile_cap = profile_cap > 0 ? profile_cap * 2 : 256;
+		grown = realloc(profiles, profile_cap
+				* sizeof(struct scenario_profile));
+		if (grown == NULL) {
+			perror("realloc fail");
+			return (-1);
+		}
+		profiles = grown;
+	}
+	memcpy(&profiles[profile_count++], prof, sizeof(*prof));
+	return 0;
+}
+
+/* directive_user - user UID NAME PASSWORD [enabled] [access BYTE] */
+int
+directive_user(struct builder *b, char **tok, int count)
+{
+	struct ipmi_user *user;
+	unsigned long uid;
+	unsigned long access = 0x34;
+	int enabled = 0;
+	int i;
+	if (count < 4) {
+		fail("user UID NAME PASSWORD expected", NULL);
+		return (-1);
+	}
+	if (parse_num(tok[1], UID_MAX, &uid) != 0) {
+		return (-1);
+	}
+	if (uid < UID_MIN || strlen(tok[2]) > 16 || strlen(tok[3]) > 20) {
+		fail("UID 1-63, name of up to 16 and password of up to 20"
+				" characters expected", NULL);
+		return (-1);
+	}
+	for (i = 4; i < count; i++) {
+		if (strcmp(tok[i], "enabled") == 0) {
+			enabled = 1;
+		} else if (strcmp(tok[i], "access") == 0) {
+			if (parse_num(tok[++i], 0x7F, &access) != 0) {
+				return (-1);
+			}
+		} else {
+			fail("unknown user option", tok[i]);
+			return (-1);
+		}
+	}
+	b->has_users = 1;
+	user = &b->users.users[uid];
+	memset(user, 0, sizeof(*user));
+	memcpy(user->name, tok[2], strlen(tok[2]));
+	memcpy(user->password, tok[3], strlen(tok[3]));
+	user->password_size = strlen(tok[3]) > 16;
+	memset(b->users.access[uid], access, CHANNEL_MAX);
+	b->prof.users_named |= 1ULL << uid;
+	if (enabled) {
+		b->prof.users_enabled |= 1ULL << uid;
+	} else {
+		b->prof.users_enabled &= ~(1ULL << uid);
+	}
+	return 0;
+}
+
+/* directive_channel - channel NUM PTYPE MTYPE SESSIONS CAPS PRIV [DESC] */
+int
+directive_channel(struct builder *b, char **tok, int count)
+{
+	struct ipmi_channel chan;
+	unsigned long val[6];
+	size_t len = 0;
+	int i;
+	if (count < 7) {
+		fail("channel NUM PTYPE MTYPE SESSIONS CAPS PRIV expected",
+				NULL);
+		return (-1);
+	}
+	for (i = 0; i < 6; i++) {
+		if (parse_num(tok[i + 1], i == 0 ? CHANNEL_MAX - 1 : 0xFF,
+					&val[i]) != 0) {
+			return (-1);
+		}
+	}
+	memset(&chan, 0, sizeof(chan));
+	chan.number = val[0];
+	chan.ptype = val[1];
+	chan.mtype = val[2];
+	chan.sessions = val[3];
+	chan.capabilities = val[4];
+	chan.priv_level = val[5];
+	for (i = 7; i < count; i++) {
+		len += strlen(tok[i]) + (i > 7);
+		if (len >= sizeof(chan.desc)) {
+			fail("channel description is too long", NULL);
+			return (-1);
+		}
+		if (i > 7) {
+			strcat(chan.desc, " ");
+		}
+		strcat(chan.desc, tok[i]);
+	}
+	for (i = 0; i < b->prof.channel_count; i++) {
+		if (b->channels[i].number == chan.number) {
+			break;
+		}
+	}
+	if (i == b->prof.channel_count) {
+		b->prof.channel_count++;
+	}
+	memcpy(&b->channels[i], &chan, sizeof(chan));
+	return 0;
+}
+
+/* directive_sensor - sensor NUM [lun N] [reading N] [THRESHOLD N] ... */
+int
+directive_sensor(struct builder *b, char **tok, int count)
+{
+	static const char *thr_names[SENSOR_THR_COUNT] = {
+		"lnc", "lc", "lnr", "unc", "uc", "unr"
+	};
+	struct sensor_preset preset;
+	unsigned long val;
+	uint32_t j;
+	int i;
+	int t;
+	memset(&preset, 0, sizeof(preset));
+	if (parse_num(tok[1], SENSOR_NUMBERS - 1, &val) != 0) {
+		return (-1);
+	}
+	preset.number = val;
+	for (i = 2; i < count; i += 2) {
+		if (parse_num(tok[i + 1], 0xFF, &val) != 0) {
+			return (-1);
+		}
+		if (strcmp(tok[i], "lun") == 0) {
+			if (val >= SENSOR_LUNS) {
+				fail("LUN must be 0-3", NULL);
+				return (-1);
+			}
+			preset.lun = val;
+			continue;
+		}
+		if (strcmp(tok[i], "reading") == 0) {
+			preset.mask |= SENSOR_PRESET_RAW;
+			preset.raw = val;
+			continue;
+		}
+		for (t = 0; t < SENSOR_THR_COUNT; t++) {
+			if (strcmp(tok[i], thr_names[t]) == 0) {
+				break;
+			}
+		}
+		if (t == SENSOR_THR_COUNT) {
+			fail("unknown sensor option", tok[i]);
+			return (-1);
+		}
+		preset.mask |= 1 << t;
+		preset.thr[t] = val;
+	}
+	for (j = 0; j < b->prof.sensor_count; j++) {
+		if (b->sensors[j].lun == preset.lun
+				&& b->sensors[j].number == preset.number) {
+			break;
+		}
+	}
+	if (j == b->prof.sensor_count) {
+		memset(&b->sensors[j], 0, sizeof(preset));
+		b->sensors[j].lun = preset.lun;
+		b->sensors[j].number = preset.number;
+		b->prof.sensor_count++;
+	}
+	/* later lines add to earlier ones */
+	if (preset.mask & SENSOR_PRESET_RAW) {
+		b->sensors[j].raw = preset.raw;
+	}
+	for (t = 0; t < SENSOR_THR_COUNT; t++) {
+		if (preset.mask & (1 << t)) {
+			b->sensors[j].thr[t] = preset.thr[t];
+		}
+	}
+	b->sensors[j].mask |= preset.mask;
+	return 0;
+}
+
+/* directive_fru - fru DEV_ID FILE */
+int
+directive_fru(struct builder *b, char **tok, int count)
+{
+	struct fru_ref *ref;
+	unsigned long dev_id;
+	uint64_t offset;
+	uint32_t size;
+	uint32_t i;
+	uint8_t *buf;
+	if (count != 3) {
+		fail("fru DEV_ID FILE expected", NULL);
+		return (-1);
+	}
+	if (parse_num(tok[1], FRU_DEVICES_MAX - 1, &dev_id) != 0) {
+		return (-1);
+	}
+	for (i = 0; i < b->prof.fru_count; i++) {
+		if (b->frus[i].dev_id == dev_id) {
+			fail("FRU device given twice", tok[1]);
+			return (-1);
+		}
+	}
+	buf = read_file(tok[2], &size);
+	if (buf == NULL) {
+		return (-1);
+	}
+	offset = section_add(buf, size, 1);
+	free(buf);
+	if (offset == 0) {
+		return (-1);
+	}
+	ref = &b->frus[b->prof.fru_count++];
+	ref->dev_id = dev_id;
+	ref->size = size;
+	/* relative to the first section, see builder_finish() */
+	ref->offset = offset - 1;
+	return 0;
+}
+
+/* directive - compile one line of a profile.
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+directive(struct builder *b, char **tok, int count)
+{
+	struct scenario_profile *prof = &b->prof;
+	unsigned long val;
+	uint8_t minor;
+	int i;
+	if (strcmp(tok[0], "user") == 0) {
+		return directive_user(b, tok, count);
+	} else if (strcmp(tok[0], "channel") == 0) {
+		return directive_channel(b, tok, count);
+	} else if (strcmp(tok[0], "sensor") == 0) {
+		return directive_sensor(b, tok, count);
+	} else if (strcmp(tok[0], "fru") == 0) {
+		return directive_fru(b, tok, count);
+	}
+	if (count != 2) {
+		fail("exactly one value expected for", tok[0]);
+		return (-1);
+	}
+	if (strcmp(tok[0], "bmcs") == 0) {
+		if (parse_num(tok[1], BMC_COUNT_MAX, &val) != 0) {
+			return (-1);
+		}
+		if (val < 1) {
+			fail("profile needs 1 BMC or more", NULL);
+			return (-1);
+		}
+		prof->bmcs = val;
+	} else if (strcmp(tok[0], "device-id") == 0) {
+		if (parse_num(tok[1], 0xFF, &val) != 0) {
+			return (-1);
+		}
+		prof->device_id[0] = val;
+	} else if (strcmp(tok[0], "device-revision") == 0) {
+		if (parse_num(tok[1], 0x0F, &val) != 0) {
+			return (-1);
+		}
+		prof->device_id[1] = (prof->device_id[1] & 0x80) | val;
+	} else if (strcmp(tok[0], "firmware") == 0) {
+		if (parse_version(tok[1], 0x7F, 2, &val, &minor) != 0) {
+			return (-1);
+		}
+		prof->device_id[2] = val;
+		prof->device_id[3] = minor;
+	} else if (strcmp(tok[0], "ipmi-version") == 0) {
+		if (parse_version(tok[1], 9, 1, &val, &minor) != 0) {
+			return (-1);
+		}
+		/* MS digit in [3:0] */
+		prof->device_id[4] = (minor << 4) | val;
+	} else if (strcmp(tok[0], "support") == 0) {
+		if (parse_num(tok[1], 0xFF, &val) != 0) {
+			return (-1);
+		}
+		prof->device_id[5] = val;
+	} else if (strcmp(tok[0], "manufacturer") == 0) {
+		if (parse_num(tok[1], 0xFFFFF, &val) != 0) {
+			return (-1);
+		}
+		for (i = 0; i < 3; i++) {
+			prof->device_id[6 + i] = val >> (8 * i);
+		}
+	} else if (strcmp(tok[0], "product") == 0) {
+		if (parse_num(tok[1], 0xFFFF, &val) != 0) {
+			return (-1);
+		}
+		prof->device_id[9] = val;
+		prof->device_id[10] = val >> 8;
+	} else if (strcmp(tok[0], "aux-firmware") == 0) {
+		if (parse_num(tok[1], 0xFFFFFFFF, &val) != 0) {
+			return (-1);
+		}
+		for (i = 0; i < 4; i++) {
+			prof->device_id[11 + i] = val >> (24 - 8 * i);
+		}
+		prof->device_id_len = DEVICE_ID_LEN_MAX;
+	} else if (strcmp(tok[0], "guid") == 0) {
+		if (parse_guid(tok[1], prof->guid) != 0) {
+			return (-1);
+		}
+		prof->flags |= SCENARIO_GUID;
+	} else {
+		fail("unknown directive", tok[0]);
+		return (-1);
+	}
+	return 0;
+}
+
+/* compile - compile scenario file into sections and profile table.
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+compile(FILE *fp)
+{
+	struct builder *b;
+	char line[LINE_MAX_LEN];
+	char *tok[TOKENS_MAX];
+	char *save;
+	int count;
+	int in_profile = 0;
+	int rc = 0;
+	b = malloc(sizeof(struct builder));
+	if (b == NULL) {
+		perror("malloc fail");
+		return (-1);
+	}
+	while (rc == 0 && fgets(line, sizeof(line), fp) != NULL) {
+		src_line++;
+		if (strchr(line, '\n') == NULL && !feof(fp)) {
+			fail("line is too long", NULL);
+			rc = (-1);
+			break;
+		}
+		save = NULL;
+		count = 0;
+		for (tok[count] = strtok_r(line, " \t\r\n", &save);
+				tok[count] != NULL && count < TOKENS_MAX - 1;
+				tok[count] = strtok_r(NULL, " \t\r\n", &save)) {
+			count++;
+		}
+		if (count == 0 || tok[0][0] == '#') {
+			continue;
+		}
+		if (tok[count] != NULL) {
+			fail("too many words on line", NULL);
+			rc = (-1);
+			break;
+		}
+		if (strcmp(tok[0], "profile") == 0) {
+			if (count != 2) {
+				fail("profile NAME expected", NULL);
+				rc = (-1);
+			} else if (in_profile && builder_finish(b) != 0) {
+				rc = (-1);
+			} else {
+				builder_start(b, tok[1]);
+				in_profile = 1;
+			}
+			continue;
+		}
+		if (!in_profile) {
+			fail("directive outside of profile", tok[0]);
+			rc = (-1);
+			continue;
+		}
+		rc = directive(b, tok, count);
+	}
+	if (rc == 0 && ferror(fp)) {
+		perror(src_path);
+		rc = (-1);
+	}
+	if (rc == 0 && in_profile) {
+		rc = builder_finish(b);
+	}
+	if (rc == 0 && profile_count == 0) {
+		fprintf(stderr, "%s: no profile\n", src_path);
+		rc = (-1);
+	}
+	free(b);
+	return rc;
+}
+
+/* write_output - write header, profiles with offsets made absolute and
+ * sections next to path, then rename it over path.
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+write_output(const char *path)
+{
+	struct scenario_header hdr;
+	struct scenario_profile *prof;
+	char tmp[4096];
+	uint64_t base;
+	uint32_t i;
+	FILE *fp;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SCENARIO_MAGIC, sizeof(hdr.magic));
+	hdr.version = SCENARIO_VERSION;
+	hdr.byte_order = SCENARIO_BYTE_ORDER;
+	hdr.profile_count = profile_count;
+	hdr.bmc_count = bmc_total;
+	hdr.profile_size = sizeof(struct scenario_profile);
+	hdr.user_db_size = sizeof(struct user_db);
+	hdr.channel_size = sizeof(struct ipmi_channel);
+	hdr.preset_size = sizeof(struct sensor_preset);
+	hdr.fru_ref_size = sizeof(struct fru_ref);
+	hdr.profiles = (sizeof(hdr) + SCENARIO_ALIGN - 1)
+		& ~(uint64_t)(SCENARIO_ALIGN - 1);
+	base = hdr.profiles + (uint64_t)profile_count * sizeof(*prof);
+	base = (base + SCENARIO_ALIGN - 1) & ~(uint64_t)(SCENARIO_ALIGN - 1);
+	hdr.size = base + data_len;
+	/* offsets so far have been those of sections plus 1 */
+	for (i = 0; i < profile_count; i++) {
+		prof = &profiles[i];
+		prof->users += prof->users != 0 ? base - 1 : 0;
+		prof->channels += prof->channels != 0 ? base - 1 : 0;
+		prof->sensors += prof->sensors != 0 ? base - 1 : 0;
+		prof->frus += prof->frus != 0 ? base - 1 : 0;
+	}
+	hdr.hash = hash_fnv1a(FNV1A_BASIS, (const uint8_t *)profiles,
+			(size_t)profile_count * sizeof(*prof));
+	hdr.hash = hash_fnv1a(hdr.hash, data, data_len);
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	fp = fopen(tmp, "wb");
+	if (fp == NULL) {
+		perror(tmp);
+		return (-1);
+	}
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1
+			|| fseek(fp, hdr.profiles, SEEK_SET) != 0
+			|| fwrite(profiles, sizeof(*prof), profile_count, fp)
+				!= profile_count
+			|| fseek(fp, base, SEEK_SET) != 0
+			|| (data_len > 0
+				&& fwrite(data, data_len, 1, fp) != 1)
+			|| fclose(fp) != 0) {
+		perror(tmp);
+		unlink(tmp);
+		return (-1);
+	}
+	if (rename(tmp, path) != 0) {
+		perror(path);
+		unlink(tmp);
+		return (-1);
+	}
+	printf("%s: %" PRIu32 " profile(s), %" PRIu32 " BMC(s), %" PRIu64
+			" bytes\n", path, profile_count, bmc_total, hdr.size);
+	return 0;
+}
+
+void
+usage(const char *progname)
+{
+	printf("Usage: %s SCENARIO OUTPUT\n", progname);
+	printf("Compile text SCENARIO into OUTPUT for fake-ipmistack"
+			" --scenario.\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	char dir[4096];
+	FILE *fp;
+	if (argc != 3) {
+		usage(argv[0]);
+		return 1;
+	}
+	src_path = argv[1];
+	snprintf(dir, sizeof(dir), "%s", src_path);
+	snprintf(src_dir, sizeof(src_dir), "%s", dirname(dir));
+	memset(section_heads, 0xFF, sizeof(section_heads));
+	fp = fopen(src_path, "r");
+	if (fp == NULL) {
+		perror(src_path);
+		return 1;
+	}
+	if (compile(fp) != 0) {
+		fclose(fp);
+		return 1;
+	}
+	fclose(fp);
+	if (write_output(argv[2]) != 0) {
+		return 1;
+	}
+	return 0;
+}
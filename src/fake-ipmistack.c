@@ -26,11 +26,29 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#define _GNU_SOURCE
 #include "fake-ipmistack/fake-ipmistack.h"
-#include "fake-ipmistack/netfn_app.h"
+#include "fake-ipmistack/arena.h"
+#include "fake-ipmistack/bmc.h"
+#include "fake-ipmistack/crypto.h"
+#include "fake-ipmistack/dispatch.h"
+#include "fake-ipmistack/fru.h"
+#include "fake-ipmistack/helper.h"
+#include "fake-ipmistack/log.h"
 #include "fake-ipmistack/netfn_chassis.h"
-#include "fake-ipmistack/netfn_storage.h"
-#include "fake-ipmistack/netfn_transport.h"
+#include "fake-ipmistack/rmcp.h"
+#include "fake-ipmistack/scenario.h"
+#include "fake-ipmistack/sdr.h"
+#include "fake-ipmistack/sensor.h"
+#include "fake-ipmistack/snapshot.h"
+#include "fake-ipmistack/stats.h"
+
+#include <getopt.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/uio.h>
 
 /* BMC rq [bytes]
  * [1] NetFn(6)/LUN(2)
@@ -92,235 +110,1167 @@
 
 /* Command assignments - IPMIv2.0 */
 
-/* data_read - read data from socket
+# define ACCEPT_BATCH 4
+# define BMC_SOCKETS_MAX 1024
+# define CLIENT_RBUF_SIZE 8192
+# define MAX_EVENTS 64
+# define PIPELINE_MAX 16
+/* datagrams taken by one recvmmsg(), batches taken per wake-up */
+# define UDP_BATCH 64
+# define UDP_ROUNDS 4
+# define WORKERS_MAX 256
+
+/* Every connection owns one read buffer. A single read() may bring in
+ * several pipelined requests, header and data of each are parsed straight
+ * out of the buffer. Responses to all of them are sent with one writev(),
+ * whatever the socket doesn't take is copied to wbuf and sent once epoll
+ * reports the socket is writable again. Response data is allocated from
+ * per-connection arena, which is reset once responses have been handed
+ * over to the socket or copied to wbuf.
+ *
+ * Every connection talks to one BMC. It's BMC 0 unless client has selected
+ * another one with DUMMY_CMD_SELECT_BMC, or has connected to per-BMC
+ * socket. epoll data of both listeners and connections start with 'kind'.
+ *
+ * RMCP datagrams arrive on a UDP socket per BMC. Sockets are shared by all
+ * workers the same way listening sockets are. Whoever is woken up takes up
+ * to UDP_BATCH datagrams with one recvmmsg() and sends the responses back
+ * with one sendmmsg(), out of buffers the worker owns.
+ */
+enum ep_kind {
+	EP_LISTENER,
+	EP_CLIENT,
+	EP_UDP
+};
+
+struct udp_batch {
+	struct mmsghdr in[UDP_BATCH];
+	struct mmsghdr out[UDP_BATCH];
+	struct iovec in_iov[UDP_BATCH];
+	struct iovec out_iov[UDP_BATCH];
+	struct sockaddr_in addr[UDP_BATCH];
+	uint8_t in_buf[UDP_BATCH][RMCP_PKT_MAX];
+	uint8_t out_buf[UDP_BATCH][RMCP_PKT_MAX];
+	struct arena arena;
+};
+
+struct worker {
+	pthread_t thread;
+	int id;
+	int cpu;
+	int epoll_fd;
+	/* NULL unless there are UDP sockets */
+	struct udp_batch *udp;
+};
+
+struct listener {
+	enum ep_kind kind;
+	int fd;
+	struct bmc *bmc;
+};
+
+struct client {
+	enum ep_kind kind;
+	int fd;
+	struct worker *worker;
+	struct bmc *bmc;
+	int want_write;
+	struct arena arena;
+	size_t rbuf_len;
+	uint8_t rbuf[CLIENT_RBUF_SIZE];
+	uint8_t *wbuf;
+	size_t wbuf_len;
+	size_t wbuf_off;
+	size_t wbuf_size;
+};
+
+static struct listener *listeners = NULL;
+static int listener_count = 0;
+static struct listener *udp_sockets = NULL;
+static int udp_socket_count = 0;
+static const char *state_path = NULL;
+static int checkpoint_secs = 0;
+
+/* set_nonblock - put file descriptor into non-blocking mode.
  *
- * @data_ptr - pointer to memory where to store read data
- * @data_len - how much to read from socket
+ * @fd: file descriptor
  *
- * return 0 on success, otherwise (-1)
+ * returns 0 on success, otherwise (-1)
  */
 int
-data_read(int fd, void *data_ptr, int data_len)
+set_nonblock(int fd)
 {
-	int rc = 0;
-	int data_read = 0;
-	int data_total = 0;
-	int try = 1;
-	int errno_save = 0;
-	if (data_len < 0) {
+	int flags = fcntl(fd, F_GETFL, 0);
+	if (flags < 0) {
 		return (-1);
 	}
-	while (data_total < data_len && try < 4) {
-		errno = 0;
-		/* TODO - add poll() */
-		data_read = read(fd, data_ptr, data_len);
-		errno_save = errno;
-		if (data_read > 0) {
-			data_total+= data_read;
-		}
-		if (errno_save != 0) {
-			if (errno_save == EINTR || errno_save == EAGAIN) {
-				try++;
-				sleep(2);
-				continue;
-			} else {
-				errno = errno_save;
-				perror("dummy failed on read(): ");
-				rc = (-1);
-				break;
+	return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/* client_close - remove connection from epoll set and release it.
+ *
+ * @client: connection
+ */
+void
+client_close(struct client *client)
+{
+	log_info("client %i disconnected, %" PRIu64 " allocations, %"
+			PRIu64 " from heap\n", client->fd,
+			client->arena.allocs, client->arena.heap_allocs);
+	epoll_ctl(client->worker->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+	/* TODO - check return value of close() */
+	close(client->fd);
+	free(client->wbuf);
+	arena_free(&client->arena);
+	free(client);
+}
+
+/* client_want_write - toggle whether connection waits for EPOLLOUT.
+ *
+ * @client: connection
+ * @want: 0 - wait for input only, otherwise wait for output only
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+client_want_write(struct client *client, int want)
+{
+	struct epoll_event ev;
+	if (client->want_write == want) {
+		return 0;
+	}
+	memset(&ev, 0, sizeof(ev));
+	ev.events = want ? EPOLLOUT : EPOLLIN;
+	ev.data.ptr = client;
+	client->want_write = want;
+	return epoll_ctl(client->worker->epoll_fd, EPOLL_CTL_MOD, client->fd,
+			&ev);
+}
+
+/* client_flush - send whatever is left in wbuf.
+ *
+ * @client: connection
+ *
+ * returns 1 when wbuf is empty, 0 when socket would block, (-1) on error
+ */
+int
+client_flush(struct client *client)
+{
+	ssize_t rc;
+	while (client->wbuf_off < client->wbuf_len) {
+		rc = write(client->fd, client->wbuf + client->wbuf_off,
+				client->wbuf_len - client->wbuf_off);
+		if (rc > 0) {
+			client->wbuf_off+= rc;
+			continue;
+		}
+		if (rc < 0 && errno == EINTR) {
+			continue;
+		}
+		if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return 0;
+		}
+		perror("dummy failed on write()");
+		return (-1);
+	}
+	client->wbuf_off = 0;
+	client->wbuf_len = 0;
+	return 1;
+}
+
+/* client_queue - keep unsent part of iovec in wbuf.
+ *
+ * @client: connection
+ * @iov: iovec which was passed to writev()
+ * @iov_cnt: number of iovec entries
+ * @skip: how many bytes writev() has sent
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+client_queue(struct client *client, struct iovec *iov, int iov_cnt,
+		size_t skip)
+{
+	uint8_t *wbuf;
+	size_t len;
+	size_t need = 0;
+	int i;
+	for (i = 0; i < iov_cnt; i++) {
+		need+= iov[i].iov_len;
+	}
+	need-= skip;
+	if (client->wbuf_len + need > client->wbuf_size) {
+		wbuf = realloc(client->wbuf, client->wbuf_len + need);
+		if (wbuf == NULL) {
+			perror("realloc fail");
+			return (-1);
+		}
+		client->wbuf = wbuf;
+		client->wbuf_size = client->wbuf_len + need;
+	}
+	for (i = 0; i < iov_cnt; i++) {
+		if (skip >= iov[i].iov_len) {
+			skip-= iov[i].iov_len;
+			continue;
+		}
+		len = iov[i].iov_len - skip;
+		memcpy(client->wbuf + client->wbuf_len,
+				(uint8_t *)iov[i].iov_base + skip, len);
+		client->wbuf_len+= len;
+		skip = 0;
+	}
+	return 0;
+}
+
+/* select_bmc - switch connection over to another BMC.
+ *
+ * @client: connection
+ * @req: Select BMC request
+ * @rsp: response, header is expected to be filled in by caller
+ */
+void
+select_bmc(struct client *client, struct dummy_rq *req, struct dummy_rs *rsp)
+{
+	struct bmc *bmc;
+	if (req->msg.data_len != 2) {
+		rsp->ccode = CC_DATA_LEN;
+		return;
+	}
+	bmc = bmc_get(req->msg.data[0] | (req->msg.data[1] << 8));
+	if (bmc == NULL) {
+		rsp->ccode = CC_PARAM_OOR;
+		return;
+	}
+	client->bmc = bmc;
+	log_info("client %i selected BMC %" PRIu32, client->fd, bmc->id);
+}
+
+/* process_request - dispatch complete request and prepare response.
+ *
+ * @client: connection the request came from
+ * @req: complete request
+ * @rsp: response to fill in
+ *
+ * returns 0 when response is ready to be sent, (-1) when client asked to
+ * terminate the connection.
+ */
+int
+process_request(struct client *client, struct dummy_rq *req,
+		struct dummy_rs *rsp)
+{
+	uint64_t start;
+	log_debug("Received: netfn %x lun %x cmd %x target_cmd %x data_len %x",
+			req->msg.netfn, req->msg.lun, req->msg.cmd,
+			req->msg.target_cmd, req->msg.data_len);
+	memset(rsp, 0, sizeof(struct dummy_rs));
+	if (req->msg.netfn == DUMMY_NETFN
+			&& req->msg.lun == 0
+			&& req->msg.cmd == DUMMY_CMD_CLOSE
+			&& req->msg.target_cmd == 0
+			&& req->msg.data_len == 0) {
+		return (-1);
+	} else if (req->msg.netfn == DUMMY_NETFN
+			&& (req->msg.cmd == DUMMY_CMD_SELECT_BMC
+				|| req->msg.cmd == DUMMY_CMD_GET_STATS)) {
+		/* server's own commands, not counted in stats */
+		rsp->msg.netfn = req->msg.netfn + 1;
+		rsp->msg.cmd = req->msg.cmd;
+		rsp->msg.lun = req->msg.lun;
+		rsp->ccode = CC_OK;
+		if (req->msg.cmd == DUMMY_CMD_SELECT_BMC) {
+			select_bmc(client, req, rsp);
+		} else {
+			stats_get(req, rsp);
+		}
+	} else {
+		start = monotonic_ns();
+		ipmi_dispatch(client->bmc, req, rsp);
+		stats_record(req->msg.netfn, req->msg.cmd, rsp->ccode,
+				monotonic_ns() - start);
+	}
+
+	log_debug("Sending: netfn %x cmd %x seq %x lun %x ccode %x data_len %x",
+			rsp->msg.netfn, rsp->msg.cmd, rsp->msg.seq,
+			rsp->msg.lun, rsp->ccode, rsp->data_len);
+	if (rsp->data_len > 0) {
+		log_debug("Sending %i bytes of data.",
+				rsp->data_len);
+	}
+	return 0;
+}
+
+/* client_process - dispatch all complete requests sitting in rbuf and send
+ * responses with a single writev().
+ *
+ * @client: connection
+ *
+ * returns 0 when connection should be kept, (-1) when it should be closed
+ */
+int
+client_process(struct client *client)
+{
+	struct dummy_rq req;
+	struct dummy_rs rsps[PIPELINE_MAX];
+	struct iovec iov[2 * PIPELINE_MAX];
+	ssize_t rc = 0;
+	size_t need;
+	size_t off = 0;
+	size_t total = 0;
+	int close_rq = 0;
+	int iov_cnt = 0;
+	int rsp_cnt = 0;
+	arena_use(&client->arena);
+	while (rsp_cnt < PIPELINE_MAX
+			&& client->rbuf_len - off >= sizeof(req)) {
+		memcpy(&req, client->rbuf + off, sizeof(req));
+		need = sizeof(req) + req.msg.data_len;
+		if (need > CLIENT_RBUF_SIZE) {
+			log_error("Request data too long: %i bytes.",
+					req.msg.data_len);
+			close_rq = 1;
+			break;
+		}
+		if (client->rbuf_len - off < need) {
+			break;
+		}
+		req.msg.data = NULL;
+		if (req.msg.data_len > 0) {
+			req.msg.data = client->rbuf + off + sizeof(req);
+		}
+		off+= need;
+		if (process_request(client, &req, &rsps[rsp_cnt]) != 0) {
+			close_rq = 1;
+			break;
+		}
+		iov[iov_cnt].iov_base = &rsps[rsp_cnt];
+		iov[iov_cnt].iov_len = sizeof(struct dummy_rs);
+		total+= iov[iov_cnt++].iov_len;
+		if (rsps[rsp_cnt].data_len > 0) {
+			iov[iov_cnt].iov_base = rsps[rsp_cnt].data;
+			iov[iov_cnt].iov_len = rsps[rsp_cnt].data_len;
+			total+= iov[iov_cnt++].iov_len;
+		}
+		rsp_cnt++;
+	}
+	/* keep partial request at the beginning of rbuf */
+	if (off > 0) {
+		memmove(client->rbuf, client->rbuf + off,
+				client->rbuf_len - off);
+		client->rbuf_len-= off;
+	}
+	if (iov_cnt > 0) {
+		do {
+			rc = writev(client->fd, iov, iov_cnt);
+		} while (rc < 0 && errno == EINTR);
+		if (rc < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+			perror("dummy failed on writev()");
+			close_rq = 1;
+		} else if ((size_t)(rc < 0 ? 0 : rc) < total) {
+			if (client_queue(client, iov, iov_cnt,
+						rc < 0 ? 0 : rc) != 0) {
+				close_rq = 1;
 			}
 		}
 	}
-	if (try > 3 && data_total != data_len) {
-		rc = (-1);
+	arena_reset(&client->arena);
+	if (close_rq) {
+		return (-1);
+	}
+	return client_want_write(client, client->wbuf_len > 0);
+}
+
+/* client_pending - returns whether rbuf holds a complete request, or the
+ * header of one which can never fit, client_process() has to look at
+ */
+int
+client_pending(struct client *client)
+{
+	struct dummy_rq req;
+	size_t need;
+	if (client->rbuf_len < sizeof(req)) {
+		return 0;
+	}
+	memcpy(&req, client->rbuf, sizeof(req));
+	need = sizeof(req) + req.msg.data_len;
+	return need > CLIENT_RBUF_SIZE || client->rbuf_len >= need;
+}
+
+/* client_drain - dispatch requests sitting in rbuf, PIPELINE_MAX at a time,
+ * until there is no complete one left or the socket stops taking
+ * responses. Requests already read are never seen by epoll again, nothing
+ * else would get to them.
+ *
+ * @client: connection
+ *
+ * returns 0 when connection should be kept, (-1) when it should be closed
+ */
+int
+client_drain(struct client *client)
+{
+	do {
+		if (client_process(client) != 0) {
+			return (-1);
+		}
+	} while (client->wbuf_len == 0 && client_pending(client));
+	return 0;
+}
+
+/* serve_client - read and dispatch as many requests as the socket allows
+ * without blocking.
+ *
+ * @client: connection
+ *
+ * returns 0 when connection should be kept, (-1) when it should be closed
+ */
+int
+serve_client(struct client *client)
+{
+	ssize_t rc;
+	size_t space;
+	if (client->wbuf_len > 0) {
+		rc = client_flush(client);
+		if (rc < 0) {
+			log_error("Send response to client.");
+			return (-1);
+		} else if (rc == 0) {
+			return 0;
+		}
+		/* requests left behind while we were waiting for output */
+		if (client_drain(client) != 0) {
+			return (-1);
+		}
+		if (client->wbuf_len > 0) {
+			return 0;
+		}
+	}
+	space = CLIENT_RBUF_SIZE - client->rbuf_len;
+	if (space == 0) {
+		/* rbuf is full of requests waiting for output */
+		return client_drain(client);
+	}
+	rc = read(client->fd, client->rbuf + client->rbuf_len, space);
+	if (rc == 0) {
+		return (-1);
+	} else if (rc < 0) {
+		if (errno == EINTR || errno == EAGAIN
+				|| errno == EWOULDBLOCK) {
+			return 0;
+		}
+		perror("dummy failed on read()");
+		return (-1);
+	}
+	client->rbuf_len+= rc;
+	/* epoll is level-triggered, whatever we didn't read wakes us up */
+	return client_drain(client);
+}
+
+/* accept_clients - accept pending connections and register them with
+ * worker's epoll set.
+ *
+ * @worker: worker which is going to own accepted connections
+ * @listener: listening socket which has woken the worker up
+ *
+ * Listening sockets are shared by all workers and are registered with
+ * EPOLLEXCLUSIVE, so only one worker is woken up per incoming connection.
+ * At most ACCEPT_BATCH connections are taken at once, anything left behind
+ * wakes up another worker.
+ */
+void
+accept_clients(struct worker *worker, struct listener *listener)
+{
+	struct epoll_event ev;
+	struct client *client;
+	int client_sockfd;
+	int i;
+	for (i = 0; i < ACCEPT_BATCH; i++) {
+		client_sockfd = accept(listener->fd, NULL, NULL);
+		if (client_sockfd < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				perror("accept");
+			}
+			return;
+		}
+		if (set_nonblock(client_sockfd) != 0) {
+			perror("fcntl");
+			close(client_sockfd);
+			continue;
+		}
+		client = malloc(sizeof(struct client));
+		if (client == NULL) {
+			perror("malloc fail");
+			close(client_sockfd);
+			continue;
+		}
+		memset(client, 0, sizeof(struct client));
+		if (arena_init(&client->arena, ARENA_SIZE) != 0) {
+			close(client_sockfd);
+			free(client);
+			continue;
+		}
+		client->kind = EP_CLIENT;
+		client->fd = client_sockfd;
+		client->worker = worker;
+		client->bmc = listener->bmc;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.ptr = client;
+		if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, client_sockfd,
+					&ev) != 0) {
+			perror("epoll_ctl");
+			close(client_sockfd);
+			arena_free(&client->arena);
+			free(client);
+			continue;
+		}
+		log_info("client %i picked up by worker %i, BMC %" PRIu32,
+				client_sockfd, worker->id, client->bmc->id);
 	}
-	return rc;
 }
 
-/* data_write - write data to the socket
+/* worker_init - create worker's epoll set and register listening sockets.
  *
- * @data_ptr - ptr to data to send
- * @data_len - how long is the data to send
+ * @worker: worker
  *
  * returns 0 on success, otherwise (-1)
  */
 int
-data_write(int fd, void *data_ptr, int data_len)
+worker_init(struct worker *worker)
 {
-	int rc = 0;
-	int data_written = 0;
-	int data_total = 0;
-	int try = 1;
-	int errno_save = 0;
-	if (data_len < 0) {
+	struct epoll_event ev;
+	int i;
+	worker->epoll_fd = epoll_create1(0);
+	if (worker->epoll_fd < 0) {
+		perror("epoll_create1");
+		return (-1);
+	}
+	for (i = 0; i < listener_count; i++) {
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+		ev.data.ptr = &listeners[i];
+		if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD,
+					listeners[i].fd, &ev) != 0) {
+			perror("epoll_ctl");
+			return (-1);
+		}
+	}
+	if (udp_socket_count == 0) {
+		return 0;
+	}
+	worker->udp = calloc(1, sizeof(struct udp_batch));
+	if (worker->udp == NULL) {
+		perror("calloc fail");
 		return (-1);
 	}
-	while (data_total < data_len && try < 4) {
-		errno = 0;
-		/* TODO - add poll() */
-		data_written = write(fd, data_ptr, data_len);
-		errno_save = errno;
-		if (data_read > 0) {
-			data_total+= data_written;
-		}
-		if (errno_save != 0) {
-			if (errno_save == EINTR || errno_save == EAGAIN) {
-				try++;
-				sleep(2);
+	if (arena_init(&worker->udp->arena, ARENA_SIZE) != 0) {
+		return (-1);
+	}
+	for (i = 0; i < udp_socket_count; i++) {
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+		ev.data.ptr = &udp_sockets[i];
+		if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD,
+					udp_sockets[i].fd, &ev) != 0) {
+			perror("epoll_ctl");
+			return (-1);
+		}
+	}
+	return 0;
+}
+
+/* udp_serve - answer datagrams waiting on a UDP socket in batches.
+ *
+ * @worker: worker which has been woken up
+ * @sock: UDP socket of a BMC
+ *
+ * At most UDP_ROUNDS batches are taken, so that one busy BMC doesn't
+ * starve the others; epoll reports the socket again if anything is left.
+ * Responses the socket doesn't take are dropped, as they would be on the
+ * wire, requester retries.
+ */
+void
+udp_serve(struct worker *worker, struct listener *sock)
+{
+	struct udp_batch *udp = worker->udp;
+	int round;
+	int count;
+	int sent;
+	int rc;
+	int len;
+	int i;
+	arena_use(&udp->arena);
+	for (round = 0; round < UDP_ROUNDS; round++) {
+		for (i = 0; i < UDP_BATCH; i++) {
+			udp->in_iov[i].iov_base = udp->in_buf[i];
+			udp->in_iov[i].iov_len = RMCP_PKT_MAX;
+			memset(&udp->in[i], 0, sizeof(udp->in[i]));
+			udp->in[i].msg_hdr.msg_name = &udp->addr[i];
+			udp->in[i].msg_hdr.msg_namelen = sizeof(udp->addr[i]);
+			udp->in[i].msg_hdr.msg_iov = &udp->in_iov[i];
+			udp->in[i].msg_hdr.msg_iovlen = 1;
+		}
+		count = recvmmsg(sock->fd, udp->in, UDP_BATCH, MSG_DONTWAIT,
+				NULL);
+		if (count < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK
+					&& errno != EINTR) {
+				perror("recvmmsg");
+			}
+			break;
+		}
+		sent = 0;
+		for (i = 0; i < count; i++) {
+			len = rmcp_handle(sock->bmc, &udp->addr[i],
+					udp->in_buf[i], udp->in[i].msg_len,
+					udp->out_buf[sent], RMCP_PKT_MAX);
+			if (len <= 0) {
 				continue;
-			} else {
-				errno = errno_save;
-				perror("dummy failed on read(): ");
-				rc = (-1);
+			}
+			udp->out_iov[sent].iov_base = udp->out_buf[sent];
+			udp->out_iov[sent].iov_len = len;
+			memset(&udp->out[sent], 0, sizeof(udp->out[sent]));
+			udp->out[sent].msg_hdr.msg_name = &udp->addr[i];
+			udp->out[sent].msg_hdr.msg_namelen =
+				udp->in[i].msg_hdr.msg_namelen;
+			udp->out[sent].msg_hdr.msg_iov = &udp->out_iov[sent];
+			udp->out[sent].msg_hdr.msg_iovlen = 1;
+			sent++;
+		}
+		for (i = 0; i < sent; i += rc) {
+			rc = sendmmsg(sock->fd, &udp->out[i], sent - i,
+					MSG_DONTWAIT);
+			if (rc < 0) {
+				if (errno == EINTR) {
+					rc = 0;
+					continue;
+				}
+				log_debug("sendmmsg: %s, %i responses dropped",
+						strerror(errno), sent - i);
 				break;
 			}
 		}
+		arena_reset(&udp->arena);
+		if (count < UDP_BATCH) {
+			break;
+		}
 	}
-	if (try > 3 && data_total != data_len) {
-		rc = (-1);
-	}
-	return rc;
 }
 
-int
-serve_client(int client_sockfd)
+/* worker_main - event loop of one worker. Every connection is owned by the
+ * worker which has accepted it and is served by that worker only.
+ *
+ * @arg: pointer to struct worker
+ *
+ * returns NULL on error, otherwise it doesn't return
+ */
+void *
+worker_main(void *arg)
 {
-	int rc = 0;
+	struct worker *worker = arg;
+	struct epoll_event events[MAX_EVENTS];
+	struct client *client;
+	cpu_set_t cpuset;
+	int i;
+	int nfds;
+	int timeout;
+	int app_timeout;
+	if (stats_thread_init() != 0) {
+		return NULL;
+	}
+	if (worker->cpu >= 0) {
+		CPU_ZERO(&cpuset);
+		CPU_SET(worker->cpu, &cpuset);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(cpuset),
+					&cpuset) != 0) {
+			log_warn("worker %i couldn't be pinned to CPU %i",
+					worker->id, worker->cpu);
+		}
+	}
 	while (1) {
-		struct dummy_rq req;
-		struct dummy_rs rsp;
-		uint8_t *rq_data_ptr = NULL;
-		memset(&req, 0, sizeof(req));
-		memset(&rsp, 0, sizeof(rsp));
-		rsp.data_len = 0;
-		rsp.data = NULL;
-		if (data_read(client_sockfd, &req, sizeof(req)) != 0) {
-			printf("[FAIL] Read request from client.\n");
-			rc = (-1);
-			goto end;
+		/* wake up in time for pending chassis transitions and
+		 * session timeouts
+		 */
+		timeout = chassis_run_timers();
+		app_timeout = app_run_timers();
+		if (timeout < 0 || (app_timeout >= 0
+					&& app_timeout < timeout)) {
+			timeout = app_timeout;
 		}
-		if (req.msg.data_len > 0) {
-			rq_data_ptr = malloc(req.msg.data_len);
-			if (rq_data_ptr == NULL) {
-				perror("malloc fail");
-				exit(1);
+		nfds = epoll_wait(worker->epoll_fd, events, MAX_EVENTS,
+				timeout);
+		if (nfds < 0) {
+			if (errno == EINTR) {
+				continue;
 			}
-			memset(rq_data_ptr, 0, req.msg.data_len);
-			printf("[INFO] expecting client to send %i bytes of data.\n",
-					req.msg.data_len);
-
-			if (data_read(client_sockfd,
-						(uint8_t *)rq_data_ptr,
-						req.msg.data_len) != 0) {
-				printf("[FAIL] Read data from client.\n");
-				rc = (-1);
-				goto end;
+			perror("epoll_wait");
+			return NULL;
+		}
+		for (i = 0; i < nfds; i++) {
+			client = events[i].data.ptr;
+			if (client->kind == EP_LISTENER) {
+				accept_clients(worker, events[i].data.ptr);
+				continue;
 			}
-			req.msg.data = rq_data_ptr;
-		}
-
-		printf("---\nReceived:\n");
-		printf("msg.netfn: %x\n", req.msg.netfn);
-		printf("msg.lun: %x\n", req.msg.lun);
-		printf("msg.cmd: %x\n", req.msg.cmd);
-		printf("msg.target_cmd: %x\n", req.msg.target_cmd);
-		printf("msg.data_len: %x\n", req.msg.data_len);
-
-		if (req.msg.netfn == 0x3f
-				&& req.msg.lun == 0
-				&& req.msg.cmd == 0xff
-				&& req.msg.target_cmd == 0
-				&& req.msg.data_len == 0) {
-			printf("---\n");
-			break;
-		} else if (req.msg.netfn == NETFN_APP) {
-			netfn_app_main(&req, &rsp);
-		} else if (req.msg.netfn == NETFN_CHASSIS) {
-			netfn_chassis_main(&req, &rsp);
-		} else if (req.msg.netfn == NETFN_SENSOR) {
-			netfn_sensor_main(&req, &rsp);
-		} else if (req.msg.netfn == NETFN_STORAGE) {
-			netfn_storage_main(&req, &rsp);
-		} else if (req.msg.netfn == NETFN_TRANSPORT) {
-			netfn_transport_main(&req, &rsp);
-		} else {
-			rsp.ccode = 0xc1;
-			rsp.data_len = 0;
-			rsp.msg.netfn = req.msg.netfn + 1;
-			rsp.msg.cmd = req.msg.cmd;
-			rsp.msg.seq = 0;
-			rsp.msg.lun = req.msg.lun;
-		}
-
-		printf("---\n");
-		printf("Sending:\n");
-		printf("msg.netfn: %x\n", rsp.msg.netfn);
-		printf("msg.cmd: %x\n", rsp.msg.cmd);
-		printf("msg.seq: %x\n", rsp.msg.seq);
-		printf("msg.lun: %x\n", rsp.msg.lun);
-		printf("ccode: %x\n", rsp.ccode);
-		printf("data_len: %x\n", rsp.data_len);
-		printf("---\n");
-		
-		if (data_write(client_sockfd, &rsp, sizeof(rsp)) != 0) {
-			printf("[FAIL] Send response to client.\n");
-			rc = (-1);
-			goto end;
-		}
-		if (rsp.data_len > 0) {
-			printf("[INFO] Sending %i bytes of data.\n",
-					rsp.data_len);
-			if (data_write(client_sockfd,
-						(uint8_t *)rsp.data,
-						rsp.data_len) != 0) {
-				printf("[FAIL] Send data to client.\n");
-				rc = (-1);
-				goto end;
+			if (client->kind == EP_UDP) {
+				udp_serve(worker, events[i].data.ptr);
+				continue;
+			}
+			if ((events[i].events & (EPOLLERR | EPOLLHUP))
+					&& !(events[i].events & EPOLLIN)) {
+				client_close(client);
+				continue;
+			}
+			if (serve_client(client) != 0) {
+				client_close(client);
 			}
 		}
-		
-		end:
-		if (rq_data_ptr != NULL) {
-			free(rq_data_ptr);
-			req.msg.data = NULL;
+	}
+	return NULL;
+}
+
+/* checkpoint_save - save state of all BMCs to state_path, logging how long
+ * it took
+ */
+static void
+checkpoint_save()
+{
+	uint64_t start = monotonic_ns();
+	if (snapshot_save(state_path) == 0) {
+		log_info("%" PRIu32 " BMC(s) saved to %s in %" PRIu64 " us",
+				bmc_count(), state_path,
+				(monotonic_ns() - start) / 1000);
+	}
+}
+
+/* checkpoint_main - save state every checkpoint_secs seconds, if set, and
+ * once more on SIGINT or SIGTERM before exiting. Those are blocked in all
+ * other threads, so they are only ever taken here and a save is never cut
+ * short by a signal handler.
+ */
+static void *
+checkpoint_main(void *arg)
+{
+	sigset_t *signals = arg;
+	struct timespec interval;
+	int sig;
+	interval.tv_sec = checkpoint_secs;
+	interval.tv_nsec = 0;
+	while (1) {
+		if (checkpoint_secs > 0) {
+			sig = sigtimedwait(signals, NULL, &interval);
+		} else {
+			sig = sigwaitinfo(signals, NULL);
 		}
-		if (rsp.data != NULL) {
-			free(rsp.data);
-			rsp.data = NULL;
+		if (sig < 0 && errno != EAGAIN) {
+			continue;
 		}
-		if (rc == (-1)) {
-			break;
+		checkpoint_save();
+		if (sig > 0) {
+			log_notice("signal %i, state saved to %s, exiting", sig,
+					state_path);
+			exit(0);
 		}
 	}
-	return rc;
+	return NULL;
 }
 
+/* listener_open - create non-blocking listening socket for given BMC.
+ *
+ * @listener: listener to fill in
+ * @path: path of UNIX socket
+ * @bmc: BMC which accepted connections start with
+ *
+ * returns 0 on success, otherwise (-1)
+ */
 int
-main()
+listener_open(struct listener *listener, const char *path, struct bmc *bmc)
 {
-	struct sockaddr_un server_address;
-	struct sockaddr_un client_address;
-	int server_sockfd, client_sockfd;
-	int server_len;
-	socklen_t client_len;
-	unlink(DUMMY_SOCKET_PATH);
-	server_sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
-	server_address.sun_family = AF_UNIX;
-	strcpy(server_address.sun_path, DUMMY_SOCKET_PATH);
-	server_len = sizeof(server_address);
-	bind(server_sockfd, (struct sockaddr *)&server_address, server_len);
-	listen(server_sockfd, 5);
-	while (1) {
-		printf("[INFO] server waiting\n");
-		client_len = sizeof(client_address);
-		client_sockfd = accept(server_sockfd,
-				(struct sockaddr *)&client_address,
-				&client_len);
-		printf("[INFO] client picked up...\n");
-		serve_client(client_sockfd);
-		/* TODO - check return value of close() */
-		close(client_sockfd);
-		client_sockfd = (-1);
+	struct sockaddr_un address;
+	listener->kind = EP_LISTENER;
+	listener->bmc = bmc;
+	unlink(path);
+	listener->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener->fd < 0) {
+		perror("socket");
+		return (-1);
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+	if (bind(listener->fd, (struct sockaddr *)&address,
+				sizeof(address)) != 0) {
+		perror("bind");
+		return (-1);
+	}
+	if (listen(listener->fd, SOMAXCONN) != 0
+			|| set_nonblock(listener->fd) != 0) {
+		perror("listen");
+		return (-1);
+	}
+	return 0;
+}
+
+/* udp_open - create non-blocking UDP socket on localhost for given BMC.
+ *
+ * @sock: socket to fill in
+ * @port: UDP port
+ * @bmc: BMC datagrams are addressed to
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+udp_open(struct listener *sock, int port, struct bmc *bmc)
+{
+	struct sockaddr_in address;
+	sock->kind = EP_UDP;
+	sock->bmc = bmc;
+	sock->fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock->fd < 0) {
+		perror("socket");
+		return (-1);
+	}
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(port);
+	if (bind(sock->fd, (struct sockaddr *)&address,
+				sizeof(address)) != 0) {
+		log_error("Couldn't bind UDP port %i: %s", port,
+				strerror(errno));
+		return (-1);
+	}
+	if (set_nonblock(sock->fd) != 0) {
+		perror("fcntl");
+		return (-1);
 	}
 	return 0;
 }
+
+void
+usage(const char *progname)
+{
+	printf("Usage: %s [-w|--workers N] [-p|--pin] [-l|--log-level N]"
+			" [-b|--bmcs N] [-s|--bmc-sockets] [-r|--sdr-sensors N]"
+			" [-f|--fru [ID:]FILE] [-F|--fru-dir DIR]"
+			" [-u|--udp-port PORT] [-S|--state FILE]"
+			" [-c|--checkpoint SECS] [-P|--scenario FILE]\n",
+			progname);
+	printf("  -w, --workers N    serve clients from N threads, default 1\n");
+	printf("  -p, --pin          pin worker N to CPU N (modulo online CPUs)\n");
+	printf("  -l, --log-level N  0 error, 1 warn, 2 notice (default), 3 info,"
+			" 4 debug\n");
+	printf("  -b, --bmcs N       simulate N BMCs, default 1\n");
+	printf("  -s, --bmc-sockets  listen on %s.<id> for each BMC as well\n",
+			DUMMY_SOCKET_PATH);
+	printf("  -r, --sdr-sensors N  put N sensors into SDR repository,"
+			" default %i\n", SDR_SENSORS_DEFAULT);
+	printf("  -f, --fru [ID:]FILE  FRU device ID (default 0) of every BMC is"
+			" FILE\n");
+	printf("  -F, --fru-dir DIR    load every <ID>.bin in DIR as FRU"
+			" device ID\n");
+	printf("  -u, --udp-port PORT  serve RMCP on 127.0.0.1, BMC N on"
+			" PORT + N\n");
+	printf("  -S, --state FILE     restore BMCs from FILE, save them to it"
+			" on SIGINT/SIGTERM\n");
+	printf("  -c, --checkpoint SECS  with --state, save every SECS seconds"
+			" as well\n");
+	printf("  -P, --scenario FILE  BMCs are who compiled scenario FILE"
+			" says, see\n"
+			"                       fake-ipmistack-scenario\n");
+	printf("  -h, --help         print this help\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	static struct option long_opts[] = {
+		{ "workers", required_argument, NULL, 'w' },
+		{ "pin", no_argument, NULL, 'p' },
+		{ "log-level", required_argument, NULL, 'l' },
+		{ "bmcs", required_argument, NULL, 'b' },
+		{ "bmc-sockets", no_argument, NULL, 's' },
+		{ "sdr-sensors", required_argument, NULL, 'r' },
+		{ "fru", required_argument, NULL, 'f' },
+		{ "fru-dir", required_argument, NULL, 'F' },
+		{ "udp-port", required_argument, NULL, 'u' },
+		{ "state", required_argument, NULL, 'S' },
+		{ "checkpoint", required_argument, NULL, 'c' },
+		{ "scenario", required_argument, NULL, 'P' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+	char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+	const char *scenario_path = NULL;
+	char **fru_args;
+	char *end;
+	int *fru_opts;
+	int fru_arg_count = 0;
+	long fru_id;
+	struct worker *workers;
+	pthread_t checkpoint_thread;
+	sigset_t signals;
+	uint64_t start;
+	long bmcs = 1;
+	long described;
+	long restored = 0;
+	long ncpus;
+	long sdr_sensors = SDR_SENSORS_DEFAULT;
+	unsigned int accel;
+	int bmc_sockets = 0;
+	int bmcs_given = 0;
+	int i;
+	int opt;
+	int pin = 0;
+	int udp_port = 0;
+	int worker_count = 1;
+	fru_args = calloc(argc, sizeof(char *));
+	fru_opts = calloc(argc, sizeof(int));
+	if (fru_args == NULL || fru_opts == NULL) {
+		perror("calloc fail");
+		return 1;
+	}
+	while ((opt = getopt_long(argc, argv, "w:pl:b:sr:f:F:u:S:c:P:h",
+					long_opts, NULL)) != (-1)) {
+		switch (opt) {
+		case 'w':
+			worker_count = atoi(optarg);
+			if (worker_count < 1 || worker_count > WORKERS_MAX) {
+				log_error("workers must be 1-%i",
+						WORKERS_MAX);
+				return 1;
+			}
+			break;
+		case 'p':
+			pin = 1;
+			break;
+		case 'l':
+			log_set_level(atoi(optarg));
+			break;
+		case 'b':
+			bmcs = atol(optarg);
+			if (bmcs < 1 || bmcs > BMC_COUNT_MAX) {
+				log_error("bmcs must be 1-%i", BMC_COUNT_MAX);
+				return 1;
+			}
+			bmcs_given = 1;
+			break;
+		case 's':
+			bmc_sockets = 1;
+			break;
+		case 'r':
+			sdr_sensors = atol(optarg);
+			if (sdr_sensors < 0 || sdr_sensors > SDR_SENSORS_MAX) {
+				log_error("sdr-sensors must be 0-%i",
+						SDR_SENSORS_MAX);
+				return 1;
+			}
+			break;
+		case 'f':
+		case 'F':
+			/* loaded once logging is set up */
+			fru_args[fru_arg_count++] = optarg;
+			fru_opts[fru_arg_count - 1] = opt;
+			break;
+		case 'u':
+			udp_port = atoi(optarg);
+			if (udp_port < 1 || udp_port > 0xFFFF) {
+				log_error("udp-port must be 1-65535");
+				return 1;
+			}
+			break;
+		case 'S':
+			state_path = optarg;
+			break;
+		case 'c':
+			checkpoint_secs = atoi(optarg);
+			if (checkpoint_secs < 1) {
+				log_error("checkpoint must be 1 second or more");
+				return 1;
+			}
+			break;
+		case 'P':
+			scenario_path = optarg;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (checkpoint_secs > 0 && state_path == NULL) {
+		log_error("checkpoint needs state");
+		return 1;
+	}
+	if (state_path != NULL) {
+		/* before any thread is started, all of them inherit the mask,
+		 * see checkpoint_main()
+		 */
+		sigemptyset(&signals);
+		sigaddset(&signals, SIGINT);
+		sigaddset(&signals, SIGTERM);
+		pthread_sigmask(SIG_BLOCK, &signals, NULL);
+	}
+	if (log_init() != 0) {
+		return 1;
+	}
+	/* errors are logged by the logger thread, let it catch up on exit */
+	atexit(log_flush);
+	/* peer going away mid-write must not kill the whole server */
+	signal(SIGPIPE, SIG_IGN);
+	if (scenario_path != NULL) {
+		described = scenario_map(scenario_path);
+		if (described < 0) {
+			return 1;
+		}
+		/* unless told otherwise, as many BMCs as the scenario has */
+		if (!bmcs_given) {
+			bmcs = described;
+		}
+	}
+	if (state_path != NULL) {
+		restored = snapshot_map(state_path);
+		if (restored < 0) {
+			return 1;
+		}
+		if (restored > 0 && bmcs_given && restored != bmcs) {
+			log_error("%s holds %li BMC(s), not %li", state_path,
+					restored, bmcs);
+			return 1;
+		}
+		if (restored > 0) {
+			bmcs = restored;
+		}
+	}
+	if (bmc_sockets && bmcs > BMC_SOCKETS_MAX) {
+		log_error("bmc-sockets allows at most %i BMCs",
+				BMC_SOCKETS_MAX);
+		return 1;
+	}
+	if (udp_port > 0 && udp_port + bmcs - 1 > 0xFFFF) {
+		log_error("udp-port leaves room for %i BMCs only",
+				0xFFFF - udp_port + 1);
+		return 1;
+	}
+	if (bmc_pool_init(bmcs) != 0 || sdr_repo_init(sdr_sensors) != 0
+			|| sensor_engine_init() != 0) {
+		return 1;
+	}
+	if (scenario_path != NULL) {
+		start = monotonic_ns();
+		if (scenario_apply() != 0) {
+			return 1;
+		}
+		log_notice("%" PRIu32 " BMC(s) set up from %s in %" PRIu64
+				" us", bmc_count(), scenario_path,
+				(monotonic_ns() - start) / 1000);
+	}
+	for (i = 0; i < fru_arg_count; i++) {
+		if (fru_opts[i] == 'F') {
+			if (fru_dir_load(fru_args[i]) < 0) {
+				return 1;
+			}
+			continue;
+		}
+		fru_id = strtol(fru_args[i], &end, 10);
+		if (end == fru_args[i] || *end != ':') {
+			fru_id = 0;
+			end = fru_args[i];
+		} else {
+			end++;
+		}
+		if (fru_id < 0 || fru_id >= FRU_DEVICES_MAX
+				|| fru_image_load(fru_id, end) != 0) {
+			return 1;
+		}
+	}
+	free(fru_args);
+	free(fru_opts);
+	if (restored > 0) {
+		start = monotonic_ns();
+		if (snapshot_restore() != 0) {
+			return 1;
+		}
+		log_notice("%li BMC(s) restored from %s in %" PRIu64 " us",
+				restored, state_path,
+				(monotonic_ns() - start) / 1000);
+	}
+	log_notice("%" PRIu32 " BMC(s), %zu bytes of state per BMC",
+			bmc_count(), sizeof(struct bmc));
+	listener_count = bmc_sockets ? bmcs + 1 : 1;
+	listeners = calloc(listener_count, sizeof(struct listener));
+	if (listeners == NULL) {
+		perror("calloc fail");
+		return 1;
+	}
+	if (listener_open(&listeners[0], DUMMY_SOCKET_PATH,
+				bmc_get(0)) != 0) {
+		return 1;
+	}
+	for (i = 1; i < listener_count; i++) {
+		snprintf(path, sizeof(path), "%s.%i", DUMMY_SOCKET_PATH,
+				i - 1);
+		if (listener_open(&listeners[i], path,
+					bmc_get(i - 1)) != 0) {
+			return 1;
+		}
+	}
+	if (udp_port > 0) {
+		accel = crypto_init(CRYPTO_ACCEL_AES | CRYPTO_ACCEL_SHA);
+		log_notice("RMCP+ crypto: AES %s, SHA %s",
+				accel & CRYPTO_ACCEL_AES ? "AES-NI" : "C",
+				accel & CRYPTO_ACCEL_SHA ? "SHA-NI" : "C");
+		udp_socket_count = bmcs;
+		udp_sockets = calloc(udp_socket_count,
+				sizeof(struct listener));
+		if (udp_sockets == NULL) {
+			perror("calloc fail");
+			return 1;
+		}
+		for (i = 0; i < udp_socket_count; i++) {
+			if (udp_open(&udp_sockets[i], udp_port + i,
+						bmc_get(i)) != 0) {
+				return 1;
+			}
+		}
+		log_notice("RMCP on UDP ports %i-%i", udp_port,
+				udp_port + udp_socket_count - 1);
+	}
+	workers = calloc(worker_count, sizeof(struct worker));
+	if (workers == NULL) {
+		perror("calloc fail");
+		return 1;
+	}
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpus < 1) {
+		ncpus = 1;
+	}
+	for (i = 0; i < worker_count; i++) {
+		workers[i].id = i;
+		workers[i].cpu = pin ? (int)(i % ncpus) : (-1);
+		if (worker_init(&workers[i]) != 0) {
+			return 1;
+		}
+	}
+	if (state_path != NULL) {
+		if (pthread_create(&checkpoint_thread, NULL, checkpoint_main,
+					&signals) != 0) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+	log_notice("server waiting, %i worker(s)", worker_count);
+	/* worker 0 runs in main thread */
+	for (i = 1; i < worker_count; i++) {
+		if (pthread_create(&workers[i].thread, NULL, worker_main,
+					&workers[i]) != 0) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+	worker_main(&workers[0]);
+	return 1;
+}
@@ -0,0 +1,148 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "client.h"
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <time.h>
+
+/* server_start - run server with logging off.
+ *
+ * @path: server binary
+ *
+ * returns PID of the server, (-1) on error
+ */
+pid_t
+server_start(const char *path)
+{
+	pid_t server = fork();
+	if (server < 0) {
+		perror("fork");
+		return (-1);
+	} else if (server == 0) {
+		execl(path, path, "--log-level", "0", (char *)NULL);
+		perror(path);
+		_exit(127);
+	}
+	return server;
+}
+
+/* server_stop - stop server and wait for it to exit */
+void
+server_stop(pid_t server)
+{
+	kill(server, SIGTERM);
+	waitpid(server, NULL, 0);
+}
+
+/* server_connect - connect to the server, retrying while it is starting.
+ *
+ * returns socket on success, otherwise (-1)
+ */
+int
+server_connect()
+{
+	struct sockaddr_un address;
+	struct timespec pause = { 0, 10 * 1000 * 1000 };
+	int fd;
+	int i;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, DUMMY_SOCKET_PATH,
+			sizeof(address.sun_path) - 1);
+	for (i = 0; i < WAIT_MS / 10; i++) {
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0) {
+			perror("socket");
+			return (-1);
+		}
+		if (connect(fd, (struct sockaddr *)&address,
+					sizeof(address)) == 0) {
+			return fd;
+		}
+		close(fd);
+		nanosleep(&pause, NULL);
+	}
+	printf("Server didn't start listening.\n");
+	return (-1);
+}
+
+/* read_all - read exactly len bytes, giving up after WAIT_MS of silence.
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+read_all(int fd, void *buf, size_t len)
+{
+	struct pollfd pfd = { fd, POLLIN, 0 };
+	uint8_t *ptr = buf;
+	ssize_t rc;
+	while (len > 0) {
+		if (poll(&pfd, 1, WAIT_MS) != 1) {
+			return (-1);
+		}
+		rc = read(fd, ptr, len);
+		if (rc < 0 && errno == EINTR) {
+			continue;
+		} else if (rc <= 0) {
+			return (-1);
+		}
+		ptr+= rc;
+		len-= rc;
+	}
+	return 0;
+}
+
+/* request - send request with no data and read response.
+ *
+ * @rsp: response, its data is read and dropped
+ *
+ * returns 0 on success, otherwise (-1)
+ */
+int
+request(int fd, uint8_t netfn, uint8_t cmd, struct dummy_rs *rsp)
+{
+	struct dummy_rq req;
+	uint8_t data[IPMI_BUF_SIZE];
+	memset(&req, 0, sizeof(req));
+	req.msg.netfn = netfn;
+	req.msg.cmd = cmd;
+	if (write(fd, &req, sizeof(req)) != (ssize_t)sizeof(req)) {
+		perror("write");
+		return (-1);
+	}
+	if (read_all(fd, rsp, sizeof(*rsp)) != 0
+			|| rsp->data_len < 0
+			|| rsp->data_len > IPMI_BUF_SIZE
+			|| read_all(fd, data, rsp->data_len) != 0) {
+		return (-1);
+	}
+	return 0;
+}
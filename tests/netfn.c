@@ -0,0 +1,101 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "client.h"
+
+/* NetFn test: request NetFns are answered by their handlers, odd ones are
+ * response NetFns and must get Invalid Command, not the handler of the
+ * request NetFn below them. Server binary is given as the only argument.
+ */
+
+struct netfn_case {
+	uint8_t netfn;
+	uint8_t cmd;
+	uint8_t ccode;
+};
+
+static const struct netfn_case netfn_cases[] = {
+	{ NETFN_CHASSIS, CHASSIS_GET_STATUS, CC_OK },
+	{ NETFN_CHASSIS + 1, CHASSIS_GET_STATUS, CC_CMD_INV },
+	{ NETFN_APP, BMC_GET_DEVICE_ID, CC_OK },
+	{ NETFN_APP + 1, BMC_GET_DEVICE_ID, CC_CMD_INV },
+	{ NETFN_STORAGE + 1, 0x10, CC_CMD_INV },
+};
+
+/* run_test - send every case over one connection.
+ *
+ * returns 0 if every response has the expected completion code,
+ * otherwise (-1)
+ */
+int
+run_test(int fd)
+{
+	const struct netfn_case *c;
+	struct dummy_rs rsp;
+	size_t i;
+	int rc = 0;
+	for (i = 0; i < sizeof(netfn_cases) / sizeof(netfn_cases[0]); i++) {
+		c = &netfn_cases[i];
+		if (request(fd, c->netfn, c->cmd, &rsp) != 0) {
+			printf("NetFn %x cmd %x: no response.\n", c->netfn,
+					c->cmd);
+			return (-1);
+		}
+		if (rsp.ccode != c->ccode) {
+			printf("NetFn %x cmd %x: ccode %x, expected %x.\n",
+					c->netfn, c->cmd, rsp.ccode, c->ccode);
+			rc = (-1);
+		}
+	}
+	return rc;
+}
+
+int
+main(int argc, char **argv)
+{
+	pid_t server;
+	int fd;
+	int rc = 1;
+	if (argc != 2) {
+		printf("Usage: %s SERVER\n", argv[0]);
+		return 1;
+	}
+	server = server_start(argv[1]);
+	if (server < 0) {
+		return 1;
+	}
+	fd = server_connect();
+	if (fd >= 0) {
+		rc = run_test(fd) == 0 ? 0 : 1;
+		close(fd);
+	}
+	server_stop(server);
+	printf("request and response NetFns: %s\n",
+			rc == 0 ? "ok" : "FAILED");
+	return rc;
+}
@@ -0,0 +1,100 @@
+/* Copyright (c) 2014, Zdenek Styblik
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ *    This product includes software developed by the Zdenek Styblik.
+ * 4. Neither the name of the Zdenek Styblik nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ZDENEK STYBLIK ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL ZDENEK STYBLIK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "client.h"
+
+/* Pipelining test: sends more requests than the server handles per batch
+ * (PIPELINE_MAX in fake-ipmistack.c) with one write() and expects every
+ * response back. Server binary is given as the only argument, it is
+ * started and stopped by the test.
+ */
+
+# define PIPELINE_REQUESTS 40
+
+/* run_test - pipeline requests over one connection.
+ *
+ * returns 0 if every response has come back, otherwise (-1)
+ */
+int
+run_test(int fd)
+{
+	struct dummy_rq reqs[PIPELINE_REQUESTS];
+	struct dummy_rs rsp;
+	uint8_t data[IPMI_BUF_SIZE];
+	int i;
+	memset(reqs, 0, sizeof(reqs));
+	for (i = 0; i < PIPELINE_REQUESTS; i++) {
+		reqs[i].msg.netfn = NETFN_APP;
+		reqs[i].msg.cmd = BMC_GET_DEVICE_ID;
+	}
+	if (write(fd, reqs, sizeof(reqs)) != (ssize_t)sizeof(reqs)) {
+		perror("write");
+		return (-1);
+	}
+	for (i = 0; i < PIPELINE_REQUESTS; i++) {
+		if (read_all(fd, &rsp, sizeof(rsp)) != 0
+				|| rsp.data_len < 0
+				|| rsp.data_len > IPMI_BUF_SIZE
+				|| read_all(fd, data, rsp.data_len) != 0) {
+			printf("Got %i of %i responses.\n", i,
+					PIPELINE_REQUESTS);
+			return (-1);
+		}
+		if (rsp.ccode != CC_OK || rsp.msg.cmd != BMC_GET_DEVICE_ID) {
+			printf("Response %i: cmd %x ccode %x.\n", i,
+					rsp.msg.cmd, rsp.ccode);
+			return (-1);
+		}
+	}
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	pid_t server;
+	int fd;
+	int rc = 1;
+	if (argc != 2) {
+		printf("Usage: %s SERVER\n", argv[0]);
+		return 1;
+	}
+	server = server_start(argv[1]);
+	if (server < 0) {
+		return 1;
+	}
+	fd = server_connect();
+	if (fd >= 0) {
+		rc = run_test(fd) == 0 ? 0 : 1;
+		close(fd);
+	}
+	server_stop(server);
+	printf("pipeline of %i requests: %s\n", PIPELINE_REQUESTS,
+			rc == 0 ? "ok" : "FAILED");
+	return rc;
+}